@@ -0,0 +1,378 @@
+/*
+** GAMESMAN solve and query benchmark.
+**
+**	bench [-g game] [-q queries] [-o file] [-c label] [-k]
+**
+** Runs a fixed set of games through each solver and database backend,
+** every case in a fresh directory under ./benchruns, and then, for the cases
+** marked below, loads the database with --interact and times random
+** "value" queries against ServerInteractLoop. Run it from bin/ (make
+** bench does). One JSON object per case is written to <file> (default:
+** stdout) so that runs on different commits can be compared; -c puts a
+** label such as the commit id into every record. A summary table goes to
+** stderr.
+**
+** "positions" is the size of the hash space of the option as reported by
+** --variantinfo (summed over tiers for tier games), so positions_per_s is
+** comparable across solvers of one game but not across games.
+**
+** filedb never loads a saved database, so --interact solves again and the
+** load_s of its query runs includes that solve.
+**
+** Not covered: netdb, which needs a database server to talk to, and
+** sharddb, whose only module (mconnect4) has no option small enough to
+** solve in a benchmark run.
+*/
+
+#define _GNU_SOURCE          /* nftw, wait4 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ftw.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAXCASEARGS 6
+
+#define DEFAULTQUERIES 2000
+
+#define PROMPT "ready =>> "
+
+typedef struct {
+	char *game;
+	char *config;           /* solver+backend, the name in the report */
+	char *args[MAXCASEARGS];
+	int query;              /* also time lookups through --interact */
+} BENCHCASE;
+
+/*
+** Acyclic (msim), loopy (mctoi) and tier (mwin4) games, through every
+** solver and backend that handles them, plus mchange for the threaded
+** case: the parallel solvers only run modules that set kReentrant, and
+** mchange is an acyclic one. Keep the list stable: changing it
+** makes reports incomparable with older ones, so add cases at the end.
+*/
+BENCHCASE cases[] = {
+	{ "msim",  "std+memdb",             { "--nobpdb" }, 1 },
+	{ "msim",  "vsstd+bpdb",            { NULL }, 1 },
+	{ "mchange", "std+memdb+2threads",  { "--option", "4", "--nobpdb", "--threads", "2" }, 0 },
+	{ "msim",  "zero+memdb",            { "--nobpdb", "--lowmem" }, 0 },
+	{ "msim",  "bottomup+memdb",        { "--nobpdb", "--bottomup" }, 0 },
+	{ "msim",  "std+colldb",            { "--nobpdb", "--colldb" }, 0 },
+	{ "mctoi", "loopy+memdb",           { "--nobpdb" }, 1 },
+	{ "mctoi", "vsloopy+bpdb",          { NULL }, 1 },
+	{ "mctoi", "loopy+memdb+gps",       { "--nobpdb", "--gps" }, 0 },
+	{ "mwin4", "retrograde+tierdb",     { NULL }, 0 },
+	{ "mwin4", "retrograde+tierdb+gps", { "--gps" }, 0 },
+	{ "msim",  "std+filedb",            { "--nobpdb", "--filedb" }, 1 },
+	{ "mctoi", "loopy+filedb",          { "--nobpdb", "--filedb" }, 1 },
+	{ "msim",  "std+univdb",            { "--nobpdb", "--univdb" }, 0 },
+	{ "mchange", "std+memdb",           { "--option", "4", "--nobpdb" }, 0 },
+};
+
+#define NUMCASES ((int) (sizeof(cases) / sizeof(cases[0])))
+
+typedef struct {
+	char *status;
+	unsigned long long positions;
+	double wall, cpu;
+	long maxrss;            /* kilobytes */
+	long long dbBytes;
+	int queries;
+	double load, p50, p99;  /* seconds */
+} RESULT;
+
+long long dirBytes;
+
+double Now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int AddFileSize(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	if(flag == FTW_F) dirBytes += sb->st_size;
+	return 0;
+}
+
+int RemoveFile(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+/* Fills argv with <bindir>/<game>, the case arguments and extra */
+int BuildArgs(char **argv, char *program, BENCHCASE *c, char *extra1, char *extra2)
+{
+	int argc = 0, i;
+
+	argv[argc++] = program;
+	for(i = 0; i < MAXCASEARGS && c->args[i] != NULL; i++)
+		argv[argc++] = c->args[i];
+	if(extra1) argv[argc++] = extra1;
+	if(extra2) argv[argc++] = extra2;
+	argv[argc] = NULL;
+	return argc;
+}
+
+/* Starts argv in dir with stdin and stdout on the given descriptors */
+pid_t Spawn(char **argv, char *dir, int in, int out)
+{
+	pid_t pid;
+
+	if((pid = fork()) == 0)
+	{
+		if(chdir(dir) < 0) _exit(127);
+		dup2(in, STDIN_FILENO);
+		dup2(out, STDOUT_FILENO);
+		dup2(out, STDERR_FILENO);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	return pid;
+}
+
+unsigned long long QueryPositions(char *program, BENCHCASE *c, char *dir)
+{
+	char *argv[MAXCASEARGS + 4], output[4096], *line;
+	int fds[2], devnull, got = 0, n, option, tiered, solved;
+	unsigned long long positions = 0;
+	pid_t pid;
+
+	BuildArgs(argv, program, c, "--variantinfo", NULL);
+	if(pipe(fds) < 0 || (devnull = open("/dev/null", O_RDONLY)) < 0)
+		return 0;
+	pid = Spawn(argv, dir, devnull, fds[1]);
+	close(fds[1]);
+	close(devnull);
+	while(got < (int) sizeof(output) - 1 && (n = read(fds[0], output + got, sizeof(output) - 1 - got)) > 0)
+		got += n;
+	output[got] = '\0';
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+	if((line = strstr(output, "option=")) != NULL)
+		sscanf(line, "option=%d positions=%llu tiered=%d solved=%d",
+		       &option, &positions, &tiered, &solved);
+	return positions;
+}
+
+void Solve(char *program, BENCHCASE *c, char *dir, RESULT *r)
+{
+	char *argv[MAXCASEARGS + 4], logname[1024];
+	int log, devnull, status;
+	struct rusage ru;
+	double start;
+	pid_t pid;
+
+	snprintf(logname, sizeof(logname), "%s/solve.log", dir);
+	BuildArgs(argv, program, c, "--solve", NULL);
+	if((log = open(logname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+	   (devnull = open("/dev/null", O_RDONLY)) < 0)
+	{
+		r->status = "error";
+		return;
+	}
+	start = Now();
+	pid = Spawn(argv, dir, devnull, log);
+	close(log);
+	close(devnull);
+	if(pid < 0 || wait4(pid, &status, 0, &ru) < 0)
+	{
+		r->status = "error";
+		return;
+	}
+	r->wall = Now() - start;
+	r->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	         ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	r->maxrss = ru.ru_maxrss;
+	r->status = (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "ok" : "failed";
+
+	snprintf(logname, sizeof(logname), "%s/data", dir);
+	dirBytes = 0;
+	nftw(logname, AddFileSize, 16, FTW_PHYS);
+	r->dbBytes = dirBytes;
+}
+
+/* Reads from fd until the interact prompt; FALSE on EOF. The child
+   waits for input after a prompt, so a prompt always ends a read. */
+int WaitForPrompt(int fd)
+{
+	static char tail[2 * sizeof(PROMPT) + 4096];
+	int len = strlen(PROMPT), have = 0, n;
+
+	while((n = read(fd, tail + have, sizeof(tail) - have)) > 0)
+	{
+		have += n;
+		if(have >= len && !memcmp(tail + have - len, PROMPT, len))
+			return 1;
+		if(have > len)
+		{
+			memmove(tail, tail + have - len, len);
+			have = len;
+		}
+	}
+	return 0;
+}
+
+int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+void Query(char *program, BENCHCASE *c, char *dir, int queries, RESULT *r)
+{
+	char *argv[MAXCASEARGS + 4], line[64];
+	int toChild[2], fromChild[2], i, len;
+	unsigned long long seed = 88172645463325252ULL;
+	double *latency, start;
+	pid_t pid;
+
+	if(r->positions == 0 || queries <= 0) return;
+	BuildArgs(argv, program, c, "--interact", NULL);
+	if(pipe(toChild) < 0 || pipe(fromChild) < 0) return;
+	start = Now();
+	pid = Spawn(argv, dir, toChild[0], fromChild[1]);
+	close(toChild[0]);
+	close(fromChild[1]);
+
+	latency = (double *) malloc(queries * sizeof(double));
+	if(WaitForPrompt(fromChild[0]))
+	{
+		r->load = Now() - start;
+		for(i = 0; i < queries; i++)
+		{
+			/* xorshift, so every run asks the same positions */
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			len = sprintf(line, "value %llu\n", seed % r->positions);
+			start = Now();
+			if(write(toChild[1], line, len) != len || !WaitForPrompt(fromChild[0]))
+				break;
+			latency[i] = Now() - start;
+		}
+		r->queries = i;
+		if(i > 0)
+		{
+			qsort(latency, i, sizeof(double), CompareDoubles);
+			r->p50 = latency[i / 2];
+			r->p99 = latency[(int) (i * 0.99)];
+		}
+		if(write(toChild[1], "quit\n", 5) < 0) kill(pid, SIGTERM);
+	}
+	close(toChild[1]);
+	close(fromChild[0]);
+	waitpid(pid, NULL, 0);
+	free(latency);
+}
+
+void Report(FILE *out, char *label, BENCHCASE *c, RESULT *r)
+{
+	int i;
+
+	fprintf(out, "{\"label\":\"%s\",\"game\":\"%s\",\"config\":\"%s\",\"args\":\"",
+	        label, c->game, c->config);
+	for(i = 0; i < MAXCASEARGS && c->args[i] != NULL; i++)
+		fprintf(out, "%s%s", i ? " " : "", c->args[i]);
+	fprintf(out, "\",\"status\":\"%s\",\"positions\":%llu,\"wall_s\":%.3f,\"cpu_s\":%.3f,"
+	        "\"positions_per_s\":%.0f,\"maxrss_kb\":%ld,\"db_bytes\":%lld",
+	        r->status, r->positions, r->wall, r->cpu,
+	        r->wall > 0 ? r->positions / r->wall : 0.0, r->maxrss, r->dbBytes);
+	if(r->queries > 0)
+		fprintf(out, ",\"queries\":%d,\"load_s\":%.3f,\"p50_us\":%.1f,\"p99_us\":%.1f",
+		        r->queries, r->load, r->p50 * 1e6, r->p99 * 1e6);
+	fprintf(out, "}\n");
+	fflush(out);
+}
+
+void Usage(char *name)
+{
+	fprintf(stderr, "Usage: %s [-g game] [-q queries] [-o file] [-c label] [-k]\n\n"
+	        "\t-g  only run the cases of this game\n"
+	        "\t-q  lookups per query run (default: %d, 0 to skip)\n"
+	        "\t-o  write the JSON records here instead of stdout\n"
+	        "\t-c  label stored in every record, e.g. a commit id\n"
+	        "\t-k  keep the per-case directories under ./benchruns\n\n"
+	        "The cases cover memdb, bpdb, colldb, filedb, univdb and the tier\n"
+	        "databases. netdb and sharddb are out of scope: one needs a server,\n"
+	        "the other a game too large for a benchmark run.\n",
+	        name, DEFAULTQUERIES);
+	exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+	int queries = DEFAULTQUERIES, keep = 0, i, failed = 0;
+	char *only = NULL, *label = "", *outname = NULL;
+	char program[2048], dir[2048], cwd[1024];
+	FILE *out = stdout;
+	BENCHCASE *c;
+	RESULT r;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-k")) { keep = 1; continue; }
+		if(argv[i][0] != '-' || i + 1 >= argc) Usage(argv[0]);
+		switch(argv[i][1])
+		{
+		case 'g': only = argv[++i]; break;
+		case 'q': queries = atoi(argv[++i]); break;
+		case 'o': outname = argv[++i]; break;
+		case 'c': label = argv[++i]; break;
+		default: Usage(argv[0]);
+		}
+	}
+	if(outname != NULL && (out = fopen(outname, "w")) == NULL)
+		fprintf(stderr, "Cannot write %s\n", outname), exit(1);
+	if(getcwd(cwd, sizeof(cwd)) == NULL)
+		perror("getcwd"), exit(1);
+	signal(SIGPIPE, SIG_IGN);
+	mkdir("benchruns", 0755);
+
+	fprintf(stderr, "%-8s %-21s %7s %12s %9s %12s %9s %11s %9s %9s\n", "game", "config", "status",
+	        "positions", "wall(s)", "pos/s", "rss(MB)", "db(bytes)", "p50(us)", "p99(us)");
+	for(c = cases; c < cases + NUMCASES; c++)
+	{
+		if(only != NULL && strcmp(only, c->game)) continue;
+
+		memset(&r, 0, sizeof(r));
+		snprintf(program, sizeof(program), "%s/%s", cwd, c->game);
+		snprintf(dir, sizeof(dir), "%s/benchruns/%s-%s", cwd, c->game, c->config);
+		nftw(dir, RemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+		if(access(program, X_OK) < 0 || mkdir(dir, 0755) < 0)
+		{
+			r.status = "missing";
+		}
+		else
+		{
+			r.positions = QueryPositions(program, c, dir);
+			Solve(program, c, dir, &r);
+			if(c->query && !strcmp(r.status, "ok"))
+				Query(program, c, dir, queries, &r);
+			if(!keep)
+				nftw(dir, RemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+		}
+		if(strcmp(r.status, "ok")) failed++;
+
+		Report(out, label, c, &r);
+		fprintf(stderr, "%-8s %-21s %7s %12llu %9.2f %12.0f %9.1f %11lld", c->game, c->config,
+		        r.status, r.positions, r.wall, r.wall > 0 ? r.positions / r.wall : 0.0,
+		        r.maxrss / 1024.0, r.dbBytes);
+		if(r.queries > 0)
+			fprintf(stderr, " %9.1f %9.1f", r.p50 * 1e6, r.p99 * 1e6);
+		fprintf(stderr, "\n");
+	}
+	if(!keep) rmdir("benchruns");
+	if(out != stdout) fclose(out);
+	return failed ? 1 : 0;
+}
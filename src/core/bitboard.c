@@ -0,0 +1,251 @@
+/************************************************************************
+**
+** NAME:	bitboard.c
+**
+** DESCRIPTION:	Bitboard kernel for games played by dropping or placing
+**		two players' stones on a rectangular board.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-19
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#include "gamesman.h"
+#include "bitboard.h"
+
+/* The ternary hash works on 8 cells at a time: gTernaryOfByte maps the
+** stones of one player on 8 cells to the base 3 number with a 1 digit for
+** each of them, and gTernaryDigits maps each of the 3^8 numbers back. */
+#define BITBOARD_CHUNK_CELLS    8
+#define BITBOARD_CHUNK_VALUES   6561    /* 3^8 */
+#define BITBOARD_MAX_TERNARY    40      /* 3^40 < 2^64 */
+
+static UINT32 gTernaryOfByte[1 << BITBOARD_CHUNK_CELLS];
+static struct {
+	UINT8 first, second;
+} gTernaryDigits[BITBOARD_CHUNK_VALUES];
+static BOOLEAN gTernaryTablesReady = FALSE;
+
+static void bitboard_init_ternary_tables(void)
+{
+	int byte, cell, value, digit;
+
+	for (byte = 0; byte < (1 << BITBOARD_CHUNK_CELLS); byte++) {
+		gTernaryOfByte[byte] = 0;
+		for (cell = BITBOARD_CHUNK_CELLS - 1; cell >= 0; cell--)
+			gTernaryOfByte[byte] = gTernaryOfByte[byte] * 3 + ((byte >> cell) & 1);
+	}
+
+	for (value = 0; value < BITBOARD_CHUNK_VALUES; value++) {
+		int rest = value;
+
+		gTernaryDigits[value].first = gTernaryDigits[value].second = 0;
+		for (cell = 0; cell < BITBOARD_CHUNK_CELLS; cell++, rest /= 3) {
+			digit = rest % 3;
+			if (digit == 1)
+				gTernaryDigits[value].first |= 1 << cell;
+			else if (digit == 2)
+				gTernaryDigits[value].second |= 1 << cell;
+		}
+	}
+
+	gTernaryTablesReady = TRUE;
+}
+
+void BitboardInitShape(BITBOARDSHAPE *shape, int cols, int rows, int lineLength)
+{
+	int col;
+
+	if (cols < 1 || rows < 1 || cols * (rows + 1) > 64)
+		BadElse("BitboardInitShape");
+
+	shape->cols = cols;
+	shape->rows = rows;
+	shape->stride = rows + 1;
+	shape->lineLength = lineLength;
+
+	shape->cells = shape->bottom = shape->top = 0;
+	for (col = 0; col < cols; col++) {
+		shape->cells |= BITBOARD_COLUMN(shape, col);
+		shape->bottom |= BITBOARD_CELL(shape, col, 0);
+		shape->top |= BITBOARD_CELL(shape, col, rows - 1);
+	}
+
+	/* Only keep the directions a line fits in; this also bounds every
+	** shift in BitboardHasLine below 64. */
+	shape->numDirections = 0;
+	if (lineLength >= 1 && lineLength <= rows)
+		shape->directions[shape->numDirections++] = 1;
+	if (lineLength >= 1 && lineLength <= cols)
+		shape->directions[shape->numDirections++] = shape->stride;
+	if (lineLength >= 1 && lineLength <= rows && lineLength <= cols) {
+		shape->directions[shape->numDirections++] = shape->stride - 1;
+		shape->directions[shape->numDirections++] = shape->stride + 1;
+	}
+
+	if (!gTernaryTablesReady)
+		bitboard_init_ternary_tables();
+}
+
+BOOLEAN BitboardHasLine(const BITBOARDSHAPE *shape, BITBOARD stones)
+{
+	int i, length, n = shape->lineLength;
+
+	for (i = 0; i < shape->numDirections; i++) {
+		int shift = shape->directions[i];
+		BITBOARD run = stones;
+
+		/* RUN keeps the cells that start LENGTH stones in a row; doubling
+		** LENGTH takes log2(n) steps instead of n - 1. */
+		for (length = 1; 2 * length <= n; length *= 2)
+			run &= run >> (length * shift);
+		if (length < n)
+			run &= run >> ((n - length) * shift);
+
+		if (run)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+BOOLEAN BitboardHasLineThrough(const BITBOARDSHAPE *shape, BITBOARD stones, BITBOARD cell)
+{
+	int i, step, n = shape->lineLength;
+
+	for (i = 0; i < shape->numDirections; i++) {
+		int shift = shape->directions[i];
+		BITBOARD run = cell;
+
+		for (step = 1; step < n; step++)
+			run |= ((run << shift) | (run >> shift)) & stones;
+
+		if (BitboardCount(run) >= n)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+MOVELIST *BitboardDropMoves(const BITBOARDSHAPE *shape, BITBOARD occupied)
+{
+	MOVELIST *moves = NULL;
+	BITBOARD drops = BitboardDropCells(shape, occupied);
+	int col;
+
+	for (col = 0; col < shape->cols; col++)
+		if (drops & BITBOARD_COLUMN(shape, col))
+			moves = CreateMovelistNode(col, moves);
+
+	return moves;
+}
+
+MOVELIST *BitboardPlaceMoves(const BITBOARDSHAPE *shape, BITBOARD occupied)
+{
+	MOVELIST *moves = NULL;
+	BITBOARD empty = shape->cells & ~occupied;
+	int bit;
+
+	for (; empty; empty &= empty - 1) {
+		bit = __builtin_ctzll(empty);
+		moves = CreateMovelistNode(bit / shape->stride * shape->rows + bit % shape->stride, moves);
+	}
+
+	return moves;
+}
+
+BITBOARD BitboardColumnUnhash(const BITBOARDSHAPE *shape, POSITION position, BITBOARD *occupied)
+{
+	BITBOARD column, columnBits = shape->stride < 64 ? ((BITBOARD) 1 << shape->stride) - 1 : ~(BITBOARD) 0;
+	int col, offset;
+
+	*occupied = 0;
+	for (col = 0, offset = 0; col < shape->cols; col++, offset += shape->stride) {
+		column = (position >> offset) & columnBits;
+		/* everything below the highest set bit, which is the sentinel */
+		if (column)
+			*occupied |= (((BITBOARD) 1 << (63 - __builtin_clzll(column))) - 1) << offset;
+	}
+
+	return position & *occupied;
+}
+
+/* Squeezes out the guard bits, so that cell (col, row) becomes bit
+** col * rows + row. */
+static BITBOARD bitboard_pack(const BITBOARDSHAPE *shape, BITBOARD board)
+{
+	BITBOARD packed = 0, columnCells = ((BITBOARD) 1 << shape->rows) - 1;
+	int col;
+
+	for (col = 0; col < shape->cols; col++)
+		packed |= ((board >> (col * shape->stride)) & columnCells) << (col * shape->rows);
+
+	return packed;
+}
+
+static BITBOARD bitboard_unpack(const BITBOARDSHAPE *shape, BITBOARD packed)
+{
+	BITBOARD board = 0, columnCells = ((BITBOARD) 1 << shape->rows) - 1;
+	int col;
+
+	for (col = 0; col < shape->cols; col++)
+		board |= ((packed >> (col * shape->rows)) & columnCells) << (col * shape->stride);
+
+	return board;
+}
+
+POSITION BitboardTernaryHash(const BITBOARDSHAPE *shape, BITBOARD first, BITBOARD second)
+{
+	BITBOARD packedFirst = bitboard_pack(shape, first), packedSecond = bitboard_pack(shape, second);
+	int chunk, cells = shape->cols * shape->rows;
+	POSITION position = 0;
+
+	if (cells > BITBOARD_MAX_TERNARY)
+		BadElse("BitboardTernaryHash");
+
+	for (chunk = (cells - 1) / BITBOARD_CHUNK_CELLS; chunk >= 0; chunk--) {
+		int shift = chunk * BITBOARD_CHUNK_CELLS;
+		position = position * BITBOARD_CHUNK_VALUES
+		           + gTernaryOfByte[(packedFirst >> shift) & 0xFF]
+		           + 2 * gTernaryOfByte[(packedSecond >> shift) & 0xFF];
+	}
+
+	return position;
+}
+
+void BitboardTernaryUnhash(const BITBOARDSHAPE *shape, POSITION position,
+                           BITBOARD *first, BITBOARD *second)
+{
+	BITBOARD packedFirst = 0, packedSecond = 0;
+	int shift, cells = shape->cols * shape->rows;
+
+	for (shift = 0; shift < cells; shift += BITBOARD_CHUNK_CELLS) {
+		int value = position % BITBOARD_CHUNK_VALUES;
+		position /= BITBOARD_CHUNK_VALUES;
+		packedFirst |= (BITBOARD) gTernaryDigits[value].first << shift;
+		packedSecond |= (BITBOARD) gTernaryDigits[value].second << shift;
+	}
+
+	*first = bitboard_unpack(shape, packedFirst);
+	*second = bitboard_unpack(shape, packedSecond);
+}
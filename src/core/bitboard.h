@@ -0,0 +1,103 @@
+/************************************************************************
+**
+** NAME:	bitboard.h
+**
+** DESCRIPTION:	Bitboard kernel for games played by dropping or placing
+**		two players' stones on a rectangular board: shift-based
+**		N-in-a-row detection, move generation and perfect hashes.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-19
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#ifndef GMCORE_BITBOARD_H
+#define GMCORE_BITBOARD_H
+
+/* A board of COLS columns of ROWS cells is stored column by column, with
+** one unused guard bit on top of every column: cell (col, row) is bit
+** col * (ROWS + 1) + row, row 0 being the bottom. The guard bits are never
+** set in a set of stones, so shifting by 1 (vertical), ROWS (falling
+** diagonal), ROWS + 1 (horizontal) or ROWS + 2 (rising diagonal) moves to
+** the neighbouring cell without wrapping around the edge of the board.
+** The whole board, guard bits included, has to fit in 64 bits. */
+
+typedef UINT64 BITBOARD;
+
+typedef struct {
+	int cols, rows;
+	int stride;             /* rows + 1 */
+	int lineLength;         /* stones in a row that make a line */
+	int numDirections;      /* directions a line of lineLength fits in */
+	int directions[4];
+	BITBOARD cells;         /* every cell of the board */
+	BITBOARD bottom;        /* row 0 of every column */
+	BITBOARD top;           /* the highest row of every column */
+} BITBOARDSHAPE;
+
+#define BITBOARD_CELL(shape, col, row) \
+	((BITBOARD) 1 << ((col) * (shape)->stride + (row)))
+
+/* All cells of column COL. */
+#define BITBOARD_COLUMN(shape, col) \
+	((((BITBOARD) 1 << (shape)->rows) - 1) << ((col) * (shape)->stride))
+
+#define BitboardCount(board) __builtin_popcountll(board)
+
+void            BitboardInitShape       (BITBOARDSHAPE *shape, int cols, int rows, int lineLength);
+
+/* TRUE iff STONES hold lineLength in a row in any direction. */
+BOOLEAN         BitboardHasLine         (const BITBOARDSHAPE *shape, BITBOARD stones);
+
+/* TRUE iff a line of STONES passes through CELL, which must be one of
+** them. Cheaper than BitboardHasLine after a move was made at CELL. */
+BOOLEAN         BitboardHasLineThrough  (const BITBOARDSHAPE *shape, BITBOARD stones, BITBOARD cell);
+
+/* The cell a stone dropped into each column that is not full would land
+** on, given the OCCUPIED cells (which have to be stacked from row 0). */
+#define BitboardDropCells(shape, occupied) \
+	(((occupied) + (shape)->bottom) & (shape)->cells)
+
+/* One move per column that is not full, numbered by column. */
+MOVELIST*       BitboardDropMoves       (const BITBOARDSHAPE *shape, BITBOARD occupied);
+
+/* One move per empty cell, numbered col * rows + row. */
+MOVELIST*       BitboardPlaceMoves      (const BITBOARDSHAPE *shape, BITBOARD occupied);
+
+/* The column hash of a gravity board: each column keeps its ONES bits
+** below a sentinel bit that marks its height, so that every stack of
+** stones gets a distinct number below 2^(cols * stride). */
+#define BitboardColumnHash(shape, ones, occupied) \
+	((POSITION) (((ones) & (occupied)) | ((occupied) + (shape)->bottom)))
+
+/* Inverse of BitboardColumnHash: returns the ONES and sets *OCCUPIED. */
+BITBOARD        BitboardColumnUnhash    (const BITBOARDSHAPE *shape, POSITION position, BITBOARD *occupied);
+
+/* Base 3 hash of a board without gravity: cell number col * rows + row is
+** digit number col * rows + row, 1 for FIRST's stones and 2 for SECOND's.
+** Boards of up to 40 cells. */
+POSITION        BitboardTernaryHash     (const BITBOARDSHAPE *shape, BITBOARD first, BITBOARD second);
+void            BitboardTernaryUnhash   (const BITBOARDSHAPE *shape, POSITION position,
+                                         BITBOARD *first, BITBOARD *second);
+
+#endif /* GMCORE_BITBOARD_H */
@@ -0,0 +1,85 @@
+/************************************************************************
+**
+** NAME:	checkpoint_preload.c
+**
+** DESCRIPTION:	time() for checkpoint_test.c, loaded with LD_PRELOAD
+**
+**		Every call returns one second more than the last, so with
+**		--tiercheckpoint 1 every rCheckpointDue() check is due and the
+**		tier solvers checkpoint at each place they can. With
+**		CHECKPOINT_KILL_AT=<n> the process SIGKILLs itself at the nth
+**		call. With CHECKPOINT_LOG=<file>, each checkpoint renamed into
+**		place appends "<calls so far> <bytes>" to <file>. Build from
+**		src/core:
+**
+** gcc -shared -fPIC -o checkpoint_preload.so checkpoint_preload.c -ldl
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#define _GNU_SOURCE          /* RTLD_NEXT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+#define PRELOAD_EPOCH           1000000000L
+
+static unsigned long calls = 0;
+
+time_t time(time_t *t) {
+	static unsigned long killAt = 0;
+	static int read = 0;
+	unsigned long n;
+	time_t now;
+
+	if (!read) {
+		char *s = getenv("CHECKPOINT_KILL_AT");
+		killAt = (s != NULL) ? strtoul(s, NULL, 10) : 0;
+		read = 1;
+	}
+	n = __sync_add_and_fetch(&calls, 1);
+	now = PRELOAD_EPOCH + (time_t) n;
+	if (killAt != 0 && n >= killAt)
+		raise(SIGKILL);
+	if (t != NULL)
+		*t = now;
+	return now;
+}
+
+int rename(const char *oldpath, const char *newpath) {
+	static int (*realRename)(const char *, const char *) = NULL;
+	char *name = getenv("CHECKPOINT_LOG");
+	struct stat st;
+	FILE *fp;
+
+	if (realRename == NULL)
+		realRename = (int (*)(const char *, const char *)) dlsym(RTLD_NEXT, "rename");
+	if (name != NULL && strstr(newpath, "_checkpoint.dat") != NULL && stat(oldpath, &st) == 0 &&
+	    (fp = fopen(name, "a")) != NULL) {
+		fprintf(fp, "%lu %lld\n", calls, (long long) st.st_size);
+		fclose(fp);
+	}
+	return realRename(oldpath, newpath);
+}
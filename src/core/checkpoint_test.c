@@ -0,0 +1,286 @@
+/************************************************************************
+**
+** NAME:	checkpoint_test.c
+**
+** DESCRIPTION:	Kill-and-resume test of the tier solver checkpoints
+**
+**		Solves a tier game once without checkpoints, for reference,
+**		and once under checkpoint_preload.so, which makes every
+**		checkpoint check due and logs each checkpoint's size. Most
+**		of those checkpoints are alike (a loopy tier checkpoints at
+**		every remoteness, mostly with nothing left to do), so the kill
+**		points are spread over the ones that differ from the one
+**		before. At each, the game is solved in a fresh directory,
+**		SIGKILLed right after that checkpoint and solved again to the
+**		end, and the resumed solve must leave exactly the reference
+**		DB files (compared decompressed) and no checkpoint. Run it
+**		from bin/ after make; the runs go to ./checkpointruns/<game>
+**		and are kept if a kill point fails. Build from src/core, with
+**		checkpoint_preload.c next to it:
+**
+** gcc -std=gnu99 -o checkpoint_test checkpoint_test.c -lz
+** gcc -shared -fPIC -o checkpoint_preload.so checkpoint_preload.c -ldl
+**
+**		Usage: checkpoint_test [-p preload.so] [-k killpoints] <game>
+**		       (default ../src/core/checkpoint_preload.so, 9 points)
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#define _GNU_SOURCE          /* nftw, realpath */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ftw.h>
+#include <limits.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define DEFAULT_PRELOAD         "../src/core/checkpoint_preload.so"
+#define DEFAULT_KILLPOINTS      9
+#define RESUME_MESSAGE          "--Resuming from checkpoint "
+#define MAX_CHECKPOINTS         1000000
+
+static char *game, program[PATH_MAX], preload[PATH_MAX];
+
+/* The directory nftw walks and the one its files are compared against */
+static char *walkRoot, *otherRoot;
+static int walkErrors;
+
+static int RemoveFile(const char *path, const struct stat *sb, int flag, struct FTW *ftw) {
+	return remove(path);
+}
+
+static void RemoveTree(char *dir) {
+	nftw(dir, RemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Runs the game's solve in dir, output to dir/<name>.log. Under the
+   preload unless killAt < 0; killAt > 0 kills it at that call to time(),
+   and log names a file for the checkpoints. Returns the wait status. */
+static int Run(char *dir, char *name, long killAt, char *log) {
+	char output[PATH_MAX], kill[32];
+	int fd, status;
+	pid_t pid;
+
+	snprintf(output, sizeof(output), "%s/%s.log", dir, name);
+	if ((fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	if ((pid = fork()) == 0) {
+		if (chdir(dir) < 0) _exit(127);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (killAt >= 0) {
+			setenv("LD_PRELOAD", preload, 1);
+			if (killAt > 0) {
+				sprintf(kill, "%ld", killAt);
+				setenv("CHECKPOINT_KILL_AT", kill, 1);
+			}
+			if (log != NULL)
+				setenv("CHECKPOINT_LOG", log, 1);
+		}
+		execl(program, program, "--nobpdb", "--tiercheckpoint", (killAt < 0) ? "0" : "1",
+		      "--solve", (char *) NULL);
+		_exit(127);
+	}
+	close(fd);
+	if (pid < 0 || waitpid(pid, &status, 0) < 0)
+		return -1;
+	return status;
+}
+
+/* Copies what follows RESUME_MESSAGE's checkpoint name in dir/<name>.log
+   into where, e.g. "at win/lose remoteness 5"; 0 if it did not resume */
+static int Resumed(char *dir, char *name, char *where, int size) {
+	char log[PATH_MAX], line[1024], *at;
+	FILE *fp;
+
+	snprintf(log, sizeof(log), "%s/%s.log", dir, name);
+	if ((fp = fopen(log, "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (strstr(line, RESUME_MESSAGE) != NULL && (at = strstr(line, ", at ")) != NULL) {
+			snprintf(where, size, "%s", at + 2);
+			where[strcspn(where, ".\n")] = '\0';
+			fclose(fp);
+			return 1;
+		}
+	fclose(fp);
+	return 0;
+}
+
+/* Whether two files hold the same data once decompressed (gzread reads
+   files that are not gzipped as they are) */
+static int SameData(const char *a, const char *b) {
+	static char bufA[1 << 16], bufB[1 << 16];
+	gzFile fa = gzopen(a, "rb"), fb = gzopen(b, "rb");
+	int na, nb, same = (fa != NULL && fb != NULL);
+
+	while (same) {
+		na = gzread(fa, bufA, sizeof(bufA));
+		nb = gzread(fb, bufB, sizeof(bufB));
+		same = (na == nb && na >= 0 && memcmp(bufA, bufB, na) == 0);
+		if (na <= 0)
+			break;
+	}
+	if (fa != NULL) gzclose(fa);
+	if (fb != NULL) gzclose(fb);
+	return same;
+}
+
+/* For each file under walkRoot, the file at the same place under otherRoot
+   must exist and, when compareFiles is set, hold the same data */
+static int compareFiles;
+
+static int CheckFile(const char *path, const struct stat *sb, int flag, struct FTW *ftw) {
+	char other[PATH_MAX];
+
+	if (flag != FTW_F)
+		return 0;
+	snprintf(other, sizeof(other), "%s%s", otherRoot, path + strlen(walkRoot));
+	if (access(other, F_OK) != 0) {
+		printf("    %s has no counterpart %s\n", path, other);
+		walkErrors++;
+	} else if (compareFiles && !SameData(path, other)) {
+		printf("    %s differs from %s\n", path, other);
+		walkErrors++;
+	}
+	return 0;
+}
+
+/* The number of differences between the DB files of dir and reference */
+static int CompareData(char *dir, char *reference) {
+	char a[PATH_MAX], b[PATH_MAX];
+
+	snprintf(a, sizeof(a), "%s/data", dir);
+	snprintf(b, sizeof(b), "%s/data", reference);
+	walkErrors = 0;
+	walkRoot = b; otherRoot = a; compareFiles = 1;
+	nftw(b, CheckFile, 16, FTW_PHYS);
+	/* and nothing else is left, such as a checkpoint or a .part DB */
+	walkRoot = a; otherRoot = b; compareFiles = 0;
+	nftw(a, CheckFile, 16, FTW_PHYS);
+	return walkErrors;
+}
+
+int main(int argc, char **argv) {
+	char base[PATH_MAX / 2], reference[PATH_MAX], dir[PATH_MAX], log[PATH_MAX];
+	char *preloadName = DEFAULT_PRELOAD, where[256];
+	int killPoints = DEFAULT_KILLPOINTS, errors = 0, c, i, status;
+	int numCheckpoints = 0, numDiffering = 0;
+	unsigned long *calls, call;
+	long long size, lastSize = -1;
+	long killAt;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "p:k:")) != -1) {
+		if (c == 'p') preloadName = optarg;
+		else if (c == 'k') killPoints = atoi(optarg);
+		else optind = argc + 1;
+	}
+	if (optind != argc - 1 || killPoints < 1) {
+		fprintf(stderr, "Usage: %s [-p preload.so] [-k killpoints] <game>\n", argv[0]);
+		return 2;
+	}
+	game = argv[optind];
+	snprintf(dir, sizeof(dir), "./%s", game);
+	if (realpath(dir, program) == NULL || realpath(preloadName, preload) == NULL) {
+		fprintf(stderr, "%s: can't find ./%s or %s\n", argv[0], game, preloadName);
+		return 2;
+	}
+
+	mkdir("./checkpointruns", 0755);
+	snprintf(base, sizeof(base), "./checkpointruns/%s", game);
+	RemoveTree(base);
+	mkdir(base, 0755);
+
+	snprintf(reference, sizeof(reference), "%s/reference", base);
+	mkdir(reference, 0755);
+	if ((status = Run(reference, "solve", -1, NULL)) != 0) {
+		printf("%s: the reference solve failed (status %d)\n", game, status);
+		return 1;
+	}
+
+	/* every check due, nothing killed: this also logs the checkpoints */
+	snprintf(dir, sizeof(dir), "%s/checkpointed", base);
+	mkdir(dir, 0755);
+	if (realpath(base, log) == NULL || strlen(log) + 13 > sizeof(log))
+		return 1;
+	strcat(log, "/checkpoints");
+	if ((status = Run(dir, "solve", 0, log)) != 0 || (fp = fopen(log, "r")) == NULL) {
+		printf("%s: the checkpointed solve failed (status %d)\n", game, status);
+		return 1;
+	}
+	calls = (unsigned long *) malloc(MAX_CHECKPOINTS * sizeof(unsigned long));
+	while (numDiffering < MAX_CHECKPOINTS && fscanf(fp, "%lu %lld", &call, &size) == 2) {
+		if (size != lastSize)
+			calls[numDiffering++] = call;
+		lastSize = size;
+		numCheckpoints++;
+	}
+	fclose(fp);
+	if ((i = CompareData(dir, reference)) != 0) {
+		printf("%s: the checkpointed solve left %d differences\n", game, i);
+		errors++;
+	}
+	printf("%s: %d checkpoints in a checkpointed solve, %d unlike the one before\n",
+	       game, numCheckpoints, numDiffering);
+	if (numDiffering < killPoints)
+		killPoints = numDiffering;
+
+	for (i = 0; i < killPoints; i++) {
+		/* the next call is the one right after the checkpoint's rename */
+		killAt = (long) calls[(long) numDiffering * i / killPoints] + 1;
+		snprintf(dir, sizeof(dir), "%s/kill%ld", base, killAt);
+		mkdir(dir, 0755);
+		status = Run(dir, "killed", killAt, NULL);
+		if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL) {
+			printf("  kill at %ld: the solve was not killed (status %d)\n", killAt, status);
+			errors++;
+			continue;
+		}
+		if ((status = Run(dir, "resumed", 0, NULL)) != 0) {
+			printf("  kill at %ld: the resumed solve failed (status %d)\n", killAt, status);
+			errors++;
+			continue;
+		}
+		if (!Resumed(dir, "resumed", where, sizeof(where))) {
+			printf("  kill at %ld: the solve did not resume from its checkpoint\n", killAt);
+			errors++;
+			continue;
+		}
+		c = CompareData(dir, reference);
+		printf("  kill at %ld: %s, %d differences\n", killAt, where, c);
+		if (c != 0)
+			errors++;
+		else
+			RemoveTree(dir);
+	}
+	free(calls);
+	if (errors == 0)
+		RemoveTree(base);
+	printf("%s: %d errors\n", argv[0], errors);
+	return errors ? 1 : 0;
+}
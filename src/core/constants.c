@@ -188,11 +188,12 @@ STRING kSolveVersion = "2006.01.01";
 
 STRING kCommandSyntaxHelp =
         "\nSyntax:\n"
-        "%s  {--nodb | --newdb | --filedb | --numoptions | --curroption |\n"
+        "%s  {--nodb | --newdb | --filedb | --numoptions | --curroption | --variantinfo |\n"
         "\t--option <n> | --nobpdb | --2bit | --colldb | --univdb | --gps |\n"
-        "\t--bottomup | --alpha-beta | --lowmem | --slicessolver | --schemes |\n"
-        "\t--allschemes | --adjust | --noadjust | --solve [<n> | <all>] |\n"
-        "\t--analyze [ <linkname> ] | --open | --visualize |\n"
+        "\t--bottomup | --alpha-beta | --lowmem | --threads <n> | --slicessolver | --schemes |\n"
+        "\t--allschemes | --adjust | --noadjust | --stats [<file>] | --statsinterval <s> |\n"
+        "\t--solve [<n> | <all>] |\n"
+        "\t--analyze [ <linkname> ] | --open | --visualize | --vissample <f> | --visdepth <n> |\n"
         "\t--DoMove <args> <move> | --Primitive <args> | --PrintPosition <args> |\n"
         "\t--GenerateMoves <args>} | --lightplayer | --netDb | --hashCounting |\n"
         "\t--help}\n\n"
@@ -203,6 +204,7 @@ STRING kCommandSyntaxHelp =
         "--filedb\t\tStarts game with file-based database.\n"
         "--numoptions\t\tPrints the number of options.\n"
         "--curroption\t\tPrints the current option.\n"
+        "--variantinfo\t\tPrints the size of the current option and whether it is solved.\n"
         "--option <n>\t\tStarts game with the n option configuration.\n"
         "--nobpdb\t\tStarts game without using Bit Perfect Database.\n"
         "--2bit\t\t\tStarts game with two-bit solving enabled.\n"
@@ -214,6 +216,10 @@ STRING kCommandSyntaxHelp =
         "--bottomup\n"
         "--alpha-beta\t\tStarts game with weak alpha-beta solver. \n"
         "--lowmem\t\tStarts game with low memory overhead solver enabled.\n"
+        "--threads <n>\t\tNumber of worker threads for the parallel solvers (default: one per core).\n"
+#ifdef HAVE_MPI
+        "\t\t\tUnder mpirun -np <n>, the shard solver runs on n-1 ranks instead.\n"
+#endif
         "--slicessolver\t\tWith bpdb turned on, the variable slice aware solver will be used (faster).\n"
         "--schemes\t\tWith bpdb turned on variable gaps compression will be used for saved dbs.\n"
         "--allschemes\n"
@@ -222,6 +228,16 @@ STRING kCommandSyntaxHelp =
         "--notiers\t\tStarts game with Tier-Gamesman Mode OFF by default.\n"
         "--notiermenu\t\tThis option disables the Tier-Gamesman solver menu, and auto-solves all tiers.\n"
         "--notierprint\t\tThis option disables the printing from the Tier-Gamesman solver menu.\n"
+        "--tierprefetch <MB>\tMemory for child tier DBs loaded ahead of time (0 disables; default: 1/8 of RAM).\n"
+        "--tiercheckpoint <s>\tSeconds between checkpoints of the tier being solved, which a\n"
+        "\t\t\trestarted solve resumes from (0 disables; default: 600).\n"
+        "--tiercheck [<n>]\tVerifies every solved tier DB against its children, printing the first\n"
+        "\t\t\tn inconsistencies of each tier (default: 10). Uses --threads worker processes.\n"
+        "--stats [<file>]\tCounts positions per tier, time in GenerateMoves, DoMove and the\n"
+        "\t\t\tdatabase, hash window loads and cache hit rates. With <file>, a JSON\n"
+        "\t\t\tsnapshot is written there periodically and at exit; the interact\n"
+        "\t\t\t'stats' command prints one. Must come before --solve or --interact.\n"
+        "--statsinterval <s>\tSeconds between snapshots written by --stats (default: 5).\n"
         "--solve [<n> | <all>]\tSolves game with the n option configuration.\n"
         "\t\t\tTo solve all option configurations of game, use <all>.\n"
         "\t\t\tIf <n> and <all> are ommited, it will solve the default\n"
@@ -233,12 +249,14 @@ STRING kCommandSyntaxHelp =
         "--analyze\t\tCreates the analysis directory with info on all variants\n"
         "--open\t\t\tStarts game with Open Positions solving enabled.\n"
         "--visualize\t\tTurns on automatic visualization.\n"
+        "--vissample <f>\t\tOnly visualize the moves out of a fraction f of the positions.\n"
+        "--visdepth <n>\t\tOnly visualize the moves out of positions fewer than n moves from the start.\n"
         "--DoMove <pos> <move>\tDoes the move on the position.\n"
         "--Primitive <pos>\tChecks whether position is a primitive.\n"
         "--PrintPosition <pos>\tPrints the ASCII representation of the position.\n"
         "--GenerateMoves <pos>\tGenerates all possible moves from position.\n"
         "--lightplayer\t\tHints the database to minimize memory usage.\n"
-        "--netDb\t\t\tStarts game with the network database.\n"
+        "--netDb [<url>]\t\tStarts game with the network database (host:port/path).\n"
         "--hashCounting\t\tStarts the generic-hash counting tool instead of the game.\n"
         "--hashtable_buckets\t(advanced) Sets the total number of buckets in any hashtables used.\n"
         "--withPen <file>\tStarts game with Anoto Pen support, reading data from <file> (with GUI only)\n"
@@ -243,11 +243,12 @@ BOOLEAN db_load_database(){
 	return FALSE;
 }
 
+/* The positions are already canonical, see GetValueAndRemotenessOfPositionBulk. */
 void db_get_bulk (POSITION* positions, VALUE* ValueArray, REMOTENESS* remotenessArray, int length) {
 	int i;
 	for (i = 0; i < length; i++) {
-		ValueArray[i] = GetValueOfPosition(positions[i]);
-		remotenessArray[i] = Remoteness(positions[i]);
+		ValueArray[i] = db_functions->get_value(positions[i]);
+		remotenessArray[i] = db_functions->get_remoteness(positions[i]);
 	}
 }
 
@@ -349,7 +350,8 @@ VALUE StoreValueOfPosition(POSITION position, VALUE value)
 	if(gSymmetries)
 		position = gCanonicalPosition(position);
 	AnalyzePosition(position,value);
-	return db_functions->put_value(position,value);
+	STATS_TIMED(STAT_DBPUT, value = db_functions->put_value(position,value));
+	return value;
 }
 
 
@@ -357,7 +359,9 @@ VALUE GetValueOfPosition(POSITION position)
 {
 	if(((gMenuMode != Analysis) || gMenuMode == Evaluated) && gSymmetries)
 		position = gCanonicalPosition(position);
-	return db_functions->get_value(position);
+	VALUE value;
+	STATS_TIMED(STAT_DBGET, value = db_functions->get_value(position));
+	return value;
 }
 
 
@@ -365,7 +369,9 @@ REMOTENESS Remoteness(POSITION position)
 {
 	if(((gMenuMode != Analysis) || gMenuMode == Evaluated) && gSymmetries)
 		position = gCanonicalPosition(position);
-	return db_functions->get_remoteness(position);
+	REMOTENESS remoteness;
+	STATS_TIMED(STAT_DBGET, remoteness = db_functions->get_remoteness(position));
+	return remoteness;
 }
 
 
@@ -373,7 +379,7 @@ void SetRemoteness (POSITION position, REMOTENESS remoteness)
 {
 	if(gSymmetries)
 		position = gCanonicalPosition(position);
-	db_functions->put_remoteness(position,remoteness);
+	STATS_TIMED(STAT_DBPUT, db_functions->put_remoteness(position,remoteness));
 }
 
 
@@ -381,7 +387,9 @@ BOOLEAN Visited(POSITION position)
 {
 	if(gSymmetries)
 		position = gCanonicalPosition(position);
-	return db_functions->check_visited(position);
+	BOOLEAN visited;
+	STATS_TIMED(STAT_DBGET, visited = db_functions->check_visited(position));
+	return visited;
 }
 
 
@@ -389,14 +397,14 @@ void MarkAsVisited (POSITION position)
 {
 	if(gSymmetries)
 		position = gCanonicalPosition(position);
-	db_functions->mark_visited(position);
+	STATS_TIMED(STAT_DBPUT, db_functions->mark_visited(position));
 }
 
 void UnMarkAsVisited (POSITION position)
 {
 	if(gSymmetries)
 		position = gCanonicalPosition(position);
-	db_functions->unmark_visited(position);
+	STATS_TIMED(STAT_DBPUT, db_functions->unmark_visited(position));
 }
 
 void UnMarkAllAsVisited()
@@ -459,6 +467,35 @@ BOOLEAN LoadDatabase() {
 	return db_functions->load_database();
 }
 
+/* TRUE if a finished database for the current option is already on disk.
+   Only the backends with a fixed file name are recognized; for the others
+   this returns FALSE and the caller has to solve. Call after Initialize(). */
+BOOLEAN DatabaseExists() {
+	char filename[256];
+	struct stat buf;
+
+	if (kSupportsTierGamesman && gTierGamesman)
+		return CheckTierDB(gInitialTier, getOption()) == 1;
+	else if (gBitPerfectDB)
+		sprintf(filename, "./data/m%s_%d_%s.dat.gz", kDBName, getOption(),
+		        gSymmetries ? "symdb" : "bpdb");
+	else if (gTwoBits || gCollDB || gUnivDB || gNetworkDB || gFileDB)
+		return FALSE;
+	else
+		sprintf(filename, "./data/m%s_%d_memdb.dat.gz", kDBName, getOption());
+
+	return stat(filename, &buf) == 0;
+}
+
 void GetValueAndRemotenessOfPositionBulk(POSITION* positions, VALUE* ValueArray, REMOTENESS* remotenessArray, int length) {
-	db_functions->get_bulk(positions, ValueArray, remotenessArray, length);
+	POSITION *canonical = positions;
+	int i;
+	if(((gMenuMode != Analysis) || gMenuMode == Evaluated) && gSymmetries) {
+		canonical = (POSITION*) SafeMalloc(length * sizeof(POSITION));
+		for (i = 0; i < length; i++)
+			canonical[i] = gCanonicalPosition(positions[i]);
+	}
+	STATS_TIMED(STAT_DBGET, db_functions->get_bulk(canonical, ValueArray, remotenessArray, length));
+	if (canonical != positions)
+		SafeFree(canonical);
 }
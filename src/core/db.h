@@ -162,6 +162,7 @@ WINBY           WinByLoad               (POSITION pos);
 /* Persistence */
 BOOLEAN         SaveDatabase            ();
 BOOLEAN         LoadDatabase            ();
+BOOLEAN         DatabaseExists          ();
 
 //bulk
 void GetValueAndRemotenessOfPositionBulk(POSITION* positions, VALUE* ValueArray, REMOTENESS* remotenessArray, int length);
@@ -61,6 +61,7 @@ MEX                     filedb_get_mex                  (POSITION pos);
 void            filedb_set_mex                  (POSITION pos, MEX mex);
 
 cellValue*      filedb_get_raw                  (POSITION pos);
+void            filedb_cache_counts             (UINT64 *hits, UINT64 *misses);
 
 /* saving to/reading from a file */
 BOOLEAN     filedb_save_database    ();
@@ -97,6 +98,7 @@ void filedb_init(DB_Table *new_db)
 	if (gZeroMemPlayer) max_pages = 1;
 
 	mydb = gamesdb_create(sizeof(cellValue), 4196, max_pages, 10, dirname);
+	StatsSetCacheCounter(STAT_FILEDB, filedb_cache_counts);
 
 	start = FALSE;
 	mypos = 0;
@@ -105,10 +107,18 @@ void filedb_init(DB_Table *new_db)
 
 void filedb_free()
 {
+	StatsSetCacheCounter(STAT_FILEDB, NULL);
 	gamesdb_put(mydb, (char *)&myvalue, mypos);
 	gamesdb_destroy(mydb);
 }
 
+/* Page hits and misses of the buffer manager, read by the stats snapshot */
+void filedb_cache_counts(UINT64 *hits, UINT64 *misses)
+{
+	*hits = mydb->buf_man->hits;
+	*misses = mydb->buf_man->misses;
+}
+
 cellValue* filedb_get_raw(POSITION pos)
 {
 	if(start == TRUE) {
@@ -43,6 +43,7 @@ static gamesdb_frameid gamesdb_translate(gamesdb* db, gamesdb_pageid vpn) {
 	gamesdb_frameid ppn = gamesdb_bman_find(db, vpn); //see if it is in physical memory
 
 	if (ppn == NULL) { //the page is not present in physical memory
+		db->buf_man->misses++;
 		ppn = gamesdb_bman_replace(db, vpn); //get a replacement page, change page table in the process
 
 		if (ppn->valid == GAMESDB_TRUE) {
@@ -63,6 +64,8 @@ static gamesdb_frameid gamesdb_translate(gamesdb* db, gamesdb_pageid vpn) {
 			//if (ppn->tag != vpn)
 			//the buffer is uninitialized, this means no record exists in the page
 		}
+	} else {
+		db->buf_man->hits++;
 	}
 
 	if (GAMESDB_DEBUG) {
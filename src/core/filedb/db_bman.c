@@ -50,6 +50,7 @@ gamesdb_bman* gamesdb_bman_init(){
 	gamesdb_bman *new = (gamesdb_bman*) gamesdb_SafeMalloc(sizeof(gamesdb_bman));
 	new->hash = gamesdb_basichash_create(INDEX_BITLENGTH, INDEX_CHUNKSIZE);
 	new->clock_hand = NULL;
+	new->hits = new->misses = 0;
 	return new;
 }
 
@@ -70,6 +70,8 @@ typedef struct {
 	//frame_id (*replace_fun) (db_bman*);
 	gamesdb_bhash *hash;
 	gamesdb_bufferpage *clock_hand;
+	unsigned long long hits;   //translations that found the page in memory
+	unsigned long long misses; //translations that had to read it in
 } gamesdb_bman;
 
 //the db object, so to speak
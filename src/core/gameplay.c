@@ -69,8 +69,7 @@ BOOLEAN usingLookupTierDB = FALSE;
 ** Local function prototypes
 */
 
-static VALUE_MOVES*    SortMoves                       (POSITION, MOVE, VALUE_MOVES*);
-static VALUE_MOVES*    StoreMoveInList                 (MOVE, REMOTENESS, VALUE_MOVES*, int);
+static VALUE_MOVES*    SortMoves                       (POSITION, MOVELIST*, VALUE_MOVES*);
 static moveList*       moveListHandleUndo              (moveList*);
 static moveList*       moveListHandleNewMove           (POSITION, MOVE, moveList*, MOVELIST*);
 static void            moveListHandleGameOver             (moveList*);
@@ -122,6 +121,7 @@ void PlayGame(PLAYER playerOne, PLAYER playerTwo)
 		gInitializeHashWindow(gInitialTier, !usingLookupTierDB);
 		position = gHashToWindowPosition(gInitialTierPosition, gInitialTier);
 	}
+	clearEvaluatorCache();
 	undo = InitializeUndo();
 
 #ifndef X
@@ -1451,18 +1451,42 @@ MOVE RandomSmallestRemotenessMove (MOVELIST *moveList, REMOTENESSLIST *remotenes
 	return (moveList->move);
 }
 
+// Scores every position of posList with one batched static evaluator call.
+// Returns a SafeMalloc'd array in list order (NULL for an empty list).
+static float *EvaluatePositionList(POSITIONLIST *posList)
+{
+	POSITIONLIST *ptr;
+	POSITION *positions;
+	float *scores;
+	int count = 0;
+
+	for (ptr = posList; ptr != NULL; ptr = ptr->next)
+		count++;
+	if (count == 0)
+		return NULL;
+
+	positions = (POSITION *) SafeMalloc(count * sizeof(POSITION));
+	scores = (float *) SafeMalloc(count * sizeof(float));
+	for (ptr = posList, count = 0; ptr != NULL; ptr = ptr->next)
+		positions[count++] = ptr->position;
+	evaluatePositions(positions, scores, count);
+	SafeFree(positions);
+	return scores;
+}
+
 // posList and moveList must have their entries pairwise matched!
 // i.e. first entry of posList is the result of first entry of moveList, etc.
 MOVE RandomLargestSEvalMove(POSITIONLIST *posList, MOVELIST *moveList)
 {
 	MOVELIST *maxValueMoveList = NULL;
-	int numMoves, random;
+	int numMoves, random, i = 0;
 	float currValue, maxValue;
+	float *scores = EvaluatePositionList(posList);
 
 	numMoves = 0;
 	maxValue = -1;
 	while(posList != NULL) {
-		currValue = evaluatePosition(posList->position);
+		currValue = scores[i++];
 		if ( currValue < maxValue) {
 			numMoves = 1;
 			maxValue = currValue;
@@ -1474,6 +1498,8 @@ MOVE RandomLargestSEvalMove(POSITIONLIST *posList, MOVELIST *moveList)
 		moveList = moveList->next;
 		posList = posList->next;
 	}
+	if (scores != NULL)
+		SafeFree(scores);
 
 	if (numMoves<=0) {
 		return -1;
@@ -1493,10 +1519,11 @@ MOVE LargestWinningSEvalMove(POSITIONLIST *posList, MOVELIST *moveList, float *b
 	float currChildValue=0;
 	(*bestValue)=1.1; // Just slightly higher than 1, so that anything is better
 	MOVE theMove;
-	int numMoves = 0;
+	int numMoves = 0, i = 0;
+	float *scores = EvaluatePositionList(posList);
 
 	while(posList != NULL) {
-		currChildValue = evaluatePosition(posList->position);
+		currChildValue = scores[i++];
 		// Choosing a child with a losing value (for the opponent) means we'll win
 		if ( currChildValue < (*bestValue)) {
 			numMoves=1;
@@ -1507,6 +1534,8 @@ MOVE LargestWinningSEvalMove(POSITIONLIST *posList, MOVELIST *moveList, float *b
 		moveList = moveList->next;
 		posList = posList->next;
 	}
+	if (scores != NULL)
+		SafeFree(scores);
 
 	// If we can't find a winning move
 
@@ -1668,96 +1697,117 @@ MOVE GetWinByMove (POSITION position, MOVELIST* genMoves)
 	return -1;
 }
 
-/* Jiong */
-VALUE_MOVES* SortMoves (POSITION thePosition, MOVE move, VALUE_MOVES* valueMoves)
+/* A move being ranked by SortMoves */
+typedef struct {
+	int type;               /* WINMOVE, TIEMOVE or LOSEMOVE */
+	REMOTENESS remoteness;
+	int order;              /* position in the generated move list */
+	MOVE move;
+} RANKEDMOVE;
+
+static int CompareRankedMoves(const void *a, const void *b)
 {
-	POSITION child;
-	VALUE childValue;
+	const RANKEDMOVE *x = a, *y = b;
 
-	child = DoMove(thePosition, move);
-	childValue = GetValueOfPosition(child);
-	if (gGoAgain(thePosition, move)) {
-		/* Robert Shi: not sure if this should be changed accordingly. */
-		switch(childValue) {
-		case win:
-			childValue = lose;
-			break;
-		case lose:
-			childValue = win;
-			break;
-		default:
-			break;
-		}
-	}
-	if (childValue == lose || childValue == drawlose) {  //winning moves
-		valueMoves = StoreMoveInList(move, Remoteness(child), valueMoves,  WINMOVE);
-	} else if (childValue == tie || childValue == drawtie) {  //tie moves
-		valueMoves = StoreMoveInList(move, Remoteness(child), valueMoves,  TIEMOVE);
-	} else if (childValue == win || childValue == drawwin) {  //lose moves
-		valueMoves = StoreMoveInList(move, Remoteness(child), valueMoves, LOSEMOVE);
-	} else {
-		BadElse("SortMoves found a child with an unknown value and");
-	}
-	return valueMoves;
+	if (x->type != y->type)
+		return x->type - y->type;
+	if (x->remoteness != y->remoteness)
+		return x->remoteness < y->remoteness ? -1 : 1;
+	/* equally remote moves are listed last generated first */
+	return y->order - x->order;
 }
 
-
-/* GamesCrafters Network Team 4/20/06 */
-VALUE_MOVES* NetworkSortMoves (POSITION thePosition, MOVELIST* head, VALUE_MOVES* valueMoves)
+/*
+** Sorts the moves in HEAD into the win, tie and lose lists of VALUEMOVES,
+** each by increasing remoteness. All the children are looked up with one
+** GetValueAndRemotenessOfPositionBulk, so that databases which read from
+** disk or from the network can fetch them together.
+*/
+VALUE_MOVES* SortMoves (POSITION thePosition, MOVELIST* head, VALUE_MOVES* valueMoves)
 {
-	POSITION *childArray;
-	VALUE *childValueArray;
-	MOVELIST *ptr = head;
-	REMOTENESS *remotenessArray;
-	int lengthOfMoveList = 0, i;
+	POSITION *children;
+	VALUE *childValues;
+	REMOTENESS *remotenesses;
+	RANKEDMOVE *ranked;
+	MOVELIST *ptr, *newMove, *lastMove[3] = { NULL, NULL, NULL };
+	REMOTENESSLIST *newRemoteness, *lastRemoteness[3] = { NULL, NULL, NULL };
+	int numMoves = 0, numRanked = 0, i, type;
 
-	while (ptr != NULL) {         //get length of the movelist
-		lengthOfMoveList++;
-		ptr = ptr->next;
-	}
-
-	ptr = head;
-
-	childArray = SafeMalloc(lengthOfMoveList*sizeof(POSITION));
-	childValueArray = SafeMalloc(lengthOfMoveList*sizeof(VALUE));
-	remotenessArray = SafeMalloc(lengthOfMoveList*sizeof(REMOTENESS));
+	for (ptr = head; ptr != NULL; ptr = ptr->next)
+		numMoves++;
+	if (numMoves == 0)
+		return valueMoves;
 
-	for (i=0; (ptr != NULL); i++, ptr = ptr->next) {
-		childArray[i] = DoMove(thePosition, ptr->move);
-	}
+	children = (POSITION *) SafeMalloc(numMoves * sizeof(POSITION));
+	childValues = (VALUE *) SafeMalloc(numMoves * sizeof(VALUE));
+	remotenesses = (REMOTENESS *) SafeMalloc(numMoves * sizeof(REMOTENESS));
+	ranked = (RANKEDMOVE *) SafeMalloc(numMoves * sizeof(RANKEDMOVE));
 
-	ptr = head;
+	for (i = 0, ptr = head; ptr != NULL; i++, ptr = ptr->next)
+		children[i] = DoMove(thePosition, ptr->move);
 
-	GetValueAndRemotenessOfPositionBulk(childArray, childValueArray, remotenessArray, lengthOfMoveList);
+	GetValueAndRemotenessOfPositionBulk(children, childValues, remotenesses, numMoves);
 
-	for (i=0; (ptr != NULL); i++, ptr = ptr->next) {
+	/* children that are neither won, tied nor lost (e.g. undecided in an
+	   unsolved database) are reported and left out of every list */
+	for (i = 0, ptr = head; ptr != NULL; i++, ptr = ptr->next) {
 		if (gGoAgain(thePosition, ptr->move)) {
-			switch(childValueArray[i]) {
+			/* Robert Shi: not sure if this should be changed accordingly. */
+			switch(childValues[i]) {
 			case win:
-				childValueArray[i] = lose;
+				childValues[i] = lose;
 				break;
 			case lose:
-				childValueArray[i] = win;
+				childValues[i] = win;
 				break;
 			default:
-				childValueArray[i] = childValueArray[i];
+				break;
 			}
 		}
-
-		if (childValueArray[i] == lose) {  //winning moves
-			valueMoves = StoreMoveInList(ptr->move, remotenessArray[i], valueMoves,  WINMOVE);
-		} else if (childValueArray[i] == tie) {  //tie moves
-			valueMoves = StoreMoveInList(ptr->move, remotenessArray[i], valueMoves,  TIEMOVE);
-		} else if (childValueArray[i] == win) {  //lose moves
-			valueMoves = StoreMoveInList(ptr->move, remotenessArray[i], valueMoves, LOSEMOVE);
+		if (childValues[i] == lose || childValues[i] == drawlose) {  //winning moves
+			type = WINMOVE;
+		} else if (childValues[i] == tie || childValues[i] == drawtie) {  //tie moves
+			type = TIEMOVE;
+		} else if (childValues[i] == win || childValues[i] == drawwin) {  //lose moves
+			type = LOSEMOVE;
 		} else {
 			BadElse("SortMoves found a child with an unknown value and");
+			continue;
+		}
+		ranked[numRanked].type = type;
+		ranked[numRanked].remoteness = remotenesses[i];
+		ranked[numRanked].order = i;
+		ranked[numRanked].move = ptr->move;
+		numRanked++;
+	}
+
+	qsort(ranked, numRanked, sizeof(RANKEDMOVE), CompareRankedMoves);
+
+	for (i = 0; i < numRanked; i++) {
+		type = ranked[i].type;
+
+		newMove = (MOVELIST *) SafeMalloc(sizeof(MOVELIST));
+		newRemoteness = (REMOTENESSLIST *) SafeMalloc(sizeof(REMOTENESSLIST));
+		newMove->move = ranked[i].move;
+		newMove->next = NULL;
+		newRemoteness->remoteness = ranked[i].remoteness;
+		newRemoteness->next = NULL;
+
+		if (lastMove[type] == NULL) {
+			valueMoves->moveList[type] = newMove;
+			valueMoves->remotenessList[type] = newRemoteness;
+		} else {
+			lastMove[type]->next = newMove;
+			lastRemoteness[type]->next = newRemoteness;
 		}
+		lastMove[type] = newMove;
+		lastRemoteness[type] = newRemoteness;
 	}
 
-	SafeFree(childArray);
-	SafeFree(childValueArray);
-	SafeFree(remotenessArray);
+	SafeFree(children);
+	SafeFree(childValues);
+	SafeFree(remotenesses);
+	SafeFree(ranked);
 
 	return valueMoves;
 }
@@ -1954,7 +2004,7 @@ MOVE GetComputersMove(POSITION thePosition)
 ****/
 VALUE_MOVES* GetValueMoves(POSITION thePosition)
 {
-	MOVELIST *ptr, *head;
+	MOVELIST *head;
 	VALUE_MOVES *valueMoves;
 	VALUE theValue;
 
@@ -1968,75 +2018,14 @@ VALUE_MOVES* GetValueMoves(POSITION thePosition)
 		return(valueMoves);
 	} else {
 		/* we are guaranteed it's win | tie now */
-		head = ptr = GenerateMoves(thePosition);
-		if (gNetworkDB) {
-			valueMoves = NetworkSortMoves(thePosition, head, valueMoves);
-		} else {
-			/* otherwise  (theValue = (win|tie) */
-			while (ptr != NULL) {
-				valueMoves = SortMoves(thePosition, ptr->move, valueMoves);
-				ptr = ptr->next;
-			}
-		}
+		head = GenerateMoves(thePosition);
+		valueMoves = SortMoves(thePosition, head, valueMoves);
 		FreeMoveList(head);
 	}
 	return(valueMoves);
 }
 
 
-/* Jiong */
-/* Who is working on this?? */
-
-VALUE_MOVES* StoreMoveInList(MOVE theMove, REMOTENESS remoteness, VALUE_MOVES* valueMoves, int typeofMove)
-{
-	MOVELIST *moveList, *newMove, *prevMoveList;
-	REMOTENESSLIST *remotenessList, *newRemoteness, *prevRemotenessList;
-
-	moveList = valueMoves->moveList[typeofMove];
-	remotenessList = valueMoves->remotenessList[typeofMove];
-
-	newMove = (MOVELIST *) SafeMalloc (sizeof(MOVELIST));
-	newRemoteness = (REMOTENESSLIST *) SafeMalloc (sizeof(REMOTENESSLIST));
-	newMove->move = theMove;
-	newMove->next = NULL;
-	newRemoteness->remoteness = remoteness;
-	newRemoteness->next = NULL;
-
-	prevMoveList = NULL;
-	prevRemotenessList = NULL;
-
-	if (moveList == NULL) {
-		valueMoves->moveList[typeofMove] = newMove;
-		valueMoves->remotenessList[typeofMove] = newRemoteness;
-		return valueMoves;
-	}
-
-	while(moveList != NULL) {
-		if (remotenessList->remoteness >= remoteness) {
-			newMove->next = moveList;
-			newRemoteness->next = remotenessList;
-
-			if (prevMoveList==NULL) {
-				valueMoves->moveList[typeofMove] = newMove;
-				valueMoves->remotenessList[typeofMove] = newRemoteness;
-			} else {
-				prevMoveList->next = newMove;
-				prevRemotenessList->next = newRemoteness;
-			}
-			return (valueMoves);
-		} else {
-			prevMoveList = moveList;
-			moveList = moveList->next;
-			prevRemotenessList = remotenessList;
-			remotenessList = remotenessList->next;
-		}
-	}
-
-	prevMoveList->next = newMove;
-	prevRemotenessList->next = newRemoteness;
-	return (valueMoves);
-}
-
 PLAYER NewHumanPlayer(STRING name, int turn)
 {
 	PLAYER new = (PLAYER)SafeMalloc(sizeof(struct Player));
@@ -35,9 +35,11 @@
 #include "misc.h"
 #include "textui.h"
 #include "mlib.h"
+#include "bitboard.h"
 #include "interact.h"
 #include "main.h"
 #include "seval.h"
+#include "stats.h"
 
 /* For memory debugging */
 #include "memwatch.h"
@@ -38,9 +38,11 @@ POSITION (*gCanonicalPosition)(POSITION) = NULL;
 STRING (*gCustomUnhash)(POSITION) = NULL;
 char (*gReturnTurn)(POSITION) = NULL;
 void* (*linearUnhash)(POSITION) = NULL;
+void (*linearUnhashInto)(POSITION, void*) = NULL;
 featureEvaluatorCustom (*gGetSEvalCustomFnPtr)(STRING) = NULL;
 POSITIONLIST *(*gEnumerateWithinStage)(int) = NULL;
 void (*gUndoMove)(MOVE move) = NULL;
+void (*gSetGPSPosition)(POSITION position) = NULL;
 STRING (*GetHelpTextInterface)() = NULL;
 STRING (*GetHelpOnYourTurn)() = NULL;
 STRING (*GetHelpObjective)() = NULL;
@@ -128,6 +130,8 @@ BOOLEAN gPlaying = FALSE;
 BOOLEAN gDrawEdges = TRUE;
 BOOLEAN gRemotenessOrder = TRUE;
 BOOLEAN gGenerateNodeViz = FALSE;
+double gVisSampleRate = 1.0;      /* fraction of the parents whose edges are drawn */
+int gVisDepthLimit = -1;          /* only draw edges this close to the initial position, -1: no limit */
 
 /* NetworkDB Globals */
 BOOLEAN gNetworkDB = FALSE;
@@ -150,6 +154,10 @@ BOOLEAN gDontLoadTierDB = FALSE;
 unsigned int HASHTABLE_BUCKETS = 1024;
 BOOLEAN gTierSolvePrint = TRUE;
 BOOLEAN gTotalTiers = 0;
+long long gTierPrefetchMB = -1;         /* -1 means an eighth of physical memory, 0 turns it off */
+int gTierCheckpointSeconds = 600;       /* between checkpoints of the tier being solved, 0 turns them off */
+BOOLEAN gTierCheck = FALSE;             /* verify tier DBs against their children after solving */
+int gTierCheckReportLimit = 10;         /* inconsistencies printed per verified tier */
 // For the hash window
 BOOLEAN gHashWindowInitialized = FALSE;
 BOOLEAN gCurrentTierIsLoopy = FALSE;
@@ -163,6 +171,7 @@ BOOLEAN*        gTierDBExists = NULL;
 BOOLEAN kSupportsTierGamesman = FALSE;
 BOOLEAN kSupportsShardGamesman = FALSE;
 BOOLEAN kUsesQuartoGamesman = FALSE;
+BOOLEAN kReentrant = FALSE;
 BOOLEAN kExclusivelyTierGamesman = FALSE;
 BOOLEAN kDebugTierMenu = FALSE;
 TIERPOSITION gInitialTierPosition = -1;
@@ -175,6 +184,12 @@ UNDOMOVELIST*   (*gGenerateUndoMovesToTierFunPtr)(POSITION,TIER) = NULL;
 POSITION (*gUnDoMoveFunPtr)(POSITION,UNDOMOVE) = NULL;
 STRING (*gTierToStringFunPtr)(TIER) = NULL;
 MULTIPARTEDGELIST* (*gGenerateMultipartMoveEdgesFunPtr)(POSITION,MOVELIST*,POSITIONLIST*) = NULL;
+// For the shard solver (see solveshard.h)
+int gShardSize = 28;
+int gShardHashLength = 0;
+POSITION (*gShardHashFunPtr)(POSITION) = NULL;
+POSITION (*gShardUnhashFunPtr)(POSITION) = NULL;
+int (*gShardChildrenFunPtr)(POSITION,POSITION**) = NULL;
 
 BOOLEAN kUsePureDraw = FALSE;
 // For the experimental GenerateMoves
@@ -184,6 +199,11 @@ int MAXFANOUT = 100;
 
 /* Variables for the parallelized solver */
 BOOLEAN gParallelizing = FALSE;
+int gNumThreads = 0;            /* 0 means one per online core */
+
+/* Live solver counters (stats.c) */
+BOOLEAN gStats = FALSE;
+int gStatsInterval = 5;         /* seconds between snapshots written by --stats */
 
 /* Tcl interp for making calls to Tcl_Eval */
 Tcl_Interp *gTclInterp = NULL;
@@ -37,6 +37,8 @@ extern STRING *gCustomTraits;
 ** Visualization globals
 */
 extern BOOLEAN gDrawEdges, gRemotenessOrder, gGenerateNodeViz, gVisualizing;
+extern double gVisSampleRate;
+extern int gVisDepthLimit;
 
 
 /*
@@ -102,14 +104,20 @@ extern char (*gReturnTurn)(POSITION);
 
 /* Custom unhash into void* function pointer (used in Static Evaluator) */
 extern void*            (*linearUnhash)(POSITION);
+/* Optional: unhash into a caller-owned board of lBoard.size elements, so
+   batched static evaluation can skip linearUnhash's per-call allocation */
+extern void             (*linearUnhashInto)(POSITION, void*);
 extern featureEvaluatorCustom (*gGetSEvalCustomFnPtr)(STRING);
 
 /* enumerate all positions that result from the same stage in a game */
 /* argument and return value will have their typedefs later */
 extern POSITIONLIST    *(*gEnumerateWithinStage)(int);
 
-/* Global position solver function pointer. */
+/* Global position solver function pointers. gSetGPSPosition loads the global
+   position from a hash, so the breadth-first and tier solvers can jump to
+   each position they expand and then DoMove/gUndoMove through its children */
 extern void (*gUndoMove)(MOVE move);
+extern void (*gSetGPSPosition)(POSITION position);
 
 /* tcl initialization function pointer (needs to be void* so games don't need tcl) */
 extern void*            gGameSpecificTclInit;
@@ -148,6 +156,10 @@ extern BOOLEAN gDontLoadTierDB;
 extern unsigned int HASHTABLE_BUCKETS;
 extern BOOLEAN gTierSolvePrint;
 extern BOOLEAN gTotalTiers;
+extern long long gTierPrefetchMB;
+extern int gTierCheckpointSeconds;
+extern BOOLEAN gTierCheck;
+extern int gTierCheckReportLimit;
 // For the hash window
 extern BOOLEAN gHashWindowInitialized;
 extern BOOLEAN gCurrentTierIsLoopy;
@@ -161,6 +173,7 @@ extern BOOLEAN*         gTierDBExists;
 extern BOOLEAN kSupportsTierGamesman;
 extern BOOLEAN kSupportsShardGamesman;
 extern BOOLEAN kUsesQuartoGamesman;
+extern BOOLEAN kReentrant;
 extern BOOLEAN kExclusivelyTierGamesman;
 extern BOOLEAN kDebugTierMenu;
 extern TIERPOSITION gInitialTierPosition;
@@ -173,6 +186,12 @@ extern UNDOMOVELIST*    (*gGenerateUndoMovesToTierFunPtr)(POSITION,TIER);
 extern POSITION (*gUnDoMoveFunPtr)(POSITION,UNDOMOVE);
 extern STRING (*gTierToStringFunPtr)(TIER);
 extern MULTIPARTEDGELIST* (*gGenerateMultipartMoveEdgesFunPtr)(POSITION,MOVELIST*,POSITIONLIST*);
+// For the shard solver (see solveshard.h)
+extern int gShardSize;
+extern int gShardHashLength;
+extern POSITION (*gShardHashFunPtr)(POSITION);
+extern POSITION (*gShardUnhashFunPtr)(POSITION);
+extern int (*gShardChildrenFunPtr)(POSITION,POSITION**);
 // For the experimental GenerateMoves
 extern int (*gGenerateMovesEfficientFunPtr)(POSITION);
 extern MOVE*            gGenerateMovesArray;
@@ -180,6 +199,11 @@ extern int MAXFANOUT;
 
 /* Variables for the parallelized solver */
 extern BOOLEAN gParallelizing;
+extern int gNumThreads;
+
+/* Live solver counters (stats.c) */
+extern BOOLEAN gStats;
+extern int gStatsInterval;
 
 /* Tcl interp for making calls to Tcl_Eval */
 extern Tcl_Interp*              gTclInterp;
@@ -55,6 +55,38 @@
 struct hashContext **contextList = NULL;
 int hash_tot_context = 0, currentContext = 0;
 BOOLEAN custom_contexts_mode = FALSE;
+
+/* Scratch space of the calling thread for hashing and unhashing. The
+   solvers call generic_hash from --threads workers, so this cannot live in
+   the shared contexts; it grows to the largest context a thread has used. */
+typedef struct {
+	int size;
+	int *thisCount, *localMins, *gpdStore, *miniIndices;
+	POSITION *miniOffset;
+} HASHSCRATCH;
+static __thread HASHSCRATCH hashScratch;
+
+static HASHSCRATCH *hash_scratch()
+{
+	int size = cCon->numPieces + 2;
+	if (hashScratch.size < size) {
+		if (hashScratch.size > 0) {
+			SafeFree(hashScratch.thisCount);
+			SafeFree(hashScratch.localMins);
+			SafeFree(hashScratch.gpdStore);
+			SafeFree(hashScratch.miniIndices);
+			SafeFree(hashScratch.miniOffset);
+		}
+		hashScratch.thisCount = (int*) SafeMalloc(sizeof(int) * size);
+		hashScratch.localMins = (int*) SafeMalloc(sizeof(int) * size);
+		hashScratch.gpdStore = (int*) SafeMalloc(sizeof(int) * size);
+		hashScratch.miniIndices = (int*) SafeMalloc(sizeof(int) * size);
+		hashScratch.miniOffset = (POSITION*) SafeMalloc(sizeof(POSITION) * size);
+		hashScratch.size = size;
+	}
+	return &hashScratch;
+}
+
 /* Hashtable Stuff */
 // Using a MOVELIST just to get ints
 MOVELIST** generic_hash_hashtable = NULL;
@@ -100,6 +132,7 @@ int             validConfig(int *t);
 int             searchIndices(int s);
 int             searchOffset(POSITION h);
 POSITION        combiCount(int* tc);
+POSITION        hash_dropPiece(POSITION total, int count, int n);
 int             hash_countPieces(int *pA);
 POSITION        hash_cruncher (char* board);
 POSITION        hash_cruncher_sym (char* board, struct symEntry* symIndex);
@@ -193,11 +226,6 @@ POSITION generic_hash_init(int boardsize, int *pieces_array, int (*fn)(int *), i
 	cCon->mins = (int*) SafeMalloc (sizeof(int) * cCon->numPieces);
 	cCon->maxs = (int*) SafeMalloc (sizeof(int) * cCon->numPieces);
 	cCon->nums = (int*) SafeMalloc (sizeof(int) * cCon->numPieces);
-	cCon->thisCount = (int*) SafeMalloc (sizeof(int) * cCon->numPieces);
-	cCon->localMins = (int*) SafeMalloc (sizeof(int) * cCon->numPieces);
-	cCon->gpdStore = (int*) SafeMalloc (sizeof(int) * cCon->numPieces);
-	cCon->miniOffset = (POSITION*) SafeMalloc (sizeof(POSITION) * (cCon->numPieces+2));
-	cCon->miniIndices = (int*) SafeMalloc (sizeof(int) * (cCon->numPieces+2));
 
 	getPieceParams(pieces_array, cCon->pieces, cCon->mins,cCon->maxs);
 	for (i = 0; i < cCon->numPieces; i++) {
@@ -343,28 +371,29 @@ void hash_combiCalc()
 
 /* hashes *board to a POSITION */
 POSITION generic_hash_hash(char* board, int player) {
+	HASHSCRATCH *scratch = hash_scratch();
 	int i, j;
 	POSITION temp, sum;
 	int boardSize = cCon->boardSize; /*hash_boardSize;*/
 
 	for (i = 0; i < cCon->numPieces; i++)
 	{
-		cCon->thisCount[i] = 0;
-		cCon->localMins[i] = cCon->mins[i];
+		scratch->thisCount[i] = 0;
+		scratch->localMins[i] = cCon->mins[i];
 	}
 
 	for (i = 0; i < boardSize; i++)
 	{
 		for (j = 0; j < cCon->numPieces; j++) {
 			if (board[i] == cCon->pieces[j]) {
-				cCon->thisCount[j]++;
+				scratch->thisCount[j]++;
 			}
 		}
 	}
 	sum = 0;
 	for (i = cCon->numPieces-1; i >= 0; i--)
 	{
-		sum += (cCon->thisCount[i] - cCon->mins[i]);
+		sum += (scratch->thisCount[i] - cCon->mins[i]);
 		if (i > 0) {
 			sum *= cCon->nums[i-1];
 		}
@@ -382,6 +411,7 @@ POSITION generic_hash_hash(char* board, int player) {
 //accomodates generic_hash_turn and symmetries
 POSITION generic_hash_hash_sym(char* board, int player, POSITION offset, struct symEntry* symIndex)
 {
+	HASHSCRATCH *scratch = hash_scratch();
 	int i, j;
 	POSITION temp;
 	int boardSize = cCon->boardSize; /*hash_boardSize;*/
@@ -391,15 +421,15 @@ POSITION generic_hash_hash_sym(char* board, int player, POSITION offset, struct
 
 	for (i = 0; i < cCon->numPieces; i++)
 	{
-		cCon->thisCount[i] = 0;
-		cCon->localMins[i] = cCon->mins[i];
+		scratch->thisCount[i] = 0;
+		scratch->localMins[i] = cCon->mins[i];
 	}
 
 	for (i = 0; i < boardSize; i++)
 	{
 		for (j = 0; j < cCon->numPieces; j++) {
 			if (board[symIndex->sym[i]] == cCon->pieces[j]) {
-				cCon->thisCount[j]++;
+				scratch->thisCount[j]++;
 			}
 		}
 	}
@@ -413,6 +443,7 @@ POSITION generic_hash_hash_sym(char* board, int player, POSITION offset, struct
    among boards with the same configuration argument *thiscount */
 POSITION hash_cruncher (char* board)
 {
+	HASHSCRATCH *scratch = hash_scratch();
 	POSITION sum = 0;
 	int i = 0, k = 0, max1 = 0;
 	int boardSize = cCon->boardSize;
@@ -424,17 +455,17 @@ POSITION hash_cruncher (char* board)
 			i++;
 		for (k = 0; k < i; k++) {
 			max1 = 1;
-			if (cCon->localMins[k] > 1)
-				max1 = cCon->localMins[k];
+			if (scratch->localMins[k] > 1)
+				max1 = scratch->localMins[k];
 
-			if (cCon->thisCount[k] >= max1) {
-				cCon->thisCount[k]--;
-				sum += combiCount(cCon->thisCount);
-				cCon->thisCount[k]++;
+			if (scratch->thisCount[k] >= max1) {
+				scratch->thisCount[k]--;
+				sum += combiCount(scratch->thisCount);
+				scratch->thisCount[k]++;
 			}
 		}
-		cCon->thisCount[i]--;
-		cCon->localMins[i]--;
+		scratch->thisCount[i]--;
+		scratch->localMins[i]--;
 	}
 
 	return sum;
@@ -443,6 +474,7 @@ POSITION hash_cruncher (char* board)
 // symmetry version
 POSITION hash_cruncher_sym (char* board, struct symEntry* symIndex)
 {
+	HASHSCRATCH *scratch = hash_scratch();
 	POSITION sum = 0;
 	int i = 0, k = 0, max1 = 0;
 	int boardSize = cCon->boardSize;
@@ -454,17 +486,17 @@ POSITION hash_cruncher_sym (char* board, struct symEntry* symIndex)
 			i++;
 		for (k = 0; k < i; k++) {
 			max1 = 1;
-			if (cCon->localMins[k] > 1)
-				max1 = cCon->localMins[k];
+			if (scratch->localMins[k] > 1)
+				max1 = scratch->localMins[k];
 
-			if (cCon->thisCount[k] >= max1) {
-				cCon->thisCount[k]--;
-				sum += combiCount(cCon->thisCount);
-				cCon->thisCount[k]++;
+			if (scratch->thisCount[k] >= max1) {
+				scratch->thisCount[k]--;
+				sum += combiCount(scratch->thisCount);
+				scratch->thisCount[k]++;
 			}
 		}
-		cCon->thisCount[i]--;
-		cCon->localMins[i]--;
+		scratch->thisCount[i]--;
+		scratch->localMins[i]--;
 	}
 
 	return sum;
@@ -497,17 +529,18 @@ char* generic_hash_unhash_tcl(POSITION pos)
 /* unhashes hashed to a board */
 char* generic_hash_unhash(POSITION hashed, char* dest)
 {
+	HASHSCRATCH *scratch = hash_scratch();
 	POSITION offst;
-	int i, j, boardSize;
+	int i, j, *dist;
 	hashed %= cCon->maxPos; //accomodates generic_hash_turn
 
-	boardSize = cCon->boardSize;
 	j = searchOffset(hashed);
 	offst = cCon->hashOffset[j];
 	hashed -= offst;
+	dist = gpd(cCon->offsetIndices[j + 1] - 1);
 	for (i = 0; i < cCon->numPieces; i++) {
-		cCon->localMins[i] = cCon->mins[i];
-		cCon->thisCount[i] = gpd(cCon->offsetIndices[j + 1] - 1)[i];
+		scratch->localMins[i] = cCon->mins[i];
+		scratch->thisCount[i] = dist[i];
 	}
 	hash_uncruncher(hashed, dest);
 	return dest;
@@ -517,37 +550,46 @@ char* generic_hash_unhash(POSITION hashed, char* dest)
    among boards with the same configuration argument *thiscount*/
 void hash_uncruncher (POSITION hashed, char *dest)
 {
+	HASHSCRATCH *scratch = hash_scratch();
 	int i = 0, j = 0;
 	int max1 = 0;
 	int boardSize = cCon->boardSize;
+	int remaining = 0;
+	POSITION total = combiCount(scratch->thisCount);
+
+	/* total is the number of boards with the remaining pieces; taking one
+	   piece off leaves hash_dropPiece(total,...) of them, so combiCount
+	   only has to run once per unhash */
+	for (i = 0; i < cCon->numPieces; i++)
+		remaining += scratch->thisCount[i];
 
 	for(; boardSize>0; boardSize--) {
 		if (boardSize == 1) {
 			i = 0;
-			while (cCon->thisCount[i] == 0)
+			while (scratch->thisCount[i] == 0)
 				i++;
 			dest[0] = cCon->pieces[i];
 		} else {
-			cCon->miniOffset[0] = 0;
-			cCon->miniIndices[0] = 0;
+			scratch->miniOffset[0] = 0;
+			scratch->miniIndices[0] = 0;
 			j = 1;
-			for (i = 0; (i < cCon->numPieces) && (cCon->miniOffset[j-1] <= hashed); i++) {
+			for (i = 0; (i < cCon->numPieces) && (scratch->miniOffset[j-1] <= hashed); i++) {
 				max1 = 1;
-				if (cCon->localMins[i] > 1)
-					max1 = cCon->localMins[i];
-				if (cCon->thisCount[i] >= max1) {
-					cCon->thisCount[i]--;
-					cCon->miniOffset[j] = cCon->miniOffset[j-1] + combiCount(cCon->thisCount);
-					cCon->thisCount[i]++;
-					cCon->miniIndices[j] = i;
+				if (scratch->localMins[i] > 1)
+					max1 = scratch->localMins[i];
+				if (scratch->thisCount[i] >= max1) {
+					scratch->miniOffset[j] = scratch->miniOffset[j-1] + hash_dropPiece(total, scratch->thisCount[i], remaining);
+					scratch->miniIndices[j] = i;
 					j++;
 				}
 			}
 			i = j-1;
-			cCon->thisCount[cCon->miniIndices[i]]--;
-			cCon->localMins[cCon->miniIndices[i]]--;
-			dest[boardSize-1] = cCon->pieces[cCon->miniIndices[i]];
-			hashed = hashed - cCon->miniOffset[i-1];
+			total = hash_dropPiece(total, scratch->thisCount[scratch->miniIndices[i]], remaining);
+			remaining--;
+			scratch->thisCount[scratch->miniIndices[i]]--;
+			scratch->localMins[scratch->miniIndices[i]]--;
+			dest[boardSize-1] = cCon->pieces[scratch->miniIndices[i]];
+			hashed = hashed - scratch->miniOffset[i-1];
 		}
 
 	}
@@ -601,7 +643,6 @@ int generic_hash_context_init()
 	newHashC->hashOffset = NULL;
 	newHashC->maxPos = 0;
 	newHashC->NCR = NULL;
-	newHashC->gpdStore = NULL;
 	newHashC->offsetIndices = NULL;
 	newHashC->pieceIndices = NULL;
 	newHashC->boardSize = 0;
@@ -612,8 +653,6 @@ int generic_hash_context_init()
 	newHashC->nums = NULL;
 	newHashC->mins = NULL;
 	newHashC->maxs = NULL;
-	newHashC->thisCount = NULL;
-	newHashC->localMins = NULL;
 	newHashC->gfn = NULL;
 	newHashC->player = 0;
 	//newHashC->init = FALSE;
@@ -676,6 +715,21 @@ int generic_hash_cur_context()
 	else return currentContext;
 }
 
+/******************************
+**
+** generic_hash_thread_safe()
+**
+** TRUE unless the game uses several hash
+** contexts: the current context is shared,
+** so only one thread at a time may switch it.
+**
+******************************/
+
+BOOLEAN generic_hash_thread_safe()
+{
+	return hash_tot_context <= 1 && !custom_contexts_mode;
+}
+
 /******************************
 **
 ** generic_hash_max_pos()
@@ -736,15 +790,12 @@ void freeHashContext(int contextNum)
 
 	SafeFree(contextList[contextNum]->hashOffset);
 	SafeFree(contextList[contextNum]->NCR);
-	SafeFree(contextList[contextNum]->gpdStore);
 	SafeFree(contextList[contextNum]->offsetIndices);
 	SafeFree(contextList[contextNum]->pieceIndices);
 	SafeFree(contextList[contextNum]->pieces);
 	SafeFree(contextList[contextNum]->nums);
 	SafeFree(contextList[contextNum]->mins);
 	SafeFree(contextList[contextNum]->maxs);
-	SafeFree(contextList[contextNum]->thisCount);
-	SafeFree(contextList[contextNum]->localMins);
 
 	SafeFree(contextList[contextNum]);
 
@@ -780,6 +831,14 @@ int searchOffset(POSITION h)
 
 /* helper function used to find n choose (t1,t2,t3,...,tn) where the ti's are
    the members of *tc */
+/* number of boards left when one of count identical pieces is taken off
+   total boards of n pieces: total*count/n, which is always exact. Split so
+   that total*count cannot wrap */
+POSITION hash_dropPiece(POSITION total, int count, int n)
+{
+	return (total / n) * count + ((total % n) * count) / n;
+}
+
 POSITION combiCount(int* tc)
 {
 	POSITION sum = 0, prod = 1, ind = 0,old=1,hold=0;
@@ -823,12 +882,13 @@ int hash_countPieces(int *pA)
 /* finds the piece distribution whose index is n */
 int* gpd (int n)
 {
+	HASHSCRATCH *scratch = hash_scratch();
 	int k = n, j;
 	for (j = 0; j < cCon->numPieces; j++) {
-		cCon->gpdStore[j] = cCon->mins[j] + (k % (cCon->nums[j]));
+		scratch->gpdStore[j] = cCon->mins[j] + (k % (cCon->nums[j]));
 		k = k/(cCon->nums[j]);
 	}
-	return cCon->gpdStore;
+	return scratch->gpdStore;
 }
 
 /* shorthand for gpd() */
@@ -1304,6 +1364,7 @@ void printXSpaces(int x) {
 }
 
 POSITION generic_hash_canonicalPosition(POSITION pos) {
+	HASHSCRATCH *scratch = hash_scratch();
 	char* board = (char*) SafeMalloc(sizeof(char) * cCon->boardSize);
 	char* flippedboard = (char*) SafeMalloc(sizeof(char) * cCon->boardSize);
 	struct symEntry* symIndex = symmetriesList->next;
@@ -1321,22 +1382,22 @@ POSITION generic_hash_canonicalPosition(POSITION pos) {
 
 	for (i = 0; i < cCon->numPieces; i++)
 	{
-		cCon->thisCount[i] = 0;
-		cCon->localMins[i] = cCon->mins[i];
+		scratch->thisCount[i] = 0;
+		scratch->localMins[i] = cCon->mins[i];
 	}
 
 	for (i = 0; i < boardSize; i++)
 	{
 		for (j = 0; j < cCon->numPieces; j++) {
 			if (board[symIndex->sym[i]] == cCon->pieces[j]) {
-				cCon->thisCount[j]++;
+				scratch->thisCount[j]++;
 			}
 		}
 	}
 	sum = 0;
 	for (i = cCon->numPieces-1; i >= 0; i--)
 	{
-		sum += (cCon->thisCount[i] - cCon->mins[i]);
+		sum += (scratch->thisCount[i] - cCon->mins[i]);
 		if (i > 0) {
 			sum *= cCon->nums[i-1];
 		}
@@ -1353,22 +1414,22 @@ POSITION generic_hash_canonicalPosition(POSITION pos) {
 		}
 
 		for (i = 0; i < cCon->numPieces; i++) {
-			cCon->thisCount[i] = 0;
-			cCon->localMins[i] = cCon->mins[i];
+			scratch->thisCount[i] = 0;
+			scratch->localMins[i] = cCon->mins[i];
 		}
 
 		for (i = 0; i < boardSize; i++)
 		{
 			for (j = 0; j < cCon->numPieces; j++) {
 				if (flippedboard[symIndex->sym[i]] == cCon->pieces[j]) {
-					cCon->thisCount[j]++;
+					scratch->thisCount[j]++;
 				}
 			}
 		}
 		flippedsum = 0;
 		for (i = cCon->numPieces-1; i >= 0; i--)
 		{
-			flippedsum += (cCon->thisCount[i] - cCon->mins[i]);
+			flippedsum += (scratch->thisCount[i] - cCon->mins[i]);
 			if (i > 0) {
 				flippedsum *= cCon->nums[i-1];
 			}
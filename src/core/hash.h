@@ -36,7 +36,6 @@ struct hashContext
 	POSITION maxPos;
 	POSITION *combiArray;
 	POSITION *NCR;
-	int *gpdStore;
 	int *offsetIndices;
 	int *pieceIndices;
 	int boardSize;
@@ -50,12 +49,6 @@ struct hashContext
 	int *mins;
 	int *maxs;
 
-	int *thisCount;
-	int *localMins;
-
-	POSITION *miniOffset;
-	int *miniIndices;
-
 	int (*gfn)(int *);
 
 	int player;             // 0=Both Player boards (default), 1=1st Player only, 2=2nd only
@@ -68,6 +61,7 @@ void generic_hash_context_switch(int context);
 void generic_hash_destroy();
 int generic_hash_cur_context();
 POSITION generic_hash_max_pos();
+BOOLEAN generic_hash_thread_safe();
 void generic_hash_custom_context_mode(BOOLEAN on);
 void generic_hash_set_context(int context);
 
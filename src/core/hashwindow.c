@@ -69,6 +69,81 @@
    -Max
  */
 
+/* Tier -> index into gTierInHashWindow, as an open-addressed table built
+   alongside the window so that Hash doesn't scan the window. A slot of 0
+   is empty (index 0 is always kBadTier, which is never looked up). */
+static int *gWindowTierSlots = NULL;
+static unsigned int gWindowTierMask = 0;
+
+static unsigned int WindowTierSlot(TIER tier) {
+	return (unsigned int) (((unsigned long long) tier * 0x9E3779B97F4A7C15ULL) >> 32) & gWindowTierMask;
+}
+
+static void BuildWindowTierIndex() {
+	unsigned int size = 4, slot;
+	int i;
+	while (size < 2 * (unsigned int) gNumTiersInHashWindow)
+		size <<= 1;
+	if (gWindowTierSlots != NULL) SafeFree(gWindowTierSlots);
+	gWindowTierSlots = (int*) SafeCalloc(size, sizeof(int));
+	gWindowTierMask = size - 1;
+	for (i = 1; i < gNumTiersInHashWindow; i++) {
+		for (slot = WindowTierSlot(gTierInHashWindow[i]); gWindowTierSlots[slot] != 0;
+		     slot = (slot + 1) & gWindowTierMask) ;
+		gWindowTierSlots[slot] = i;
+	}
+}
+
+// Index of TIER in the window, or 0 if it isn't there.
+static int WindowIndexOfTier(TIER tier) {
+	unsigned int slot;
+	for (slot = WindowTierSlot(tier); gWindowTierSlots[slot] != 0;
+	     slot = (slot + 1) & gWindowTierMask)
+		if (gTierInHashWindow[gWindowTierSlots[slot]] == tier)
+			return gWindowTierSlots[slot];
+	return 0;
+}
+
+/* Window position -> index, the other way around: the window is cut into
+   equal buckets of 2^gWindowBucketShift positions and each bucket records
+   the index of the tier its first position belongs to. A position's tier
+   is then between its bucket's entry and the next one's, which is almost
+   always the same tier or its neighbour. */
+static int *gWindowBuckets = NULL;
+static int gWindowBucketShift = 0;
+
+static void BuildWindowBuckets() {
+	int buckets = 16, i = 1, b;
+	while (buckets < 4 * gNumTiersInHashWindow)
+		buckets <<= 1;
+	gWindowBucketShift = 0;
+	while (gNumberOfPositions > 0 && ((gNumberOfPositions - 1) >> gWindowBucketShift) >= (POSITION) buckets)
+		gWindowBucketShift++;
+	if (gWindowBuckets != NULL) SafeFree(gWindowBuckets);
+	gWindowBuckets = (int*) SafeMalloc((buckets + 1) * sizeof(int));
+	for (b = 0; b <= buckets; b++) {
+		POSITION start = (POSITION) b << gWindowBucketShift;
+		while (i < gNumTiersInHashWindow - 1 && start >= gMaxPosOffset[i])
+			i++;
+		gWindowBuckets[b] = i;
+	}
+}
+
+// Index of the tier holding POSITION: the first i with POSITION < gMaxPosOffset[i].
+static int WindowIndexOfPosition(POSITION position) {
+	POSITION b = position >> gWindowBucketShift;
+	int lo = gWindowBuckets[b], hi = gWindowBuckets[b + 1], mid;
+	while (hi - lo > 4) { // many small tiers start in this bucket
+		mid = (lo + hi) / 2;
+		if (position < gMaxPosOffset[mid])
+			hi = mid;
+		else lo = mid + 1;
+	}
+	while (position >= gMaxPosOffset[lo])
+		lo++;
+	return lo;
+}
+
 /* FOR MODULES TO CALL */
 
 // Called by "Unhash".
@@ -85,14 +160,9 @@ void gUnhashToTierPosition(POSITION position, TIERPOSITION* tierposition,
 		ExitStageRight();
 	}
 	// since we know position is legal, this works:
-	int i;
-	for(i = 1; i < gNumTiersInHashWindow; i++) {
-		if (position < gMaxPosOffset[i]) { //in THIS tier
-			(*tierposition) = position - gMaxPosOffset[i-1];
-			(*tier) = gTierInHashWindow[i];
-			return;
-		}
-	}
+	int i = WindowIndexOfPosition(position);
+	(*tierposition) = position - gMaxPosOffset[i-1];
+	(*tier) = gTierInHashWindow[i];
 }
 
 // Call by "Hash".
@@ -101,18 +171,16 @@ POSITION gHashToWindowPosition(TIERPOSITION tierposition, TIER tier) {
 		printf("ERROR: Hash Window is not initialized!\n");
 		ExitStageRight();
 	}
-	int i;
-	for(i = 1; i < gNumTiersInHashWindow; i++) {
-		if (gTierInHashWindow[i] == tier) {
-			if (tierposition > gMaxPosOffset[i]) {
-				printf("ERROR: Hash Window function \"gHashToWindowPosition\" called with\n"
-				       "illegal TIERPOSITION: %llu\n"
-				       "(Tier %llu's reported range is from 0 to %llu)\n",
-				       tierposition, tier, gMaxPosOffset[i]-1);
-				ExitStageRight();
-			}
-			return tierposition + gMaxPosOffset[i-1];
+	int i = WindowIndexOfTier(tier);
+	if (i != 0) {
+		if (tierposition >= gMaxPosOffset[i] - gMaxPosOffset[i-1]) {
+			printf("ERROR: Hash Window function \"gHashToWindowPosition\" called with\n"
+			       "illegal TIERPOSITION: %llu\n"
+			       "(Tier %llu's reported range is from 0 to %llu)\n",
+			       tierposition, tier, gMaxPosOffset[i] - gMaxPosOffset[i-1] - 1);
+			ExitStageRight();
 		}
+		return tierposition + gMaxPosOffset[i-1];
 	}
 	// shouldn't be reached. So, error:
 	printf("ERROR: Hash Window function \"gHashToWindowPosition\" called with\n"
@@ -136,6 +204,7 @@ void gInitializeHashWindow(TIER tier, BOOLEAN loadDB) {
 		if (gTierDBExists != NULL) SafeFree(gTierDBExists);
 	}
 	gHashWindowInitialized = TRUE;
+	UINT64 statsStart = gStats ? StatsClock() : 0;
 
 	// Start by seeing what children go here
 	TIERLIST *children, *ptr, *back;
@@ -171,6 +240,8 @@ void gInitializeHashWindow(TIER tier, BOOLEAN loadDB) {
 	// set gNumberOfPositions
 	gNumberOfPositions = gMaxPosOffset[gNumTiersInHashWindow-1];
 	FreeTierList(ptr);
+	BuildWindowTierIndex();
+	BuildWindowBuckets();
 	// finally, load the databases to memory:
 	// if gDontLoadTierDB is true, we have non-solve playing, so don't load db
 	// however, if static evaluator is on, then load as much as you can anyway
@@ -190,6 +261,8 @@ void gInitializeHashWindow(TIER tier, BOOLEAN loadDB) {
 	// just a few helper variables for the solver
 	gCurrentTier = gTierInHashWindow[1];
 	gCurrentTierSize = gMaxPosOffset[1];
+	if (statsStart)
+		StatsTimerRecord(STAT_HASHWINDOW, StatsClock() - statsStart);
 }
 
 // FOR GAMEPLAY.C
@@ -203,10 +276,7 @@ void gInitializeHashWindowToPosition(POSITION* position, BOOLEAN loadDB) {
 BOOLEAN gTierDBExistsForPosition(POSITION position) {
 	if (!gHashWindowInitialized || gSEvalPerfect)
 		return FALSE;
-	TIERPOSITION tierposition; TIER tier; int i;
-	gUnhashToTierPosition(position, &tierposition, &tier);
-	for(i = 1; i < gNumTiersInHashWindow; i++)
-		if (gTierInHashWindow[i] == tier) //get value for THIS tier
-			return gTierDBExists[i];
-	return FALSE; // This actually can't happen (invariant)
+	if (position >= gNumberOfPositions)
+		return FALSE;
+	return gTierDBExists[WindowIndexOfPosition(position)];
 }
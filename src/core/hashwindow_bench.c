@@ -0,0 +1,136 @@
+/************************************************************************
+**
+** NAME:	hashwindow_bench.c
+**
+** DESCRIPTION:	Per-call cost of the hash window lookups
+**
+**		Times gUnhashToTierPosition and gHashToWindowPosition on
+**		random inputs for windows with 1, 10 and 100 child tiers,
+**		next to the linear scan of the window they replaced.
+**		Build from src/core after make, like levelfile_test.c;
+**		hashwindow.c is compiled in so that both sides get -O2:
+**
+** gcc -O2 -std=gnu99 -I.. -I/usr/include/tcl8.6 -Wl,--allow-multiple-definition hashwindow_bench.c hashwindow.c ../m1210.o
+**     ../gamesman.a ../gamesdb.a ../libUWAPI_boardstrings.a -lz -lgmp -ltcl8.6 -lpthread -lm
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#include "gamesman.h"
+#include <time.h>
+
+#define BENCH_CALLS     (1 << 22)
+#define BENCH_INPUTS    (1 << 12)     // random inputs, cycled through
+
+/* A synthetic tier graph: tier 0 has benchChildren children, 1 .. n,
+   of pseudo-random sizes. */
+static int benchChildren;
+
+static TIERLIST *BenchTierChildren(TIER tier) {
+	TIERLIST *list = NULL;
+	int i;
+	if (tier == 0)
+		for (i = benchChildren; i >= 1; i--)
+			list = CreateTierlistNode(i, list);
+	return list;
+}
+
+static TIERPOSITION BenchNumberOfTierPositions(TIER tier) {
+	return 1000 + (tier * 2654435761ULL) % 1000000;
+}
+
+/* The lookups as they were before the window kept an index; not inlined,
+   so that they pay for a call like the library functions do. */
+static __attribute__((noinline)) void ScanUnhashToTierPosition(POSITION position, TIERPOSITION *tierposition, TIER *tier) {
+	int i;
+	for (i = 1; i < gNumTiersInHashWindow; i++)
+		if (position < gMaxPosOffset[i]) {
+			(*tierposition) = position - gMaxPosOffset[i-1];
+			(*tier) = gTierInHashWindow[i];
+			return;
+		}
+}
+
+static __attribute__((noinline)) POSITION ScanHashToWindowPosition(TIERPOSITION tierposition, TIER tier) {
+	int i;
+	for (i = 1; i < gNumTiersInHashWindow; i++)
+		if (gTierInHashWindow[i] == tier)
+			return tierposition + gMaxPosOffset[i-1];
+	return kBadPosition;
+}
+
+static double Seconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	int childCounts[] = { 1, 10, 100 }, c, k, errors = 0;
+	POSITION positions[BENCH_INPUTS], sink = 0;
+	TIERPOSITION tierpositions[BENCH_INPUTS], tierposition, scanTierposition = 0;
+	TIER tiers[BENCH_INPUTS], tier, scanTier = kBadTier;
+	double start, unhash, unhashScan, hash, hashScan;
+
+	gTierChildrenFunPtr = BenchTierChildren;
+	gNumberOfTierPositionsFunPtr = BenchNumberOfTierPositions;
+	srandom(1);
+	printf("children   unhash scan -> window     hash scan -> window   (ns per call)\n");
+	for (c = 0; c < 3; c++) {
+		benchChildren = childCounts[c];
+		gHashWindowInitialized = FALSE;
+		gInitializeHashWindow(0, FALSE);
+		for (k = 0; k < BENCH_INPUTS; k++) {
+			positions[k] = ((POSITION) random() << 31 | random()) % gNumberOfPositions;
+			gUnhashToTierPosition(positions[k], &tierpositions[k], &tiers[k]);
+			ScanUnhashToTierPosition(positions[k], &scanTierposition, &scanTier);
+			if (scanTierposition != tierpositions[k] || scanTier != tiers[k] ||
+			    gHashToWindowPosition(tierpositions[k], tiers[k]) != positions[k])
+				errors++;
+		}
+
+		start = Seconds();
+		for (k = 0; k < BENCH_CALLS; k++) {
+			ScanUnhashToTierPosition(positions[k % BENCH_INPUTS], &tierposition, &tier);
+			sink += tierposition + tier;
+		}
+		unhashScan = Seconds() - start;
+		start = Seconds();
+		for (k = 0; k < BENCH_CALLS; k++) {
+			gUnhashToTierPosition(positions[k % BENCH_INPUTS], &tierposition, &tier);
+			sink += tierposition + tier;
+		}
+		unhash = Seconds() - start;
+		start = Seconds();
+		for (k = 0; k < BENCH_CALLS; k++)
+			sink += ScanHashToWindowPosition(tierpositions[k % BENCH_INPUTS], tiers[k % BENCH_INPUTS]);
+		hashScan = Seconds() - start;
+		start = Seconds();
+		for (k = 0; k < BENCH_CALLS; k++)
+			sink += gHashToWindowPosition(tierpositions[k % BENCH_INPUTS], tiers[k % BENCH_INPUTS]);
+		hash = Seconds() - start;
+
+		printf("%8d   %11.1f -> %-10.1f %9.1f -> %-10.1f\n", benchChildren,
+		       unhashScan * 1e9 / BENCH_CALLS, unhash * 1e9 / BENCH_CALLS,
+		       hashScan * 1e9 / BENCH_CALLS, hash * 1e9 / BENCH_CALLS);
+	}
+	printf("%s: %d errors (checksum %llu)\n", argv[0], errors, sink);
+	return errors ? 1 : 0;
+}
@@ -2,6 +2,10 @@
 #include <errno.h>
 #include "globals.h"
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 
 /* FUNCTIONS */
 
@@ -953,3 +957,413 @@ int mallocstrcpyext(char** errMsg, char msg1[], char msg2[])
 	strcat(*errMsg, msg2);
 	return 0;
 }
+
+/**
+ * Parses and resolves the specified url once and returns a connection
+ * to it through conn. Nothing is connected until the first send; after
+ * that the socket is kept open across requests (HTTP/1.1 keep-alive).
+ * Returns 0 if successful, non-zero otherwise with errMsg populated.
+ *
+ * WARNING: clobbers url
+ *
+ * url - url the requests will use (minus the http:// prefix)
+ * conn - handle to the httpconn struct
+ * errMsg - handle to the error message string
+ */
+int openconnection(char url[], httpconn** conn, char** errMsg)
+{
+	httpreq req;
+	struct hostent *serverAddr;
+	int n;
+	*conn = NULL;
+	*errMsg = NULL;
+
+	if (url == NULL || strlen(url) == 0)
+	{
+		mallocstrcpy(errMsg, "Cannot specify a NULL url for a connection");
+		return 1;
+	}
+	memset(&req, 0, sizeof(httpreq));
+	req.portNum = 80;
+	if (parse(url, &req, errMsg) != 0)
+		return 1;
+	if ((serverAddr = gethostbyname(req.hostName)) == NULL)
+	{
+		mallocstrcpyext(errMsg, "ERROR, no such host: ", req.hostName);
+		free(req.hostName);
+		free(req.path);
+		return 1;
+	}
+
+	if ((*conn = calloc(1, sizeof(httpconn))) == NULL)
+	{
+		fprintf(stderr,"ERROR, could not allocate memory for http connection\n");
+		return 1;
+	}
+	memcpy(&((*conn)->sock.req.sin_addr.s_addr), *(serverAddr->h_addr_list), sizeof(struct in_addr));
+	(*conn)->sock.req.sin_family = AF_INET;
+	(*conn)->sock.req.sin_port = htons(req.portNum);
+	(*conn)->hostName = req.hostName;
+	(*conn)->path = req.path;
+	(*conn)->portNum = req.portNum;
+	(*conn)->sockFd = -1;
+
+	// Everything up to the per-request headers is the same for every request
+	n = strlen(req.path) + strlen(req.hostName) + 128;
+	(*conn)->preamble = malloc(n);
+	(*conn)->preambleLength = snprintf((*conn)->preamble, n,
+	                                   "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n"
+	                                   "User-Agent: Gamesman/1.0\r\nContent-Type: application/octet-stream\r\n",
+	                                   req.path, req.hostName);
+	(*conn)->bufferSize = 4096;
+	(*conn)->buffer = malloc((*conn)->bufferSize);
+	return 0;
+}
+
+/**
+ * Connects the socket of the specified connection if it is not already.
+ */
+static int ensureconnected(httpconn *conn, char** errMsg)
+{
+	char buffer[64];
+	int one = 1;
+
+	if (conn->sockFd >= 0)
+		return 0;
+	if ((conn->sockFd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+	{
+		connecterror(buffer);
+		mallocstrcpyext(errMsg, "ERROR, creating socket: ", buffer);
+		return errno;
+	}
+	if (connect(conn->sockFd, &(conn->sock.res), sizeof(struct sockaddr_in)) < 0)
+	{
+		connecterror(buffer);
+		mallocstrcpyext(errMsg, "ERROR, opening socket: ", buffer);
+		close(conn->sockFd);
+		conn->sockFd = -1;
+		return errno;
+	}
+	// Batches are small and latency bound; don't let Nagle hold them back
+	setsockopt(conn->sockFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	conn->bufferStart = conn->bufferEnd = 0;
+	return 0;
+}
+
+/**
+ * Writes the pieces described by iov to the connection in as few system
+ * calls as possible. Returns 0 if successful, non-zero otherwise.
+ */
+static int writeall(httpconn *conn, struct iovec *iov, int iovcnt, char** errMsg)
+{
+	struct msghdr msg;
+	char buffer[64];
+	ssize_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	while (iovcnt > 0)
+	{
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iovcnt;
+		if ((n = sendmsg(conn->sockFd, &msg, MSG_NOSIGNAL)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			connecterror(buffer);
+			mallocstrcpyext(errMsg, "ERROR, writing to socket: ", buffer);
+			resetconnection(conn);
+			return 1;
+		}
+		while (iovcnt > 0 && (size_t) n >= iov->iov_len)
+		{
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Sends a POST over the specified connection without waiting for the
+ * response, so several requests may be outstanding at once. The caller
+ * formats its own headers ("Name: value\r\n" each); the body is written
+ * straight from the caller's memory. Returns 0 if successful, non-zero
+ * otherwise with errMsg populated.
+ *
+ * conn - connection to send on
+ * headers - request-specific headers, can be NULL
+ * headersLength - length of headers
+ * body - content for the body of the POST, can be NULL
+ * bodyLength - length of the body content
+ * errMsg - handle to the error message string
+ */
+int sendrequest(httpconn *conn, const char headers[], int headersLength, const void *body, int bodyLength, char** errMsg)
+{
+	char contentLength[48];
+	struct iovec iov[4];
+
+	*errMsg = NULL;
+	if (ensureconnected(conn, errMsg) != 0)
+		return 1;
+	iov[0].iov_base = conn->preamble;
+	iov[0].iov_len = conn->preambleLength;
+	iov[1].iov_base = (void *) headers;
+	iov[1].iov_len = headers ? headersLength : 0;
+	iov[2].iov_base = contentLength;
+	iov[2].iov_len = snprintf(contentLength, sizeof(contentLength), "Content-Length: %d\r\n\r\n", bodyLength);
+	iov[3].iov_base = (void *) body;
+	iov[3].iov_len = body ? bodyLength : 0;
+	return writeall(conn, iov, 4, errMsg);
+}
+
+/**
+ * Writes up to two buffers to the connection as is (for protocols that
+ * leave HTTP behind on an established connection).
+ */
+int sendraw(httpconn *conn, const void *data1, int length1, const void *data2, int length2, char** errMsg)
+{
+	struct iovec iov[2];
+
+	*errMsg = NULL;
+	if (ensureconnected(conn, errMsg) != 0)
+		return 1;
+	iov[0].iov_base = (void *) data1;
+	iov[0].iov_len = length1;
+	iov[1].iov_base = (void *) data2;
+	iov[1].iov_len = data2 ? length2 : 0;
+	return writeall(conn, iov, 2, errMsg);
+}
+
+/**
+ * Makes sure at least one unread byte is in the connection buffer.
+ * Returns 0 if successful, non-zero at end of stream or on error.
+ */
+static int fillbuffer(httpconn *conn, char** errMsg)
+{
+	char buffer[64];
+	ssize_t n;
+
+	if (conn->bufferStart < conn->bufferEnd)
+		return 0;
+	conn->bufferStart = conn->bufferEnd = 0;
+	if (conn->sockFd < 0)
+	{
+		mallocstrcpy(errMsg, "ERROR, reading from a closed connection");
+		return 1;
+	}
+	do
+		n = read(conn->sockFd, conn->buffer, conn->bufferSize);
+	while (n < 0 && errno == EINTR);
+	if (n <= 0)
+	{
+		if (n < 0)
+		{
+			connecterror(buffer);
+			mallocstrcpyext(errMsg, "ERROR, reading from socket: ", buffer);
+		}
+		else
+			mallocstrcpy(errMsg, "ERROR, connection closed by server");
+		resetconnection(conn);
+		return 1;
+	}
+	conn->bufferEnd = n;
+	return 0;
+}
+
+/**
+ * Reads exactly length bytes from the connection into data. Whatever is
+ * already buffered is copied; the rest is read straight into data.
+ * Returns 0 if successful, non-zero otherwise with errMsg populated.
+ */
+int receiveraw(httpconn *conn, void *data, int length, char** errMsg)
+{
+	char *dst = data;
+	char buffer[64];
+	ssize_t n;
+	int have = conn->bufferEnd - conn->bufferStart;
+
+	*errMsg = NULL;
+	if (have > length)
+		have = length;
+	memcpy(dst, conn->buffer + conn->bufferStart, have);
+	conn->bufferStart += have;
+	dst += have;
+	length -= have;
+	while (length > 0)
+	{
+		if (conn->sockFd < 0)
+		{
+			mallocstrcpy(errMsg, "ERROR, reading from a closed connection");
+			return 1;
+		}
+		n = read(conn->sockFd, dst, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			if (n < 0)
+			{
+				connecterror(buffer);
+				mallocstrcpyext(errMsg, "ERROR, reading from socket: ", buffer);
+			}
+			else
+				mallocstrcpy(errMsg, "ERROR, connection closed by server");
+			resetconnection(conn);
+			return 1;
+		}
+		dst += n;
+		length -= n;
+	}
+	return 0;
+}
+
+/**
+ * Reads one line (without its CR LF) from the connection into line,
+ * which holds size bytes. Overlong lines are truncated.
+ */
+static int readline(httpconn *conn, char line[], int size, char** errMsg)
+{
+	int p = 0;
+	char c;
+
+	while (1)
+	{
+		if (fillbuffer(conn, errMsg) != 0)
+			return 1;
+		c = conn->buffer[conn->bufferStart++];
+		if (c == '\n')
+			break;
+		if (c != '\r' && p < size - 1)
+			line[p++] = c;
+	}
+	line[p] = '\0';
+	return 0;
+}
+
+/**
+ * Reads the response to the oldest request sent on the connection and
+ * populates an httpres struct (to be freed with freeresponse). If body is
+ * not NULL and the response body fits in bodyCapacity bytes, the body is
+ * read directly into it and res->body is left NULL; otherwise it is
+ * malloc'd as with post. Returns 0 if successful, non-zero otherwise with
+ * errMsg populated.
+ *
+ * conn - connection to read from
+ * res - handle to the httpres struct
+ * body - caller's buffer for the body, can be NULL
+ * bodyCapacity - size of body
+ * errMsg - handle to the error message string
+ */
+int receiveresponse(httpconn *conn, httpres** res, void *body, int bodyCapacity, char** errMsg)
+{
+	header *currHdr = NULL;
+	header *tmpHdr = NULL;
+	char line[512];
+	char *pos;
+	int contentLength = 0;
+	BOOLEAN closeAfter = FALSE;
+
+	*errMsg = NULL;
+	if ((*res = calloc(1, sizeof(httpres))) == NULL)
+	{
+		fprintf(stderr,"ERROR, could not allocate memory for http response\n");
+		return 1;
+	}
+
+	// Status line
+	if (readline(conn, line, sizeof(line), errMsg) != 0)
+		return 1;
+	(*res)->status = malloc(strlen(line) + 1);
+	strcpy((*res)->status, line);
+	if ((pos = strchr(line, ' ')) != NULL)
+		(*res)->statusCode = atoi(pos + 1);
+
+	// Headers, up to the blank line
+	while (1)
+	{
+		if (readline(conn, line, sizeof(line), errMsg) != 0)
+			return 1;
+		if (line[0] == '\0')
+			break;
+		if ((currHdr = calloc(1, sizeof(header))) == NULL)
+		{
+			fprintf(stderr,"ERROR, could not allocate memory for http response header\n");
+			return 1;
+		}
+		if ((pos = strchr(line, ':')) != NULL)
+		{
+			*pos++ = '\0';
+			while (*pos == ' ' || *pos == '\t')
+				pos++;
+			currHdr->value = malloc(strlen(pos) + 1);
+			strcpy(currHdr->value, pos);
+		}
+		currHdr->name = malloc(strlen(line) + 1);
+		strcpy(currHdr->name, line);
+		if (!strcasecmp(currHdr->name, "Content-Length") && currHdr->value)
+			contentLength = atoi(currHdr->value);
+		else if (!strcasecmp(currHdr->name, "Connection") && currHdr->value &&
+		         !strcasecmp(currHdr->value, "close"))
+			closeAfter = TRUE;
+		if (tmpHdr != NULL)
+			tmpHdr->next = currHdr;
+		else
+			(*res)->headers = currHdr;
+		tmpHdr = currHdr;
+	}
+
+	// Body
+	if (contentLength > 0)
+	{
+		if (body == NULL || contentLength > bodyCapacity)
+		{
+			if (((*res)->body = malloc(contentLength + 1)) == NULL)
+			{
+				fprintf(stderr,"ERROR, could not allocate memory for response body\n");
+				return 1;
+			}
+			(*res)->body[contentLength] = '\0';
+			body = (*res)->body;
+		}
+		if (receiveraw(conn, body, contentLength, errMsg) != 0)
+			return 1;
+		(*res)->bodyLength = contentLength;
+	}
+	if (closeAfter)
+		resetconnection(conn);
+	return 0;
+}
+
+/**
+ * Closes the socket of the connection (if open) and drops anything
+ * buffered. The next send reconnects.
+ */
+void resetconnection(httpconn *conn)
+{
+	if (conn == NULL || conn->sockFd < 0)
+		return;
+	close(conn->sockFd);
+	conn->sockFd = -1;
+	conn->bufferStart = conn->bufferEnd = 0;
+}
+
+/**
+ * Closes and frees the specified connection.
+ */
+void closeconnection(httpconn *conn)
+{
+	if (conn == NULL)
+		return;
+	resetconnection(conn);
+	free(conn->hostName);
+	free(conn->path);
+	free(conn->preamble);
+	free(conn->buffer);
+	free(conn);
+}
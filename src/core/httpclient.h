@@ -41,6 +41,24 @@ struct httpres_struct
 };
 typedef struct httpres_struct httpres;
 
+/* A kept-alive connection to one url. Requests on it can be pipelined:
+ * send several with sendrequest, then read the responses back in order. */
+struct httpconn_struct
+{
+	union sock sock;
+	char *hostName;
+	char *path;
+	int portNum;
+	int sockFd;             // -1 while disconnected
+	char *preamble;         // request line and fixed headers
+	int preambleLength;
+	char *buffer;           // bytes read but not consumed yet
+	int bufferStart;
+	int bufferEnd;
+	int bufferSize;
+};
+typedef struct httpconn_struct httpconn;
+
 
 /* FUNCTION DECLARATIONS */
 #ifndef htonll
@@ -62,6 +80,14 @@ void connecterror(char errMsg[]); // copies the error message corresponding to t
 int mallocstrcpy(char** errMsg, const char msg[]); // copies a string into a malloc'd area of memory
 int mallocstrcpyext(char** errMsg, char msg1[], char msg2[]); // copies and concatenates 2 strings into a malloc' area of memory
 
+int openconnection(char url[], httpconn** conn, char** errMsg); // resolve url once for a keep-alive connection
+int sendrequest(httpconn *conn, const char headers[], int headersLength, const void *body, int bodyLength, char** errMsg); // queue a POST
+int receiveresponse(httpconn *conn, httpres** res, void *body, int bodyCapacity, char** errMsg); // read the oldest outstanding response
+int sendraw(httpconn *conn, const void *data1, int length1, const void *data2, int length2, char** errMsg); // write bytes as is
+int receiveraw(httpconn *conn, void *data, int length, char** errMsg); // read exactly length bytes
+void resetconnection(httpconn *conn); // drop the socket; the next send reconnects
+void closeconnection(httpconn *conn); // free the connection
+
 /* HEADERS AND VALUES */
 #define HD_GET_VALUE_OF_POSITIONS "GetValueOfPositions"
 #define HD_INIT_DATABASE "InitDatabase"
@@ -99,5 +125,7 @@ int mallocstrcpyext(char** errMsg, char msg1[], char msg2[]); // copies and conc
 #define HD_LAST_MOVE "LastMove"
 #define HD_MOVE "Move"
 
+#define HD_FRAMING "Framing"
+
 #define HD_RETURN_CODE "ReturnCode"
 #define HD_RETURN_MESSAGE "ReturnMessage"
@@ -345,6 +345,10 @@ void ServerInteractLoop(void) {
 				SafeFree(data);
 			}
 			printf("}}");
+		} else if (FirstWordMatches(input, "stats")) {
+			InteractCheckErrantExtra(input, 1);
+			printf(RESULT);
+			StatsPrint(stdout);
 		} else if (FirstWordMatches(input, "value")) {
 			if (!InteractReadPosition(input, &pos)) {
 				continue;
@@ -0,0 +1,115 @@
+/************************************************************************
+**
+** NAME:	levelfile_bench.c
+**
+** DESCRIPTION:	Level file write, validate and read throughput
+**
+**		Writes a random level of n positions (default 100M) at a few
+**		densities, with WriteLevelFile (which picks the type) and
+**		WriteIndexedLevelFile, then times isValidLevelFile and
+**		ReadLevelFile on one thread and on every online core. Each
+**		read is compared with the source array.
+**		Build from src/core after make, like levelfile_test.c:
+**
+** gcc -O2 -std=gnu99 -I.. -I/usr/include/tcl8.6 -Wl,--allow-multiple-definition levelfile_bench.c ../m1210.o
+**     ../gamesman.a ../gamesdb.a ../libUWAPI_boardstrings.a -lz -lgmp -ltcl8.6 -lpthread -lm
+**
+**		Usage: levelfile_bench [positions]
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#include "levelfile_generator.h"
+#include "threadpool.h"
+#include <time.h>
+
+#define BENCH_POSITIONS         100000000ULL
+
+static double Seconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static off_t FileSize(char *name) {
+	struct stat st;
+	return stat(name, &st) == 0 ? st.st_size : 0;
+}
+
+/* Reads name into answer on numThreads threads (0: one per core) and
+   returns the seconds taken, or -1 if it differs from array */
+static double TimeRead(char *name, BITARRAY *array, BITARRAY *answer, POSITION length, int numThreads) {
+	double start;
+	gNumThreads = numThreads;
+	start = Seconds();
+	if (ReadLevelFile(name, answer, length) != 0 ||
+	    memcmp(answer, array, (length + BITSINBYTE - 1) / BITSINBYTE) != 0)
+		return -1;
+	return Seconds() - start;
+}
+
+int main(int argc, char **argv) {
+	/* reachable positions per 10000: WriteLevelFile picks types 1, 3 and 2 */
+	int densities[] = { 100, 3000, 9900 }, d, k, indexed, errors = 0;
+	POSITION length = (argc > 1) ? strtoull(argv[1], NULL, 10) : BENCH_POSITIONS, i;
+	UINT64 numBytes = (length + BITSINBYTE - 1) / BITSINBYTE;
+	BITARRAY *array = (BITARRAY *) SafeMalloc(numBytes);
+	BITARRAY *answer = (BITARRAY *) SafeMalloc(numBytes);
+	char name[80];
+	double start, write, validate, readOne, readAll;
+
+	mkdir("./test", 0755);
+	srandom(1);
+	printf("%llu positions, %d cores\n", (unsigned long long) length, DefaultNumberOfThreads());
+	printf("density  type    file MB    write s  validate s  read 1 thread s  read all s\n");
+	for (d = 0; d < (int) (sizeof(densities) / sizeof(densities[0])); d++) {
+		memset(array, 0, numBytes);
+		for (i = 0; i < length; i++)
+			if (random() % 10000 < densities[d])
+				array[i / BITSINBYTE] |= (BYTE) (0x80 >> (i % BITSINBYTE));
+		/* first and last reachable, so the file spans the whole array */
+		array[0] |= 0x80;
+		array[(length - 1) / BITSINBYTE] |= (BYTE) (0x80 >> ((length - 1) % BITSINBYTE));
+
+		for (indexed = 0; indexed < 2; indexed++) {
+			sprintf(name, "./test/levelfile_bench_%d_%d.dat.gz", d, indexed);
+			start = Seconds();
+			k = indexed ? WriteIndexedLevelFile(name, array, 0, length)
+			    : WriteLevelFile(name, array, 0, length);
+			write = Seconds() - start;
+			start = Seconds();
+			k |= isValidLevelFile(name);
+			validate = Seconds() - start;
+			readOne = TimeRead(name, array, answer, length, 1);
+			readAll = TimeRead(name, array, answer, length, 0);
+			if (k != 0 || readOne < 0 || readAll < 0) {
+				printf("%s: write, validate or read back failed\n", name);
+				errors++;
+			}
+			printf("%5.2f%%  %5d %10.1f %10.2f %11.2f %16.2f %11.2f\n", densities[d] / 100.0,
+			       getLevelFileType(name), FileSize(name) / 1e6, write, validate, readOne, readAll);
+			unlink(name);
+		}
+	}
+	SafeFree(array);
+	SafeFree(answer);
+	printf("%s: %d errors\n", argv[0], errors);
+	return errors ? 1 : 0;
+}
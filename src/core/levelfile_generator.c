@@ -30,244 +30,353 @@
 **
 **************************************************************************/
 #include "levelfile_generator.h"
+#include "threadpool.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Level files with fewer positions than gLevelFileParallelMin (by default
+** LEVELFILE_PARALLEL_MIN) are decoded on the calling thread; above it the
+** body is split into independent chunks. */
+#define LEVELFILE_PARALLEL_MIN          (1 << 22)
+#define LEVELFILE_CHUNKS_PER_THREAD     4
+#define LEVELFILE_OUT_BUFFER            (1 << 16)
+#define LEVELFILE_IN_BUFFER             (1 << 20)
+#define LEVELFILE_HEADER_MAX            1024
+
+/* Indexed level files: positions per block and the block encodings */
+#define LEVELFILE_BLOCK_POSITIONS       (1 << 16)
+#define LEVELFILE_BLOCK_ONES            1
+#define LEVELFILE_BLOCK_ZEROS           2
+#define LEVELFILE_BLOCK_BITMAP          3
 
 // GLOBAL VARIABLES
 gzFile        compressed_filep;
-gzFile        compressed_filep_type0;
-gzFile        compressed_filep_type1;
-gzFile        compressed_filep_type2;
-gzFile        compressed_filep_type3;
+POSITION      gLevelFileParallelMin = LEVELFILE_PARALLEL_MIN;
+
+/* What a single pass over a BITARRAY learns about it; enough to size every
+** level file type without encoding any of them. */
+typedef struct {
+	BOOLEAN empty;          // no reachable positions at all
+	UINT64 first;           // bit index of the first reachable position
+	UINT64 last;            // bit index of the last reachable position
+	UINT64 ones;            // number of reachable positions
+	UINT64 asciiBytes;      // body size of the type 0 encoding
+} LEVELFILE_STATS;
+
+/* Buffered, bit-granular output to a gzFile */
+typedef struct {
+	gzFile file;
+	BYTE buffer[LEVELFILE_OUT_BUFFER];
+	UINT32 used;
+	UINT64 pending;         // bits not yet written, right aligned
+	int pendingBits;
+	GMSTATUS status;
+} LEVELFILE_WRITER;
+
+/* A whole level file, decompressed into memory */
+typedef struct {
+	BYTE *data;
+	UINT64 size;
+	BYTE *body;             // first byte after the header
+	UINT64 bodySize;        // bytes up to, not including, the 0x0C \n 1 trailer
+	int type;
+	UINT64 minHashValue;
+	UINT64 maxHashValue;
+} LEVELFILE_IMAGE;
+
+static int levelfileReadIndexed(char* compressed_filename, BITARRAY *array, POSITION length);
+
+/* One independent piece of a level file body */
+typedef struct {
+	LEVELFILE_IMAGE *image;
+	BITARRAY *array;
+	UINT64 length;          // positions covered by array
+	UINT64 begin, end;      // records for types 1 and 2, body bytes for type 0
+	UINT64 bitsPerPosition;
+} LEVELFILE_CHUNK;
+
+/****************************************************************************
+* Description
+*      levelfileBitsPerPosition returns the number of bits needed to store
+*      offsets up to and including maxOffset (at least one)
+****************************************************************************/
+static UINT64 levelfileBitsPerPosition(UINT64 maxOffset)
+{
+	UINT64 bits = 1;
+	while (bits < BITSINPOS && (maxOffset >> bits) != 0)
+		bits++;
+	return bits;
+}
+
+static UINT64 levelfileDigits(UINT64 value)
+{
+	UINT64 digits = 1;
+	while (value >= 10) {
+		value /= 10;
+		digits++;
+	}
+	return digits;
+}
+
+/* Smallest power of ten above value, saturating at UINT64_MAX */
+static UINT64 levelfileNextDecade(UINT64 value)
+{
+	UINT64 decade = 10;
+	while (decade <= value) {
+		if (decade > UINT64_MAX / 10)
+			return UINT64_MAX;
+		decade *= 10;
+	}
+	return decade;
+}
+
+/****************************************************************************
+* Description
+*      levelfileWord returns the 64 bits of array starting at bit index
+*      64*word, most significant bit first (the order getBitValue uses),
+*      keeping only the bits whose index lies in [lo, hi]. With invert set
+*      the zeros in that range are returned as ones instead.
+****************************************************************************/
+static UINT64 levelfileWord(BITARRAY *array, UINT64 word, UINT64 lo, UINT64 hi, BOOLEAN invert)
+{
+	UINT64 firstBit = word * BITSINPOS, value = 0, mask = (UINT64) -1;
+	UINT64 lastByte = hi / BITSINBYTE, byte = word * sizeof(UINT64), i;
+
+	if (byte + sizeof(UINT64) - 1 <= lastByte) {
+		for (i = 0; i < sizeof(UINT64); i++)
+			value = (value << BITSINBYTE) | array[byte + i];
+	} else {
+		for (i = 0; i < sizeof(UINT64); i++)
+			value = (value << BITSINBYTE) | ((byte + i <= lastByte) ? array[byte + i] : 0);
+	}
+	if (invert)
+		value = ~value;
+	if (lo > firstBit)
+		mask &= (UINT64) -1 >> (lo - firstBit);
+	if (hi < firstBit + BITSINPOS - 1)
+		mask &= ~((UINT64) -1 >> (hi - firstBit + 1));
+	return value & mask;
+}
+
+/****************************************************************************
+* Description
+*      levelfileScan makes the single pass over array (positions
+*      startIndex .. startIndex+numBits-1) that WriteLevelFile needs to
+*      pick a level file type.
+****************************************************************************/
+static void levelfileScan(BITARRAY *array, UINT64 startIndex, UINT64 numBits, LEVELFILE_STATS *stats)
+{
+	UINT64 w, numWords = (numBits + BITSINPOS - 1) / BITSINPOS;
+	UINT64 digits = levelfileDigits(startIndex), decadeEnd = levelfileNextDecade(startIndex);
+	UINT64 word, base, count, position;
+	int bit;
+
+	memset(stats, 0, sizeof(LEVELFILE_STATS));
+	stats->empty = TRUE;
+	for (w = 0; w < numWords; w++) {
+		word = levelfileWord(array, w, 0, numBits - 1, FALSE);
+		if (word == 0)
+			continue;
+		count = __builtin_popcountll(word);
+		if (stats->empty) {
+			stats->first = w * BITSINPOS + __builtin_clzll(word);
+			stats->empty = FALSE;
+		}
+		stats->last = w * BITSINPOS + (BITSINPOS - 1) - __builtin_ctzll(word);
+		stats->ones += count;
+		base = startIndex + w * BITSINPOS;
+		if (base + BITSINPOS <= decadeEnd) {
+			stats->asciiBytes += count * (digits + 1);
+			continue;
+		}
+		while (word != 0) {
+			bit = __builtin_clzll(word);
+			position = base + bit;
+			while (position >= decadeEnd) {
+				digits++;
+				decadeEnd = levelfileNextDecade(decadeEnd);
+			}
+			stats->asciiBytes += digits + 1;
+			word &= ~((UINT64) 1 << (BITSINPOS - 1 - bit));
+		}
+	}
+}
+
+/****************************************************************************
+* Description
+*      levelfileBodySize returns how many bytes the body of a level file
+*      of the given type would take, before gzip, for the scanned array.
+****************************************************************************/
+static UINT64 levelfileBodySize(LEVELFILE_STATS *stats, int type)
+{
+	UINT64 range = stats->last - stats->first + 1;
+	UINT64 bitsPerPosition = levelfileBitsPerPosition(range - 1);
+
+	switch (type) {
+	case 0: return stats->asciiBytes;
+	case 1: return (stats->ones * bitsPerPosition + BITSINBYTE - 1) / BITSINBYTE;
+	case 2: return ((range - stats->ones) * bitsPerPosition + BITSINBYTE - 1) / BITSINBYTE;
+	default: return (range + BITSINBYTE - 1) / BITSINBYTE;
+	}
+}
+
+/****************************************************************************
+* Description
+*      levelfileCopyBits copies bits [from, from+count) of array to the
+*      start of out, most significant bit first, zeroing the bits that pad
+*      the last byte.
+****************************************************************************/
+static void levelfileCopyBits(BITARRAY *array, UINT64 from, UINT64 count, BYTE *out)
+{
+	UINT64 numBytes = (count + BITSINBYTE - 1) / BITSINBYTE, k;
+	UINT64 firstByte = from / BITSINBYTE, lastByte = (from + count - 1) / BITSINBYTE;
+	int shift = from % BITSINBYTE;
+
+	if (shift == 0)
+	{
+		memcpy(out, array + firstByte, numBytes);
+	}
+	else
+	{
+		for (k = 0; k < numBytes; k++)
+		{
+			out[k] = array[firstByte + k] << shift;
+			if (firstByte + k + 1 <= lastByte)
+				out[k] |= array[firstByte + k + 1] >> (BITSINBYTE - shift);
+		}
+	}
+	if (count % BITSINBYTE != 0)
+		out[numBytes - 1] &= (BYTE) (0xFF << (BITSINBYTE - count % BITSINBYTE));
+}
+
+static void levelfileFlush(LEVELFILE_WRITER *out)
+{
+	if (out->used != 0 && out->status == STATUS_SUCCESS)
+		out->status = bitlib_file_write_bytes(out->file, out->buffer, out->used);
+	out->used = 0;
+}
+
+static void levelfilePutByte(LEVELFILE_WRITER *out, BYTE value)
+{
+	if (out->used == LEVELFILE_OUT_BUFFER)
+		levelfileFlush(out);
+	out->buffer[out->used++] = value;
+}
+
+static void levelfilePutString(LEVELFILE_WRITER *out, char *string, int length)
+{
+	int i;
+	for (i = 0; i < length; i++)
+		levelfilePutByte(out, (BYTE) string[i]);
+}
+
+/* Appends the low BITS bits of value, most significant first */
+static void levelfilePutBits(LEVELFILE_WRITER *out, UINT64 value, int bits)
+{
+	if (bits > 32) {
+		levelfilePutBits(out, value >> 32, bits - 32);
+		value &= 0xFFFFFFFFULL;
+		bits = 32;
+	}
+	out->pending = (out->pending << bits) | value;
+	out->pendingBits += bits;
+	while (out->pendingBits >= BITSINBYTE) {
+		out->pendingBits -= BITSINBYTE;
+		levelfilePutByte(out, (BYTE) (out->pending >> out->pendingBits));
+	}
+	out->pending &= ((UINT64) 1 << out->pendingBits) - 1;
+}
+
+/* Pads the last partial byte with zeros and writes the body trailer */
+static int levelfileFinishBody(LEVELFILE_WRITER *out)
+{
+	GMSTATUS status;
+	if (out->pendingBits > 0)
+		levelfilePutBits(out, 0, BITSINBYTE - out->pendingBits);
+	levelfilePutByte(out, 0x0C);
+	levelfilePutByte(out, '\n');
+	levelfileFlush(out);
+	status = out->status;
+	free(out);
+	return (status == STATUS_SUCCESS) ? 0 : 1;
+}
+
+static LEVELFILE_WRITER *levelfileNewWriter(gzFile file)
+{
+	LEVELFILE_WRITER *out = (LEVELFILE_WRITER *) SafeMalloc(sizeof(LEVELFILE_WRITER));
+	out->file = file;
+	out->used = 0;
+	out->pending = 0;
+	out->pendingBits = 0;
+	out->status = STATUS_SUCCESS;
+	return out;
+}
 
 /********************************************************************************
  * Description
  *      WriteLevelFile reads an array of hash values and returns a
- *      level file. This file may be of any format type. The function
- *      optimizes for size by generating all types sequentially and
- *      comparing size of file after each file is generated. If the endIndex
- *      is greater than the startIndex then the function knows that the
- *      array has been corrupted at some other level
+ *      level file. This file may be of any format type. One pass over the
+ *      array gives the size each of the four types would have, and only
+ *      the smallest one is encoded. If the endIndex is smaller than the
+ *      startIndex then the function knows that the array has been
+ *      corrupted at some other level
  * Arguments
  *      char* compressed_filename
  *      BITARRAY *array
  *      POSITION startIndex
  *      POSITION endIndex
  * Return Values
- *      int 0 for success -1 for error
+ *      int 0 for success 1 for error
  *********************************************************************************/
 int WriteLevelFile(char* compressed_filename, BITARRAY* array, POSITION startIndex, POSITION endIndex)
 {
-	char filename_type0[82];
-	char filename_type1[82];
-	char filename_type2[82];
-	char filename_type3[82];
-	UINT64 minHashValue, maxHashValue;
-	char* check ="1";
-	minHashValue = startIndex + findMinValueFromArray(array, endIndex-startIndex);
-	maxHashValue = startIndex + findMaxValueFromArray(array, endIndex-startIndex);
-
-	int type = 0;
+	LEVELFILE_STATS stats;
+	UINT64 minHashValue, maxHashValue, bitsPerPosition, lastZero = 0, size, bestSize = 0;
+	int type, bestType = 0, status;
 
 	if(endIndex < startIndex)
 	{
 		return 1;
 	}
-	UINT64 bitsPerPosition = log2(maxHashValue - minHashValue) + 1;
+	levelfileScan(array, startIndex, endIndex - startIndex, &stats);
+	minHashValue = startIndex + stats.first;
+	maxHashValue = startIndex + stats.last;
+	bitsPerPosition = levelfileBitsPerPosition(maxHashValue - minHashValue);
 
-	//      UINT64 length = ceil((maxHashValue - minHashValue)/BITSINBYTE);
-
-	while(type < NUMOFTYPES) // create the four file types
+	for (type = 0; type < NUMOFTYPES; type++)
 	{
-		if(type == 0)
-		{
-			strncpy(filename_type0, compressed_filename, strlen(compressed_filename)-LENGTHOFEXT);
-			filename_type0[strlen(compressed_filename)-LENGTHOFEXT] = '\0';
-			strcat(filename_type0, "_0.dat.gz");
-			printf("0: Compressed_filename is:  %s \n", filename_type0);
-			compressed_filep_type0 = gzopen(filename_type0, "wb");
-			if(!compressed_filep_type0)
-			{
-				printf("0: Couldn't open file");
-				return 1;
-			}
-			writeHeader(compressed_filep_type0, minHashValue, maxHashValue, 0, type);
-			printf("0: Header is Written to File\n");
-			ArrayToType0Write(array, startIndex, maxHashValue);
-			printf("0: Body is Written to File\n");
-			bitlib_file_write_bytes(compressed_filep_type0, (BYTE *)check, strlen(check));
-			gzclose(compressed_filep_type0);
-
-		}
-
-		if(type == 1)
-		{
-			strncpy(filename_type1, compressed_filename, strlen(compressed_filename)-LENGTHOFEXT);
-			filename_type1[strlen(compressed_filename)-LENGTHOFEXT] = '\0';
-			strcat(filename_type1, "_1.dat.gz");
-			printf("1: Compressed_filename is:  %s \n", filename_type1);
-			compressed_filep_type1 = gzopen(filename_type1, "wb");
-			if(!compressed_filep_type1)
-			{
-				printf("1: couldn't open file");
-				return 1;
-			}
-			writeHeader(compressed_filep_type1, minHashValue, maxHashValue, 0,  type);
-			printf("1: Header is Written to File\n");
-			ArrayToType1Write(array, startIndex, maxHashValue, bitsPerPosition, minHashValue);
-			printf("1: Body is Written to File\n");
-			bitlib_file_write_bytes(compressed_filep_type1, (BYTE *)check, strlen(check));
-			gzclose(compressed_filep_type1);
-		}
-
-		if(type == 2)
-		{
-			strncpy(filename_type2, compressed_filename, strlen(compressed_filename)-LENGTHOFEXT);
-			filename_type2[strlen(compressed_filename)-LENGTHOFEXT] = '\0';
-			strcat(filename_type2, "_2.dat.gz");
-
-			printf("2: Compressed_filename is:  %s \n", filename_type2);
-			compressed_filep_type2 = gzopen(filename_type2, "wb");
-			if(!compressed_filep_type2)
-			{
-				printf("2: couldn't open file");
-				return 1;
-			}
-//			printf("bpppppp %llu %llu %llu", bitsPerPosition, maxHashValue, minHashValue);
-			writeHeader(compressed_filep_type2, minHashValue, maxHashValue, findLastZero(array, maxHashValue-minHashValue) - findMinValueFromArray(array, endIndex-startIndex), type);
-			printf("2: Header is Written to File\n");
-			ArrayToType2Write(array, startIndex, maxHashValue, bitsPerPosition, minHashValue);
-
-			printf("2: Body is Written to File\n");
-			bitlib_file_write_bytes(compressed_filep_type2, (BYTE *)check, strlen(check));
-			gzclose(compressed_filep_type2);
-		}
-
-		if(type == 3)
+		size = levelfileBodySize(&stats, type);
+		if (type == 0 || size < bestSize)
 		{
-			strncpy(filename_type3, compressed_filename, strlen(compressed_filename)-LENGTHOFEXT);
-			filename_type3[strlen(compressed_filename)-LENGTHOFEXT] = '\0';
-			strcat(filename_type3, "_3.dat.gz");
-			printf("3: Compressed_filename is:  %s \n", filename_type3);
-			compressed_filep_type3 = gzopen(filename_type3, "wb");
-			if(!compressed_filep_type3)
-			{
-				printf("3: couldn't open file");
-				return 1;
-			}
-			writeHeader(compressed_filep_type3, minHashValue, maxHashValue, 0, type);
-			printf("3: Header is Written to File\n");
-
-			ArrayToType3Write(array, startIndex, minHashValue, maxHashValue);
-			printf("3: Body is Written to File\n");
-			bitlib_file_write_bytes(compressed_filep_type3, (BYTE *)check, strlen(check));
-			gzclose(compressed_filep_type3);
+			bestSize = size;
+			bestType = type;
 		}
-
-		type++;
+	}
+	if (bestType == 2)
+	{
+		lastZero = maxHashValue - minHashValue;
+		while (lastZero > 0 && getBitValue(array[(stats.first + lastZero) / BITSINBYTE], (stats.first + lastZero) % BITSINBYTE))
+			lastZero--;
 	}
 
-	char* fnameChosen = NULL; /*s
-	                             stat(filename_type0, &fileinfo0);
-	                             stat(filename_type1, &fileinfo1);
-	                             stat(filename_type2, &fileinfo2);
-	                             stat(filename_type3, &fileinfo3);
-	                             if(fileinfo1.st_size > fileinfo0.st_size)
-	                             {
-	                             if(fileinfo2.st_size > fileinfo1.st_size)
-	                             {
-	                             if(fileinfo3.st_size > fileinfo2.st_size)
-	                             {
-	                             compressed_filep = compressed_filep_type3;
-	                             fnameChosen = filename_type3;
-	                             remove(filename_type0);
-	                             remove(filename_type1);
-	                             remove(filename_type2);
-	                             printf("type 3a");
-	                             }
-	                             else
-	                             {
-	                             compressed_filep = compressed_filep_type2;
-	                             fnameChosen = filename_type2;
-	                             remove(filename_type0);
-	                             remove(filename_type1);
-	                             remove(filename_type3);
-	                             printf("type 2a");
-	                             }
-	                             }
-	                             else
-	                             {
-	                             if(fileinfo3.st_size > fileinfo1.st_size)
-	                             {
-	                             compressed_filep = compressed_filep_type3;
-	                             fnameChosen = filename_type3;
-	                             remove(filename_type0);
-	                             remove(filename_type1);
-	                             remove(filename_type2);
-	                             printf("type 3b");
-	                             }
-	                             else
-	                             {
-	                             compressed_filep = compressed_filep_type1;
-	                             fnameChosen = filename_type1;
-	                             remove(filename_type0);
-	                             remove(filename_type3);
-	                             remove(filename_type2);
-	                             printf("type 1a");
-	                             }
-	                             }
-	                             }
-	                             else
-	                             {
-	                             if(fileinfo2.st_size > fileinfo0.st_size)
-	                             {
-	                             if(fileinfo3.st_size > fileinfo2.st_size)
-	                             {
-	                             compressed_filep = compressed_filep_type3;
-	                             fnameChosen = filename_type3;
-	                             remove(filename_type0);
-	                             remove(filename_type1);
-	                             remove(filename_type2);
-	                             printf("type 3c");
-	                             }
-	                             else
-	                             {
-	                             compressed_filep = compressed_filep_type2;
-	                             fnameChosen = filename_type2;
-	                             remove(filename_type0);
-	                             remove(filename_type1);
-	                             remove(filename_type3);
-	                             printf("type 2b");
-	                             }
-	                             }
-	                             else
-	                             {
-	                             if(fileinfo3.st_size > fileinfo0.st_size)
-	                             {
-	                             compressed_filep = compressed_filep_type3;
-	                             fnameChosen = filename_type3;
-	                             remove(filename_type0);
-	                             remove(filename_type1);
-	                             remove(filename_type2);
-	                             printf("type 3d");
-	                             }
-	                             else
-	                             {
-	                             compressed_filep = compressed_filep_type0;
-	                             fnameChosen = filename_type0;
-	                             remove(filename_type3);
-	                             remove(filename_type1);
-	                             remove(filename_type2);
-	                             printf("type 0a");
-	                             }
-	                             }
-	                             }*/
-	compressed_filep = compressed_filep_type0;
-	fnameChosen = filename_type0;
-	remove(filename_type3);
-	remove(filename_type1);
-	remove(filename_type2);
-	rename(fnameChosen, compressed_filename);
-
-	return 0;
+	compressed_filep = gzopen(compressed_filename, "wb");
+	if(!compressed_filep)
+	{
+		printf("Couldn't open level file %s\n", compressed_filename);
+		return 1;
+	}
+	status = writeHeader(compressed_filep, minHashValue, maxHashValue, lastZero, bestType);
+	if (bestType == 0)
+		status |= ArrayToType0Write(compressed_filep, array, startIndex, minHashValue, maxHashValue);
+	else if (bestType == 1)
+		status |= ArrayToType1Write(compressed_filep, array, startIndex, minHashValue, maxHashValue, bitsPerPosition);
+	else if (bestType == 2)
+		status |= ArrayToType2Write(compressed_filep, array, startIndex, minHashValue, maxHashValue, bitsPerPosition);
+	else
+		status |= ArrayToType3Write(compressed_filep, array, startIndex, minHashValue, maxHashValue);
+	status |= (bitlib_file_write_bytes(compressed_filep, (BYTE *) "1", 1) != STATUS_SUCCESS);
+	status |= (gzclose(compressed_filep) != Z_OK);
+	return status ? 1 : 0;
 }
 
 /****************************************************************************
@@ -319,1114 +428,969 @@ int writeHeader(gzFile file, UINT64 minHashValue, UINT64 maxHashValue, UINT64 la
 //returns 0 if valid and 1 if not valid
 int isValidLevelFile(char* compressed_filename)
 {
-	//read bytes until two 0xC 0xA have been found. Then read next bit, must be 1
-	int status;
-	int firstValid = 0;
-	int endSectionCounter = 0;
-	int sawx0C = 0;
-	BYTE* buffer = (BYTE*)malloc(sizeof(BYTE));
-	compressed_filep = gzopen(compressed_filename, "rb");
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-	if((BYTE)(*buffer)=='1')
+	//the first byte and the last byte must both be the check bit '1',
+	//the latter preceded by the 0xC 0xA that closes the body
+	BYTE* buffer;
+	BYTE first = 0, tail[3] = {0, 0, 0};
+	int numRead, i;
+	UINT64 total = 0;
+	gzFile file;
+	FILE* plain = fopen(compressed_filename, "rb");
+	if(!plain)
 	{
-		firstValid = 1;
+		return 1;
 	}
-	while(status == STATUS_SUCCESS && endSectionCounter < 3)
+	//indexed level files are not gzipped, so their ends can be read directly
+	if(fread(tail, 1, 1, plain) == 1 && tail[0] == '1' &&
+	   fseek(plain, -3, SEEK_END) == 0 && fread(tail, 1, 3, plain) == 3)
 	{
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-		if(status)
-		{
-			return 1;
-		}
-		if(*buffer == 0x0C)
-		{
-			sawx0C = 1;
-		}
-		else if (sawx0C)
-		{
-			sawx0C = 0;
-			if(*buffer == 0x0A)
-			{
-				endSectionCounter++;
-			}
-		}
+		fclose(plain);
+		return (tail[0] == 0x0C && tail[1] == 0x0A && tail[2] == '1') ? 0 : 1;
 	}
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-	if((BYTE)(*buffer)!='1')
+	fclose(plain);
+	tail[0] = 0;
+	file = gzopen(compressed_filename, "rb");
+	if(!file)
 	{
-		if(buffer)
-			free(buffer);
-		gzclose(compressed_filep);
 		return 1;
 	}
-	else
+	buffer = (BYTE*)SafeMalloc(LEVELFILE_IN_BUFFER);
+	while((numRead = gzread(file, buffer, LEVELFILE_IN_BUFFER)) > 0)
 	{
-		if(buffer)
-			free(buffer);
-		gzclose(compressed_filep);
-		return 0;
+		if(total == 0)
+			first = buffer[0];
+		for(i = (numRead > 3) ? numRead - 3 : 0; i < numRead; i++)
+		{
+			tail[0] = tail[1];
+			tail[1] = tail[2];
+			tail[2] = buffer[i];
+		}
+		total += numRead;
 	}
-	gzclose(compressed_filep);
-	return 1;
+	SafeFree(buffer);
+	gzclose(file);
+	if(numRead < 0 || total < 4 || first != '1')
+		return 1;
+	return (tail[0] == 0x0C && tail[1] == 0x0A && tail[2] == '1') ? 0 : 1;
 }
+
 /****************************************************************************
 * Description
-*      ArrayToType0Write reads in an array of BYTE values and
-*      creates a Type 0 level File.
+*      ArrayToType0Write writes the reachable positions in
+*      [minHashValue, maxHashValue] as space separated ASCII numbers.
 * Arguments
-*      BITARRAY *array
+*      gzFile file
+*      BITARRAY *array   (bit 0 is position startIndex)
 *      UINT64 startIndex
+*      UINT64 minHashValue
 *      UINT64 maxHashValue
 * Return Values
 *      0 upon success or 1 upon error
 ****************************************************************************/
-int ArrayToType0Write(BITARRAY *array, UINT64 startIndex, UINT64 maxHashValue)
+int ArrayToType0Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue)
 {
-	POSITION counter = startIndex;
-	UINT8 bitcounter = 0, currentByte;
-	BYTE* buffer = (BYTE*)malloc(sizeof(UINT64));
-	GMSTATUS status = STATUS_SUCCESS;
+	LEVELFILE_WRITER *out = levelfileNewWriter(file);
+	UINT64 lo = minHashValue - startIndex, hi = maxHashValue - startIndex;
+	UINT64 w, word, position;
 	char positionString[22];
+	int bit, digits;
 
-	while(counter <= maxHashValue)
+	for (w = lo / BITSINPOS; w <= hi / BITSINPOS; w++)
 	{
-		bitcounter=0;
-		currentByte = *array;
-		while(counter <= maxHashValue && bitcounter < BITSINBYTE)
+		word = levelfileWord(array, w, lo, hi, FALSE);
+		while (word != 0)
 		{
-			if(getBitValue(currentByte, bitcounter))
-			{
-				sprintf(positionString, "%llu ", counter);
-				status = bitlib_file_write_bytes(compressed_filep_type0, (BYTE *)positionString, strlen(positionString));
-			}
-			bitcounter++;
-			counter++;
+			bit = __builtin_clzll(word);
+			word &= ~((UINT64) 1 << (BITSINPOS - 1 - bit));
+			position = startIndex + w * BITSINPOS + bit;
+			digits = sizeof(positionString);
+			positionString[--digits] = ' ';
+			do {
+				positionString[--digits] = '0' + (position % 10);
+				position /= 10;
+			} while (position != 0);
+			levelfilePutString(out, positionString + digits, sizeof(positionString) - digits);
 		}
-		array++;
 	}
-	char endline = 0x0C;
-	sprintf(positionString, "%c\n", endline);
-	status = bitlib_file_write_bytes(compressed_filep_type0, (BYTE *)positionString, strlen(positionString));
-	if(buffer)
-		free(buffer);
-	return 0;
+	return levelfileFinishBody(out);
 }
 
 /****************************************************************************
 * Description
-*      ArrayToType1Write reads in an array of BYTE values and
-*      creates a Type 0 level File.
+*      ArrayToType1Write writes the reachable positions in
+*      [minHashValue, maxHashValue] as offsets from minHashValue, each
+*      packed into bitsPerPosition bits, most significant bit first.
 * Arguments
-*      BYTE *array
+*      gzFile file
+*      BITARRAY *array   (bit 0 is position startIndex)
 *      UINT64 startIndex
+*      UINT64 minHashValue
 *      UINT64 maxHashValue
-*      UINT8 bitsPerPosition
-*      UINT64 offset
+*      UINT64 bitsPerPosition
 * Return Values
 *      0 upon success or 1 upon error
 ****************************************************************************/
-int ArrayToType1Write(BITARRAY *array, UINT64 startIndex, UINT64 maxHashValue, UINT64 bitsPerPosition, UINT64 offset)
+int ArrayToType1Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue, UINT64 bitsPerPosition)
 {
+	LEVELFILE_WRITER *out = levelfileNewWriter(file);
+	UINT64 lo = minHashValue - startIndex, hi = maxHashValue - startIndex;
+	UINT64 w, word;
+	int bit;
 
-	POSITION counter = startIndex;
-	UINT8 bitcounter = 0, currentByte;
-	BYTE bufferPrev = 0;
-	BYTE* bufferCurr = (BYTE*)malloc(sizeof(UINT64));
-	char positionString[22];
-	GMSTATUS status = STATUS_SUCCESS;
-	UINT8 leftOffset=0;
-	int numBytesInCurrent = 0;
-	UINT64 offsetValue;
-	int leftShift;
-	/*
-	   take the first one, bitshift by bpp. Then print the floor(first bpp/8) Bytes.
-	   set leftOffset to 8-(bpp%8) and take the next Byte and set to buffer Prev
-	   take 2nd value, shift left bpp - leftOffset
-	   or byte 1 with buffer Prev, Print all bytes up to floor(bitsPerPosition+leftOffset)/8
-	   set leftOffset to 8-(bpp+leftOffset)%8 set bufferPrev to the next Byte
-	 */
-	while(counter <= maxHashValue)
+	for (w = lo / BITSINPOS; w <= hi / BITSINPOS; w++)
 	{
-		bitcounter=0;
-		currentByte = *array;
-		while(status == STATUS_SUCCESS && counter <= maxHashValue && bitcounter < BITSINBYTE)
-		{
-			if(counter >= offset && getBitValue(currentByte, bitcounter)) // you have a position
-			{
-				offsetValue = counter - offset;
-				leftShift = 8*8 - leftOffset - bitsPerPosition;
-				positionToByteArray(bufferCurr, offsetValue << leftShift, bufferPrev);
-				status = bitlib_file_write_bytes(compressed_filep_type1, bufferCurr, floor((bitsPerPosition + leftOffset)/8));
-//				bitlib_print_bytes_in_bits(bufferCurr, floor((bitsPerPosition + leftOffset)/8));
-//				printf("counter %d amountt %d", counter, (UINT8)(bitsPerPosition));
-				numBytesInCurrent = floor((leftOffset + bitsPerPosition)/8);
-				bufferPrev = *(bufferCurr + (UINT8)floor((leftOffset+bitsPerPosition)/8));
-				leftOffset = ((bitsPerPosition+leftOffset)%8);
-			}
-			bitcounter++;
-			counter++;
-		}
-		if(bufferPrev !=0)
+		word = levelfileWord(array, w, lo, hi, FALSE);
+		while (word != 0)
 		{
-			status = bitlib_file_write_bytes(compressed_filep_type1, bufferCurr, 1);
-			//bitlib_print_bytes_in_bits(bufferCurr, 1);
-
+			bit = __builtin_clzll(word);
+			word &= ~((UINT64) 1 << (BITSINPOS - 1 - bit));
+			levelfilePutBits(out, w * BITSINPOS + bit - lo, bitsPerPosition);
 		}
-		array++;
 	}
-
-	sprintf(positionString, "%c\n", 0x0C);
-	status = bitlib_file_write_bytes(compressed_filep_type0, (BYTE *)positionString, strlen(positionString));
-	if(bufferCurr)
-		free(bufferCurr);
-	return 0;
+	return levelfileFinishBody(out);
 }
 
 /****************************************************************************
 * Description
-*      positionToByteArray takes a 64 bit integer and puts it in a
-*      BITARRAY. It also takes in a bufferPrev, which will bit-wise OR the
-*      first BYTE of the return value with the value of bufferPrev
+*      ArrayToType2Write is ArrayToType1Write for the positions that are
+*      NOT reachable.
 * Arguments
-*      BITARRAY* buffer
-*      UINT64 value
-*      BYTE bufferPrev
+*      gzFile file
+*      BITARRAY *array   (bit 0 is position startIndex)
+*      UINT64 startIndex
+*      UINT64 minHashValue
+*      UINT64 maxHashValue
+*      UINT64 bitsPerPosition
 * Return Values
 *      0 upon success or 1 upon error
 ****************************************************************************/
-int positionToByteArray(BITARRAY* buffer, UINT64 value, BYTE bufferPrev)
+int ArrayToType2Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue, UINT64 bitsPerPosition)
 {
-	int byteNum = 0;
-	BYTE oneByte;
-//	printf("value %x	\n", bufferPrev);
-	while(byteNum < sizeof(UINT64))
+	LEVELFILE_WRITER *out = levelfileNewWriter(file);
+	UINT64 lo = minHashValue - startIndex, hi = maxHashValue - startIndex;
+	UINT64 w, word;
+	int bit;
+
+	for (w = lo / BITSINPOS; w <= hi / BITSINPOS; w++)
 	{
-		UINT8 bitsTillDesiredByte, bitsInSevenBytes;
-		bitsTillDesiredByte = byteNum*BITSINBYTE;
-		bitsInSevenBytes = 56; //(sizeof(UINT64)-1)*BITSINBYTE;
-		oneByte = (BYTE)((value << bitsTillDesiredByte) >> bitsInSevenBytes);
-//        printf("%x ", oneByte);
-		if(byteNum == 0)
+		word = levelfileWord(array, w, lo, hi, TRUE);
+		while (word != 0)
 		{
-			oneByte = oneByte|bufferPrev;
+			bit = __builtin_clzll(word);
+			word &= ~((UINT64) 1 << (BITSINPOS - 1 - bit));
+			levelfilePutBits(out, w * BITSINPOS + bit - lo, bitsPerPosition);
 		}
-		*buffer = oneByte;
-		buffer++;
-		byteNum += 1;
 	}
-//   printf(" the bytes for the number %llu\n", value);
-	return 0;
+	return levelfileFinishBody(out);
 }
 
 /****************************************************************************
 * Description
-*      ArrayToType2Write reads in an array of BYTE values and
-*      creates a Type 1 level File.
+*      ArrayToType3Write writes the bits of array for positions
+*      [minHashValue, maxHashValue], realigned so that minHashValue is the
+*      first bit of the body.
 * Arguments
-*      BITARRAY *array
+*      gzFile file
+*      BITARRAY *array   (bit 0 is position startIndex)
 *      UINT64 startIndex
+*      UINT64 minHashValue
 *      UINT64 maxHashValue
-*      UINT8 bitsPerPosition
-*      UINT64 offset
 * Return Values
 *      0 upon success or 1 upon error
 ****************************************************************************/
-int ArrayToType2Write(BITARRAY *array, UINT64 startIndex, UINT64 maxHashValue, UINT64 bitsPerPosition, UINT64 offset)
+int ArrayToType3Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue)
 {
-	POSITION counter = startIndex;
-	UINT8 bitcounter = 0, currentByte;
-	BYTE bufferPrev = 0;
-	BYTE* bufferCurr = (BYTE*)malloc(sizeof(UINT64));
-	char positionString[22];
-	GMSTATUS status = STATUS_SUCCESS;
-	UINT8 leftOffset=0;
-	int numBytesInCurrent = 0;
-	UINT64 offsetValue;
-	int leftShift;
-	/*
-	   take the first one, bitshift by bpp. Then print the floor(first bpp/8) Bytes.
-	   set leftOffset to 8-(bpp%8) and take the next Byte and set to buffer Prev
-	   take 2nd value, shift left bpp - leftOffset
-	   or byte 1 with buffer Prev, Print all bytes up to floor(bitsPerPosition+leftOffset)/8
-	   set leftOffset to 8-(bpp+leftOffset)%8 set bufferPrev to the next Byte
-	 */
-	while(counter <= maxHashValue)
+	LEVELFILE_WRITER *out = levelfileNewWriter(file);
+	UINT64 lo = minHashValue - startIndex, range = maxHashValue - minHashValue + 1;
+	UINT64 done, count, step = (UINT64) LEVELFILE_OUT_BUFFER * BITSINBYTE;
+
+	for (done = 0; done < range; done += count)
 	{
-		bitcounter=0;
-		currentByte = *array;
-		while(status == STATUS_SUCCESS && counter <= maxHashValue && bitcounter < BITSINBYTE)
+		count = (range - done < step) ? range - done : step;
+		levelfileFlush(out);
+		levelfileCopyBits(array, lo + done, count, out->buffer);
+		out->used = (count + BITSINBYTE - 1) / BITSINBYTE;
+	}
+	return levelfileFinishBody(out);
+}
+
+/****************************************************************************
+* Description
+*      levelfileParseHeader parses the ASCII header at the start of a level
+*      file held in memory.
+* Return Values
+*      the first byte after the header, or NULL if it is malformed
+****************************************************************************/
+static BYTE *levelfileParseHeader(BYTE *data, UINT64 size, int *type, UINT64 *minHashValue, UINT64 *maxHashValue)
+{
+	BYTE *p = data, *end = data + size;
+	UINT64 value;
+	int field;
+
+	//check bit, then comments and blank lines until the type
+	*type = -1;
+	if(size == 0 || *p++ != '1')
+		return NULL;
+	for(field = 0; p < end && field < 2; )
+	{
+		if(*p == '#')
 		{
-			if(counter >= offset && !getBitValue(currentByte, bitcounter)) // you have a position
-			{
-				offsetValue = counter - offset;
-				leftShift = 8*8 - leftOffset - bitsPerPosition;
-				positionToByteArray(bufferCurr, offsetValue << (64 - bitsPerPosition-leftOffset), bufferPrev);
-				status = bitlib_file_write_bytes(compressed_filep_type1, bufferCurr, floor((bitsPerPosition + leftOffset)/8));
-				numBytesInCurrent = floor((leftOffset + bitsPerPosition)/8);
-				bufferPrev = *(bufferCurr + (UINT8)floor((leftOffset+bitsPerPosition)/8));
-				leftOffset = ((bitsPerPosition+leftOffset)%8);
-			}
-			bitcounter++;
-			counter++;
+			while(p < end && *p != 0x0A)
+				p++;
 		}
-		if(bufferPrev !=0)
+		else if(*p == 0x0A)
 		{
-			status = bitlib_file_write_bytes(compressed_filep_type1, bufferCurr, 1);
+			p++;
+		}
+		else if(field == 0)
+		{
+			*type = *p - '0';
+			while(p < end && *p != 0x0A)
+				p++;
+			field = 1;
+		}
+		else
+		{
+			//minHashValue maxHashValue [lastZero] 0x0C 0x0A
+			for(field = 0; p < end && *p != 0x0C; p++)
+			{
+				if(*p < '0' || *p > '9')
+					continue;
+				for(value = 0; p < end && *p >= '0' && *p <= '9'; p++)
+					value = value * 10 + (*p - '0');
+				if(field == 0)
+					*minHashValue = value;
+				else if(field == 1)
+					*maxHashValue = value;
+				field++;
+				if(*p == 0x0C)
+					break;
+			}
+			if(p + 1 >= end || p[1] != 0x0A || field < 2)
+				return NULL;
+			p += 2;
+			field = 2;
 		}
-		array++;
 	}
-
-	sprintf(positionString, "%c\n", 0x0C);
-	status = bitlib_file_write_bytes(compressed_filep_type0, (BYTE *)positionString, strlen(positionString));
-	if(bufferCurr)
-		free(bufferCurr);
-	return 0;
+	if(field != 2 || *type < 0)
+		return NULL;
+	return p;
 }
 
 /****************************************************************************
 * Description
-*      ArrayToType3Write reads in an array of BYTE values and
-*      creates a Type 2 level File.
-* Arguments
-*      BITARRAY *array
-*      UINT64 minHashValue
-*      UINT64 maxHashValue
+*      levelfileLoad decompresses a whole level file into memory and
+*      parses its header.
 * Return Values
 *      0 upon success or 1 upon error
 ****************************************************************************/
-int ArrayToType3Write(BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue)
+static int levelfileLoad(char* compressed_filename, LEVELFILE_IMAGE *image)
 {
-	POSITION counter = minHashValue;
-	BYTE* buffer = (BYTE*)malloc(sizeof(UINT8));
-	GMSTATUS status = STATUS_SUCCESS;
-	char positionString[1];
-	UINT64 temp = minHashValue - startIndex;
-	int offset = temp % 8;
-	array += (temp / 8);
+	UINT64 capacity = LEVELFILE_IN_BUFFER;
+	BYTE *p, *end;
+	int numRead;
+	gzFile file = gzopen(compressed_filename, "rb");
+
+	memset(image, 0, sizeof(LEVELFILE_IMAGE));
+	if(!file)
+	{
+		return 1;
+	}
+	gzbuffer(file, LEVELFILE_IN_BUFFER);
+	// keep sizeof(UINT64) zero bytes past the end for levelfileGetBits
+	image->data = (BYTE *) SafeMalloc(capacity + sizeof(UINT64));
+	while((numRead = gzread(file, image->data + image->size, capacity - image->size)) > 0)
+	{
+		image->size += numRead;
+		if(image->size == capacity)
+		{
+			capacity *= 2;
+			image->data = (BYTE *) SafeRealloc(image->data, capacity + sizeof(UINT64));
+		}
+	}
+	gzclose(file);
+	if(numRead < 0 || image->size < 4)
+		return 1;
+	memset(image->data + image->size, 0, sizeof(UINT64));
 
+	end = image->data + image->size;
+	p = levelfileParseHeader(image->data, image->size, &image->type, &image->minHashValue, &image->maxHashValue);
+	if(p == NULL || image->type >= NUMOFTYPES)
+		return 1;
+	if(end - p < 3 || end[-3] != 0x0C || end[-2] != 0x0A || end[-1] != '1')
+		return 1;
+	image->body = p;
+	image->bodySize = (end - 3) - p;
+	return 0;
+}
 
+/* Reads BITS (at most 64) bits starting at bit offset OFFSET of buffer */
+static UINT64 levelfileGetBits(BYTE *buffer, UINT64 offset, UINT64 bits)
+{
+	UINT64 value = 0, i;
+	BYTE *p;
+	if (bits > 32)
+		return (levelfileGetBits(buffer, offset, bits - 32) << 32) |
+		       levelfileGetBits(buffer, offset + bits - 32, 32);
+	p = buffer + offset / BITSINBYTE;
+	for (i = 0; i < sizeof(UINT64); i++)
+		value = (value << BITSINBYTE) | p[i];
+	return (value << (offset % BITSINBYTE)) >> (BITSINPOS - bits);
+}
 
-// Get this to just rite the 8 bits skipping the 0's between start index and minHashValue
-	while(counter <= maxHashValue)
-	{
-		*buffer = (*array << offset) + (*(array+1) >> (8-offset));
-		status = bitlib_file_write_bytes(compressed_filep_type3, buffer, 1);
-		counter+=8;
-		array++;
+/* Merges the accumulated bits of one output byte. Only the first and last
+** byte a chunk touches can be shared with a neighbouring chunk. */
+static void levelfileMerge(BITARRAY *array, UINT64 cell, BYTE bits, BOOLEAN set, BOOLEAN shared)
+{
+	if (set) {
+		if (shared)
+			__sync_fetch_and_or(&array[cell], bits);
+		else
+			array[cell] |= bits;
+	} else {
+		if (shared)
+			__sync_fetch_and_and(&array[cell], (BYTE) ~bits);
+		else
+			array[cell] &= (BYTE) ~bits;
+	}
+}
 
+/****************************************************************************
+* Description
+*      levelfileDecodeChunk sets (type 0 and 1) or clears (type 2) the
+*      bits of the positions listed in one chunk of a level file body.
+*      Positions are sorted, so chunks only overlap on their edge bytes.
+****************************************************************************/
+static void levelfileDecodeChunk(void *arg)
+{
+	LEVELFILE_CHUNK *chunk = (LEVELFILE_CHUNK *) arg;
+	LEVELFILE_IMAGE *image = chunk->image;
+	BYTE *body = image->body, accumulated = 0;
+	UINT64 cell = 0, offset, r, p, stop;
+	BOOLEAN haveCell = FALSE, firstMerge = TRUE, set = (image->type != 2);
+
+#define LEVELFILE_MARK(OFFSET) \
+	if ((OFFSET) < chunk->length) { \
+		if (!haveCell || (OFFSET) / BITSINBYTE != cell) { \
+			if (haveCell) { \
+				levelfileMerge(chunk->array, cell, accumulated, set, firstMerge); \
+				firstMerge = FALSE; \
+			} \
+			cell = (OFFSET) / BITSINBYTE; \
+			accumulated = 0; \
+			haveCell = TRUE; \
+		} \
+		accumulated |= 0x80 >> ((OFFSET) % BITSINBYTE); \
 	}
 
-	sprintf(positionString, "%c\n", 0x0C);
-	status = bitlib_file_write_bytes(compressed_filep_type0, (BYTE *)positionString, strlen(positionString));
-	if(buffer)
-		free(buffer);
-	return 0;
+	if (image->type == 0) {
+		//a chunk owns the numbers that start inside [begin, end)
+		p = chunk->begin;
+		while (p > 0 && p < image->bodySize && body[p - 1] != ' ')
+			p++;
+		stop = chunk->end;
+		while (stop > 0 && stop < image->bodySize && body[stop - 1] != ' ')
+			stop++;
+		while (p < stop) {
+			for (offset = 0; p < image->bodySize && body[p] != ' '; p++)
+				offset = offset * 10 + (body[p] - '0');
+			p++;
+			if (offset < image->minHashValue)
+				continue;
+			offset -= image->minHashValue;
+			LEVELFILE_MARK(offset);
+		}
+	} else {
+		for (r = chunk->begin; r < chunk->end; r++) {
+			offset = levelfileGetBits(body, r * chunk->bitsPerPosition, chunk->bitsPerPosition);
+			LEVELFILE_MARK(offset);
+		}
+	}
+	if (haveCell)
+		levelfileMerge(chunk->array, cell, accumulated, set, TRUE);
+#undef LEVELFILE_MARK
 }
 
 /****************************************************************************
 * Description
-*      ReadLevelFile takes a pointer to a bitarray and a compressed file
-*      and creates a bitarray starting at the files minHashValue until
-*      its maxHashValue (0=not valid, 1 = valid
+*      levelfileRead decodes a level file into array, bit i standing for
+*      position minHashValue+i. Bodies of large files are split into
+*      independent chunks that are decoded on a thread pool.
 * Arguments
 *      char* compressed_filename
 *      BITARRAY *array
-*      int length   (maxHashValue-minHashValue)
+*      POSITION length   (maxHashValue-minHashValue+1)
+*      int type          (-1 to accept any type)
 * Return Values
-*      UINT8 status
+*      0 upon success or 1 upon error
 ****************************************************************************/
-int ReadLevelFile(char* compressed_filename, BITARRAY *array, int length)
+static int levelfileRead(char* compressed_filename, BITARRAY *array, POSITION length, int type)
 {
-	int status;
-	//length++;
-	int type = getLevelFileType(compressed_filename);
-	if(type == 0)
+	LEVELFILE_IMAGE image;
+	LEVELFILE_CHUNK *chunks;
+	THREADPOOL *pool = NULL;
+	UINT64 numBytes = (length + BITSINBYTE - 1) / BITSINBYTE, units, numRecords = 0, bitsPerPosition = 0;
+	int numThreads = 1, numChunks = 1, c;
+
+	if (type == LEVELFILE_INDEXED || (type == -1 && getLevelFileType(compressed_filename) == LEVELFILE_INDEXED))
+		return levelfileReadIndexed(compressed_filename, array, length);
+	if (levelfileLoad(compressed_filename, &image) != 0 || (type != -1 && image.type != type))
 	{
-		status = readLevelFileType0(compressed_filename, array, length);
+		if (image.data != NULL)
+			SafeFree(image.data);
+		return 1;
+	}
+
+	if (image.type == 3)
+	{
+		UINT64 copy = (image.bodySize < numBytes) ? image.bodySize : numBytes;
+		memcpy(array, image.body, copy);
+		memset(array + copy, 0, numBytes - copy);
+		if (length % BITSINBYTE != 0 && numBytes > 0)
+			array[numBytes - 1] &= (BYTE) (0xFF << (BITSINBYTE - length % BITSINBYTE));
+		SafeFree(image.data);
+		return 0;
 	}
-	else if(type == 1)
+
+	if (image.type == 2)
 	{
-		status = readLevelFileType1(compressed_filename, array, length);
+		memset(array, 0xFF, numBytes);
+		if (length % BITSINBYTE != 0 && numBytes > 0)
+			array[numBytes - 1] = (BYTE) (0xFF << (BITSINBYTE - length % BITSINBYTE));
 	}
-	else if(type == 2)
+	else
 	{
-		status = readLevelFileType2(compressed_filename, array, length);
+		memset(array, 0, numBytes);
 	}
-	else if(type == 3)
+
+	if (image.type == 0)
 	{
-		status = readLevelFileType3(compressed_filename, array, length);
+		units = image.bodySize;
 	}
 	else
 	{
-		return 1;
+		//the padding of the last byte may hold whole records of zeros;
+		//real records are strictly increasing, so drop any that are not
+		bitsPerPosition = levelfileBitsPerPosition(image.maxHashValue - image.minHashValue);
+		numRecords = image.bodySize * BITSINBYTE / bitsPerPosition;
+		while (numRecords > 1 &&
+		       levelfileGetBits(image.body, (numRecords - 1) * bitsPerPosition, bitsPerPosition) <=
+		       levelfileGetBits(image.body, (numRecords - 2) * bitsPerPosition, bitsPerPosition))
+			numRecords--;
+		units = numRecords;
+	}
+
+	if (length >= gLevelFileParallelMin)
+		numThreads = DefaultNumberOfThreads();
+	if (numThreads > 1)
+	{
+		numChunks = numThreads * LEVELFILE_CHUNKS_PER_THREAD;
+		pool = ThreadPoolCreate(numThreads);
 	}
+	chunks = (LEVELFILE_CHUNK *) SafeMalloc(numChunks * sizeof(LEVELFILE_CHUNK));
+	for (c = 0; c < numChunks; c++)
+	{
+		chunks[c].image = &image;
+		chunks[c].array = array;
+		chunks[c].length = length;
+		chunks[c].begin = units * c / numChunks;
+		chunks[c].end = units * (c + 1) / numChunks;
+		chunks[c].bitsPerPosition = bitsPerPosition;
+		if (pool != NULL)
+			ThreadPoolSubmit(pool, levelfileDecodeChunk, &chunks[c]);
+		else
+			levelfileDecodeChunk(&chunks[c]);
+	}
+	ThreadPoolDestroy(pool);
+	SafeFree(chunks);
+	SafeFree(image.data);
 	return 0;
 }
+
 /****************************************************************************
 * Description
-*      readLevelFileType0 takes a pointer to a bitarray and a compressed file
+*      ReadLevelFile takes a pointer to a bitarray and a compressed file
 *      and creates a bitarray starting at the files minHashValue until
 *      its maxHashValue (0=not valid, 1 = valid
 * Arguments
 *      char* compressed_filename
 *      BITARRAY *array
-*      int length   (maxHashValue-minHashValue)
+*      POSITION length   (maxHashValue-minHashValue+1)
 * Return Values
-*      UINT8 status
+*      0 upon success or 1 upon error
 ****************************************************************************/
-int readLevelFileType0(char* compressed_filename, BITARRAY *array, int length)
+int ReadLevelFile(char* compressed_filename, BITARRAY *array, POSITION length)
 {
-	int index=0;
-	UINT64 minHashValue = getLevelFileMinHashValue(compressed_filename);
-	UINT64 temp = 0;
-	BYTE* buffer = (BYTE*)malloc(sizeof(BYTE));
-	int bitValue=0;
-	int status = STATUS_SUCCESS;
-	int endSectionCounter = 0;
-	int diff  = 0;
-	compressed_filep = gzopen(compressed_filename, "rb");
-	//length ++;
-	//skips header section which has two 0xC (at end of header) and all other ASCII chars
-	while(status == STATUS_SUCCESS && endSectionCounter < 2)
-	{
-		//printf("Begining Header Parse");
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-		if(status)
-		{
-			return 1;
-		}
-		if(*buffer == 0x0C)
-		{
-			endSectionCounter++;
-		}
-	}
-	//copies data into the bitarray
-	temp = 0;
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1); // new line
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-	while(index <= length && *buffer!= 0x0C)
-	{
-		//   printf("buffer %d", *buffer);
-		if((*buffer) != 0x20) //create number
-		{
-			temp = temp * 10 + ((*buffer) - '0');
-//		  printf(" number %d  --", temp);
-		}
-		else //number done, put in array
-		{
-			diff = temp - minHashValue;
-			while(index < diff)
-			{
-				bitValue = index % 8;
-				if(bitValue ==0)
-				{
-					(*array) = 0;
-				}
-				index++;
-				if(bitValue == 7)
-				{
-//					printf("== %d %x==", bitValue, *array);
-					array++;
-				}
-			}
-			if(index == diff)
-			{
-				bitValue = index % 8;
-//				printf("\nputting in a 1 %d , %d,  %d bitValue", temp, bitValue, index);
-				if(bitValue ==0)
-				{
-					(*array) = 0;
-				}
-				(*array) = (*array) | (1 << (7-bitValue));
-				index++;
-			}
-			if(bitValue == 7)
-			{
-//				printf("== %d %x==", bitValue, *array);
-				array++;
-			}
-			temp = 0;
-		}
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-	}
-	printf("== %d %x==", bitValue, *array);
-
-	bitlib_print_bytes_in_bits(array, 2);
-	if(buffer)
-		free(buffer);
-	gzclose(compressed_filep);
-	return 0;
+	return levelfileRead(compressed_filename, array, length, -1);
 }
 
 /****************************************************************************
 * Description
-*      readLevelFileType1 takes a pointer to a bitarray and a compressed
-*      file and creates a bitarray starting at the files minHashValue until
-*      its maxHashValue (0=not valid, 1 = valid
-* Arguments
-*      char* compressed_filename
-*      BITARRAY *array
-*      int length   (maxHashValue-minHashValue)
-* Return Values
-*      UINT8 status
+*      readLevelFileType0 .. readLevelFileType3 are ReadLevelFile for a file
+*      that must be of that particular type.
 ****************************************************************************/
-int readLevelFileType1(char* compressed_filename, BITARRAY *bitArray, int length)
+int readLevelFileType0(char* compressed_filename, BITARRAY *array, POSITION length)
 {
-	int index = 0;
-	UINT64 minHashValue = getLevelFileMinHashValue(compressed_filename);
-	UINT64 maxHashValue = getLevelFileMaxHashValue(compressed_filename);
-	UINT64 bitsPerPosition = log2(maxHashValue - minHashValue) + 1;
-	BYTE*     buffer = (BYTE*)malloc(sizeof(BYTE));
-	int status = STATUS_SUCCESS;
-	int endSectionCounter = 0;
-
-	//    BITARRAY* bitArray = (BITARRAY*)malloc(sizeof(BITARRAY)*BITSINPOS/BITSINBYTE);
-	int currentIndex = 0;
-	BYTE*     currentByte = (BYTE*)malloc(sizeof(BYTE));
+	return levelfileRead(compressed_filename, array, length, 0);
+}
 
-	compressed_filep = gzopen(compressed_filename, "rb");
-	(*bitArray) = 0;
-	//skips header section which has two 0xC 's(at end of header) and all other ASCII chars
-	while(status == STATUS_SUCCESS && endSectionCounter < 2)
-	{
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-		if(status)
-		{
-			return status;
-		}
-		if(*buffer == 0x0C)
-		{
-			endSectionCounter++;
-		}
-	}
-	//copies data into the bitarray
-	int tempBitIndexInByte = 1;
-	UINT8 tempNumber = 0;
-	int bitValue;
-	int counter = 0;
-	int lastTempNumber = -1;
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-	while((lastTempNumber+1) < length)
-	{
-		if(tempBitIndexInByte != 1) //stll evaluating same byte
-		{
-			printf("case1\n");
-			printf("--- %x %d\n", *buffer, currentIndex);
-			if((8 - (tempBitIndexInByte - 1)) > bitsPerPosition) // doesn't use up rest of byte
-			{
-				printf(" == %d %x==", tempBitIndexInByte, *buffer);
-				tempNumber += (UINT8)((UINT8)((*buffer) << (tempBitIndexInByte - 1)) >> (8 - (bitsPerPosition)));
-				tempBitIndexInByte += bitsPerPosition;
-				//add number to bitArray
-				lastTempNumber = tempNumber;
-				printf("1tempNumber %d\n", tempNumber);
-				///ADDNUMBERTOBITARRAY
-				if(counter > length)
-				{
-					gzclose(compressed_filep);
-					if(buffer)
-						free(buffer);
-					if(currentByte)
-						free(currentByte);
-					return 0;
-				}
-				else
-				{
-					while(counter < tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						counter++;
-					}
-					if(counter == tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-						counter++;
-					}
-					if(bitValue == 7)
-					{
-						bitArray++;
-					}
-				}
-				//ENDADDNUMBERTOBITARRAY
-				tempNumber = 0;
-				currentIndex =0;
-			}
-			else // uses up rest of Byte
-			{
-				tempNumber += (UINT8)((UINT8)((*buffer) << (tempBitIndexInByte - 1)) >> (tempBitIndexInByte - 1));
-				printf(" *** %d %d ", currentIndex, tempBitIndexInByte);
-				currentIndex += (8-(tempBitIndexInByte-1));
-				tempBitIndexInByte = 1;
-				if(currentIndex >= bitsPerPosition) //add number to bitArray
-				{
-//					printf("add case1b to array ");
-					///ADDNUMBERTOBITARRAY
-					printf("2tempNumber %d\n", tempNumber);
-					lastTempNumber = tempNumber;
-					if(counter > length)
-					{
-						gzclose(compressed_filep);
-						if(buffer)
-							free(buffer);
-						if(currentByte)
-							free(currentByte);
-						return 0;
-					}
-					else
-					{
-						while(counter < tempNumber)
-						{
-//							printf("counter %d %d", counter, tempNumber);
-							bitValue = counter % 8;
-							if(bitValue ==0)
-							{
-								(*bitArray) = 0;
-							}
-							counter++;
-							if(bitValue == 7)
-							{
-								bitArray++;
-							}
-						}
-						if(counter == tempNumber)
-						{
-							bitValue = counter % 8;
-							if(bitValue ==0)
-							{
-								(*bitArray) = 0;
-							}
-							(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-							counter++;
-						}
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-					}
-					//ENDADDNUMBERTOBITARRAY
-					currentIndex = 0;
-					tempNumber = 0;
-				}
-			}
-		}
-		else if((currentIndex + 8) < bitsPerPosition) //if using whole Byte
-		{
-			printf("case2\n");
-			status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-			printf("--- %x %d\n", *buffer, currentIndex);
-			index++;
-			tempNumber += ((*buffer) << (bitsPerPosition - currentIndex));
-			tempBitIndexInByte = 1;
-			currentIndex += 8;
-			if(currentIndex >= bitsPerPosition) //add number to bitArray
-			{
-				printf("3tempNumber %d\n", tempNumber);
-				///ADDNUMBERTOBITARRAY
-				lastTempNumber = tempNumber;
-				if(counter > length)
-				{
-					gzclose(compressed_filep);
-					if(buffer)
-						free(buffer);
-					if(currentByte)
-						free(currentByte);
-					return 0;
-				}
-				else
-				{
-					while(counter < tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-						counter++;
-					}
-					if(counter == tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-						counter++;
-					}
-					if(bitValue == 7)
-					{
-						bitArray++;
-					}
-				}
-				//ENDADDNUMBERTOBITARRAY
-				currentIndex = 0;
-				tempNumber = 0;
-			}
-		}
-		else // getting new byte but only using some of it
-		{
-			printf("case3\n");
-			status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-			printf("--- %x %d\n", *buffer, currentIndex);
-			index++;
-			if(currentIndex)
-				tempNumber = (tempNumber << (bitsPerPosition - currentIndex))  + ((*buffer) >> (8-(bitsPerPosition-currentIndex)));
-			else
-				tempNumber = (((*buffer) << (tempBitIndexInByte - 1))  >> (8 - bitsPerPosition));
+int readLevelFileType1(char* compressed_filename, BITARRAY *array, POSITION length)
+{
+	return levelfileRead(compressed_filename, array, length, 1);
+}
 
-			tempBitIndexInByte = (bitsPerPosition - currentIndex + 1);
-//			printf("tempNumber %x %d %d\n", *buffer, bitsPerPosition, tempBitIndexInByte);
-			currentIndex = bitsPerPosition;
-			if(currentIndex >= bitsPerPosition) //add number to bitArray
-			{
-				///ADDNUMBERTOBITARRAY
-				lastTempNumber = tempNumber;
-				printf("4tempNumber %d\n", tempNumber);
-				if(counter > length)
-				{
-					gzclose(compressed_filep);
-					if(buffer)
-						free(buffer);
+int readLevelFileType2(char* compressed_filename, BITARRAY *array, POSITION length)
+{
+	return levelfileRead(compressed_filename, array, length, 2);
+}
 
-					if(currentByte)
-						free(currentByte);
-					return 0;
-				}
-				else
-				{
-					while(counter < tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						counter++;
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-					}
-					if(counter == tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-						counter++;
-					}
-					if(bitValue == 7)
-					{
-						bitArray++;
-					}
-				}
-				//ENDADDNUMBERTOBITARRAY
-				currentIndex = 0;
-				tempNumber = 0;
-			}
-			//printf("bitInByte %d  CurrentIndex %d \n", tempBitIndexInByte, currentIndex);
-		}
-	}
-	// read bits and form number until bits per postition, then increment index
+int readLevelFileType3(char* compressed_filename, BITARRAY *array, POSITION length)
+{
+	return levelfileRead(compressed_filename, array, length, 3);
+}
 
-	gzclose(compressed_filep);
+/********************************************************************************
+ * Indexed level files (type 4)
+ *
+ * The other types are a single gzip stream, so answering whether one
+ * position is reachable means decompressing everything before it. An
+ * indexed level file keeps the usual ASCII header uncompressed (gzread
+ * passes it through, so getLevelFileType and friends still work), then
+ * cuts [minHashValue, maxHashValue] into blocks of
+ * LEVELFILE_BLOCK_POSITIONS positions, each deflated on its own:
+ *
+ *      header
+ *      block 0 .. block n-1
+ *      n+1 x (UINT64 file offset, UINT64 reachable positions before it)
+ *      UINT64 positions per block, UINT64 n, UINT64 offset of the table
+ *      0x0C 0x0A 1
+ *
+ * All integers are little endian. Inflated, a block starts with its kind:
+ * LEVELFILE_BLOCK_ONES or LEVELFILE_BLOCK_ZEROS followed by the UINT16
+ * offsets of its reachable or unreachable positions, or
+ * LEVELFILE_BLOCK_BITMAP followed by its bits, whichever is smallest.
+ *********************************************************************************/
 
-	if(buffer)
-		free(buffer);
+static void levelfilePut64(BYTE *buffer, UINT64 value)
+{
+	int i;
+	for (i = 0; i < 8; i++)
+		buffer[i] = (BYTE) (value >> (BITSINBYTE * i));
+}
+
+static UINT64 levelfileGet64(BYTE *buffer)
+{
+	UINT64 value = 0;
+	int i;
+	for (i = 7; i >= 0; i--)
+		value = (value << BITSINBYTE) | buffer[i];
+	return value;
+}
+
+static UINT64 levelfileCountBits(BYTE *bitmap, UINT64 first, UINT64 last)
+{
+	UINT64 count = 0, i;
+	for (i = first; i <= last && i % BITSINBYTE != 0; i++)
+		count += getBitValue(bitmap[i / BITSINBYTE], i % BITSINBYTE);
+	for (; i + BITSINBYTE - 1 <= last; i += BITSINBYTE)
+		count += __builtin_popcount(bitmap[i / BITSINBYTE]);
+	for (; i <= last; i++)
+		count += getBitValue(bitmap[i / BITSINBYTE], i % BITSINBYTE);
+	return count;
+}
 
-	if(currentByte)
-		free(currentByte);
+/* Turns an inflated block into the bitmap of its numPositions positions */
+static int levelfileExpandBlock(BYTE *raw, UINT64 rawSize, UINT64 numPositions, BYTE *bitmap)
+{
+	UINT64 numBytes = (numPositions + BITSINBYTE - 1) / BITSINBYTE, i, offset;
 
+	if (rawSize < 1)
+		return 1;
+	if (raw[0] == LEVELFILE_BLOCK_BITMAP) {
+		if (rawSize - 1 != numBytes)
+			return 1;
+		memcpy(bitmap, raw + 1, numBytes);
+		return 0;
+	}
+	if (raw[0] != LEVELFILE_BLOCK_ONES && raw[0] != LEVELFILE_BLOCK_ZEROS)
+		return 1;
+	memset(bitmap, (raw[0] == LEVELFILE_BLOCK_ONES) ? 0 : 0xFF, numBytes);
+	if (numPositions % BITSINBYTE != 0)
+		bitmap[numBytes - 1] &= (BYTE) (0xFF << (BITSINBYTE - numPositions % BITSINBYTE));
+	for (i = 1; i + 1 < rawSize; i += 2) {
+		offset = raw[i] | ((UINT64) raw[i + 1] << BITSINBYTE);
+		if (offset >= numPositions)
+			return 1;
+		if (raw[0] == LEVELFILE_BLOCK_ONES)
+			bitmap[offset / BITSINBYTE] |= 0x80 >> (offset % BITSINBYTE);
+		else
+			bitmap[offset / BITSINBYTE] &= (BYTE) ~(0x80 >> (offset % BITSINBYTE));
+	}
 	return 0;
 }
-/****************************************************************************
-* Description
-*      readLevelFileType2 takes a pointer to a bitarray and a compressed
-*      file and creates a bitarray starting at the files minHashValue until
-*      its maxHashValue (0=not valid, 1 = valid
-* Arguments
-*      char* compressed_filename
-*      BITARRAY *array
-*      int length   (maxHashValue-minHashValue)
-* Return Values
-*      UINT8 status
-****************************************************************************/
-int readLevelFileType2(char* compressed_filename, BITARRAY *bitArray, int length)
+
+/* Reads and inflates block b of index into bitmap; safe to call from
+** several threads at once since it only uses pread and its own buffers */
+static int levelfileLoadBlock(LEVELFILE_INDEX *index, UINT64 b, BYTE *bitmap, BYTE *compressed, BYTE *raw)
+{
+	UINT64 size = index->offsets[b + 1] - index->offsets[b];
+	UINT64 first = b * index->blockPositions;
+	UINT64 range = index->maxHashValue - index->minHashValue + 1;
+	UINT64 numPositions = (range - first < index->blockPositions) ? range - first : index->blockPositions;
+	uLongf rawSize = 1 + index->blockPositions / BITSINBYTE;
+
+	if (size > compressBound(rawSize) ||
+	    pread(index->fd, compressed, size, index->offsets[b]) != (ssize_t) size ||
+	    uncompress(raw, &rawSize, compressed, size) != Z_OK)
+		return 1;
+	return levelfileExpandBlock(raw, rawSize, numPositions, bitmap);
+}
+
+/* Makes block b the cached one and returns its bitmap. A block that can't
+** be read ends the program: answering "unreachable" for its positions would
+** silently leave them out of the tier being solved. */
+static BYTE *levelfileCachedBlock(LEVELFILE_INDEX *index, UINT64 b)
 {
-	int index = 0;
-	UINT64 minHashValue = getLevelFileMinHashValue(compressed_filename);
-	UINT64 maxHashValue = getLevelFileMaxHashValue(compressed_filename);
-	UINT64 lastZero = getLastZero(compressed_filename);
-	UINT64 bitsPerPosition = log2(maxHashValue - minHashValue) + 1;
-	BYTE*     buffer = (BYTE*)malloc(sizeof(BYTE));
-	int status = STATUS_SUCCESS;
-	int endSectionCounter = 0;
-
-	//    BITARRAY* bitArray = (BITARRAY*)malloc(sizeof(BITARRAY)*BITSINPOS/BITSINBYTE);
-	int currentIndex = 0;
-	BYTE*     currentByte = (BYTE*)malloc(sizeof(BYTE));
+	char message[1024];
 
-	compressed_filep = gzopen(compressed_filename, "rb");
-	(*bitArray) = 0;
-	//skips header section which has two 0xC 's(at end of header) and all other ASCII chars
-	while(status == STATUS_SUCCESS && endSectionCounter < 2)
+	if (index->cachedBlock == b)
+		return index->cache;
+	index->cachedBlock = index->numBlocks;
+	if (levelfileLoadBlock(index, b, index->cache, index->compressed, index->raw) != 0)
 	{
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-		if(status)
-		{
-			return 1;
-		}
-		if(*buffer == 0x0C)
-		{
-			endSectionCounter++;
-		}
+		snprintf(message, sizeof(message), "Couldn't read block %llu of level file %s, it may be corrupt",
+		         (unsigned long long) b, index->filename);
+		ExitStageRightErrorString(message);
 	}
-	//copies data into the bitarray
-	int tempBitIndexInByte = 1;
-	UINT8 tempNumber = 0;
-	int bitValue;
-	int counter = 0;
-	int lastTempNumber = -1;
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-	while(counter <= lastZero)
+	index->cachedBlock = b;
+	return index->cache;
+}
+
+/********************************************************************************
+ * Description
+ *      WriteIndexedLevelFile is WriteLevelFile for a type 4 file, which
+ *      LevelFileIndexContains and LevelFileIndexCount can query without
+ *      decoding it.
+ * Arguments
+ *      char* compressed_filename
+ *      BITARRAY *array
+ *      POSITION startIndex
+ *      POSITION endIndex
+ * Return Values
+ *      int 0 for success 1 for error
+ *********************************************************************************/
+int WriteIndexedLevelFile(char* compressed_filename, BITARRAY *array, POSITION startIndex, POSITION endIndex)
+{
+	LEVELFILE_STATS stats;
+	UINT64 minHashValue, maxHashValue, range, numBlocks, b, i, first, numPositions, count, offset, ones = 0;
+	UINT64 rawCapacity = 1 + LEVELFILE_BLOCK_POSITIONS / BITSINBYTE, tableOffset;
+	uLongf compressedSize, compressedCapacity = compressBound(rawCapacity);
+	BYTE *bitmap, *raw, *compressed, *table, kind;
+	int status = 0;
+	gzFile file;
+
+	if(endIndex < startIndex)
 	{
-		if(tempBitIndexInByte != 1) //stll evaluating same byte
-		{
-//			printf("case1\n");
-			if((8 - (tempBitIndexInByte - 1)) > bitsPerPosition) // doesn't use up rest of byte
-			{
-				tempNumber += (UINT8)((UINT8)((*buffer) << (tempBitIndexInByte - 1)) >> (8 - (bitsPerPosition)));
-				tempBitIndexInByte += bitsPerPosition;
-				//add number to bitArray
-				lastTempNumber = tempNumber;
-				///ADDNUMBERTOBITARRAY
-				if(counter > length)
-				{
-					gzclose(compressed_filep);
-					if(buffer)
-						free(buffer);
-					if(currentByte)
-						free(currentByte);
-					return 0;
-				}
-				else
-				{
-					while(counter < tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-						counter++;
-					}
-					if(counter == tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						counter++;
-					}
-					if(bitValue == 7)
-					{
-						bitArray++;
-					}
-				}
-				//ENDADDNUMBERTOBITARRAY
-				tempNumber = 0;
-				currentIndex =0;
-			}
-			else // uses up rest of Byte
-			{
-				tempNumber += (UINT8)((UINT8)((*buffer) << (tempBitIndexInByte - 1)) >> (tempBitIndexInByte - 1));
-				currentIndex = (8-(tempBitIndexInByte-1));
-				tempBitIndexInByte = 1;
-				if(currentIndex >= bitsPerPosition) //add number to bitArray
-				{
-					///ADDNUMBERTOBITARRAY
-					lastTempNumber = tempNumber;
-					if(counter > length)
-					{
-						gzclose(compressed_filep);
-						if(buffer)
-							free(buffer);
-						if(currentByte)
-							free(currentByte);
-						return 0;
-					}
-					else
-					{
-						while(counter < tempNumber)
-						{
-							bitValue = counter % 8;
-							if(bitValue ==0)
-							{
-								(*bitArray) = 0;
-							}
-							(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-							counter++;
-						}
-						if(counter == tempNumber)
-						{
-							bitValue = counter % 8;
-							if(bitValue ==0)
-							{
-								(*bitArray) = 0;
-							}
-							counter++;
-						}
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-
-						currentIndex = 0;
-						tempNumber = 0;
-					}
-					//ENDADDNUMBERTOBITARRAY
+		return 1;
+	}
+	levelfileScan(array, startIndex, endIndex - startIndex, &stats);
+	minHashValue = startIndex + stats.first;
+	maxHashValue = startIndex + stats.last;
+	range = maxHashValue - minHashValue + 1;
+	numBlocks = (range + LEVELFILE_BLOCK_POSITIONS - 1) / LEVELFILE_BLOCK_POSITIONS;
+
+	file = gzopen(compressed_filename, "wbT");
+	if(!file)
+	{
+		printf("Couldn't open level file %s\n", compressed_filename);
+		return 1;
+	}
+	status |= writeHeader(file, minHashValue, maxHashValue, 0, LEVELFILE_INDEXED);
 
-				}
-			}
-		}
-		else if((currentIndex + 8) < bitsPerPosition) //if using whole Byte
+	bitmap = (BYTE *) SafeMalloc(LEVELFILE_BLOCK_POSITIONS / BITSINBYTE);
+	raw = (BYTE *) SafeMalloc(rawCapacity);
+	compressed = (BYTE *) SafeMalloc(compressedCapacity);
+	table = (BYTE *) SafeMalloc((numBlocks + 1) * 2 * sizeof(UINT64) + 3 * sizeof(UINT64));
+	for (b = 0; b <= numBlocks && status == 0; b++)
+	{
+		offset = gztell(file);
+		levelfilePut64(table + 16 * b, offset);
+		levelfilePut64(table + 16 * b + 8, ones);
+		if (b == numBlocks)
+			break;
+
+		first = b * LEVELFILE_BLOCK_POSITIONS;
+		numPositions = (range - first < LEVELFILE_BLOCK_POSITIONS) ? range - first : LEVELFILE_BLOCK_POSITIONS;
+		levelfileCopyBits(array, stats.first + first, numPositions, bitmap);
+		count = levelfileCountBits(bitmap, 0, numPositions - 1);
+		ones += count;
+		if (2 * count < numPositions / BITSINBYTE)
+			kind = LEVELFILE_BLOCK_ONES;
+		else if (2 * (numPositions - count) < numPositions / BITSINBYTE)
+			kind = LEVELFILE_BLOCK_ZEROS;
+		else
+			kind = LEVELFILE_BLOCK_BITMAP;
+		raw[0] = kind;
+		count = 1;
+		if (kind == LEVELFILE_BLOCK_BITMAP)
 		{
-//			printf("case2\n");
-			status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-			if(*buffer == 0x0C)
-				endSectionCounter = 1;
-			else
-			{
-				if(endSectionCounter == 1 && (*buffer) == 0x0A)
-				{
-					///ADDNUMBERTOBITARRAY
-					lastTempNumber = tempNumber;
-					if(counter > length)
-					{
-						gzclose(compressed_filep);
-						if(buffer)
-							free(buffer);
-						if(currentByte)
-							free(currentByte);
-						return 0;
-					}
-					else
-					{
-						while(counter <= length)
-						{
-							bitValue = counter % 8;
-							if(bitValue ==0)
-							{
-								(*bitArray) = 0;
-							}
-							(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-							counter++;
-						}
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-					}
-					//ENDADDNUMBERTOBITARRAY
-				}
-				endSectionCounter = 0;
-			}
-			index++;
-			tempNumber += ((*buffer) << (bitsPerPosition - currentIndex));
-			tempBitIndexInByte = 1;
-			currentIndex += 8;
-			if(currentIndex >= bitsPerPosition) //add number to bitArray
-			{
-				///ADDNUMBERTOBITARRAY
-				lastTempNumber = tempNumber;
-				if(counter > length)
-				{
-					gzclose(compressed_filep);
-					if(buffer)
-						free(buffer);
-					if(currentByte)
-						free(currentByte);
-					return 0;
-				}
-				else
-				{
-					while(counter < tempNumber)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-						counter++;
-					}
-					if(counter == tempNumber)
-					{
-
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-						counter++;
-					}
-					if(bitValue == 7)
-					{
-						bitArray++;
-					}
-				}
-				//ENDADDNUMBERTOBITARRAY
-				currentIndex = 0;
-				tempNumber = 0;
-			}
+			memcpy(raw + 1, bitmap, (numPositions + BITSINBYTE - 1) / BITSINBYTE);
+			count += (numPositions + BITSINBYTE - 1) / BITSINBYTE;
 		}
-		else // getting new byte but only using some of it
+		else
 		{
-//			printf("case3\n");
-			status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-			if(*buffer == 0x0C)
+			for (i = 0; i < numPositions; i++)
 			{
-				printf("ksljfd?");
-				endSectionCounter = 1;
-			}
-			else
-			{
-				if(endSectionCounter == 1 && (*buffer) != 0x0A)
-				{
-
-					if(counter > length)
-					{
-						gzclose(compressed_filep);
-						if(buffer)
-							free(buffer);
-						if(currentByte)
-							free(currentByte);
-						return 0;
-					}
-					else
-					{
-						lastTempNumber = tempNumber;
-//						printf("tempnumber %d", tempNumber);
-						while(counter <= length)
-						{
-							bitValue = counter % 8;
-							if(bitValue ==0)
-							{
-								(*bitArray) = 0;
-							}
-							(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-							printf(" conter bitvalue, bitarray %d, %d, %d", counter, bitValue, *bitArray);
-							counter++;
-							if(bitValue == 7)
-							{
-								bitArray++;
-							}
-						}
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-						endSectionCounter = 0;
-					}
-				}
-				else
-				{
-					while(counter <= length)
-					{
-						bitValue = counter % 8;
-						if(bitValue ==0)
-						{
-							(*bitArray) = 0;
-						}
-//						printf("count %d", counter);
-						(*bitArray) = (*bitArray) | (1 << (7-bitValue));
-						counter++;
-						if(bitValue == 7)
-						{
-							bitArray++;
-						}
-					}
-				}
+				if (getBitValue(bitmap[i / BITSINBYTE], i % BITSINBYTE) != (kind == LEVELFILE_BLOCK_ONES))
+					continue;
+				raw[count++] = (BYTE) i;
+				raw[count++] = (BYTE) (i >> BITSINBYTE);
 			}
-
-			//ENDADDNUMBERTOBITARRAY
-			//printf("bitInByte %d  CurrentIndex %d \n", tempBitIndexInByte, currentIndex);
 		}
+		compressedSize = compressedCapacity;
+		if (compress2(compressed, &compressedSize, raw, count, Z_DEFAULT_COMPRESSION) != Z_OK)
+			status = 1;
+		else
+			status |= bitlib_file_write_bytes(file, compressed, compressedSize) != STATUS_SUCCESS;
 	}
-
-	// read bits and form number until bits per postition, then increment index
-
-	gzclose(compressed_filep);
-
-	if(buffer)
-		free(buffer);
-
-	if(currentByte)
-		free(currentByte);
-
-	return 0;
+	tableOffset = gztell(file);
+	levelfilePut64(table + 16 * (numBlocks + 1), LEVELFILE_BLOCK_POSITIONS);
+	levelfilePut64(table + 16 * (numBlocks + 1) + 8, numBlocks);
+	levelfilePut64(table + 16 * (numBlocks + 1) + 16, tableOffset);
+	if (status == 0)
+		status |= bitlib_file_write_bytes(file, table, 16 * (numBlocks + 1) + 24) != STATUS_SUCCESS;
+	status |= bitlib_file_write_bytes(file, (BYTE *) "\x0C\n1", 3) != STATUS_SUCCESS;
+	status |= (gzclose(file) != Z_OK);
+	SafeFree(table);
+	SafeFree(compressed);
+	SafeFree(raw);
+	SafeFree(bitmap);
+	return status ? 1 : 0;
 }
 
 /****************************************************************************
 * Description
-*      readLevelFileType3 takes a pointer to a bitarray and a compressed file
-*      and creates a bitarray starting at the files minHashValue until
-*      its maxHashValue (0=not valid, 1 = valid
+*      OpenLevelFileIndex reads the header and block table of an indexed
+*      level file. The handle caches one decoded block and must not be
+*      shared between threads.
 * Arguments
 *      char* compressed_filename
-*      BITARRAY *array
-*      int length   (maxHashValue-minHashValue)
 * Return Values
-*      UINT8 status
+*      the index, or NULL if the file is not a valid indexed level file
 ****************************************************************************/
-int readLevelFileType3(char* compressed_filename, BITARRAY *array, int length)
+LEVELFILE_INDEX *OpenLevelFileIndex(char* compressed_filename)
 {
-	int index=0;
-	BYTE* buffer = (BYTE*)malloc(sizeof(BYTE));
-	int status = STATUS_SUCCESS;
-	compressed_filep = gzopen(compressed_filename, "rb");
-	int endSectionCounter = 0;
+	LEVELFILE_INDEX *index;
+	BYTE head[LEVELFILE_HEADER_MAX], tail[3 * sizeof(UINT64) + 3], *table;
+	UINT64 fileSize, tableOffset, tableSize, b;
+	ssize_t headSize;
+	int fd, type;
+	struct stat info;
+
+	fd = open(compressed_filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	index = (LEVELFILE_INDEX *) SafeMalloc(sizeof(LEVELFILE_INDEX));
+	memset(index, 0, sizeof(LEVELFILE_INDEX));
+	index->fd = fd;
+	index->filename = (char *) SafeMalloc(strlen(compressed_filename) + 1);
+	strcpy(index->filename, compressed_filename);
+
+	headSize = pread(fd, head, sizeof(head), 0);
+	if (fstat(fd, &info) != 0 || headSize <= 0 ||
+	    levelfileParseHeader(head, headSize, &type, &index->minHashValue, &index->maxHashValue) == NULL ||
+	    type != LEVELFILE_INDEXED)
+		goto fail;
+	fileSize = info.st_size;
+	if (fileSize < sizeof(tail) ||
+	    pread(fd, tail, sizeof(tail), fileSize - sizeof(tail)) != (ssize_t) sizeof(tail) ||
+	    tail[sizeof(tail) - 3] != 0x0C || tail[sizeof(tail) - 2] != 0x0A || tail[sizeof(tail) - 1] != '1')
+		goto fail;
+	index->blockPositions = levelfileGet64(tail);
+	index->numBlocks = levelfileGet64(tail + 8);
+	tableOffset = levelfileGet64(tail + 16);
+	tableSize = 16 * (index->numBlocks + 1);
+	if (index->blockPositions == 0 || index->blockPositions % BITSINBYTE != 0 ||
+	    index->blockPositions > (1 << 16) || tableOffset + tableSize + sizeof(tail) != fileSize ||
+	    index->numBlocks != (index->maxHashValue - index->minHashValue) / index->blockPositions + 1)
+		goto fail;
+
+	table = (BYTE *) SafeMalloc(tableSize);
+	if (pread(fd, table, tableSize, tableOffset) != (ssize_t) tableSize)
+	{
+		SafeFree(table);
+		goto fail;
+	}
+	index->offsets = (UINT64 *) SafeMalloc((index->numBlocks + 1) * sizeof(UINT64));
+	index->onesBefore = (UINT64 *) SafeMalloc((index->numBlocks + 1) * sizeof(UINT64));
+	for (b = 0; b <= index->numBlocks; b++)
+	{
+		index->offsets[b] = levelfileGet64(table + 16 * b);
+		index->onesBefore[b] = levelfileGet64(table + 16 * b + 8);
+	}
+	SafeFree(table);
+	index->cachedBlock = index->numBlocks;
+	index->cache = (BYTE *) SafeMalloc(index->blockPositions / BITSINBYTE);
+	index->raw = (BYTE *) SafeMalloc(1 + index->blockPositions / BITSINBYTE);
+	index->compressed = (BYTE *) SafeMalloc(compressBound(1 + index->blockPositions / BITSINBYTE));
+	return index;
+
+fail:
+	close(fd);
+	SafeFree(index->filename);
+	SafeFree(index);
+	return NULL;
+}
 
-	//skips header section which has one 0xC (at end of header) and all other ASCII chars
-	while(status == STATUS_SUCCESS && endSectionCounter < 2)
+void CloseLevelFileIndex(LEVELFILE_INDEX *index)
+{
+	if (index == NULL)
+		return;
+	close(index->fd);
+	SafeFree(index->filename);
+	if (index->offsets != NULL)
 	{
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-		if(*buffer == 0x0C)
-		{
-			endSectionCounter++;
-		}
+		SafeFree(index->offsets);
+		SafeFree(index->onesBefore);
+		SafeFree(index->cache);
+		SafeFree(index->raw);
+		SafeFree(index->compressed);
 	}
-	status = bitlib_file_read_bytes(compressed_filep, buffer, 1); //newline
-	//copies data into the bitarray
-	while(status == STATUS_SUCCESS && index <= length)
+	SafeFree(index);
+}
+
+/****************************************************************************
+* Description
+*      LevelFileIndexContains tells whether position is reachable,
+*      inflating at most one block. If that block can't be read the
+*      program ends with an error rather than answering FALSE.
+****************************************************************************/
+BOOLEAN LevelFileIndexContains(LEVELFILE_INDEX *index, POSITION position)
+{
+	UINT64 offset;
+	BYTE *bitmap;
+
+	if (position < index->minHashValue || position > index->maxHashValue)
+		return FALSE;
+	offset = position - index->minHashValue;
+	bitmap = levelfileCachedBlock(index, offset / index->blockPositions);
+	offset %= index->blockPositions;
+	return getBitValue(bitmap[offset / BITSINBYTE], offset % BITSINBYTE);
+}
+
+/****************************************************************************
+* Description
+*      LevelFileIndexCount returns how many positions in [first, last] are
+*      reachable, inflating at most the two blocks at the ends of the range.
+*      Like LevelFileIndexContains, it ends the program if one can't be read.
+****************************************************************************/
+UINT64 LevelFileIndexCount(LEVELFILE_INDEX *index, POSITION first, POSITION last)
+{
+	UINT64 firstBlock, lastBlock, count;
+	BYTE *bitmap;
+
+	if (first < index->minHashValue)
+		first = index->minHashValue;
+	if (last > index->maxHashValue)
+		last = index->maxHashValue;
+	if (first > last)
+		return 0;
+	first -= index->minHashValue;
+	last -= index->minHashValue;
+	firstBlock = first / index->blockPositions;
+	lastBlock = last / index->blockPositions;
+
+	bitmap = levelfileCachedBlock(index, firstBlock);
+	if (firstBlock == lastBlock)
+		return levelfileCountBits(bitmap, first % index->blockPositions, last % index->blockPositions);
+	count = levelfileCountBits(bitmap, first % index->blockPositions, index->blockPositions - 1);
+	count += index->onesBefore[lastBlock] - index->onesBefore[firstBlock + 1];
+	bitmap = levelfileCachedBlock(index, lastBlock);
+	return count + levelfileCountBits(bitmap, 0, last % index->blockPositions);
+}
+
+typedef struct {
+	LEVELFILE_INDEX *index;
+	BITARRAY *array;
+	UINT64 length;
+	UINT64 firstBlock, lastBlock;
+	int status;
+} LEVELFILE_BLOCKS;
+
+/* Decodes a run of blocks straight into the caller's array. Blocks hold a
+** multiple of eight positions, so no two runs share an output byte. */
+static void levelfileDecodeBlocks(void *arg)
+{
+	LEVELFILE_BLOCKS *run = (LEVELFILE_BLOCKS *) arg;
+	LEVELFILE_INDEX *index = run->index;
+	UINT64 blockBytes = index->blockPositions / BITSINBYTE, b, numBytes, copy;
+	UINT64 range = index->maxHashValue - index->minHashValue + 1;
+	BYTE *bitmap = (BYTE *) SafeMalloc(blockBytes);
+	BYTE *raw = (BYTE *) SafeMalloc(1 + blockBytes);
+	BYTE *compressed = (BYTE *) SafeMalloc(compressBound(1 + blockBytes));
+
+	numBytes = (run->length + BITSINBYTE - 1) / BITSINBYTE;
+	for (b = run->firstBlock; b < run->lastBlock && run->status == 0; b++)
 	{
-		status = bitlib_file_read_bytes(compressed_filep, buffer, 1);
-		*array = *buffer;
-		index += 8;
-		array++;
+		if (b * blockBytes >= numBytes)
+			break;
+		copy = (range - b * index->blockPositions + BITSINBYTE - 1) / BITSINBYTE;
+		if (copy > blockBytes)
+			copy = blockBytes;
+		if (copy > numBytes - b * blockBytes)
+			copy = numBytes - b * blockBytes;
+		if (levelfileLoadBlock(index, b, bitmap, compressed, raw) != 0)
+			run->status = 1;
+		else
+			memcpy(run->array + b * blockBytes, bitmap, copy);
 	}
+	SafeFree(compressed);
+	SafeFree(raw);
+	SafeFree(bitmap);
+}
 
-	gzclose(compressed_filep);
-	if(buffer)
-		free(buffer);
-	return 0;
+/* ReadLevelFile for indexed level files: the blocks are independent, so
+** large files are inflated on the thread pool. */
+static int levelfileReadIndexed(char* compressed_filename, BITARRAY *array, POSITION length)
+{
+	LEVELFILE_INDEX *index = OpenLevelFileIndex(compressed_filename);
+	LEVELFILE_BLOCKS *runs;
+	THREADPOOL *pool = NULL;
+	UINT64 numBytes = (length + BITSINBYTE - 1) / BITSINBYTE;
+	int numThreads = 1, numRuns = 1, r, status = 0;
+
+	if (index == NULL)
+		return 1;
+	memset(array, 0, numBytes);
+	if (length >= gLevelFileParallelMin)
+		numThreads = DefaultNumberOfThreads();
+	if (numThreads > 1)
+	{
+		numRuns = numThreads * LEVELFILE_CHUNKS_PER_THREAD;
+		pool = ThreadPoolCreate(numThreads);
+	}
+	runs = (LEVELFILE_BLOCKS *) SafeMalloc(numRuns * sizeof(LEVELFILE_BLOCKS));
+	for (r = 0; r < numRuns; r++)
+	{
+		runs[r].index = index;
+		runs[r].array = array;
+		runs[r].length = length;
+		runs[r].firstBlock = index->numBlocks * r / numRuns;
+		runs[r].lastBlock = index->numBlocks * (r + 1) / numRuns;
+		runs[r].status = 0;
+		if (pool != NULL)
+			ThreadPoolSubmit(pool, levelfileDecodeBlocks, &runs[r]);
+		else
+			levelfileDecodeBlocks(&runs[r]);
+	}
+	ThreadPoolDestroy(pool);
+	for (r = 0; r < numRuns; r++)
+		status |= runs[r].status;
+	if (length % BITSINBYTE != 0 && numBytes > 0)
+		array[numBytes - 1] &= (BYTE) (0xFF << (BITSINBYTE - length % BITSINBYTE));
+	SafeFree(runs);
+	CloseLevelFileIndex(index);
+	return status;
 }
 
 /****************************************************************************
@@ -1731,7 +1695,6 @@ UINT64 findMaxValueFromArray(BITARRAY* array, UINT64 length)
 		}
 		array++;
 	}
-	printf("!!!!!!!!!!!!!!!! max %llu", lastVal);
 	return lastVal;
 }
 
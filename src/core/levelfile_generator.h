@@ -43,32 +43,60 @@
 #define BITSINPOS 64
 #define NUMOFTYPES 4
 #define LENGTHOFEXT 7 //.dat.gz
-// gcc levelfile_generator.c levelfile_generator.h bpdb_bitlib.h bpdb_bitlib.c levelfile_test.c -lZ
+// gcc -std=gnu99 -I.. -I/usr/include/tcl8.6 -Wl,--allow-multiple-definition levelfile_test.c ../m1210.o
+//     ../gamesman.a ../gamesdb.a ../libUWAPI_boardstrings.a -lz -lgmp -ltcl8.6 -lpthread -lm
 // hexedit to view binary characters
 typedef unsigned char BITARRAY;
 
+#define LEVELFILE_INDEXED 4 // type of the block-indexed level files
+
+/* Smallest level file ReadLevelFile splits across the thread pool;
+   levelfile_test lowers it to reach the chunked reader. */
+extern POSITION gLevelFileParallelMin;
+
+/* An open indexed level file; see WriteIndexedLevelFile */
+typedef struct {
+	int fd;
+	char *filename;         // for the error that ends the program if a block can't be read
+	UINT64 minHashValue;
+	UINT64 maxHashValue;
+	UINT64 blockPositions;
+	UINT64 numBlocks;
+	UINT64 *offsets;        // file offset of every block, plus the end of the last one
+	UINT64 *onesBefore;     // reachable positions in the blocks before each block
+	UINT64 cachedBlock;     // block held in cache, numBlocks if none
+	BYTE *cache;
+	BYTE *raw;
+	BYTE *compressed;
+} LEVELFILE_INDEX;
+
 
 int WriteLevelFile(char* compressed_filename, BITARRAY *array, POSITION minHashValue, POSITION maxHashValue);
 int writeHeader(gzFile file, UINT64 minHashValue, UINT64 maxHashValue, UINT64 lastZero, int type);
-int ArrayToType0Write(BITARRAY *array, UINT64 minHashValue, UINT64 maxHashValue);
-int ArrayToType1Write(BITARRAY *array, UINT64 startIndex, UINT64 maxHashValue, UINT64 bitsPerPosition, UINT64 offset);
-int ArrayToType2Write(BITARRAY *array, UINT64 startIndex, UINT64 maxHashValue, UINT64 bitsPerPosition, UINT64 offset);
-int ArrayToType3Write(BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue);
+int ArrayToType0Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue);
+int ArrayToType1Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue, UINT64 bitsPerPosition);
+int ArrayToType2Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue, UINT64 bitsPerPosition);
+int ArrayToType3Write(gzFile file, BITARRAY *array, UINT64 startIndex, UINT64 minHashValue, UINT64 maxHashValue);
+
+int WriteIndexedLevelFile(char* compressed_filename, BITARRAY *array, POSITION startIndex, POSITION endIndex);
 
-int ReadLevelFile(char* compressed_filename, BITARRAY *array, int length);
+int ReadLevelFile(char* compressed_filename, BITARRAY *array, POSITION length);
+LEVELFILE_INDEX* OpenLevelFileIndex(char* compressed_filename);
+BOOLEAN LevelFileIndexContains(LEVELFILE_INDEX *index, POSITION position);
+UINT64 LevelFileIndexCount(LEVELFILE_INDEX *index, POSITION first, POSITION last);
+void CloseLevelFileIndex(LEVELFILE_INDEX *index);
 int getLevelFileType(char* compressed_filename);
 UINT64 getLevelFileMinHashValue(char* compressed_filename);
 UINT64 getLevelFileMaxHashValue(char* compressed_filename);
 UINT64 getLevelFileBitsPerPosition(char* compressed_filename);
 int isValidLevelFile(char* compressed_filename);
-int readLevelFileType0(char* compressed_filename, BITARRAY *array, int length);
-int readLevelFileType1(char* compressed_filename, BITARRAY *bitArray, int length);
-int readLevelFileType2(char* compressed_filename, BITARRAY *bitArray, int length);
-int readLevelFileType3(char* compressed_filename, BITARRAY *array, int length);
+int readLevelFileType0(char* compressed_filename, BITARRAY *array, POSITION length);
+int readLevelFileType1(char* compressed_filename, BITARRAY *array, POSITION length);
+int readLevelFileType2(char* compressed_filename, BITARRAY *array, POSITION length);
+int readLevelFileType3(char* compressed_filename, BITARRAY *array, POSITION length);
 UINT8 getBitValue(BYTE currentByte, UINT8 bitnum);
 UINT64 findMinValueFromArray(BITARRAY* array, UINT64 length);
 UINT64 findMaxValueFromArray(BITARRAY* array, UINT64 length);
 UINT64 findLastZero(BITARRAY* array, UINT64 length);
-int positionToByteArray(BITARRAY* buffer, UINT64 value, BYTE bufferPrev);
 int getLastZero(char* compressed_filename);
 #endif /* GMCORE_LEVELFILEGENERATOR_H */
@@ -30,157 +30,332 @@
 **
 **************************************************************************/
 #include "levelfile_generator.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Reads compressedFileName back with ReadLevelFile and checks that it holds
+** exactly the reachable positions of array, positions startIndex ..
+** endIndex-1. Returns the number of mismatches, counting an invalid file
+** as one. */
+int CheckLevelFile(char* compressedFileName, BITARRAY* array, POSITION startIndex, POSITION endIndex)
+{
+	int type = getLevelFileType(compressedFileName);
+	UINT64 minHashValue = getLevelFileMinHashValue(compressedFileName);
+	UINT64 maxHashValue = getLevelFileMaxHashValue(compressedFileName);
+	UINT64 bitsPerPosition = getLevelFileBitsPerPosition(compressedFileName);
+	UINT64 length = maxHashValue - minHashValue + 1;
+	BITARRAY* answer = (BITARRAY*) malloc(sizeof(BITARRAY) * (length / BITSINBYTE + 1));
+	POSITION position;
+	BOOLEAN expected, actual;
+	int errors = isValidLevelFile(compressedFileName);
+
+	printf("\n%s: type %d min value %llu max value %llu bpp %llu%s\n", compressedFileName, type,
+	       (unsigned long long) minHashValue, (unsigned long long) maxHashValue, (unsigned long long) bitsPerPosition,
+	       errors ? " not valid" : "");
+	if (ReadLevelFile(compressedFileName, answer, length) != 0)
+	{
+		printf("%s: read failed\n", compressedFileName);
+		free(answer);
+		return 1;
+	}
+	for (position = startIndex; position < endIndex; position++)
+	{
+		expected = getBitValue(array[(position - startIndex) / BITSINBYTE], (position - startIndex) % BITSINBYTE);
+		actual = FALSE;
+		if (position >= minHashValue && position <= maxHashValue)
+			actual = getBitValue(answer[(position - minHashValue) / BITSINBYTE], (position - minHashValue) % BITSINBYTE);
+		if (expected != actual)
+		{
+			printf("%s: position %llu is %d, should be %d\n", compressedFileName, (unsigned long long) position, actual, expected);
+			errors++;
+		}
+	}
+	free(answer);
+	return errors;
+}
+
+/* Checks LevelFileIndexContains and LevelFileIndexCount on an indexed
+** level file against a full decode of it with ReadLevelFile, at numQueries
+** random positions and ranges. Returns the number of mismatches. */
+int CheckLevelFileIndex(char* compressedFileName, int numQueries)
+{
+	UINT64 minHashValue = getLevelFileMinHashValue(compressedFileName);
+	UINT64 maxHashValue = getLevelFileMaxHashValue(compressedFileName);
+	UINT64 length = maxHashValue - minHashValue + 1;
+	BITARRAY* answer = (BITARRAY*) malloc(sizeof(BITARRAY) * (length / BITSINBYTE + 1));
+	UINT64* onesBefore = (UINT64*) malloc(sizeof(UINT64) * (length + 1));
+	LEVELFILE_INDEX* index = OpenLevelFileIndex(compressedFileName);
+	POSITION position, first, last, offset;
+	BOOLEAN expected;
+	UINT64 count;
+	int q, errors = 0;
+
+	if (index == NULL || ReadLevelFile(compressedFileName, answer, length) != 0)
+	{
+		printf("%s: could not open the index\n", compressedFileName);
+		free(answer);
+		free(onesBefore);
+		return 1;
+	}
+	onesBefore[0] = 0;
+	for (offset = 0; offset < length; offset++)
+		onesBefore[offset + 1] = onesBefore[offset] + getBitValue(answer[offset / BITSINBYTE], offset % BITSINBYTE);
+
+	for (q = 0; q < numQueries; q++)
+	{
+		//a few positions on either side of the file as well
+		position = minHashValue + (UINT64) random() % (length + 200) - 100;
+		expected = FALSE;
+		if (position >= minHashValue && position <= maxHashValue)
+			expected = getBitValue(answer[(position - minHashValue) / BITSINBYTE], (position - minHashValue) % BITSINBYTE);
+		if (LevelFileIndexContains(index, position) != expected)
+		{
+			printf("%s: contains %llu should be %d\n", compressedFileName, (unsigned long long) position, expected);
+			errors++;
+		}
+
+		first = minHashValue + (UINT64) random() % (length + 200) - 100;
+		last = first + (UINT64) random() % (q % 2 ? length : 1000);
+		count = 0;
+		if (first <= maxHashValue && last >= minHashValue)
+			count = onesBefore[(last > maxHashValue ? maxHashValue : last) - minHashValue + 1] -
+			        onesBefore[(first < minHashValue ? minHashValue : first) - minHashValue];
+		if (LevelFileIndexCount(index, first, last) != count)
+		{
+			printf("%s: count %llu..%llu should be %llu\n", compressedFileName,
+			       (unsigned long long) first, (unsigned long long) last, (unsigned long long) count);
+			errors++;
+		}
+	}
+	if (LevelFileIndexCount(index, minHashValue, maxHashValue) != onesBefore[length])
+	{
+		printf("%s: count of the whole file should be %llu\n", compressedFileName, (unsigned long long) onesBefore[length]);
+		errors++;
+	}
+	CloseLevelFileIndex(index);
+	free(answer);
+	free(onesBefore);
+	return errors;
+}
+
+/* Copies the indexed level file compressedFileName to corruptFileName with
+** block b damaged, and checks that a query into that block ends the program
+** with an error instead of answering. Returns the number of failures. */
+int CheckCorruptLevelFileIndex(char* compressedFileName, char* corruptFileName, UINT64 b)
+{
+	LEVELFILE_INDEX* index = OpenLevelFileIndex(compressedFileName);
+	POSITION position;
+	BYTE* contents;
+	FILE* file;
+	long size;
+	int status;
+	pid_t pid;
+
+	if (index == NULL || b >= index->numBlocks || (file = fopen(compressedFileName, "rb")) == NULL)
+	{
+		printf("%s: could not open the index\n", compressedFileName);
+		CloseLevelFileIndex(index);
+		return 1;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+	contents = (BYTE*) malloc(size);
+	status = (fread(contents, 1, size, file) != (size_t) size);
+	fclose(file);
+	//four bytes in the middle of the block's deflate stream
+	contents[(index->offsets[b] + index->offsets[b + 1]) / 2] ^= 0xFF;
+	contents[(index->offsets[b] + index->offsets[b + 1]) / 2 + 1] ^= 0xFF;
+	contents[(index->offsets[b] + index->offsets[b + 1]) / 2 + 2] ^= 0xFF;
+	contents[(index->offsets[b] + index->offsets[b + 1]) / 2 + 3] ^= 0xFF;
+	position = index->minHashValue + b * index->blockPositions;
+	CloseLevelFileIndex(index);
+	if (status != 0 || (file = fopen(corruptFileName, "wb")) == NULL ||
+	    fwrite(contents, 1, size, file) != (size_t) size || fclose(file) != 0)
+	{
+		printf("%s: write failed\n", corruptFileName);
+		free(contents);
+		return 1;
+	}
+	free(contents);
+
+	fflush(stdout);
+	if ((pid = fork()) == 0)
+	{
+		index = OpenLevelFileIndex(corruptFileName);
+		if (index == NULL)
+			_exit(2);
+		//an answer either way means the damage went unnoticed
+		LevelFileIndexContains(index, position);
+		_exit(0);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 1)
+	{
+		printf("%s: a query into damaged block %llu did not end with an error\n", corruptFileName, (unsigned long long) b);
+		return 1;
+	}
+	return 0;
+}
+
+/* WriteLevelFile never picks type 0 for a large array, so this writes one
+** directly with the type-0 encoder. Returns 0 for success. */
+int WriteType0LevelFile(char* compressedFileName, BITARRAY* array, POSITION startIndex, POSITION endIndex)
+{
+	POSITION offset, minHashValue = endIndex, maxHashValue = startIndex;
+	gzFile file;
+	int status;
+
+	for (offset = 0; offset < endIndex - startIndex; offset++)
+	{
+		if (getBitValue(array[offset / BITSINBYTE], offset % BITSINBYTE))
+		{
+			if (minHashValue == endIndex)
+				minHashValue = startIndex + offset;
+			maxHashValue = startIndex + offset;
+		}
+	}
+	if ((file = gzopen(compressedFileName, "wb")) == NULL)
+		return 1;
+	status = writeHeader(file, minHashValue, maxHashValue, 0, 0);
+	status |= ArrayToType0Write(file, array, startIndex, minHashValue, maxHashValue);
+	status |= (bitlib_file_write_bytes(file, (BYTE *) "1", 1) != STATUS_SUCCESS);
+	status |= (gzclose(file) != Z_OK);
+	return status ? 1 : 0;
+}
 
 int main(int argc, char **argv)
 {
 	//File stuff
 	char compressedFileName[80] = "./test/game_opt_tier.dat.gz";
-	char compressedFileName0[80] = "./test/game_opt_tier_0.dat.gz";
-	char compressedFileName1[80] = "./test/game_opt_tier_1.dat.gz";
-	char compressedFileName2[80] = "./test/game_opt_tier_2.dat.gz";
-	char compressedFileName3[80] = "./test/game_opt_tier_3.dat.gz";
-
-	char textFileName0[80]="./test/game_opt_tier_0.txt";
-	char textFileName1[80]="./test/game_opt_tier_1.txt";
-	char textFileName2[80]="./test/game_opt_tier_2.txt";
-	char textFileName3[80]="./test/game_opt_tier_3.txt";
-	gzFile* compressed_fp;
-	FILE* text_fp;
-////TO CREATE A FILENAME
-//     char game[10] = sprintf("%s",gameName);
-//	char opt[4] = sprintf("%d",optName);
-//	char tier[6] = sprintf("%d",tierName);
-//     fileName = game + "_" + opt + "_" + tier + ".dat.gz";
-//// END TO CREATE A FILENAME
-//File input
-	BITARRAY* compressedValues = (BITARRAY*) malloc(sizeof(BITARRAY)*2);
-	BITARRAY* buffer = (BITARRAY*)malloc(sizeof(BITARRAY)*1);
-	POSITION startIndex, endIndex;
-	GMSTATUS status = 0;
-
-	//file read
-	int numRead = 0;
-
-	//array values
-	*compressedValues = 0x4F;              //0100 1111   ->11 , 14, 15, 16, 17
-	*(compressedValues+1)  = 0x00;         //0000 0000 -> 21 22 24 25
-	startIndex = 10;
-	endIndex = 30;
-// Write all Types
-	status = WriteLevelFile(compressedFileName, compressedValues, startIndex, endIndex);
-	printf("Compressed All\n\n");
-// Type 0 Text
-	compressed_fp = gzopen(compressedFileName0, "rb");
-	text_fp = fopen(textFileName0, "wb");
-
-	//read from compressed file and write to text file
-	while ((numRead = gzread(compressed_fp, buffer, sizeof(buffer))) > 0)
-	{
-//        printf("write");
-		fwrite(buffer, 1, numRead, text_fp);
-	}
-	gzclose(compressed_fp);
-	fclose(text_fp);
-	printf("0: Decompressed\n");
-
-// Type 0 Read
-	int type = getLevelFileType(compressedFileName0);
-	int minHashValue = getLevelFileMinHashValue(compressedFileName0);
-	int maxHashValue = getLevelFileMaxHashValue(compressedFileName0);
-	int bitsPerPosition = getLevelFileBitsPerPosition(compressedFileName0);
-	printf("0: This is type %d and min value %d max value %d  bpp %d\n", type, minHashValue, maxHashValue, bitsPerPosition);
-	BITARRAY* answer = (BYTE *) malloc(sizeof(BYTE) * (ceil((maxHashValue - minHashValue) / 8)+1));
-	printf("0: Beginning Read\n");
-	ReadLevelFile(compressedFileName0, answer, maxHashValue-minHashValue);
-	printf("0: Read\n0: The bit string is : \t");
-	bitlib_print_bytes_in_bits(answer, ceil((maxHashValue - minHashValue) / 8)+1);
-	printf("0: Printed\n\n");
-
-// Type 1 Text
-	compressed_fp = gzopen(compressedFileName1, "rb");
-	text_fp = fopen(textFileName1, "wb");
-
-	//read from compressed file and write to text file
-	while ((numRead = gzread(compressed_fp, buffer, sizeof(buffer))) > 0)
-	{
-//        printf("write");
-		fwrite(buffer, 1, numRead, text_fp);
-	}
-	gzclose(compressed_fp);
-	fclose(text_fp);
-	printf("1: Decompressed\n");
-
-// Type 1 Read
-	type = getLevelFileType(compressedFileName1);
-	minHashValue = getLevelFileMinHashValue(compressedFileName1);
-	maxHashValue = getLevelFileMaxHashValue(compressedFileName1);
-	bitsPerPosition = getLevelFileBitsPerPosition(compressedFileName1);
-	printf("1: This is type %d and min value %d max value %d  bpp %d\n", type, minHashValue, maxHashValue, bitsPerPosition);
-	answer = (BYTE *) malloc(sizeof(BYTE) * (ceil((maxHashValue - minHashValue) / 8)+1));
-
-	ReadLevelFile(compressedFileName1, answer, maxHashValue-minHashValue);
-	printf("1: Read\n1: The bit string is : \t");
-	bitlib_print_bytes_in_bits(answer, ceil((maxHashValue - minHashValue) / 8)+1);
-	printf("1: Printed\n\n");
-
-// Type 2 Text
-	compressed_fp = gzopen(compressedFileName2, "rb");
-	text_fp = fopen(textFileName2, "wb");
-
-	//read from compressed file and write to text file
-	while ((numRead = gzread(compressed_fp, buffer, sizeof(buffer))) > 0)
-	{
-//        printf("write");
-		fwrite(buffer, 1, numRead, text_fp);
-	}
-	gzclose(compressed_fp);
-	fclose(text_fp);
-	printf("2: Decompressed\n");
-
-// Type 2 Read
-	type = getLevelFileType(compressedFileName2);
-	minHashValue = getLevelFileMinHashValue(compressedFileName2);
-	maxHashValue = getLevelFileMaxHashValue(compressedFileName2);
-	bitsPerPosition = getLevelFileBitsPerPosition(compressedFileName2);
-	printf("2: This is type %d and min value %d max value %d  bpp %d\n", type, minHashValue, maxHashValue, bitsPerPosition);
-	answer = (BYTE *) malloc(sizeof(BYTE) * (ceil((maxHashValue - minHashValue) / 8)+1));
-
-	ReadLevelFile(compressedFileName2, answer, maxHashValue-minHashValue);
-	printf("2: Read\n2: The bit string is : \t");
-	bitlib_print_bytes_in_bits(answer, ceil((maxHashValue - minHashValue) / 8)+1);
-	printf("2: Printed\n\n");
-
-// Type 3 Text
-	compressed_fp = gzopen(compressedFileName3, "rb");
-	text_fp = fopen(textFileName3, "wb");
-
-	//read from compressed file and write to text file
-	while ((numRead = gzread(compressed_fp, buffer, sizeof(buffer))) > 0)
-	{
-//        printf("write");
-		fwrite(buffer, 1, numRead, text_fp);
-	}
-	gzclose(compressed_fp);
-	fclose(text_fp);
-	printf("3: Decompressed\n");
-
-// Type 3 Read
-	type = getLevelFileType(compressedFileName3);
-	minHashValue = getLevelFileMinHashValue(compressedFileName3);
-	maxHashValue = getLevelFileMaxHashValue(compressedFileName3);
-	bitsPerPosition = getLevelFileBitsPerPosition(compressedFileName3);
-	printf("3: This is type %d and min value %d max value %d  bpp %d\n", type, minHashValue, maxHashValue, bitsPerPosition);
-	answer = (BYTE *) malloc(sizeof(BYTE) * (ceil((maxHashValue - minHashValue) / 8)+1));
-
-	ReadLevelFile(compressedFileName3, answer, maxHashValue-minHashValue);
-	printf("3: Read\n3: The bit string is : \t");
-	bitlib_print_bytes_in_bits(answer, ceil((maxHashValue - minHashValue) / 8)+1);
-	printf("3: Printed\n");
-
-	printf("These are valid %d, %d, %d, %d", isValidLevelFile(compressedFileName0), isValidLevelFile(compressedFileName1), isValidLevelFile(compressedFileName2), isValidLevelFile(compressedFileName3));
-
-
-	if(answer)
-		free(answer);
-	return 0;
+	char indexedFileName[80] = "./test/game_opt_tier_indexed.dat.gz";
+	char sampleFileName[80];
+	char largeFileName[80] = "./test/game_opt_tier_large.dat.gz";
+	char corruptFileName[80] = "./test/game_opt_tier_corrupt.dat.gz";
+	char parallelFileName[80];
+
+	//array values, one sample per level file type the writer should pick
+	BITARRAY samples[4][8] = {
+		{ 0x4F, 0x00 },                                   //0100 1111 0000 0000 -> 11, 14, 15, 16, 17
+		{ 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 }, //sparse
+		{ 0xFF, 0xFF, 0xFF, 0xEF, 0xFF, 0xFF, 0xFF, 0xFF }, //dense
+		{ 0x5A, 0x3C, 0xA5, 0x69, 0x96, 0xC3, 0x0F, 0xF1 }  //mixed
+	};
+	POSITION startIndex[4] = { 10, 10, 1000000, 10 };
+	POSITION endIndex[4] = { 30, 74, 1000064, 74 };
+	//spans several index blocks, some all reachable and some all unreachable
+	POSITION largeStart = 12345, largeEnd = 12345 + 5 * 65536 + 777;
+	BITARRAY* large = (BITARRAY*) calloc((largeEnd - largeStart) / BITSINBYTE + 8, sizeof(BITARRAY));
+	//random arrays for the chunked reader: reachable positions per 10000
+	int densities[4] = { 3, 100, 5000, 9990 };
+	POSITION offset;
+	int i, type, typesSeen = 0, errors = 0;
+
+	mkdir("./test", 0755);
+// Write and read back every sample with the single pass writer
+	for (i = 0; i < 4; i++)
+	{
+		sprintf(sampleFileName, "./test/game_opt_tier_%d.dat.gz", i);
+		if (WriteLevelFile(sampleFileName, samples[i], startIndex[i], endIndex[i]) != 0)
+		{
+			printf("%s: write failed\n", sampleFileName);
+			errors++;
+			continue;
+		}
+		errors += CheckLevelFile(sampleFileName, samples[i], startIndex[i], endIndex[i]);
+	}
+	WriteLevelFile(compressedFileName, samples[0], startIndex[0], endIndex[0]);
+	errors += CheckLevelFile(compressedFileName, samples[0], startIndex[0], endIndex[0]);
+
+// Indexed (type 4) files
+	for (i = 0; i < 4; i++)
+	{
+		if (WriteIndexedLevelFile(indexedFileName, samples[i], startIndex[i], endIndex[i]) != 0)
+		{
+			printf("%s: write failed\n", indexedFileName);
+			errors++;
+			continue;
+		}
+		if (getLevelFileType(indexedFileName) != LEVELFILE_INDEXED)
+		{
+			printf("%s: not an indexed level file\n", indexedFileName);
+			errors++;
+		}
+		errors += CheckLevelFile(indexedFileName, samples[i], startIndex[i], endIndex[i]);
+	}
+
+// Queries on a large indexed file, against a full decode
+	srandom(1);
+	for (offset = 0; offset < largeEnd - largeStart; offset++)
+	{
+		if (offset / 65536 == 1 || (offset / 65536 != 3 && random() % 5 == 0))
+			large[offset / BITSINBYTE] |= (BYTE) (0x80 >> (offset % BITSINBYTE));
+	}
+	if (WriteIndexedLevelFile(largeFileName, large, largeStart, largeEnd) != 0)
+	{
+		printf("%s: write failed\n", largeFileName);
+		errors++;
+	}
+	else
+	{
+		errors += CheckLevelFile(largeFileName, large, largeStart, largeEnd);
+		errors += CheckLevelFileIndex(largeFileName, 20000);
+		errors += CheckCorruptLevelFileIndex(largeFileName, corruptFileName, 2);
+	}
+
+// The chunked parallel reader: every file again, split on four threads
+	gLevelFileParallelMin = 1;
+	gNumThreads = 4;
+	for (i = 0; i < 4; i++)
+	{
+		sprintf(parallelFileName, "./test/game_opt_tier_parallel_%d.dat.gz", i);
+		WriteLevelFile(parallelFileName, samples[i], startIndex[i], endIndex[i]);
+		typesSeen |= 1 << getLevelFileType(parallelFileName);
+		errors += CheckLevelFile(parallelFileName, samples[i], startIndex[i], endIndex[i]);
+	}
+	for (i = 0; i < 4; i++)
+	{
+		memset(large, 0, (largeEnd - largeStart) / BITSINBYTE + 8);
+		for (offset = 0; offset < largeEnd - largeStart; offset++)
+		{
+			if (random() % 10000 < densities[i])
+				large[offset / BITSINBYTE] |= (BYTE) (0x80 >> (offset % BITSINBYTE));
+		}
+		sprintf(parallelFileName, "./test/game_opt_tier_parallel_large_%d.dat.gz", i);
+		if (WriteLevelFile(parallelFileName, large, largeStart, largeEnd) != 0)
+		{
+			printf("%s: write failed\n", parallelFileName);
+			errors++;
+			continue;
+		}
+		type = getLevelFileType(parallelFileName);
+		typesSeen |= 1 << type;
+		errors += CheckLevelFile(parallelFileName, large, largeStart, largeEnd);
+		if (WriteIndexedLevelFile(indexedFileName, large, largeStart, largeEnd) != 0)
+		{
+			printf("%s: write failed\n", indexedFileName);
+			errors++;
+			continue;
+		}
+		errors += CheckLevelFile(indexedFileName, large, largeStart, largeEnd);
+	}
+	sprintf(parallelFileName, "./test/game_opt_tier_parallel_type0.dat.gz");
+	if (WriteType0LevelFile(parallelFileName, large, largeStart, largeEnd) != 0)
+	{
+		printf("%s: write failed\n", parallelFileName);
+		errors++;
+	}
+	else
+	{
+		typesSeen |= 1 << getLevelFileType(parallelFileName);
+		errors += CheckLevelFile(parallelFileName, large, largeStart, largeEnd);
+	}
+	if (typesSeen != 0xF)
+	{
+		printf("the chunked reader only saw types %x of 0-3\n", typesSeen);
+		errors++;
+	}
+	free(large);
+
+	printf("%s: %d errors\n", argv[0], errors);
+	return errors ? 1 : 0;
 }
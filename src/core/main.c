@@ -41,6 +41,7 @@
 #include "solvebottomup.h"
 #include "solveweakab.h"
 #include "solveretrograde.h"
+#include "solveshard.h"
 #include "hash.h"
 #include "visualization.h"
 #include "openPositions.h"
@@ -59,6 +60,7 @@ extern POSITION InteractStringToPosition(STRING str);
 */
 
 static void    SetSolver ();
+static void    PrintVariantInfo ();
 
 /*
 ** Code
@@ -152,6 +154,14 @@ VALUE DetermineValue(POSITION position)
 	}
 
 	if(kSupportsShardGamesman) {
+		if (gJustSolving && (!gLoadDatabase || !ShardDatabaseExists(position))) {
+			if (gPrintDatabaseInfo)
+				printf("\nEvaluating the value of %s...", kGameName);
+			DetermineShardValue(position);
+			if (ShardWorkerRank())
+				return undecided;
+			printf("done in %u seconds!\e[K", Stopwatch());
+		}
 		InitializeShardDB();
 		printf("Done loading shard database.\n");
 	} else if (kUsesQuartoGamesman) {
@@ -236,12 +246,50 @@ void StartGame(STRING executableName)
 	Menus(executableName);
 }
 
+/* Prints one machine-readable line about the current option: its size
+   (summed over all tiers for tier games) and whether its database already
+   exists. bin/solve uses it to schedule and skip variants. */
+static void PrintVariantInfo()
+{
+	POSITION positions = 0;
+	BOOLEAN tiered;
+	TIERLIST *todo, *seen = NULL, *children, *ptr;
+	TIER tier;
+
+	Initialize();
+	tiered = kSupportsTierGamesman && gTierGamesman;
+	if (!tiered)
+		positions = gNumberOfPositions;
+	else {
+		todo = CreateTierlistNode(gInitialTier, NULL);
+		while (todo != NULL) {
+			ptr = todo;
+			todo = todo->next;
+			tier = ptr->tier;
+			SafeFree(ptr);
+			if (TierInList(tier, seen))
+				continue;
+			seen = CreateTierlistNode(tier, seen);
+			positions += gNumberOfTierPositionsFunPtr(tier);
+			children = gTierChildrenFunPtr(tier);
+			for (ptr = children; ptr != NULL; ptr = ptr->next)
+				if (!TierInList(ptr->tier, seen))
+					todo = CreateTierlistNode(ptr->tier, todo);
+			FreeTierList(children);
+		}
+		FreeTierList(seen);
+	}
+	printf("option=%d positions=%llu tiered=%d solved=%d\n",
+	       getOption(), positions, tiered ? 1 : 0, DatabaseExists() ? 1 : 0);
+	fflush(stdout);
+}
+
 /* Solves the game and stores it, without anybody actually playing it */
 void SolveAndStore()
 {
 	Initialize();
 	printf("\nInitialized..\n");
-	if (gVisTiers || gVisTiersPlain)
+	if (gVisTiers || gVisTiersPlain || kSupportsShardGamesman)
 	{
 		//Don't initialize DB since we don't need to, it seems.
 		printf("Skipping db initialzation... heh\n");
@@ -257,6 +305,8 @@ void SolveAndStore()
 	Stopwatch();
 	printf("Going into solver....");
 	DetermineValue(gInitialPosition);
+	if (kSupportsShardGamesman && ShardWorkerRank())
+		return; // rank 0 of the MPI shard solve writes the analysis
 
 	if (gAnalyzing) {
 		// Writing HTML Has Now Been Deprecated
@@ -298,6 +348,7 @@ void RemoteStartGamesman(BOOLEAN admin) {
 void HandleArguments (int argc, char *argv[])
 {
 	int i, option;
+	BOOLEAN variantInfo = FALSE;
 	for(i = 1; i < argc; i++) {
 		if(!strcasecmp(argv[i], "--nodb")) {
 			gSaveDatabase = FALSE;
@@ -314,6 +365,9 @@ void HandleArguments (int argc, char *argv[])
 		} else if (!strcasecmp(argv[i], "--curroption")) {
 			fprintf(stderr, "\nCurrent Option: %d\n", getOption());
 			gMessage = TRUE;
+		} else if (!strcasecmp(argv[i], "--variantinfo")) {
+			variantInfo = TRUE;
+			gMessage = TRUE;
 		} else if (!strcasecmp(argv[i], "--option")) {
 			if(argc < (i + 2)) {
 				fprintf(stderr, "\nUsage: %s --option <n>\n\n", argv[0]);
@@ -349,6 +403,13 @@ void HandleArguments (int argc, char *argv[])
 			gBottomUp = TRUE;
 		} else if (!strcasecmp(argv[i], "--alpha-beta")) {
 			gAlphaBeta = TRUE;
+		} else if (!strcasecmp(argv[i], "--threads")) {
+			if(argc < (i + 2)) {
+				fprintf(stderr, "\nUsage: %s --threads <n>\n\n", argv[0]);
+				gMessage = TRUE;
+			} else {
+				gNumThreads = atoi(argv[++i]);
+			}
 		} else if (!strcasecmp(argv[i], "--lowmem")) {
 			gZeroMemSolver = TRUE;
 		} else if (!strcasecmp(argv[i], "--slicessolver")) {
@@ -395,6 +456,36 @@ void HandleArguments (int argc, char *argv[])
 		} else if (!strcasecmp(argv[i], "--notierprint")) {
 			gTierSolvePrint = FALSE;
 			gTierSolverMenu = FALSE;
+		} else if (!strcasecmp(argv[i], "--tierprefetch")) {
+			if(argc < (i + 2)) {
+				fprintf(stderr, "\nUsage: %s --tierprefetch <MB>\n\n", argv[0]);
+				gMessage = TRUE;
+			} else {
+				gTierPrefetchMB = atoll(argv[++i]);
+			}
+		} else if (!strcasecmp(argv[i], "--tiercheckpoint")) {
+			if(argc < (i + 2)) {
+				fprintf(stderr, "\nUsage: %s --tiercheckpoint <seconds>\n\n", argv[0]);
+				gMessage = TRUE;
+			} else {
+				gTierCheckpointSeconds = atoi(argv[++i]);
+			}
+		} else if (!strcasecmp(argv[i], "--stats")) {
+			if ((i + 1) < argc && strncmp(argv[i + 1], "--", 2))
+				StatsStart(argv[++i]);
+			else
+				StatsStart(NULL);
+		} else if (!strcasecmp(argv[i], "--statsinterval")) {
+			if(argc < (i + 2)) {
+				fprintf(stderr, "\nUsage: %s --statsinterval <seconds>\n\n", argv[0]);
+				gMessage = TRUE;
+			} else {
+				gStatsInterval = atoi(argv[++i]);
+			}
+		} else if (!strcasecmp(argv[i], "--tiercheck")) {
+			gTierCheck = TRUE;
+			if ((i + 1) < argc && isdigit((unsigned char) argv[i + 1][0]))
+				gTierCheckReportLimit = atoi(argv[++i]);
 		} else if (!strcasecmp(argv[i], "--solve")) {
 			gJustSolving = TRUE;
 			if((i + 1) < argc && !strcasecmp(argv[++i], "all"))
@@ -419,6 +510,20 @@ void HandleArguments (int argc, char *argv[])
 			gUseOpen = TRUE;
 		} else if (!strcasecmp(argv[i], "--visualize")) {
 			gVisualizing = TRUE;
+		} else if (!strcasecmp(argv[i], "--vissample")) {
+			if(argc < (i + 2)) {
+				fprintf(stderr, "\nUsage: %s --vissample <fraction>\n\n", argv[0]);
+				gMessage = TRUE;
+			} else {
+				gVisSampleRate = atof(argv[++i]);
+			}
+		} else if (!strcasecmp(argv[i], "--visdepth")) {
+			if(argc < (i + 2)) {
+				fprintf(stderr, "\nUsage: %s --visdepth <n>\n\n", argv[0]);
+				gMessage = TRUE;
+			} else {
+				gVisDepthLimit = atoi(argv[++i]);
+			}
 		} else if (!strcasecmp(argv[i], "--DoMove")) {
 			InitializeGame();
 			if(argc != 4)
@@ -482,8 +587,8 @@ void HandleArguments (int argc, char *argv[])
 			gNetworkDB = TRUE;
 			gBitPerfectDB = FALSE;
 			gBitPerfectDBSolver = FALSE;
-			if ((i + 1) < argc) {
-				ServerAddress = argv[i++];
+			if ((i + 1) < argc && strncmp(argv[i + 1], "--", 2)) {
+				ServerAddress = argv[++i];
 			}
 		} else if (!strcasecmp(argv[i],"--hashCounting")) {
 			hashCounting();
@@ -609,6 +714,9 @@ void HandleArguments (int argc, char *argv[])
 			i += argc;
 		}
 	}
+	/* Initializes the game, so only once every other flag has been seen */
+	if (variantInfo)
+		PrintVariantInfo();
 }
 
 
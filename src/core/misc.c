@@ -579,6 +579,15 @@ BOOLEAN DefaultGoAgain(POSITION pos,MOVE move)
 	return FALSE; /* Always toggle turn by default */
 }
 
+/* TRUE if --threads workers may call GenerateMoves, DoMove, Primitive and
+   gCanonicalPosition concurrently: the module says it is reentrant
+   (kReentrant) and generic_hash has a single context. Many modules unhash
+   into global boards, so every parallel solver path checks this first. */
+BOOLEAN ParallelSolveSafe()
+{
+	return kReentrant && generic_hash_thread_safe();
+}
+
 
 
 POSITION GetNextPosition()
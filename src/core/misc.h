@@ -41,6 +41,7 @@ MOVELIST*       CopyMovelist                    (MOVELIST* list);
 POSITIONLIST*   StorePositionInList             (POSITION pos, POSITIONLIST* head);
 POSITIONLIST*   CopyPositionList                (POSITIONLIST* list);
 
+extern int      IPOSITION_SUBLIST_SIZE; /* positions per IPOSITIONSUBLIST */
 IPOSITIONLIST*  StorePositionInIList(POSITION thePosition, IPOSITIONLIST* thePositionList);
 void            FreeIPositionList(IPOSITIONLIST* ptr);
 void            FreeMultipartEdgeList(MULTIPARTEDGELIST* ptr);
@@ -63,6 +64,7 @@ MULTIPARTEDGELIST* CreateMultipartEdgeListNode(POSITION from, POSITION to, MOVE
 void            FoundBadPosition                (POSITION pos, POSITION parent, MOVE move);
 
 BOOLEAN         DefaultGoAgain                  (POSITION pos, MOVE move);
+BOOLEAN         ParallelSolveSafe               ();
 POSITION        GetNextPosition                 ();             // TODO: Move to solve
 
 MEXCALC         MexAdd                          (MEXCALC calc, MEX mex);
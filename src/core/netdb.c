@@ -49,8 +49,8 @@
 
 typedef short cellValue;
 
-void            netdb_close                     (){
-};                                                    //nothing
+void            netdb_close                     ();
+
 /* Value */
 VALUE           netdb_get_value                 (POSITION pos);
 
@@ -67,23 +67,13 @@ void netdb_get_bulk (POSITION* positions, VALUE* ValueArray, REMOTENESS* remoten
 /* saving to/reading from a file */
 BOOLEAN         netdb_load_database             ();
 
-/*LUI replacement algorithm using nth-chance clock*/
-/*This would probably be faster as a hash, but for small cache_Size < 100
- * naive looping may be better*/
-/*for smart db*/
-#define CACHE_SIZE 100
-#define CLOCK_LOOPS 5 //number of clock interations
+/*Direct-mapped cache: a position can only live in the slot its hash picks,
+ * so lookup and insert are O(1). A collision simply evicts the older entry.*/
+#define CACHE_BITS 14
+#define CACHE_SIZE (1 << CACHE_BITS)
 POSITION p_cache[CACHE_SIZE];
 cellValue v_cache[CACHE_SIZE];
-uint8_t cache_sweep[CACHE_SIZE]; //0 = fresh; CLOCK_LOOPS = replace
-short valid_num = 0; //index of first invalid entry
-short c_clock =0;         //the clock hand
-
-//cache prototypes:
-
-//FIXME: exact LRU should be used!
-//linked list?
-
+uint8_t cache_valid[CACHE_SIZE];
 
 //get cached position
 BOOLEAN get_position (POSITION pos, cellValue * outcell);
@@ -92,8 +82,26 @@ BOOLEAN get_position (POSITION pos, cellValue * outcell);
 //set cached position:
 void set_position (POSITION pos, cellValue cv);
 
+//forget everything cached (positions belong to one variant)
+void clear_cache ();
+
 void checkResponseForErrors(httpres *res);
 
+/*Connection state: one kept-alive connection per database, the headers
+ * every value request carries (built once), and whether the server agreed
+ * to binary frames instead of HTTP requests.*/
+static httpconn *conn = NULL;
+static char requestHeaders[256];
+static int requestHeadersLength = 0;
+static BOOLEAN binaryFraming = FALSE;
+static POSITION *scratch = NULL; //byte-swapped copy of a batch when needed
+
+/*Binary frames are little-endian:
+ *  request   uint32 count, count x uint64 position
+ *  response  int32 return code, uint32 count, count x uint16 cell
+ *            (on a non-zero return code, count bytes of message instead)*/
+#define FRAME_HEADER_SIZE 8
+
 /*
 ** Code
 */
@@ -131,164 +139,273 @@ void badResponseCode(char * reason, int code)
 	exit(1);
 }
 
-//warning: syncronous net sending
-//will need to rewrite to be asynch
-
-void netdb_get_raw(POSITION * positions, cellValue * cells, int length){ //dispatch to get cells
-	httpreq *req;
-	httpres *res;
-	char* errMsg;
-
-	//byte found[] = malloc(sizeof(int)*length); //array to note found items
-	//fixme: reduce server request based on a bitmap!
+static BOOLEAN host_is_little_endian()
+{
+	uint16_t one = 1;
+	return *(uint8_t *) &one == 1;
+}
 
-	//before we do anything, access the cache:
-	BOOLEAN allcached = TRUE;
-	int i;
-	for (i = 0; i< length; i++) {
-		if (!get_position(positions[i], cells + i))
-			allcached = FALSE;
-	}
-	if (allcached) //done
-		return;
+static void put_le32(unsigned char *dst, uint32_t n)
+{
+	dst[0] = n; dst[1] = n >> 8; dst[2] = n >> 16; dst[3] = n >> 24;
+}
 
+static uint32_t get_le32(const unsigned char *src)
+{
+	return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t) src[3] << 24);
+}
 
+static POSITION swap64(POSITION n)
+{
+	return __builtin_bswap64(n);
+}
 
-	char * url = malloc(strlen(ServerAddress)+1);
-	memcpy(url,ServerAddress,strlen(ServerAddress)+1);
+//Opens the connection (first call only) and sends InitDatabase on it,
+//offering binary frames. Exits on failure, like every netdb error.
+void netdb_handshake()
+{
+	httpres *res;
+	char* errMsg;
+	char *url;
+	char headers[256];
+	char *framing;
+	int n;
 
-	char option[32]; //option encoding
-	char length_str[32]; //length encoding
+	if (conn == NULL)
+	{
+		url = malloc(strlen(ServerAddress)+1);
+		memcpy(url, ServerAddress, strlen(ServerAddress)+1);
+		if (openconnection(url, &conn, &errMsg) != 0)
+		{
+			fprintf(stderr, "Problem creating request: %s\n", errMsg);
+			exit(1);
+		}
+		free(url);
+	}
+	else
+		resetconnection(conn);
 
-	//connect to the server
-	if (newrequest(url, &req, &errMsg) != 0)
+	n = snprintf(headers, sizeof(headers), "TYPE: %s\r\n%s: %s\r\n%s: %d\r\n%s: binary\r\n",
+	             HD_INIT_DATABASE, HD_GAME_NAME, kDBName, HD_GAME_VARIANT, getOption(), HD_FRAMING);
+	if (sendrequest(conn, headers, n, NULL, 0, &errMsg) != 0 ||
+	    receiveresponse(conn, &res, NULL, 0, &errMsg) != 0)
 	{
-		fprintf(stderr, "Problem creating request: %s\n", errMsg);
+		fprintf(stderr, "Problem posting to the server: %s\n", errMsg);
 		exit(1);
 	}
+	checkResponseForErrors(res);
 
-	settype(req, HD_GET_VALUE_OF_POSITIONS);
-
-	addheader(req, HD_GAME_NAME,  kDBName);
-
-	net_itoa(getOption(),option);
-	addheader(req, HD_GAME_VARIANT, option);
+	// A server that knows about frames echoes the header back and switches
+	// this connection over; anyone else ignores it and we stay on HTTP.
+	getheader(res, HD_FRAMING, &framing);
+	binaryFraming = (framing != NULL && strcmp(framing, "binary") == 0 && conn->sockFd >= 0);
+	free(framing);
+	freeresponse(res);
 
-	net_itoa(length,length_str);
-	addheader(req,HD_LENGTH,length_str);
+	requestHeadersLength = snprintf(requestHeaders, sizeof(requestHeaders), "TYPE: %s\r\n%s: %s\r\n%s: %d\r\n",
+	                                HD_GET_VALUE_OF_POSITIONS, HD_GAME_NAME, kDBName, HD_GAME_VARIANT, getOption());
+	if (scratch == NULL)
+		scratch = malloc(sizeof(POSITION)*NETDB_BATCH_SIZE);
+}
 
-	//now generate the body:
-	POSITION * positions_copy = malloc(sizeof(POSITION)*length);
-	//position is 64 bit.. must convert
+//Puts one batch on the wire without waiting for the answer.
+//Returns 0 if sent, non-zero if the connection failed.
+static int netdb_send_batch(POSITION * positions, int length)
+{
+	char headers[sizeof(requestHeaders) + 32];
+	unsigned char frame[FRAME_HEADER_SIZE];
+	POSITION * body = positions;
+	char* errMsg;
+	int i, n, rc;
 
-	for (i=0; i<length; i++) {
-		positions_copy[i] = htonll(positions[i]); //convert to net order
+	if (binaryFraming)
+	{
+		// Little-endian hosts send the caller's array as it is
+		if (!host_is_little_endian())
+		{
+			for (i=0; i<length; i++)
+				scratch[i] = swap64(positions[i]);
+			body = scratch;
+		}
+		put_le32(frame, length);
+		rc = sendraw(conn, frame, 4, body, length*sizeof(POSITION), &errMsg);
 	}
-
-	//now post
-	if ((post(req,(char*)positions_copy,length*sizeof(POSITION), &res, &errMsg)) != 0)
+	else
 	{
-		fprintf(stderr, "Problem posting to the server: %s\n", errMsg);
-		exit(1);
+		if (htonll(1) != 1)
+		{
+			for (i=0; i<length; i++)
+				scratch[i] = htonll(positions[i]); //convert to net order
+			body = scratch;
+		}
+		memcpy(headers, requestHeaders, requestHeadersLength);
+		n = requestHeadersLength + snprintf(headers + requestHeadersLength, 32, "%s: %d\r\n", HD_LENGTH, length);
+		rc = sendrequest(conn, headers, n, body, length*sizeof(POSITION), &errMsg);
 	}
+	if (rc != 0)
+		free(errMsg);
+	return rc;
+}
 
-	free (positions_copy);
-	//now check errors:
-
-	//debug:
-	//printf("%s: %s\n", "Date", getheader(res, "date"));
-	//	printf("%s: %s\n", "Content-Length", getheader(res, "Content-Length"));
-	//	printf("%s: %s\n", "ReturnCode", getheader(res, HD_RETURN_CODE));
-	//	printf("%s: %s\n", "ReturnMessage", getheader(res, HD_RETURN_MESSAGE));
-
-	//normal:
-	//FIXME: check status
-	char* tmpVal;
-	getheader(res,"date",&tmpVal);
-	if (tmpVal == NULL) { //all real responses have this
-		error("Server did not respond to http request",10);
-	}
+//Reads the answer to the oldest outstanding batch straight into cells.
+//Returns 0 if read, non-zero if the connection failed; exits if the
+//server answered with an error.
+static int netdb_receive_batch(cellValue * cells, int length)
+{
+	unsigned char frame[FRAME_HEADER_SIZE];
+	uint16_t * raw = (uint16_t *) cells;
+	httpres *res;
+	char* errMsg;
+	char* len_str;
+	char* msg;
+	int i, ecode;
+	uint32_t count;
 
-	char * ecode_str;
-	getheader(res,HD_RETURN_CODE,&ecode_str);
-	if (ecode_str == NULL) {
-		error("Server sent back invalid response",11);
+	if (binaryFraming)
+	{
+		if (receiveraw(conn, frame, FRAME_HEADER_SIZE, &errMsg) != 0)
+		{
+			free(errMsg);
+			return 1;
+		}
+		ecode = (int) get_le32(frame);
+		count = get_le32(frame + 4);
+		if (ecode != 0)
+		{
+			msg = malloc(count + 1);
+			if (receiveraw(conn, msg, count, &errMsg) != 0)
+				error("Server sent back invalid response", 11);
+			msg[count] = '\0';
+			error(msg, ecode);
+		}
+		if (count != (uint32_t) length)
+			error("Server sent back invalid response",10);
+		if (receiveraw(conn, cells, length*sizeof(cellValue), &errMsg) != 0)
+		{
+			free(errMsg);
+			return 1;
+		}
+		if (!host_is_little_endian())
+			for (i=0; i<length; i++)
+				raw[i] = (raw[i] >> 8) | (raw[i] << 8);
+		return 0;
 	}
-	int ecode = atoi(ecode_str);
-	// printf("return code - %d\n",ecode);
-	if (ecode != 0) { //error
-		getheader(res,HD_RETURN_MESSAGE,&tmpVal);
-		error(tmpVal,ecode);
-		//can quit
+
+	if (receiveresponse(conn, &res, cells, length*sizeof(cellValue), &errMsg) != 0)
+	{
+		free(errMsg);
+		return 1;
 	}
+	checkResponseForErrors(res);
 
 	//verify server not broken
-	char * len_str;
 	getheader(res,HD_LENGTH,&len_str);
-	if (len_str == NULL || length!=atoi(len_str) || res->bodyLength != length*sizeof(cellValue)) {
+	if (len_str == NULL || length!=atoi(len_str) || res->body != NULL ||
+	    res->bodyLength != length*sizeof(cellValue)) {
 		error("Server sent back invalid response",10);
 	}
+	free(len_str);
+	freeresponse(res);
 
-
-
-	//now safe - just read out the body (length should be the same or we errored)
-	cellValue * resvals = (cellValue*)(res->body);
-
-	//must do byte conversion (16 bit)
+	//must do byte conversion (16 bit), in place
 	for (i=0; i<length; i++) {
-		cells[i] = ntohs(resvals[i]);
+		cells[i] = ntohs(raw[i]);
 	}
+	return 0;
+}
 
+//Fetches length positions from the server, pipelining the batches. If the
+//connection drops, it is reopened and everything not yet answered is sent
+//again; a second failure in a row is fatal.
+void netdb_fetch(POSITION * positions, cellValue * cells, int length)
+{
+	int sent = 0, received = 0, retried = FALSE, batch;
 
-	for (i = 0; i< length; i++) //cache what we got back
-		set_position(positions[i], cells[i]);
-
-
-
-	//done - free response
-	freeresponse(res);
-	free(url);
+	if (conn == NULL)
+		netdb_handshake();
 
+	while (received < length) {
+		while (sent < length && sent - received < NETDB_PIPELINE_DEPTH*NETDB_BATCH_SIZE) {
+			batch = (length - sent < NETDB_BATCH_SIZE) ? length - sent : NETDB_BATCH_SIZE;
+			if (netdb_send_batch(positions + sent, batch) != 0)
+				goto retry;
+			sent += batch;
+		}
+		batch = (length - received < NETDB_BATCH_SIZE) ? length - received : NETDB_BATCH_SIZE;
+		if (netdb_receive_batch(cells + received, batch) != 0)
+			goto retry;
+		received += batch;
+		retried = FALSE;
+		continue;
+retry:
+		if (retried)
+			error("Lost the connection to the server", 12);
+		retried = TRUE;
+		sent = received;
+		if (binaryFraming)
+			netdb_handshake(); //a fresh socket starts out speaking HTTP
+		else
+			resetconnection(conn);
+	}
 }
 
-void netdb_init_db()
-{
-	httpreq *req;
-	httpres *res;
-	char* errMsg;
-	char *url;
-	char option[32];
+void netdb_get_raw(POSITION * positions, cellValue * cells, int length){ //dispatch to get cells
+	POSITION * missing;
+	cellValue * fetched;
+	int * index;
+	int i, n = 0;
 
-	// Create a new request
-	url = malloc(strlen(ServerAddress)+1);
-	memcpy(url, ServerAddress, strlen(ServerAddress)+1);
-	if (newrequest(url, &req, &errMsg) != 0)
-	{
-		fprintf(stderr, "Problem creating request: %s\n", errMsg);
-		exit(1);
+	//before we do anything, access the cache; only misses go to the server
+	for (i = 0; i< length; i++) {
+		if (!get_position(positions[i], cells + i))
+			n++;
 	}
-	settype(req, HD_INIT_DATABASE);
-
-	// Set the gamename header
-	addheader(req, HD_GAME_NAME,  kDBName);
+	StatsCacheAccess(STAT_NETDB, length - n, n);
+	if (n == 0) //done
+		return;
 
-	// Set the option header
-	net_itoa(getOption(), option);
-	addheader(req, HD_GAME_VARIANT, option);
+	if (n == length) {
+		//nothing cached: fetch straight into the caller's arrays
+		netdb_fetch(positions, cells, length);
+		for (i = 0; i< length; i++) //cache what we got back
+			set_position(positions[i], cells[i]);
+		return;
+	}
 
-	// Now post
-	if ((post(req, NULL, 0, &res, &errMsg)) != 0)
-	{
-		fprintf(stderr, "Problem posting to the server: %s\n", errMsg);
-		exit(1);
+	missing = malloc(sizeof(POSITION)*n);
+	fetched = malloc(sizeof(cellValue)*n);
+	index = malloc(sizeof(int)*n);
+	n = 0;
+	for (i = 0; i< length; i++) {
+		if (!get_position(positions[i], cells + i)) {
+			missing[n] = positions[i];
+			index[n++] = i;
+		}
+	}
+	netdb_fetch(missing, fetched, n);
+	for (i = 0; i < n; i++) {
+		cells[index[i]] = fetched[i];
+		set_position(missing[i], fetched[i]);
 	}
+	free(missing);
+	free(fetched);
+	free(index);
+}
 
-	// Check for errors:
-	checkResponseForErrors(res);
+void netdb_init_db()
+{
+	clear_cache();
+	netdb_handshake();
+}
 
-	// Done - free memory
-	freeresponse(res);
-	free(url);
+void netdb_close()
+{
+	closeconnection(conn);
+	conn = NULL;
+	binaryFraming = FALSE;
+	free(scratch);
+	scratch = NULL;
+	clear_cache();
 }
 
 
@@ -309,6 +426,7 @@ void checkResponseForErrors(httpres *res)
 	if (ecode_str == NULL)
 		error("GamesmanServlet sent back invalid response. Missing return code.", 11);
 	ecode = atoi(ecode_str);
+	free(ecode_str);
 	if (ecode != 0)
 	{
 		getheader(res, HD_RETURN_MESSAGE, &ecode_str);
@@ -318,57 +436,36 @@ void checkResponseForErrors(httpres *res)
 
 
 //cache support:
+static int cache_slot (POSITION pos){
+	return (int)((pos * 0x9E3779B97F4A7C15ULL) >> (64 - CACHE_BITS));
+}
+
 //return False if not found
 //If true, set the cached value appropriately
 BOOLEAN get_position (POSITION pos, cellValue * outcell){
-	int i;
-	for (i=0; i<valid_num; i++) {
-		if (p_cache[i] == pos) {
-			*outcell = v_cache[i];
-			cache_sweep[i] = 0; //reset
-			return TRUE;
-		}
+	int i = cache_slot(pos);
+	if (cache_valid[i] && p_cache[i] == pos) {
+		*outcell = v_cache[i];
+		return TRUE;
 	}
 	return FALSE;
 }
 
 //this will push entries to the cache
 void set_position (POSITION pos, cellValue cv){
-	//check if already cached
-	if (get_position(pos,&cv))
-		return;
-
-	if (valid_num < CACHE_SIZE) {
-		p_cache[valid_num] = pos;
-		v_cache[valid_num] = cv;
-		cache_sweep[valid_num] = 0;
-		valid_num++;
-	}
-	//replacement (nth-chance clock)
-	while (TRUE) {
-		if (cache_sweep[c_clock] == CLOCK_LOOPS) { //replace
-			cache_sweep[c_clock] = 0; //reset
-			p_cache[c_clock] = pos;
-			v_cache[c_clock] = cv;
-			c_clock=(c_clock+1)%CACHE_SIZE;
-			return;
-		}
-		//otherwise increment clock and sweep counter
-		cache_sweep[c_clock]++;
-		c_clock=(c_clock+1)%CACHE_SIZE;
-	}
+	int i = cache_slot(pos);
+	p_cache[i] = pos;
+	v_cache[i] = cv;
+	cache_valid[i] = 1;
 }
 
-//FIXME: add a cache clear function
+void clear_cache (){
+	memset(cache_valid, 0, sizeof(cache_valid));
+}
 
 
 /*bulk request*/
 
-//fine details about caching:
-//All entries must be in the cache to abort the request
-//Bandwidth is not an issue
-//FIXME: This is dumb - refactor
-
 void netdb_get_bulk (POSITION* positions, VALUE* ValueArray, REMOTENESS* remotenessArray, int length){
 	if (!length)
 		return;
@@ -384,12 +481,40 @@ void netdb_get_bulk (POSITION* positions, VALUE* ValueArray, REMOTENESS* remoten
 
 
 //easy way to issue a single query
-//really should be inlined
+//A miss is almost always followed by queries for the children (move
+//values, hints), so fetch pos and all its children in the same round trip.
 cellValue netdb_single_query(POSITION pos){
 	cellValue cell;
+	POSITION * batch;
+	cellValue * cells;
+	MOVELIST *moves, *ptr;
+	int n = 1;
+
+	if (get_position(pos, &cell)) {
+		StatsCacheAccess(STAT_NETDB, 1, 0);
+		return cell;
+	}
 
-	netdb_get_raw(&pos,&cell,1);
+	if (Primitive(pos) != undecided) {
+		netdb_get_raw(&pos,&cell,1);
+		return cell;
+	}
 
+	moves = GenerateMoves(pos);
+	for (ptr = moves; ptr != NULL; ptr = ptr->next)
+		n++;
+	batch = malloc(sizeof(POSITION)*n);
+	cells = malloc(sizeof(cellValue)*n);
+	batch[0] = pos;
+	n = 1;
+	for (ptr = moves; ptr != NULL; ptr = ptr->next)
+		batch[n++] = DoMove(pos, ptr->move);
+	FreeMoveList(moves);
+
+	netdb_get_raw(batch,cells,n);
+	cell = cells[0];
+	free(batch);
+	free(cells);
 	return cell;
 }
 
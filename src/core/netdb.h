@@ -1,6 +1,12 @@
 #ifndef GMCORE_NETDB_H
 #define GMCORE_NETDB_H
 
+/* Positions go to the server in batches of at most NETDB_BATCH_SIZE, with
+ * up to NETDB_PIPELINE_DEPTH batches on the wire before we wait for the
+ * first answer. */
+#define NETDB_BATCH_SIZE 1024
+#define NETDB_PIPELINE_DEPTH 4
+
 /* General */
 void            netdb_init              (DB_Table *new_db);
 
@@ -0,0 +1,396 @@
+/************************************************************************
+**
+** NAME:	netdb_test.c
+**
+** DESCRIPTION:	The netdb transport against a local stand-in server
+**
+**		Runs a small GamesmanServlet stand-in on a loopback port and
+**		fetches positions through netdb: plain HTTP keep-alive and
+**		binary frames, with and without the server dropping the
+**		connection part way through. Every answer is checked, and so
+**		are the batch sizes and the number of batches in flight that
+**		the server saw. With -s <port> it only runs the stand-in, for
+**		trying a module by hand with --netdb 127.0.0.1:<port>/.
+**		Build from src/core after make, like levelfile_test.c:
+**
+** gcc -std=gnu99 -I.. -I/usr/include/tcl8.6 -Wl,--allow-multiple-definition netdb_test.c ../m1210.o
+**     ../gamesman.a ../gamesdb.a ../libUWAPI_boardstrings.a -lz -lgmp -ltcl8.6 -lpthread -lm
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#define _GNU_SOURCE          /* memmem */
+
+#include "gamesman.h"
+#include "netdb.h"
+#include "httpclient.h"
+#include <pthread.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Requests that arrive within STANDIN_GAP_MS of each other are taken to be
+   in flight together; the stand-in answers them once the line goes quiet. */
+#define STANDIN_GAP_MS          100
+#define STANDIN_MAX_QUEUED      64
+
+typedef struct {
+	int listenFd, port;
+	BOOLEAN offerBinary;    /* echo "Framing: binary" on InitDatabase */
+	int closeAfter;         /* drop the first connection after this many
+	                           value answers (0: never) */
+	/* what the stand-in saw */
+	int connections, inits, httpBatches, binaryBatches;
+	int maxBatch, maxInFlight, positions, errors;
+} STANDIN;
+
+typedef struct {
+	int fd;
+	BOOLEAN binary;
+	char *buffer;
+	int start, end, size;
+} STANDINCONN;
+
+typedef struct {
+	BOOLEAN init;
+	int count;
+	POSITION *positions;
+} STANDINREQUEST;
+
+/* The cell the stand-in serves for a position */
+static unsigned short StandInCell(POSITION position)
+{
+	return (unsigned short) (((position * 0x9E3779B97F4A7C15ULL) >> 40) & 0x7fff);
+}
+
+static uint32_t GetLE32(const unsigned char *src)
+{
+	return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static void PutLE32(unsigned char *dst, uint32_t n)
+{
+	dst[0] = n; dst[1] = n >> 8; dst[2] = n >> 16; dst[3] = n >> 24;
+}
+
+/* Reads whatever arrives within timeoutMs (-1: wait). Returns the number
+   of bytes read, 0 on timeout, -1 once the client has gone. */
+static int StandInRead(STANDINCONN *conn, int timeoutMs)
+{
+	struct pollfd pfd = { conn->fd, POLLIN, 0 };
+	int n;
+
+	if (poll(&pfd, 1, timeoutMs) <= 0)
+		return 0;
+	if (conn->start > 0) {
+		memmove(conn->buffer, conn->buffer + conn->start, conn->end - conn->start);
+		conn->end -= conn->start;
+		conn->start = 0;
+	}
+	if (conn->end == conn->size) {
+		conn->size *= 2;
+		conn->buffer = (char *) realloc(conn->buffer, conn->size);
+	}
+	n = read(conn->fd, conn->buffer + conn->end, conn->size - conn->end);
+	if (n <= 0)
+		return -1;
+	conn->end += n;
+	return n;
+}
+
+/* Takes one complete request off the connection buffer. Returns FALSE if
+   it has not fully arrived yet. */
+static BOOLEAN StandInParse(STANDIN *server, STANDINCONN *conn, STANDINREQUEST *request)
+{
+	char *data = conn->buffer + conn->start, *end, *headers, *line, *next, *value;
+	int have = conn->end - conn->start, headerLength, contentLength = 0, length = -1, i;
+	BOOLEAN init = FALSE, binary = FALSE;
+	const unsigned char *body;
+	POSITION p;
+
+	if (conn->binary) {
+		if (have < 4 || have < 4 + 8 * (int) GetLE32((unsigned char *) data))
+			return FALSE;
+		request->init = FALSE;
+		request->count = GetLE32((unsigned char *) data);
+		request->positions = (POSITION *) malloc(request->count * sizeof(POSITION) + 1);
+		body = (unsigned char *) data + 4;
+		for (i = 0; i < request->count; i++)
+			request->positions[i] = (POSITION) GetLE32(body + 8 * i) |
+			                        ((POSITION) GetLE32(body + 8 * i + 4) << 32);
+		conn->start += 4 + 8 * request->count;
+		server->binaryBatches++;
+		return TRUE;
+	}
+
+	if ((end = memmem(data, have, "\r\n\r\n", 4)) == NULL)
+		return FALSE;
+	headerLength = end + 4 - data;
+	headers = strndup(data, end - data);
+	for (line = strstr(headers, "\r\n"); line != NULL; line = next) {
+		line += 2;
+		if ((next = strstr(line, "\r\n")) != NULL)
+			*next = '\0';
+		if ((value = strchr(line, ':')) == NULL)
+			continue;
+		*value++ = '\0';
+		while (*value == ' ')
+			value++;
+		if (!strcasecmp(line, "Content-Length"))
+			contentLength = atoi(value);
+		else if (!strcasecmp(line, HD_LENGTH))
+			length = atoi(value);
+		else if (!strcasecmp(line, "TYPE"))
+			init = !strcmp(value, HD_INIT_DATABASE);
+		else if (!strcasecmp(line, HD_FRAMING))
+			binary = !strcmp(value, "binary");
+	}
+	free(headers);
+	if (have < headerLength + contentLength)
+		return FALSE;   /* parsed again once the body is in */
+	body = (unsigned char *) data + headerLength;
+	request->init = init;
+	request->count = init ? 0 : length;
+	request->positions = NULL;
+	if (init) {
+		server->inits++;
+		conn->binary = binary && server->offerBinary;
+	} else if (length < 0 || contentLength != 8 * length) {
+		printf("stand-in: value request with Length %d and %d bytes of body\n", length, contentLength);
+		server->errors++;
+		request->count = 0;
+	} else {
+		request->positions = (POSITION *) malloc(length * sizeof(POSITION) + 1);
+		for (i = 0; i < length; i++) {
+			/* positions come in network order */
+			for (p = 0, end = (char *) body + 8 * i; end < (char *) body + 8 * i + 8; end++)
+				p = (p << 8) | (unsigned char) *end;
+			request->positions[i] = p;
+		}
+		server->httpBatches++;
+	}
+	conn->start += headerLength + contentLength;
+	return TRUE;
+}
+
+static void StandInAnswer(STANDIN *server, STANDINCONN *conn, STANDINREQUEST *request)
+{
+	char header[256];
+	unsigned char frame[8], *cells;
+	unsigned short cell;
+	int n, i;
+
+	if (request->init) {
+		n = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n%s: 0\r\n%sContent-Length: 0\r\n\r\n",
+		             HD_RETURN_CODE, conn->binary ? HD_FRAMING ": binary\r\n" : "");
+		write(conn->fd, header, n);
+		return;
+	}
+	cells = (unsigned char *) malloc(2 * request->count + 1);
+	for (i = 0; i < request->count; i++) {
+		cell = StandInCell(request->positions[i]);
+		/* little-endian in frames, network order over HTTP */
+		cells[2 * i + (conn->binary ? 0 : 1)] = cell & 0xff;
+		cells[2 * i + (conn->binary ? 1 : 0)] = cell >> 8;
+	}
+	if (conn->binary) {
+		PutLE32(frame, 0);
+		PutLE32(frame + 4, request->count);
+		write(conn->fd, frame, 8);
+	} else {
+		n = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n%s: 0\r\n%s: %d\r\nContent-Length: %d\r\n\r\n",
+		             HD_RETURN_CODE, HD_LENGTH, request->count, 2 * request->count);
+		write(conn->fd, header, n);
+	}
+	write(conn->fd, cells, 2 * request->count);
+	free(cells);
+}
+
+/* Serves one connection at a time until the process ends */
+static void *StandInServe(void *arg)
+{
+	STANDIN *server = (STANDIN *) arg;
+	STANDINCONN conn;
+	STANDINREQUEST queue[STANDIN_MAX_QUEUED];
+	int queued, inFlight, answered, i;
+	BOOLEAN open;
+
+	conn.size = 1 << 16;
+	conn.buffer = (char *) malloc(conn.size);
+	while ((conn.fd = accept(server->listenFd, NULL, NULL)) >= 0) {
+		server->connections++;
+		conn.binary = FALSE;
+		conn.start = conn.end = 0;
+		answered = 0;
+		open = TRUE;
+		while (open) {
+			/* wait for a request, then collect the ones sent right after it */
+			queued = 0;
+			while (queued < STANDIN_MAX_QUEUED) {
+				if (StandInParse(server, &conn, &queue[queued])) {
+					queued++;
+					continue;
+				}
+				i = StandInRead(&conn, queued == 0 ? -1 : STANDIN_GAP_MS);
+				if (i < 0)
+					open = FALSE;
+				if (i <= 0 && (queued > 0 || !open))
+					break;
+			}
+			for (i = 0, inFlight = 0; i < queued; i++)
+				if (!queue[i].init) {
+					inFlight++;
+					if (queue[i].count > server->maxBatch)
+						server->maxBatch = queue[i].count;
+					server->positions += queue[i].count;
+				}
+			if (inFlight > server->maxInFlight)
+				server->maxInFlight = inFlight;
+			for (i = 0; i < queued; i++) {
+				if (open)
+					StandInAnswer(server, &conn, &queue[i]);
+				if (!queue[i].init && ++answered == server->closeAfter && server->connections == 1)
+					open = FALSE;
+				free(queue[i].positions);
+			}
+		}
+		close(conn.fd);
+	}
+	free(conn.buffer);
+	return NULL;
+}
+
+/* Listens on port (0: any free one) and starts serving in the background */
+static void StandInStart(STANDIN *server, int port, BOOLEAN offerBinary, int closeAfter)
+{
+	struct sockaddr_in addr;
+	socklen_t length = sizeof(addr);
+	pthread_t thread;
+	int one = 1;
+
+	memset(server, 0, sizeof(STANDIN));
+	server->offerBinary = offerBinary;
+	server->closeAfter = closeAfter;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if ((server->listenFd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	    setsockopt(server->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+	    bind(server->listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(server->listenFd, 4) < 0 ||
+	    getsockname(server->listenFd, (struct sockaddr *) &addr, &length) < 0) {
+		perror("stand-in");
+		exit(1);
+	}
+	server->port = ntohs(addr.sin_port);
+	pthread_create(&thread, NULL, StandInServe, server);
+	pthread_detach(thread);
+}
+
+#define EXPECT(condition, ...) \
+	do { if (!(condition)) { printf("%s: ", name); printf(__VA_ARGS__); printf("\n"); errors++; } } while (0)
+
+/* Fetches length positions through netdb from a fresh stand-in and checks
+   the answers and what the stand-in saw. Returns the number of errors. */
+static int CheckFetch(char *name, BOOLEAN offerBinary, int closeAfter, int length)
+{
+	static char address[64];
+	STANDIN server;
+	DB_Table db;
+	POSITION *positions = (POSITION *) SafeMalloc(length * sizeof(POSITION));
+	VALUE *values = (VALUE *) SafeMalloc(length * sizeof(VALUE));
+	REMOTENESS *remotenesses = (REMOTENESS *) SafeMalloc(length * sizeof(REMOTENESS));
+	int batches = (length + NETDB_BATCH_SIZE - 1) / NETDB_BATCH_SIZE;
+	int inFlight = (batches < NETDB_PIPELINE_DEPTH) ? batches : NETDB_PIPELINE_DEPTH;
+	int i, wrong = 0, errors = 0;
+	unsigned short cell;
+
+	StandInStart(&server, 0, offerBinary, closeAfter);
+	snprintf(address, sizeof(address), "127.0.0.1:%d/GamesmanServlet", server.port);
+	ServerAddress = address;
+	for (i = 0; i < length; i++)
+		positions[i] = (POSITION) i * 7919 + 11;
+
+	memset(&db, 0, sizeof(db));
+	netdb_init(&db);
+	db.load_database();
+	db.get_bulk(positions, values, remotenesses, length);
+	db.free_db();
+
+	for (i = 0; i < length; i++) {
+		cell = StandInCell(positions[i]);
+		if (values[i] != (VALUE) (cell & VALUE_MASK) ||
+		    remotenesses[i] != (REMOTENESS) ((cell & REMOTENESS_MASK) >> REMOTENESS_SHIFT))
+			wrong++;
+	}
+	EXPECT(wrong == 0, "%d of %d answers wrong", wrong, length);
+	EXPECT(server.errors == 0, "%d malformed requests", server.errors);
+	EXPECT(server.maxBatch == ((length < NETDB_BATCH_SIZE) ? length : NETDB_BATCH_SIZE),
+	      "largest batch %d", server.maxBatch);
+	if (offerBinary)
+		EXPECT(server.httpBatches == 0 && server.binaryBatches >= batches,
+		      "%d HTTP and %d binary batches", server.httpBatches, server.binaryBatches);
+	else
+		EXPECT(server.binaryBatches == 0 && server.httpBatches >= batches,
+		      "%d HTTP and %d binary batches", server.httpBatches, server.binaryBatches);
+	if (closeAfter == 0) {
+		EXPECT(server.positions == length, "server saw %d positions", server.positions);
+		EXPECT(server.maxInFlight == inFlight, "%d batches in flight, expected %d", server.maxInFlight, inFlight);
+		EXPECT(server.connections == 1 && server.inits == 1,
+		      "%d connections, %d InitDatabase", server.connections, server.inits);
+	} else {
+		EXPECT(server.maxInFlight <= NETDB_PIPELINE_DEPTH, "%d batches in flight", server.maxInFlight);
+		/* only binary frames need a new handshake on the new connection */
+		EXPECT(server.connections == 2 && server.inits == (offerBinary ? 2 : 1),
+		      "%d connections, %d InitDatabase", server.connections, server.inits);
+	}
+	printf("%-28s %s: %d positions, %d HTTP and %d binary batches, %d in flight, %d connection%s\n",
+	       name, errors ? "FAILED" : "ok", length, server.httpBatches, server.binaryBatches,
+	       server.maxInFlight, server.connections, server.connections == 1 ? "" : "s");
+
+	SafeFree(positions);
+	SafeFree(values);
+	SafeFree(remotenesses);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	STANDIN server;
+	int errors = 0;
+
+	if (argc == 3 && !strcmp(argv[1], "-s")) {
+		StandInStart(&server, atoi(argv[2]), TRUE, 0);
+		printf("Serving on 127.0.0.1:%d\n", server.port);
+		pause();
+		return 0;
+	}
+
+	kDBName = "netdb_test";
+	errors += CheckFetch("http", FALSE, 0, 4500);
+	errors += CheckFetch("binary", TRUE, 0, 4500);
+	errors += CheckFetch("binary, one batch", TRUE, 0, 100);
+	errors += CheckFetch("http, server drops", FALSE, 2, 4500);
+	errors += CheckFetch("binary, server drops", TRUE, 2, 4500);
+
+	printf(errors ? "%d errors\n" : "All passed\n", errors);
+	return errors ? 1 : 0;
+}
@@ -4,11 +4,13 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <netinet/in.h>
 #include "openPositions.h"
 #include "solveloopy.h"
 #include "gameplay.h"
 #include "misc.h"
+#include "threadpool.h"
 
 #include "analysis.h"
 //MATT
@@ -20,6 +22,7 @@ POSITIONLIST* headNodeDP;
 POSITIONLIST* tailNodeDP;
 char* corruptedPositions;
 char* fringePositions;
+static char* drawPositions = NULL;	/* 1 where the values DB has a tie at REMOTENESS_MAX */
 extern char* gNumberChildren;
 extern char* gNumberChildrenOriginal;
 extern POSITION gNumberOfPositions;
@@ -30,6 +33,7 @@ static void             DrawParentInitialize                (void);
 static void    			DeterminePure1           			(POSITION pos);
 static void             DrawParentFree                      (void);
 static void             SetDrawParents                      (POSITION bad, POSITION root);
+static void             FreeDR                              (void);
 
 void InitializeOpenPositions(int numPossiblePositions)
 {
@@ -140,17 +144,105 @@ void PropogateFreAndCorUp(POSITION p)
 {
 	PropogateFreAndCorUpFringe(p, 0);
 }
+
+/* While corruption levels are fixed, DetermineFreAndCorDown1LevelForWin is
+   asked about the same few thousand winning positions millions of times, so
+   their children are kept here until ComputeOpenPositions returns (open
+   addressing on the position, children packed in move order in
+   openChildPool). */
+typedef struct {
+	POSITION position;
+	POSITION first;
+	unsigned int count;
+	BOOLEAN used;
+} OPENCHILDREN;
+
+static OPENCHILDREN* openChildTable = NULL;
+static POSITION openChildTableSize = 0, openChildTableUsed = 0;
+static POSITION* openChildPool = NULL;
+static POSITION openChildPoolUsed = 0, openChildPoolCapacity = 0;
+
+static OPENCHILDREN* openChildSlot(OPENCHILDREN* table, POSITION size, POSITION p)
+{
+	POSITION i=(p*0x9E3779B97F4A7C15ULL)&(size-1);
+	while(table[i].used && table[i].position!=p)
+		i=(i+1)&(size-1);
+	return &table[i];
+}
+
+static void openChildCacheInitialize(void)
+{
+	openChildTableSize=1024;
+	openChildTableUsed=0;
+	openChildTable=(OPENCHILDREN*)SafeCalloc(openChildTableSize,sizeof(OPENCHILDREN));
+	openChildPoolUsed=0;
+	openChildPoolCapacity=0;
+	openChildPool=NULL;
+}
+
+static void openChildCacheFree(void)
+{
+	if(openChildTable) SafeFree(openChildTable);
+	if(openChildPool) SafeFree(openChildPool);
+	openChildTable=NULL;
+	openChildPool=NULL;
+	openChildTableSize=openChildTableUsed=0;
+	openChildPoolUsed=openChildPoolCapacity=0;
+}
+
+/* the children of P in move order; valid until the next call */
+static POSITION* openChildren(POSITION p, unsigned int* count)
+{
+	OPENCHILDREN* slot;
+	MOVELIST *moves, *temp;
+	if(!openChildTable) openChildCacheInitialize();
+	slot=openChildSlot(openChildTable,openChildTableSize,p);
+	if(!slot->used)
+	{
+		if(2*(openChildTableUsed+1)>openChildTableSize)
+		{
+			OPENCHILDREN* old=openChildTable;
+			POSITION oldSize=openChildTableSize, i;
+			openChildTableSize*=2;
+			openChildTable=(OPENCHILDREN*)SafeCalloc(openChildTableSize,sizeof(OPENCHILDREN));
+			for(i=0; i<oldSize; i++)
+				if(old[i].used) *openChildSlot(openChildTable,openChildTableSize,old[i].position)=old[i];
+			SafeFree(old);
+			slot=openChildSlot(openChildTable,openChildTableSize,p);
+		}
+		slot->used=TRUE;
+		slot->position=p;
+		slot->first=openChildPoolUsed;
+		slot->count=0;
+		openChildTableUsed++;
+		moves=temp=GenerateMoves(p);
+		for(; moves; moves=moves->next)
+		{
+			if(openChildPoolUsed==openChildPoolCapacity)
+			{
+				openChildPoolCapacity=openChildPoolCapacity ? 2*openChildPoolCapacity : 4096;
+				openChildPool=openChildPool ? (POSITION*)SafeRealloc(openChildPool,openChildPoolCapacity*sizeof(POSITION)) : (POSITION*)SafeMalloc(openChildPoolCapacity*sizeof(POSITION));
+			}
+			openChildPool[openChildPoolUsed++]=DoMove(p,moves->move);
+			slot->count++;
+		}
+		FreeMoveList(temp);
+	}
+	*count=slot->count;
+	return openChildPool+slot->first;
+}
+
 OPEN_POS_DATA DetermineFreAndCorDown1LevelForWin(POSITION p)
 {
 	OPEN_POS_DATA dat=GetOpenData(p);
-	MOVELIST* moves=GenerateMoves(p);
-	MOVELIST* temp=moves;
+	unsigned int numChildren, k;
+	POSITION* children=openChildren(p,&numChildren);
 	int count=0;
 	int minFremoteness=FREMOTENESS_MAX;
 	int minCorruption=CORRUPTION_MAX;
-	for(; moves; moves=moves->next)
+	for(k=0; k<numChildren; k++)
 	{
-		POSITION child=DoMove(p,moves->move);
+		POSITION child=children[k];
 		OPEN_POS_DATA cdat=GetOpenData(child);
 		if(GetDrawValue(cdat)!=lose || GetLevelNumber(cdat)!=GetLevelNumber(dat)) continue;
 		if(GetCorruptionLevel(cdat)==minCorruption && GetFremoteness(cdat)<minFremoteness)
@@ -166,7 +258,6 @@ OPEN_POS_DATA DetermineFreAndCorDown1LevelForWin(POSITION p)
 		}
 		count++;
 	}
-	FreeMoveList(temp);
 	if(count==0) return GetOpenData(p);
 	dat=SetFremoteness(SetCorruptionLevel(dat,minCorruption),minFremoteness+1);
 	return dat;
@@ -256,14 +347,199 @@ void AddToParentsChildrenCount(POSITION child, int amt)
 	for(; parents; parents=parents->next)
 		gNumberChildren[parents->position]+=amt;
 }
+
+/* The whole-array scans of ComputeOpenPositions write only the position they
+   visit, so they run in chunks on --threads workers when the module passes
+   ParallelSolveSafe. Each chunk keeps the positions it would have
+   queued in scan order and the caller queues them chunk by chunk, which
+   leaves the frontiers, and so the saved DB, exactly as a serial scan would. */
+#define OPEN_CHUNK_POSITIONS (1 << 16)
+
+typedef struct {
+	POSITION first, last;           /* scans [first, last) */
+	int level, corruption;
+	POSITION *wins, *loses;         /* positions to queue, in scan order */
+	POSITION numWins, numLoses, winCapacity, loseCapacity;
+} OPENCHUNK;
+
+static void openChunkPush(POSITION **list, POSITION *count, POSITION *capacity, POSITION pos)
+{
+	if(*count==*capacity)
+	{
+		*capacity=*capacity ? 2**capacity : 1024;
+		*list=*list ? (POSITION*)SafeRealloc(*list,*capacity*sizeof(POSITION)) : (POSITION*)SafeMalloc(*capacity*sizeof(POSITION));
+	}
+	(*list)[(*count)++]=pos;
+}
+
+static void openRunChunks(THREADPOOL* pool, THREADTASK task, OPENCHUNK* chunks, int numChunks, int level, int corruption)
+{
+	int c;
+	for(c=0; c<numChunks; c++)
+	{
+		chunks[c].level=level;
+		chunks[c].corruption=corruption;
+		chunks[c].numWins=chunks[c].numLoses=0;
+		if(pool) ThreadPoolSubmit(pool,task,&chunks[c]);
+		else task(&chunks[c]);
+	}
+	if(pool) ThreadPoolWait(pool);
+}
+
+/* queue what the chunks collected, in position order */
+static int openQueueChunks(OPENCHUNK* chunks, int numChunks)
+{
+	int c, queued=0;
+	POSITION k;
+	for(c=0; c<numChunks; c++)
+	{
+		for(k=0; k<chunks[c].numWins; k++)
+			InsertWinFR(chunks[c].wins[k]);
+		for(k=0; k<chunks[c].numLoses; k++)
+			InsertLoseFR(chunks[c].loses[k]);
+		queued+=chunks[c].numWins+chunks[c].numLoses;
+	}
+	return queued;
+}
+
+/* several chunks may adjust the count of the same parent */
+static void addToParentsChildrenCountShared(POSITION child, int amt)
+{
+	POSITIONLIST* parents=gParents[child];
+	for(; parents; parents=parents->next)
+		__atomic_fetch_add(&gNumberChildren[parents->position],(char)amt,__ATOMIC_RELAXED);
+}
+
+/* Only undecided positions become (losing) fringes here, so the winning
+   children each one inspects are the same whatever the other chunks do.
+   The first level's scan also fills in drawPositions for everything after. */
+static void openFringeScan(void* arg)
+{
+	OPENCHUNK* chunk=(OPENCHUNK*)arg;
+	POSITION iter;
+	for(iter=chunk->first; iter<chunk->last; iter++)
+	{
+		OPEN_POS_DATA dat=GetOpenData(iter);
+		if(chunk->level==1)
+			drawPositions[iter]=(GetValueOfPosition(iter)==tie && Remoteness(iter)==REMOTENESS_MAX);
+
+		/* if the number of children of an undecided value is less than the original number of children but >0, it
+		   has a winning child and is therefore a fringe */
+		if(gNumberChildren[iter]>0&&gNumberChildren[iter]<gNumberChildrenOriginal[iter]&&GetDrawValue(dat)==undecided && drawPositions[iter])
+		{
+			if(chunk->level==1) dat=SetCorruptionLevel(dat,0);
+			else
+			{
+				int maxWinChildCorr=0;
+				MOVELIST* moves=GenerateMoves(iter);
+				MOVELIST* temp=moves;
+				for(; moves; moves=moves->next)
+				{
+					POSITION child=DoMove(iter,moves->move);
+					OPEN_POS_DATA cdat=GetOpenData(child);
+					if(GetDrawValue(cdat)!=win) continue;
+					if(GetCorruptionLevel(cdat)>maxWinChildCorr) maxWinChildCorr=GetCorruptionLevel(cdat);
+				}
+				FreeMoveList(temp);
+				dat=SetCorruptionLevel(dat,maxWinChildCorr);
+			}
+			SetOpenData(iter,SetFringe(SetLevelNumber(SetFremoteness(SetDrawValue(dat,lose),0),chunk->level),1));
+			openChunkPush(&chunk->loses,&chunk->numLoses,&chunk->loseCapacity,iter);
+			fringePositions[iter]=1;
+		}
+	}
+}
+
+/* load the win/lose frontier and subtract off children from the counts of their parents if they're not in the
+   current level and they are losing */
+static void openFrontierScan(void* arg)
+{
+	OPENCHUNK* chunk=(OPENCHUNK*)arg;
+	POSITION iter;
+	int i=chunk->corruption;
+	for(iter=chunk->first; iter<chunk->last; iter++)
+	{
+		OPEN_POS_DATA dat=GetOpenData(iter);
+		corruptedPositions[iter]=0;
+		if(GetFringe(dat) && GetFremoteness(dat)) printf("ASDFDASFDASDFA!\n");
+		if((GetCorruptionLevel(dat)>i && GetDrawValue(dat)==lose && GetLevelNumber(dat)==chunk->level))
+		{
+			if(GetDrawValue(dat)==undecided) continue;
+			addToParentsChildrenCountShared(iter,-1);
+		}
+		else if(GetCorruptionLevel(dat)==i && GetLevelNumber(dat)==chunk->level)
+		{
+			if(GetDrawValue(dat)==win)
+			{
+				openChunkPush(&chunk->wins,&chunk->numWins,&chunk->winCapacity,iter);
+				addToParentsChildrenCountShared(iter,1);
+			}
+			else if(GetDrawValue(dat)==lose)
+				openChunkPush(&chunk->loses,&chunk->numLoses,&chunk->loseCapacity,iter);
+		}
+	}
+}
+
+/* undo the count adjustment of openFrontierScan after having fixed */
+static void openUndoScan(void* arg)
+{
+	OPENCHUNK* chunk=(OPENCHUNK*)arg;
+	POSITION iter;
+	for(iter=chunk->first; iter<chunk->last; iter++)
+	{
+		OPEN_POS_DATA dat=GetOpenData(iter);
+		if(GetCorruptionLevel(dat)>chunk->corruption && GetDrawValue(dat)==lose && GetLevelNumber(dat)==chunk->level)
+			addToParentsChildrenCountShared(iter,1);
+	}
+}
+
+/* Loop length of each fringe position: the longest non-fringe child of its
+   level. Only fringes are written, and those are never read back. */
+static void openFringeFremoteness(void* arg)
+{
+	OPENCHUNK* chunk=(OPENCHUNK*)arg;
+	POSITION iter;
+	for(iter=chunk->first; iter<chunk->last; iter++)
+	{
+		int maxFremote=0;
+		OPEN_POS_DATA dat=GetOpenData(iter);
+		MOVELIST *moves, *temp;
+		if(!drawPositions[iter] || !GetFringe(dat)) continue;
+		moves=temp=GenerateMoves(iter);
+		for(; moves; moves=moves->next)
+		{
+			POSITION child=DoMove(iter,moves->move);
+			OPEN_POS_DATA cdat=GetOpenData(child);
+			if(!GetFringe(cdat) && GetLevelNumber(cdat)==GetLevelNumber(dat) && GetFremoteness(cdat)>maxFremote)
+				maxFremote=GetFremoteness(cdat);
+		}
+		FreeMoveList(temp);
+		SetOpenData(iter,SetFremoteness(dat,maxFremote+1));
+	}
+}
+
 void ComputeOpenPositions()
 {
 	int curLevel=1;
 	POSITION iter;
+	int numThreads=(gNumThreads>0 && ParallelSolveSafe()) ? gNumThreads : 1;
+	THREADPOOL* pool;
+	OPENCHUNK* chunks;
+	int numChunks, c;
 	InitializeOpenPositions(gNumberOfPositions);
 	if(!openPosData) return;
 	//PrintChildrenCounts();
 
+	pool=(numThreads>1) ? ThreadPoolCreate(numThreads) : NULL;
+	numChunks=(int)((gNumberOfPositions+OPEN_CHUNK_POSITIONS-1)/OPEN_CHUNK_POSITIONS);
+	chunks=(OPENCHUNK*)SafeCalloc(numChunks,sizeof(OPENCHUNK));
+	for(c=0; c<numChunks; c++)
+	{
+		chunks[c].first=(POSITION)c*OPEN_CHUNK_POSITIONS;
+		chunks[c].last=(c==numChunks-1) ? gNumberOfPositions : chunks[c].first+OPEN_CHUNK_POSITIONS;
+	}
+	drawPositions=(char*)SafeMalloc(gNumberOfPositions*sizeof(char));
+
 	InitializeFR();
 
 	while(1)
@@ -273,38 +549,8 @@ void ComputeOpenPositions()
 		int i;
 		/* first, find all fringe positions */
 		printf("Get going!\n");
-		for(iter=0; iter<gNumberOfPositions; iter++)
-		{
-			OPEN_POS_DATA dat=GetOpenData(iter);
-
-			/* if the number of children of an undecided value is less than the original number of children but >0, it
-			   has a winning child and is therefore a fringe */
-			//printf("Pos %d has %d/%d children\n",iter,(int)gNumberChildren[iter],(int)gNumberChildrenOriginal[iter]);
-			if(gNumberChildren[iter]>0&&gNumberChildren[iter]<gNumberChildrenOriginal[iter]&&GetDrawValue(dat)==undecided && GetValueOfPosition(iter)==tie && Remoteness(iter)==REMOTENESS_MAX)
-			{
-				if(curLevel==1) dat=SetCorruptionLevel(dat,0);
-				else
-				{
-					int maxWinChildCorr=0;
-					MOVELIST* moves=GenerateMoves(iter);
-					MOVELIST* temp=moves;
-					for(; moves; moves=moves->next)
-					{
-						POSITION child=DoMove(iter,moves->move);
-						OPEN_POS_DATA cdat=GetOpenData(child);
-						if(GetDrawValue(cdat)!=win) continue;
-						if(GetCorruptionLevel(cdat)>maxWinChildCorr) maxWinChildCorr=GetCorruptionLevel(cdat);
-					}
-					FreeMoveList(temp);
-					dat=SetCorruptionLevel(dat,maxWinChildCorr);
-				}
-				//printf("Corruption level of %d is %d\n",iter,GetCorruptionLevel(dat));
-				SetOpenData(iter,SetFringe(SetLevelNumber(SetFremoteness(SetDrawValue(dat,lose),0),curLevel),1));
-				InsertLoseFR(iter);
-				fringePosCount++;
-				fringePositions[iter]=1;
-			}
-		}
+		openRunChunks(pool,openFringeScan,chunks,numChunks,curLevel,0);
+		fringePosCount=openQueueChunks(chunks,numChunks);
 		/* if we didn't find any fringe positions, we just label everyone else as pure ties */
 		if(fringePosCount==0) {
 			//printf("Done!!!\n");
@@ -325,7 +571,7 @@ void ComputeOpenPositions()
 				{
 					OPEN_POS_DATA pdat;
 					OPEN_POS_DATA old;
-					if(!(GetValueOfPosition(parents->position)==tie && Remoteness(parents->position)==REMOTENESS_MAX)) continue;
+					if(!drawPositions[parents->position]) continue;
 					pdat=GetOpenData(parents->position);
 					/* If my parent is already a lose and not already corrupted, corrupt it and move on */
 					if(GetDrawValue(pdat)==lose)
@@ -388,7 +634,7 @@ void ComputeOpenPositions()
 				{
 					OPEN_POS_DATA pdat;
 					OPEN_POS_DATA old;
-					if(!(GetValueOfPosition(parents->position)==tie && Remoteness(parents->position)==REMOTENESS_MAX)) continue;
+					if(!drawPositions[parents->position]) continue;
 					pdat=GetOpenData(parents->position);
 					if(GetFringe(pdat)) continue;
 					if(--gNumberChildren[parents->position]==0)
@@ -417,29 +663,8 @@ void ComputeOpenPositions()
 		/* all that's left is to do fixing at each corruption level. */
 		for(i=0; i<curLevel; i++)
 		{
-			/* load the win/lose frontier and subtract off children from the counts of their parents if they're not in the
-			   current level and they are losing */
-			for(iter=0; iter<gNumberOfPositions; iter++)
-			{
-				OPEN_POS_DATA dat=GetOpenData(iter);
-				corruptedPositions[iter]=0;
-				if(GetFringe(dat) && GetFremoteness(dat)) printf("ASDFDASFDASDFA!\n");
-				if((GetCorruptionLevel(dat)>i && GetDrawValue(dat)==lose && GetLevelNumber(dat)==curLevel))
-				{
-					if(GetDrawValue(dat)==undecided) continue;
-					AddToParentsChildrenCount(iter,-1);
-				}
-				else if(GetCorruptionLevel(dat)==i && GetLevelNumber(dat)==curLevel)
-				{
-					if(GetDrawValue(dat)==win)
-					{
-						InsertWinFR(iter);
-						AddToParentsChildrenCount(iter,1);
-					}
-					else if(GetDrawValue(dat)==lose)
-						InsertLoseFR(iter);
-				}
-			}
+			openRunChunks(pool,openFrontierScan,chunks,numChunks,curLevel,i);
+			openQueueChunks(chunks,numChunks);
 			/* solve, fixing */
 			printf("here1\n");
 			while(gHeadLoseFR || gHeadWinFR)
@@ -454,7 +679,7 @@ void ComputeOpenPositions()
 					{
 						OPEN_POS_DATA pdat=GetOpenData(parents->position);
 						OPEN_POS_DATA old;
-						if(!(GetValueOfPosition(parents->position)==tie && Remoteness(parents->position)==REMOTENESS_MAX)) continue;
+						if(!drawPositions[parents->position]) continue;
 						old=pdat;
 						/* If I've got a losing parent of the same corruption level, it's legit. */
 						if(GetDrawValue(pdat)==lose && GetCorruptionLevel(pdat)==i) continue;
@@ -501,7 +726,7 @@ void ComputeOpenPositions()
 					{
 						OPEN_POS_DATA pdat;
 						OPEN_POS_DATA old;
-						if(!(GetValueOfPosition(parents->position)==tie && Remoteness(parents->position)==REMOTENESS_MAX)) continue;
+						if(!drawPositions[parents->position]) continue;
 						pdat=GetOpenData(parents->position);
 						old=pdat;
 						if(GetCorruptionLevel(pdat)<i) continue;
@@ -540,61 +765,52 @@ void ComputeOpenPositions()
 				}
 			}
 			/* undo our first step after having fixed */
-			for(iter=0; iter<gNumberOfPositions; iter++)
-			{
-				OPEN_POS_DATA dat=GetOpenData(iter);
-				if(GetCorruptionLevel(dat)>i && GetDrawValue(dat)==lose && GetLevelNumber(dat)==curLevel)
-				{
-					if(GetDrawValue(dat)==undecided) continue;
-					AddToParentsChildrenCount(iter,1);
-				}
-			}
+			openRunChunks(pool,openUndoScan,chunks,numChunks,curLevel,i);
 			printf("here2\n");
 		}
 		//PrintChildrenCounts();
 
 		curLevel++;
 	}
-	/* One more thing... find loop lengths for fringe positions and label drawdraws */
+	/* One more thing... label drawdraws, then find loop lengths for fringe positions */
 	for(iter=0; iter<gNumberOfPositions; iter++)
 	{
-		int maxFremote=0;
 		OPEN_POS_DATA dat=GetOpenData(iter);
-		MOVELIST* moves;
 		//printf("There%d\n",iter);
 		//PrintSingleOpenData(iter);
-		if(GetValueOfPosition(iter)==tie && Remoteness(iter)==REMOTENESS_MAX) {
-			if (GetDrawValue(dat) == undecided) {
-				dat=SetDrawValue(dat,tie);
-				dat=SetFremoteness(dat,0xFFFFFFFF);
-				SetOpenData(iter,dat);
-				gAnalysis.DrawDraws +=1;                                        //MATT
-			} else {
-				gAnalysis.DetailedOpenSummary[GetLevelNumber(dat)][GetCorruptionLevel(dat)][GetFremoteness(dat)][GetDrawValue(dat)]+=1;
-				gAnalysis.OpenSummary[GetDrawValue(dat)]+=1;
-				if(GetCorruptionLevel(dat)>gAnalysis.LargestFoundCorruption) gAnalysis.LargestFoundCorruption=GetCorruptionLevel(dat);  //MATT/David
-			}
-			if(GetCorruptionLevel(dat)>GetLevelNumber(dat)) PrintSingleOpenData(iter);
-			if(GetDrawValue(dat)==win && GetFremoteness(dat)==0) PrintSingleOpenData(iter);
+		if(!drawPositions[iter]) continue;
+		if (GetDrawValue(dat) == undecided) {
+			dat=SetDrawValue(dat,tie);
+			dat=SetFremoteness(dat,0xFFFFFFFF);
+			SetOpenData(iter,dat);
+			gAnalysis.DrawDraws +=1;                                        //MATT
+		} else {
+			gAnalysis.DetailedOpenSummary[GetLevelNumber(dat)][GetCorruptionLevel(dat)][GetFremoteness(dat)][GetDrawValue(dat)]+=1;
+			gAnalysis.OpenSummary[GetDrawValue(dat)]+=1;
+			if(GetCorruptionLevel(dat)>gAnalysis.LargestFoundCorruption) gAnalysis.LargestFoundCorruption=GetCorruptionLevel(dat);  //MATT/David
 		}
-		else continue;
-		if(!GetFringe(dat)) continue;
-		if(GetFremoteness(dat)!=0)
+		if(GetCorruptionLevel(dat)>GetLevelNumber(dat)) PrintSingleOpenData(iter);
+		if(GetDrawValue(dat)==win && GetFremoteness(dat)==0) PrintSingleOpenData(iter);
+		if(GetFringe(dat) && GetFremoteness(dat)!=0)
 		{
 			printf("ACKKKK!\n");
 			PrintSingleOpenData(iter);
 		}
-		moves=GenerateMoves(iter);
-		for(; moves; moves=moves->next)
-		{
-			POSITION child=DoMove(iter,moves->move);
-			OPEN_POS_DATA cdat=GetOpenData(child);
-			if(!GetFringe(cdat) && GetLevelNumber(cdat)==GetLevelNumber(dat) && GetFremoteness(cdat)>maxFremote)
-				maxFremote=GetFremoteness(cdat);
-		}
-		dat=SetFremoteness(dat,maxFremote+1);
-		SetOpenData(iter,dat);
 	}
+	/* drawdraws sit at level 0 and fringes are skipped, so no fringe sees a
+	   child that changes under it */
+	openRunChunks(pool,openFringeFremoteness,chunks,numChunks,0,0);
+
+	for(c=0; c<numChunks; c++)
+	{
+		if(chunks[c].wins) SafeFree(chunks[c].wins);
+		if(chunks[c].loses) SafeFree(chunks[c].loses);
+	}
+	SafeFree(chunks);
+	ThreadPoolDestroy(pool);
+	SafeFree(drawPositions);
+	drawPositions=NULL;
+	openChildCacheFree();
 	CleanupOpenPositions();
 	return;
 }
@@ -878,12 +1094,9 @@ REMOTENESS*  		gPositionLevel = NULL;  /* A list of each position's draw level *
 VALUE*  			gPositionValue = NULL;	/* A list of each position's value (win/lose/undecided/draw) */
 int 				level = 0;
 int 				maxLevel = 0;
-FRnode*         	gHeadWinDR = NULL;      /* The FRontier Win Queue */
-FRnode*         	gTailWinDR = NULL;
-FRnode*         	gHeadLoseDR = NULL;     /* The FRontier Lose Queue */
-FRnode*         	gTailLoseDR = NULL;
-FRnode*         	gHeadTieDR = NULL;      /* The FRontier Tie Queue */
-FRnode*         	gTailTieDR = NULL;
+DRQUEUE         	gWinDR = { NULL, 0, 0, 0 };     /* The FRontier Win Queue */
+DRQUEUE         	gLoseDR = { NULL, 0, 0, 0 };    /* The FRontier Lose Queue */
+DRQUEUE         	gTieDR = { NULL, 0, 0, 0 };     /* The FRontier Tie Queue */
 POSITIONLIST**  	gDrawParents = NULL;        /* The Parent of each node in a list */
 char*           	gDrawNumberChildren = NULL; /* The Number of children (used for Loopy games) */
 char*       		gDrawNumberChildrenOriginal = NULL;
@@ -946,6 +1159,7 @@ BOOLEAN DeterminePure(POSITION position)
 	/* free */
 	DrawNumberChildrenFree();  
 	DrawParentFree();
+	FreeDR();
 
 	PrintDrawAnalysis();
 
@@ -977,7 +1191,7 @@ void DeterminePure1(POSITION position)
 
 	/* Now, the fun part. Starting from the children, work your way back up. */
 	//@@ separate lose/win frontiers
-	while ((gHeadLoseDR != NULL) || (gHeadWinDR != NULL)) {
+	while (!DRQueueEmpty(&gLoseDR) || !DRQueueEmpty(&gWinDR)) {
 
 		if ((child = DeQueueLoseDR()) == kBadPosition)
 			child = DeQueueWinDR();
@@ -1076,7 +1290,7 @@ void DeterminePure1(POSITION position)
 	} /* while still positions in FR */
 
 	/* Now process the tie frontier */
-	while(gHeadTieDR != NULL) {
+	while(!DRQueueEmpty(&gTieDR)) {
 		child = DeQueueTieDR();
 
 		ptr = gDrawParents[child];
@@ -1157,6 +1371,74 @@ void DeterminePure1(POSITION position)
 	}
 }
 
+/* SetDrawParents expands a BFS level in chunks on --threads workers (when
+   the module passes ParallelSolveSafe) and then records parents, counts and frontiers in the order the serial walk
+   did, so gDrawParents lists and the DR queues come out the same. */
+#define DRAW_CHUNK_POSITIONS 4096
+
+typedef struct {
+	POSITION *positions;    /* slice of the level */
+	POSITION count;
+	POSITION *children;     /* children of every position, in move order */
+	unsigned int *numChildren;
+	POSITION numEdges, capacity;
+	VALUE *values;          /* Primitive of each position, for newly found ones */
+} DRAWCHUNK;
+
+static void drawExpandChunk(void *arg)
+{
+	DRAWCHUNK *chunk = (DRAWCHUNK *) arg;
+	MOVELIST *moveptr, *movehead;
+	POSITION k, pos, child;
+
+	chunk->numEdges = 0;
+	for (k = 0; k < chunk->count; k++) {
+		pos = chunk->positions[k];
+		chunk->numChildren[k] = 0;
+		movehead = GenerateMoves(pos);
+		for (moveptr = movehead; moveptr != NULL; moveptr = moveptr->next) {
+			child = DoMove(pos, moveptr->move);
+			if (gSymmetries)
+				child = gCanonicalPosition(child);
+
+			if (child >= gNumberOfPositions)
+				FoundBadPosition(child, pos, moveptr->move);
+			if (chunk->numEdges == chunk->capacity) {
+				chunk->capacity = chunk->capacity ? 2 * chunk->capacity : DRAW_CHUNK_POSITIONS;
+				chunk->children = chunk->children ?
+				                  (POSITION *) SafeRealloc(chunk->children, chunk->capacity * sizeof(POSITION)) :
+				                  (POSITION *) SafeMalloc(chunk->capacity * sizeof(POSITION));
+			}
+			chunk->children[chunk->numEdges++] = child;
+			chunk->numChildren[k]++;
+		}
+		FreeMoveList(movehead);
+	}
+}
+
+static void drawPrimitiveChunk(void *arg)
+{
+	DRAWCHUNK *chunk = (DRAWCHUNK *) arg;
+	POSITION k;
+
+	for (k = 0; k < chunk->count; k++)
+		chunk->values[k] = Primitive(chunk->positions[k]);
+}
+
+static void drawRunChunks(THREADPOOL *pool, THREADTASK task, DRAWCHUNK *chunks, int numChunks)
+{
+	int c;
+
+	for (c = 0; c < numChunks; c++) {
+		if (pool)
+			ThreadPoolSubmit(pool, task, &chunks[c]);
+		else
+			task(&chunks[c]);
+	}
+	if (pool)
+		ThreadPoolWait(pool);
+}
+
 /*
 ** Requires: the root has not been visited yet
 ** (We do not check to see if its been visited)
@@ -1165,14 +1447,14 @@ void DeterminePure1(POSITION position)
 /* BFS from root.  */
 void SetDrawParents (POSITION parent, POSITION root)
 {
-	MOVELIST*       moveptr = NULL;
-	MOVELIST*       movehead = NULL;
-	POSITIONLIST*   posptr = NULL;
-	POSITIONLIST*   thisLevel = NULL;
-	POSITIONLIST*   nextLevel = NULL;
-	POSITION pos;
-	POSITION child;
+	POSITION *thisLevel, *found;
+	POSITION levelSize, numFound, nextSize, k, e, j;
+	DRAWCHUNK *chunks;
+	VALUE *values;
 	VALUE value;
+	int numChunks, c;
+	int numThreads = (gNumThreads > 0 && ParallelSolveSafe()) ? gNumThreads : 1;
+	THREADPOOL *pool = (numThreads > 1) ? ThreadPoolCreate(numThreads) : NULL;
 
 	// Check if the top is primitive.
 	// Robert Shi: I don't think it is safe to comment out this block.
@@ -1192,56 +1474,91 @@ void SetDrawParents (POSITION parent, POSITION root)
 	// 	return;
 	// }
 
-	thisLevel = StorePositionInList(root, thisLevel);
-
-	while (thisLevel != NULL) {
-		POSITIONLIST *next;
-		for (posptr = thisLevel; posptr != NULL; posptr = next) {
-			next = posptr->next;
-			pos = posptr->position;
-			movehead = GenerateMoves(pos);
-
-			for (moveptr = movehead; moveptr != NULL; moveptr = moveptr->next) {
-				child = DoMove(pos, moveptr->move);
-				if (gSymmetries)
-					child = gCanonicalPosition(child);
-
-				if (child >= gNumberOfPositions)
-					FoundBadPosition(child, pos, moveptr->move);
-				// Robert Shi: (int) conversions may not be necessary.
-				++gDrawNumberChildren[(int)pos];
-				++gDrawNumberChildrenOriginal[(int)pos];
-				gDrawParents[(int)child] = StorePositionInList(pos, gDrawParents[(int)child]);
-
-				if (Visited(child)) continue;
-				MarkAsVisited(child);
-
-				if ((value = Primitive(child)) != undecided) { // If child is primitive.
-					switch (value) {
-					case lose: InsertLoseDR(child); break;
-					case win: InsertWinDR(child);  break;
-					case tie: InsertTieDR(child);  break;
-					default: BadElse("SetParents found bad primitive value");
-					}
-					gPositionValue[child] = value;
-					if (level > maxLevel) {
-						maxLevel = level;
-					}
-				} else {
-					nextLevel = StorePositionInList(child, nextLevel);
+	thisLevel = (POSITION *) SafeMalloc(sizeof(POSITION));
+	thisLevel[0] = root;
+	levelSize = 1;
+
+	while (levelSize > 0) {
+		numChunks = (int) ((levelSize + DRAW_CHUNK_POSITIONS - 1) / DRAW_CHUNK_POSITIONS);
+		chunks = (DRAWCHUNK *) SafeCalloc(numChunks, sizeof(DRAWCHUNK));
+		for (c = 0; c < numChunks; c++) {
+			chunks[c].positions = thisLevel + (POSITION) c * DRAW_CHUNK_POSITIONS;
+			chunks[c].count = (c == numChunks - 1) ? levelSize - (POSITION) c * DRAW_CHUNK_POSITIONS : DRAW_CHUNK_POSITIONS;
+			chunks[c].numChildren = (unsigned int *) SafeMalloc(chunks[c].count * sizeof(unsigned int));
+		}
+		drawRunChunks(pool, drawExpandChunk, chunks, numChunks);
+
+		/* Record every edge in the serial order, collecting first visits */
+		numFound = 0;
+		for (c = 0; c < numChunks; c++)
+			numFound += chunks[c].numEdges;
+		found = (POSITION *) SafeMalloc((numFound ? numFound : 1) * sizeof(POSITION));
+		numFound = 0;
+		for (c = 0; c < numChunks; c++) {
+			for (k = 0, e = 0; k < chunks[c].count; k++) {
+				POSITION pos = chunks[c].positions[k];
+				for (j = 0; j < chunks[c].numChildren[k]; j++) {
+					POSITION child = chunks[c].children[e++];
+					++gDrawNumberChildren[pos];
+					++gDrawNumberChildrenOriginal[pos];
+					gDrawParents[child] = StorePositionInList(pos, gDrawParents[child]);
+
+					if (Visited(child)) continue;
+					MarkAsVisited(child);
+					found[numFound++] = child;
+					// Robert Shi: Does this mess up the stat if this analysis is run after loopysolver?
+					gTotalMoves++;
 				}
-				// Robert Shi: Does this mess up the stat if this analysis is run after loopysolver?
-				gTotalMoves++;
 			}
-			FreeMoveList(movehead);
-
-			/* Free as we go */
-			free(posptr);
+			if (chunks[c].children)
+				SafeFree(chunks[c].children);
+			SafeFree(chunks[c].numChildren);
 		}
+		SafeFree(chunks);
+		SafeFree(thisLevel);
+
+		/* Evaluate the newly found positions */
+		values = (VALUE *) SafeMalloc((numFound ? numFound : 1) * sizeof(VALUE));
+		numChunks = (int) ((numFound + DRAW_CHUNK_POSITIONS - 1) / DRAW_CHUNK_POSITIONS);
+		chunks = (DRAWCHUNK *) SafeCalloc(numChunks ? numChunks : 1, sizeof(DRAWCHUNK));
+		for (c = 0; c < numChunks; c++) {
+			chunks[c].positions = found + (POSITION) c * DRAW_CHUNK_POSITIONS;
+			chunks[c].values = values + (POSITION) c * DRAW_CHUNK_POSITIONS;
+			chunks[c].count = (c == numChunks - 1) ? numFound - (POSITION) c * DRAW_CHUNK_POSITIONS : DRAW_CHUNK_POSITIONS;
+		}
+		drawRunChunks(pool, drawPrimitiveChunk, chunks, numChunks);
+		SafeFree(chunks);
+
+		/* The next level holds the undecided ones, most recently found first */
+		nextSize = 0;
+		for (j = 0; j < numFound; j++) {
+			if ((value = values[j]) != undecided) { // If child is primitive.
+				switch (value) {
+				case lose: InsertLoseDR(found[j]); break;
+				case win: InsertWinDR(found[j]);  break;
+				case tie: InsertTieDR(found[j]);  break;
+				default: BadElse("SetParents found bad primitive value");
+				}
+				gPositionValue[found[j]] = value;
+				if (level > maxLevel) {
+					maxLevel = level;
+				}
+			} else {
+				found[nextSize++] = found[j];
+			}
+		}
+		for (j = 0; j < nextSize / 2; j++) {
+			POSITION tmp = found[j];
+			found[j] = found[nextSize - 1 - j];
+			found[nextSize - 1 - j] = tmp;
+		}
+		SafeFree(values);
 
-		thisLevel = nextLevel;
-		nextLevel = NULL;
+		thisLevel = found;
+		levelSize = nextSize;
 	}
+	SafeFree(thisLevel);
+	ThreadPoolDestroy(pool);
 }
 
 
@@ -1321,81 +1638,91 @@ void DrawNumberChildrenFree()
 
 void InitializeDR()
 {
-	gHeadWinDR = NULL;
-	gTailWinDR = NULL;
-	gHeadLoseDR = NULL;
-	gTailLoseDR = NULL;
-	gHeadTieDR = NULL;
-	gTailTieDR = NULL;
+	gWinDR.head = gWinDR.tail = 0;
+	gLoseDR.head = gLoseDR.tail = 0;
+	gTieDR.head = gTieDR.tail = 0;
+}
+
+static void FreeDR(void)
+{
+	DRQUEUE *queues[3] = { &gWinDR, &gLoseDR, &gTieDR };
+	int q;
+
+	for (q = 0; q < 3; q++) {
+		if (queues[q]->positions)
+			SafeFree(queues[q]->positions);
+		queues[q]->positions = NULL;
+		queues[q]->head = queues[q]->tail = queues[q]->capacity = 0;
+	}
+}
+
+BOOLEAN DRQueueEmpty(DRQUEUE *queue)
+{
+	return queue->head == queue->tail;
 }
 
-static POSITION DeQueueDR(FRnode **gHeadFR, FRnode **gTailFR)
+static POSITION DeQueueDR(DRQUEUE *queue)
 {
 	POSITION position;
-	FRnode *tmp;
 
-	if (*gHeadFR == NULL)
+	if (queue->head == queue->tail)
 		return kBadPosition;
-	else {
-		position = (*gHeadFR)->position;
-		tmp = *gHeadFR;
-		(*gHeadFR) = (*gHeadFR)->next;
-		SafeFree(tmp);
-
-		if (*gHeadFR == NULL)
-			*gTailFR = NULL;
-	}
+	position = queue->positions[queue->head++];
+	if (queue->head == queue->tail)
+		queue->head = queue->tail = 0;
 	return position;
 }
 
 POSITION DeQueueWinDR()
 {
-	return DeQueueDR(&gHeadWinDR, &gTailWinDR);
+	return DeQueueDR(&gWinDR);
 }
 
 POSITION DeQueueLoseDR()
 {
-	return DeQueueDR(&gHeadLoseDR, &gTailLoseDR);
+	return DeQueueDR(&gLoseDR);
 }
 
 POSITION DeQueueTieDR()
 {
-	return DeQueueDR(&gHeadTieDR, &gTailTieDR);
+	return DeQueueDR(&gTieDR);
 }
 
-static void InsertDR(POSITION position, FRnode **firstnode,
-                     FRnode **lastnode)
+/* Array-backed FIFO: a full queue slides its live entries to the front when
+   at least half of it has been dequeued, and doubles otherwise. */
+static void InsertDR(POSITION position, DRQUEUE *queue)
 {
-	FRnode *tmp = (FRnode *) SafeMalloc(sizeof(FRnode));
-	tmp->position = position;
-	tmp->next = NULL;
-
-	if (*lastnode == NULL) {
-		assert(*firstnode == NULL);
-		*firstnode = tmp;
-		*lastnode = tmp;
-	} else {
-		assert((*lastnode)->next == NULL);
-		(*lastnode)->next = tmp;
-		*lastnode = tmp;
+	if (queue->tail == queue->capacity) {
+		if (queue->head > 0 && queue->head >= queue->capacity / 2) {
+			memmove(queue->positions, queue->positions + queue->head,
+			        (queue->tail - queue->head) * sizeof(POSITION));
+			queue->tail -= queue->head;
+			queue->head = 0;
+		} else {
+			queue->capacity = queue->capacity ? 2 * queue->capacity : 1024;
+			queue->positions = queue->positions ?
+			                   (POSITION *) SafeRealloc(queue->positions, queue->capacity * sizeof(POSITION)) :
+			                   (POSITION *) SafeMalloc(queue->capacity * sizeof(POSITION));
+		}
 	}
+	queue->positions[queue->tail++] = position;
 }
 
 void InsertWinDR(POSITION position)
 {
 	/* printf("Inserting WinFR...\n"); */
-	InsertDR(position, &gHeadWinDR, &gTailWinDR);
+	InsertDR(position, &gWinDR);
 }
 
 void InsertLoseDR(POSITION position)
 {
 	/* printf("Inserting LoseFR...\n"); */
-	InsertDR(position, &gHeadLoseDR, &gTailLoseDR);
+	InsertDR(position, &gLoseDR);
 }
 
 void InsertTieDR(POSITION position)
 {
-	InsertDR(position, &gHeadTieDR, &gTailTieDR);
+	InsertDR(position, &gTieDR);
 }
 
 void SetNewLevelFringe()
@@ -159,6 +159,12 @@ extern VALUE*              gPositionValue;
 extern REMOTENESS*         gPositionLevel;
 extern POSITIONLIST**      gDrawParents;
 
+/* FIFO of positions for the purity check's win/lose/tie frontiers */
+typedef struct {
+	POSITION *positions;
+	POSITION head, tail, capacity;  /* live entries are [head, tail) */
+} DRQUEUE;
+
 /* Functions relative to purity */
 BOOLEAN RunPurityCheck();
 //void SetDrawParents(POSITION parent, POSITION root);
@@ -173,6 +179,7 @@ BOOLEAN           DeterminePure             (POSITION position);
 void            DrawNumberChildrenInitialize        (void);
 void            DrawNumberChildrenFree              (void);
 void            InitializeDR                    (void);
+BOOLEAN         DRQueueEmpty                    (DRQUEUE *queue);
 
 POSITION        DeQueueWinDR                    (void);
 POSITION        DeQueueLoseDR                   (void);
@@ -188,12 +195,9 @@ void            PrintDrawAnalysis               (void);
 
 /* Loopy globals */
 
-extern FRnode*          gHeadWinDR;
-extern FRnode*          gTailWinDR;
-extern FRnode*          gHeadLoseDR;
-extern FRnode*          gTailLoseDR;
-extern FRnode*          gHeadTieDR;
-extern FRnode*          gTailTieDR;
+extern DRQUEUE          gWinDR;
+extern DRQUEUE          gLoseDR;
+extern DRQUEUE          gTieDR;
 
 extern POSITIONLIST**   gDrawParents;
 extern char*            gDrawNumberChildren;
@@ -43,6 +43,7 @@ int numLibraryTraits = 4;
 int numCustomTraits = 0;
 
 //private functions
+static void invalidateEvaluatorPlan();
 void printEvaluator();
 void printFeature();
 STRING getScaleFnName(fList feature);
@@ -111,6 +112,7 @@ void chooseEvaluator(int numInEvaluatorList){
 		currEvaluator->name = copyString(temp->name);
 		currEvaluator->featureList = copyFeatureList(temp->featureList);
 		currEvaluator->next = NULL;
+		invalidateEvaluatorPlan();
 		printf("\nThe Evaluator has been set to %s\n", currEvaluator->name);
 		gSEvalLoaded = TRUE;
 	}
@@ -148,6 +150,7 @@ void updateCurrentEvaluator(){
 			freeFeatureList(currEvaluator->featureList);
 		currEvaluator->featureList = copyFeatureList(srcEvaluator->featureList);
 	}
+	invalidateEvaluatorPlan();
 }
 
 BOOLEAN evaluatorExistsForVariant(int variant) {
@@ -587,57 +590,368 @@ void initializeStaticEvaluatorBoard(int eltSize,int rows, int cols, BOOLEAN diag
 	lBoard.initialPlayerPiece = initialPlayerPiece;
 	lBoard.opponentPlayerPiece = opponentPlayerPiece;
 	lBoard.blankPiece = blankPiece;
+	invalidateEvaluatorPlan();
 }
 
 /************************************************************************
 **
 ** The Evaluator
 **
+** currEvaluator's feature list is flattened into an array (the "plan")
+** the first time it is used, and every position of a batch is unhashed
+** into one reused scratch board. Each slot is classified once per
+** position, after which the library traits only walk a byte array
+** instead of memcmp-ing the board trait by trait. The kernels mirror
+** numPieces, numFromEdge, clustering and connections exactly (getCol's
+** slot%rows included), so scores match the per-trait functions.
+**
 ************************************************************************/
 
-float evaluatePosition(POSITION p){
-	fList features = NULL;
-	float valueSum = 0;
-	float weightSum = 0;
-	void* board = NULL;
+#define SEVAL_INITIAL   1
+#define SEVAL_OPPONENT  2
+#define SEVAL_BLANK     4
+
+typedef enum seval_kernel {
+	kNumPieces, kNumFromEdge, kClustering, kConnections, kLibrary, kCustom
+} SEVALKERNEL;
+
+typedef struct sevalFeature {
+	SEVALKERNEL kernel;
+	float weight;
+	char mask; //SEVAL_INITIAL or SEVAL_OPPONENT
+	int side;  //index into sevalPlan.pieces
+	void* piece;
+	int evalParams[SEVAL_NUMEVALPARAMS];
+	float scaleParams[SEVAL_NUMSCALEPARAMS];
+	scalingFunction scale;
+	featureEvaluatorCustom fEvalC;
+	featureEvaluatorLibrary fEvalL;
+} SEVALFEATURE;
+
+/* Scores already computed under the current plan, direct-mapped by
+   position. Tier games key them by window too, since a POSITION only
+   names a board relative to the hash window of gCurrentTier. The table
+   never grows: a new score takes over its slot, and every game starts
+   with an empty table (clearEvaluatorCache). */
+#define SEVAL_MEMO_SIZE (1<<16)
+
+typedef struct sevalMemo {
+	POSITION position;
+	TIER tier;
+	float score;
+	BOOLEAN used;
+} SEVALMEMO;
+
+static struct {
+	BOOLEAN valid;
+	seList evaluator;
+	SEVALFEATURE* features;
+	int numFeatures, featureCapacity;
+	float weightSum;
+	BOOLEAN needsBoard, needsBlank;
+	//the lBoard the plan was built for
+	int eltSize, rows, cols, size;
+	void *initialPiece, *opponentPiece, *blankPiece;
+	int* row;       //getRow(slot)
+	int* col;       //getCol(slot)
+	int* path;      //connections path length for directions 3..6 of each slot
+	char* board;    //scratch board of size*eltSize bytes
+	char* classes;  //SEVAL_* mask of each slot of the current board
+	int* pieces[2]; //slots holding the initial/opponent piece, in order
+	int numPieces[2];
+	int option;
+	SEVALMEMO* memo;
+} sevalPlan;
+
+static void invalidateEvaluatorPlan() {
+	sevalPlan.valid = FALSE;
+}
+
+static BOOLEAN evaluatorPlanIsCurrent() {
+	return sevalPlan.valid && sevalPlan.evaluator == currEvaluator &&
+	       sevalPlan.option == getOption() &&
+	       sevalPlan.eltSize == lBoard.eltSize && sevalPlan.rows == lBoard.rows &&
+	       sevalPlan.cols == lBoard.cols && sevalPlan.size == lBoard.size &&
+	       sevalPlan.initialPiece == lBoard.initialPlayerPiece &&
+	       sevalPlan.opponentPiece == lBoard.opponentPlayerPiece &&
+	       sevalPlan.blankPiece == lBoard.blankPiece;
+}
+
+static void buildEvaluatorPlan() {
+	fList features = NULL, fNode;
+	SEVALFEATURE* f;
+	int i, direction, pathLength, loc, step, size = lBoard.size;
+
+	sevalPlan.evaluator = currEvaluator;
+	sevalPlan.option = getOption();
+	sevalPlan.eltSize = lBoard.eltSize;
+	sevalPlan.rows = lBoard.rows;
+	sevalPlan.cols = lBoard.cols;
+	sevalPlan.size = size;
+	sevalPlan.initialPiece = lBoard.initialPlayerPiece;
+	sevalPlan.opponentPiece = lBoard.opponentPlayerPiece;
+	sevalPlan.blankPiece = lBoard.blankPiece;
+	sevalPlan.numFeatures = 0;
+	sevalPlan.weightSum = 0;
+	sevalPlan.needsBoard = sevalPlan.needsBlank = FALSE;
 
 	if(currEvaluator!=NULL)
 		features = currEvaluator->featureList;
-	else{
+	for(fNode = features, i = 0; fNode!=NULL; fNode = fNode->next) i++;
+	if(i > sevalPlan.featureCapacity) {
+		if(sevalPlan.features!=NULL)
+			SafeFree(sevalPlan.features);
+		sevalPlan.features = SafeMalloc(i * sizeof(SEVALFEATURE));
+		sevalPlan.featureCapacity = i;
+	}
+
+	for(; features!=NULL; features = features->next) {
+		if(features->type != library && features->type != custom) {
+			printf("ERROR, unknown feature type");
+			sevalPlan.weightSum += features->weight;
+			continue;
+		}
+		f = &sevalPlan.features[sevalPlan.numFeatures++];
+		f->weight = features->weight;
+		f->mask = (features->piece==initial ? SEVAL_INITIAL : SEVAL_OPPONENT);
+		f->side = (features->piece==initial ? 0 : 1);
+		f->piece = (features->piece==initial ? lBoard.initialPlayerPiece : lBoard.opponentPlayerPiece);
+		memcpy(f->evalParams, features->evalParams, sizeof(f->evalParams));
+		memcpy(f->scaleParams, features->scaleParams, sizeof(f->scaleParams));
+		f->scale = features->scale;
+		f->fEvalC = features->fEvalC;
+		f->fEvalL = features->fEvalL;
+		if(features->type == custom) {
+			f->kernel = kCustom;
+		} else {
+			sevalPlan.needsBoard = TRUE;
+			if(f->fEvalL == &numPieces) f->kernel = kNumPieces;
+			else if(f->fEvalL == &numFromEdge) f->kernel = kNumFromEdge;
+			else if(f->fEvalL == &clustering) f->kernel = kClustering;
+			else if(f->fEvalL == &connections) {
+				f->kernel = kConnections;
+				sevalPlan.needsBlank = TRUE;
+			}
+			else f->kernel = kLibrary;
+		}
+		sevalPlan.weightSum += features->weight;
+	}
+
+	if(sevalPlan.board!=NULL) {
+		SafeFree(sevalPlan.row);
+		SafeFree(sevalPlan.col);
+		SafeFree(sevalPlan.path);
+		SafeFree(sevalPlan.classes);
+		SafeFree(sevalPlan.pieces[0]);
+		SafeFree(sevalPlan.pieces[1]);
+		SafeFree(sevalPlan.board);
+	}
+	sevalPlan.row = SafeMalloc((size+1) * sizeof(int));
+	sevalPlan.col = SafeMalloc((size+1) * sizeof(int));
+	sevalPlan.path = SafeMalloc((4*size+1) * sizeof(int));
+	sevalPlan.classes = SafeMalloc(size+1);
+	sevalPlan.pieces[0] = SafeMalloc((size+1) * sizeof(int));
+	sevalPlan.pieces[1] = SafeMalloc((size+1) * sizeof(int));
+	sevalPlan.board = SafeMalloc(size * lBoard.eltSize + 1);
+
+	if(sevalPlan.memo==NULL)
+		sevalPlan.memo = SafeMalloc(SEVAL_MEMO_SIZE * sizeof(SEVALMEMO));
+	memset(sevalPlan.memo, 0, SEVAL_MEMO_SIZE * sizeof(SEVALMEMO));
+
+	for(i=0; i<size; i++) {
+		sevalPlan.row[i] = getRow(i);
+		sevalPlan.col[i] = getCol(i);
+		for(direction = 3; direction<7; direction++) {
+			if (direction==3) {
+				pathLength = lBoard.cols-1-getCol(i);
+			} else if (direction==4) {
+				pathLength = min(lBoard.cols-1-getCol(i),lBoard.rows-1-getRow(i));
+			} else if (direction==5) {
+				pathLength = lBoard.rows-1-getRow(i);
+			} else {
+				pathLength = min(lBoard.rows-1-getRow(i),getCol(i));
+			}
+			//getCol's quirk can walk a path off the board; those slots
+			//are neither the piece nor blank, so stop the path there
+			for(step=0, loc=i; step<pathLength; step++) {
+				loc += lBoard.directionMap[direction];
+				if(loc < 0 || loc >= size)
+					break;
+			}
+			sevalPlan.path[4*i + direction-3] = step;
+		}
+	}
+	sevalPlan.valid = TRUE;
+}
+
+static void classifyBoard(char* board) {
+	int i, eltSize = sevalPlan.eltSize;
+	char* initialPiece = sevalPlan.initialPiece;
+	char* opponentPiece = sevalPlan.opponentPiece;
+	char* blankPiece = sevalPlan.needsBlank ? sevalPlan.blankPiece : NULL;
+	char c;
+
+	sevalPlan.numPieces[0] = sevalPlan.numPieces[1] = 0;
+	for(i=0; i<sevalPlan.size; i++, board+=eltSize) {
+		c = 0;
+		if(eltSize == 1) {
+			if(initialPiece!=NULL && *board == *initialPiece) c |= SEVAL_INITIAL;
+			if(opponentPiece!=NULL && *board == *opponentPiece) c |= SEVAL_OPPONENT;
+			if(blankPiece!=NULL && *board == *blankPiece) c |= SEVAL_BLANK;
+		} else {
+			if(initialPiece!=NULL && !memcmp(board,initialPiece,eltSize)) c |= SEVAL_INITIAL;
+			if(opponentPiece!=NULL && !memcmp(board,opponentPiece,eltSize)) c |= SEVAL_OPPONENT;
+			if(blankPiece!=NULL && !memcmp(board,blankPiece,eltSize)) c |= SEVAL_BLANK;
+		}
+		sevalPlan.classes[i] = c;
+		if(c & SEVAL_INITIAL)
+			sevalPlan.pieces[0][sevalPlan.numPieces[0]++] = i;
+		if(c & SEVAL_OPPONENT)
+			sevalPlan.pieces[1][sevalPlan.numPieces[1]++] = i;
+	}
+}
+
+static float evaluateKernel(SEVALFEATURE* f, POSITION p, void* board) {
+	char* classes = sevalPlan.classes;
+	char mask = f->mask;
+	int* pieces = sevalPlan.pieces[f->side];
+	int numPieces = sevalPlan.numPieces[f->side];
+	int i, j, k, count=0;
+	int rowAverage=0, colAverage=0, loc, direction, pathLength, edge;
+	float value=0;
+
+	switch(f->kernel) {
+	case kNumPieces:
+		return (float) numPieces;
+	case kNumFromEdge:
+		edge = f->evalParams[0];
+		for(k=0; k<numPieces; k++) {
+			i = pieces[k];
+			if (edge==0) {
+				count+= (i/sevalPlan.cols);
+			} else if (edge==1) {
+				count+= (sevalPlan.cols-(i%sevalPlan.cols));
+			} else if (edge==2) {
+				count+= (sevalPlan.rows-(i/sevalPlan.cols));
+			} else if (edge==3) {
+				count+= (i%sevalPlan.cols);
+			} else {
+				printf("Error, unknown edge input");
+			}
+		}
+		return (float) count;
+	case kClustering:
+		if(numPieces==0)
+			return 0;
+		for(k=0; k<numPieces; k++) {
+			rowAverage+=sevalPlan.row[pieces[k]];
+			colAverage+=sevalPlan.col[pieces[k]];
+		}
+		rowAverage = rowAverage/numPieces;
+		colAverage = colAverage/numPieces;
+		for(k=0; k<numPieces; k++) {
+			i = pieces[k];
+			value += (sevalPlan.row[i]-rowAverage)*(sevalPlan.row[i]-rowAverage) +
+			         (sevalPlan.col[i]-colAverage)*(sevalPlan.col[i]-colAverage);
+		}
+		value /= numPieces;
+		return value;
+	case kConnections:
+		for(k=0; k<numPieces; k++) {
+			i = pieces[k];
+			for(direction = 3; direction<7; direction+= (f->evalParams[0] ? 1 : 2)) {
+				pathLength = sevalPlan.path[4*i + direction-3];
+				loc = i;
+				for(j=0; j<pathLength; j++) {
+					loc+=lBoard.directionMap[direction];
+					if (classes[loc] & mask) {
+						count++;
+						break;
+					} else if (!(classes[loc] & SEVAL_BLANK)) {
+						break;
+					}
+				}
+			}
+		}
+		return (float) count;
+	case kLibrary:
+		return f->fEvalL(board,f->piece,f->evalParams);
+	case kCustom:
+	default:
+		return f->fEvalC(p);
+	}
+}
+
+/* Scores count positions into scores[], exactly as evaluatePosition would
+   score each of them, but without a board allocation per position. */
+void evaluatePositions(POSITION* positions, float* scores, int count){
+	SEVALFEATURE* f;
+	SEVALMEMO* memo;
+	TIER tier = gHashWindowInitialized ? gCurrentTier : 0;
+	float valueSum;
+	void* board;
+	int i, n;
+
+	if(currEvaluator==NULL) {
 		BadElse("evaluatePosition");
 		printf("Tried to call evaluatePosition when currEvaluator==NULL");
 	}
+	if(!evaluatorPlanIsCurrent())
+		buildEvaluatorPlan();
 
+	if(sevalPlan.needsBoard && linearUnhash==NULL && linearUnhashInto==NULL) {
+		BadElse("evaluatePosition");
+		printf("linearUnhash MUST be set if library functions are used!\n");
+		printf("Results will be nondeterministic.\n");
+		for(n=0; n<count; n++)
+			scores[n] = -2;
+		return;
+	}
 
-	if(linearUnhash != NULL)
-		board = (*linearUnhash)(p);
+	for(n=0; n<count; n++) {
+		memo = &sevalPlan.memo[(positions[n] ^ (tier * 0x9E3779B1)) & (SEVAL_MEMO_SIZE-1)];
+		if(memo->used && memo->position == positions[n] && memo->tier == tier) {
+			scores[n] = memo->score;
+			continue;
+		}
 
-	while(features!=NULL) {
-		if(features->type == library) {
-			if( linearUnhash!=NULL )
-				valueSum += features->weight * // += weight * scale(evaluateTrait(board))
-				            features->scale(features->fEvalL(board,(features->piece==initial ? lBoard.initialPlayerPiece : lBoard.opponentPlayerPiece)
-				                                             ,features->evalParams),features->scaleParams);
-			else{
-				BadElse("evaluatePosition");
-				printf("linearUnhash MUST be set if library functions are used!\n");
-				printf("Results will be nondeterministic.\n");
-				return -2;
+		board = NULL;
+		if(sevalPlan.needsBoard) {
+			if(linearUnhashInto != NULL) {
+				board = sevalPlan.board;
+				(*linearUnhashInto)(positions[n], board);
+			} else {
+				board = (*linearUnhash)(positions[n]);
 			}
-		} else if(features->type == custom) {
-			valueSum += features->weight * features->scale(features->fEvalC(p),features->scaleParams);
-		} else {
-			printf("ERROR, unknown feature type");
+			classifyBoard(board);
 		}
 
-		weightSum += features->weight;
-		features = features->next;
+		valueSum = 0;
+		for(i=0, f=sevalPlan.features; i<sevalPlan.numFeatures; i++, f++)
+			valueSum += f->weight * f->scale(evaluateKernel(f,positions[n],board),f->scaleParams);
+
+		if(board!=NULL && board!=sevalPlan.board)
+			SafeFree(board);
+		scores[n] = valueSum/sevalPlan.weightSum;
+
+		memo->position = positions[n];
+		memo->tier = tier;
+		memo->score = scores[n];
+		memo->used = TRUE;
 	}
+}
 
-	if(board!=NULL)
-		SafeFree(board);
+/* Forgets every memoised score, so that a long session against the
+   evaluator only keeps the positions of the game being played. */
+void clearEvaluatorCache(){
+	if(sevalPlan.memo!=NULL)
+		memset(sevalPlan.memo, 0, SEVAL_MEMO_SIZE * sizeof(SEVALMEMO));
+}
 
-	return (valueSum/weightSum);
+float evaluatePosition(POSITION p){
+	float score;
+	evaluatePositions(&p, &score, 1);
+	return score;
 }
 
 VALUE evaluatePositionValue(POSITION p) {
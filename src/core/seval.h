@@ -57,6 +57,8 @@ extern seList evaluatorList;
 
 extern USERINPUT StaticEvaluatorMenu();
 extern float evaluatePosition(POSITION);
+extern void evaluatePositions(POSITION*,float*,int);
+extern void clearEvaluatorCache();
 extern VALUE evaluatePositionValue(POSITION);
 extern void TryToLoadAnEvaluator();
 
@@ -4,6 +4,8 @@
 **
 ** DESCRIPTION:	Accessor functions for shard-solved Connect 4.
 **              WORKS FOR 6x6 and 6x7 CONNECT 4 ONLY AS OF 11/07/2022.
+**              Shards are located through the module's shard hooks and
+**              are written by solveshard.c.
 **
 ** AUTHOR:	GamesCrafters Research Group, UC Berkeley
 **		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
@@ -18,6 +20,7 @@
 #include <dirent.h>
 #include "interact.h"
 #include "sharddb.h"
+#include "solveshard.h"
 #define RESULT "result =>> "
 #define MAX_C4_SHARD_SIZE 52428800 // All un-gzipped shards are less than 50 MiB.
 
@@ -33,6 +36,9 @@ VALUE           sharddb_set_value                (POSITION pos, VALUE val);
 REMOTENESS      sharddb_get_remoteness           (POSITION pos);
 void            sharddb_set_remoteness           (POSITION pos, REMOTENESS val);
 
+/* Value and remoteness of many positions, reading each shard once */
+void            sharddb_get_bulk                 (POSITION *positions, VALUE *values, REMOTENESS *remotenesses, int length);
+
 /* Visited */
 BOOLEAN         sharddb_check_visited            (POSITION pos);
 void            sharddb_mark_visited             (POSITION pos);
@@ -67,6 +73,9 @@ static BOOLEAN sharddb_cache_dump_to_disk(void);
 static BOOLEAN sharddb_cache_table_remove(elem_t *e);
 static void sharddb_cache_put(POSITION p, VALUE v, REMOTENESS r);
 static void sharddb_cache_get(VALUE *v, REMOTENESS *r, POSITION p);
+static BOOLEAN sharddb_cache_lookup(VALUE *v, REMOTENESS *r, POSITION p);
+static char *sharddb_read_shard(unsigned long long shard);
+static void sharddb_decode(VALUE *v, REMOTENESS *r, char *gzbuffer, unsigned long long key);
 
 /*
 ** Code
@@ -82,6 +91,7 @@ void sharddb_init(DB_Table *new_db) {
 
 	new_db->get_value = sharddb_get_value;
 	new_db->get_remoteness = sharddb_get_remoteness;
+	new_db->get_bulk = sharddb_get_bulk;
 	new_db->check_visited = sharddb_check_visited;
 	new_db->get_mex = sharddb_get_mex;
 	new_db->save_database = sharddb_save_database;
@@ -144,13 +154,6 @@ void getValueRemotenessFromByte(VALUE *value, REMOTENESS *remoteness, unsigned c
 	}
 }
 
-void getShardIDAndLeading3Digits(int *shardId, int *leading3digits, POSITION key) {
-	int d = key >> 28;
-	(*shardId) = d;
-	while (d >= 1000) d /= 10;
-	*leading3digits = d;
-}
-
 VALUE sharddb_get_value(POSITION pos) {
 	VALUE value;
 	REMOTENESS remoteness;
@@ -506,13 +509,14 @@ static void sharddb_cache_put(POSITION p, VALUE v, REMOTENESS r) {
 	hash_table[slot] = e;
 }
 
-static void sharddb_cache_get(VALUE *v, REMOTENESS *r, POSITION p) {
-	/* Look inside cache first. */
+static BOOLEAN sharddb_cache_lookup(VALUE *v, REMOTENESS *r, POSITION p) {
+	if (!hash_table) sharddb_cache_init();
 	unsigned long long slot = p % NUM_BUCKETS;
 	elem_t *walker = hash_table[slot];
 	while (walker) {
 		if (walker->p == p) {
 			/* Cache hit, read from cache and bring element to head. */
+			StatsCacheAccess(STAT_SHARDDB, 1, 0);
 			*v = walker->v;
 			*r = walker->r;
 			walker->d_next->d_prev = walker->d_prev;
@@ -521,30 +525,105 @@ static void sharddb_cache_get(VALUE *v, REMOTENESS *r, POSITION p) {
 			walker->d_next = head->d_next;
 			head->d_next = walker;
 			walker->d_next->d_prev = walker;
-			return;
+			return TRUE;
 		}
 		walker = walker->s_next;
 	}
-	/* Cache miss, read from disk and put in cache. */
-	unsigned long long key = p & 0xFFFFFFFFFFFFF;
+	StatsCacheAccess(STAT_SHARDDB, 0, 1);
+	return FALSE;
+}
+
+static unsigned long long sharddb_key(POSITION p) {
+	return gShardHashFunPtr ? gShardHashFunPtr(p) : (p & 0xFFFFFFFFFFFFF);
+}
+
+/* Returns the whole un-gzipped SHARD, or NULL if it was not solved. */
+static char *sharddb_read_shard(unsigned long long shard) {
 	gzFile file = NULL;
-	int shardId, leading3digits;
-	getShardIDAndLeading3Digits(&shardId, &leading3digits, key);
-	key &= ((1ULL << 28) - 1);
-	char filename[100];
-	snprintf(filename, 100, "./data/mconnect4_%d_sharddb/%d/solved-%d.gz", getOption(), leading3digits, shardId);
+	char filename[256];
+	ShardSolvedFileName(filename, 256, shard);
 	file = gzopen(filename, "rb");
-    if (!file) {
-        return;
-    }
+	if (!file) {
+		return NULL;
+	}
 	char *gzbuffer = (char *) calloc(MAX_C4_SHARD_SIZE, 1);
 	gzread(file, gzbuffer, MAX_C4_SHARD_SIZE);
 	gzclose(file);
-	char size = 28;
+	return gzbuffer;
+}
+
+/* KEY is the position's key within the shard in GZBUFFER. */
+static void sharddb_decode(VALUE *v, REMOTENESS *r, char *gzbuffer, unsigned long long key) {
+	char size;
 	POSITION i = 0;
 	size = gzbuffer[i++];
-    char res = initializesegment(0, gzbuffer, size, key, &i);
-	SafeFree(gzbuffer);
+	char res = initializesegment(0, gzbuffer, size, key, &i);
 	getValueRemotenessFromByte(v, r, res);
+}
+
+static void sharddb_cache_get(VALUE *v, REMOTENESS *r, POSITION p) {
+	/* Look inside cache first. */
+	if (sharddb_cache_lookup(v, r, p)) return;
+	/* Cache miss, read from disk and put in cache. */
+	unsigned long long key = sharddb_key(p);
+	char *gzbuffer = sharddb_read_shard(key >> gShardSize);
+	if (!gzbuffer) {
+		/* Not solved yet. */
+		*v = undecided;
+		*r = 0;
+		return;
+	}
+	sharddb_decode(v, r, gzbuffer, key & ((1ULL << gShardSize) - 1));
+	SafeFree(gzbuffer);
 	sharddb_cache_put(p, *v, *r);
 }
+
+/* A cache miss of sharddb_get_bulk. */
+typedef struct {
+	unsigned long long key;
+	int index;
+} sharddb_miss_t;
+
+static int sharddb_miss_compare(const void *a, const void *b) {
+	unsigned long long x = ((const sharddb_miss_t *) a)->key, y = ((const sharddb_miss_t *) b)->key;
+	return (x > y) - (x < y);
+}
+
+/* Children of one position mostly share a few shards, and reading a shard
+   means un-gzipping all of it, so the misses are sorted by key and every
+   shard is read once for all of its positions. */
+void sharddb_get_bulk(POSITION *positions, VALUE *values, REMOTENESS *remotenesses, int length) {
+	sharddb_miss_t *misses = (sharddb_miss_t *) SafeMalloc(length * sizeof(sharddb_miss_t));
+	int i, j, numMisses = 0;
+	for (i = 0; i < length; ++i) {
+		if (!sharddb_cache_lookup(&values[i], &remotenesses[i], positions[i])) {
+			misses[numMisses].key = sharddb_key(positions[i]);
+			misses[numMisses++].index = i;
+		}
+	}
+	qsort(misses, numMisses, sizeof(sharddb_miss_t), sharddb_miss_compare);
+	for (i = 0; i < numMisses; i = j) {
+		unsigned long long shard = misses[i].key >> gShardSize;
+		char *gzbuffer = sharddb_read_shard(shard);
+		for (j = i; j < numMisses && (misses[j].key >> gShardSize) == shard; ++j) {
+			int index = misses[j].index;
+			if (!gzbuffer) {
+				/* Not solved yet, as in sharddb_cache_get. */
+				values[index] = undecided;
+				remotenesses[index] = 0;
+				continue;
+			}
+			if (j > i && misses[j].key == misses[j - 1].key) {
+				/* The same child twice, already in the cache. */
+				values[index] = values[misses[j - 1].index];
+				remotenesses[index] = remotenesses[misses[j - 1].index];
+				continue;
+			}
+			sharddb_decode(&values[index], &remotenesses[index], gzbuffer,
+			               misses[j].key & ((1ULL << gShardSize) - 1));
+			sharddb_cache_put(positions[index], values[index], remotenesses[index]);
+		}
+		if (gzbuffer) SafeFree(gzbuffer);
+	}
+	SafeFree(misses);
+}
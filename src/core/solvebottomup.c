@@ -29,113 +29,198 @@
 **
 **************************************************************************/
 
+#include <time.h>
 #include "gamesman.h"
+#include "threadpool.h"
 
-#define MAX_FN_LEN 40
+#define MAX_FN_LEN 256
+
+/* Positions handed to one thread at a time while expanding a stage. */
+#define STAGE_CHUNK 4096
 
 //DO NOT USE THIS WITH A LOOPY GAME, IT WILL SPIN IN AN INFINITE LOOP
 
 int TotalStages;
 
-FILE *StageFile;
+/* Stage files are flat arrays of POSITION in host byte order; the count is
+   the file size over sizeof(POSITION). They only live for one solve. */
+void stageFileName(char *filename, int stagenum)
+{
+	snprintf(filename, MAX_FN_LEN, "./stages/%s_stage%d.bin", kDBName, stagenum);
+}
 
-void newStageFile()
+void writeStageFile(int stagenum, POSITION *positions, POSITION count)
 {
 	char filename[MAX_FN_LEN];
-	int i;
+	FILE *stageFile;
 
-	for (i = 0; i < MAX_FN_LEN; i++)
-		filename[i] = ' ';
-	sprintf(filename, "./stages/%s_stage%d.txt", kDBName, TotalStages);
-	if ((StageFile = fopen(filename, "wb")) == NULL) {
+	stageFileName(filename, stagenum);
+	if ((stageFile = fopen(filename, "wb")) == NULL ||
+	    fwrite(positions, sizeof(POSITION), count, stageFile) != count ||
+	    fclose(stageFile) != 0) {
 		printf("Unable to create file for writing positions in a stage. Aborting.");
 		ExitStageRight();
 		exit(1);
 	}
 }
 
-void openStageFile(FILE **filep, int stagenum)
+POSITION *readStageFile(int stagenum, POSITION *count)
 {
-	int i;
-	char filen[MAX_FN_LEN];
-
-	for (i = 0; i < MAX_FN_LEN; i++)
-		filen[i]=' ';
-	sprintf(filen, "./stages/%s_stage%d.txt", kDBName, stagenum);
-	if (((*filep) = fopen(filen, "r")) == NULL) {
-		printf("unable to create file for reading positions in a stage. Aborting.");
+	char filename[MAX_FN_LEN];
+	FILE *stageFile;
+	POSITION *positions;
+	long size;
+
+	stageFileName(filename, stagenum);
+	if ((stageFile = fopen(filename, "rb")) == NULL ||
+	    fseek(stageFile, 0, SEEK_END) != 0 || (size = ftell(stageFile)) < 0 ||
+	    size % sizeof(POSITION) != 0) {
+		printf("unable to open file for reading positions in a stage. Aborting.");
 		ExitStageRight();
 		exit(1);
 	}
+	*count = size / sizeof(POSITION);
+	positions = (POSITION *) SafeMalloc(size ? size : 1);
+	rewind(stageFile);
+	if (fread(positions, sizeof(POSITION), *count, stageFile) != *count) {
+		printf("unable to read positions in a stage. Aborting.");
+		ExitStageRight();
+		exit(1);
+	}
+	fclose(stageFile);
+	return positions;
 }
 
-/* walk the game tree in a BFS (no graphs please) and generate files with the names
-        "./stages/1210_stage1_positions.txt"
-   to aid solving the stuff*/
-void WalkGameTree()
-{
-	POSITIONQUEUE *head, *tail, *stagetail;
-	BOOLEAN isPrimitive, beginNewStage;
-	MOVELIST      *currentMoves, *currentMovesHead;
-	POSITION currentPos, childPos;
-
-	tail = NULL;
-	AddPositionToQueue(gInitialPosition, &tail);
-	head = tail;
-	stagetail = tail;
-	TotalStages = -1;
-
-	mkdir("stages", 0755);
-
-	printf("I am walking the game tree now.\n");
-
-	beginNewStage = TRUE;
+/* One bit per position, claimed atomically so that threads expanding the
+   same stage agree on which of them queues a child. */
+static unsigned char *walkVisited;
 
-	UnMarkAllAsVisited();
+static BOOLEAN claimPosition(POSITION pos)
+{
+	unsigned char bit = 1 << (pos & 7);
+	return !(__atomic_fetch_or(&walkVisited[pos >> 3], bit, __ATOMIC_RELAXED) & bit);
+}
 
-	do {
-		currentPos = head->position;
-
-		/*write the position to the first file;*/
-		if (beginNewStage) {
-			TotalStages++;
-			printf("walking stage %d\n", TotalStages);
-			newStageFile();
-			beginNewStage = FALSE;
-		}
+typedef struct {
+	POSITION *positions;    /* slice of the current stage */
+	POSITION count;
+	POSITION *children;     /* newly claimed children, in discovery order */
+	POSITION numChildren, capacity;
+} STAGECHUNK;
 
-		fprintf(StageFile, POSITION_FORMAT "\n", currentPos);
-		fflush(StageFile);
+static void expandChunk(void *arg)
+{
+	STAGECHUNK *chunk = (STAGECHUNK *) arg;
+	MOVELIST *currentMoves, *currentMovesHead;
+	POSITION i, currentPos, childPos;
 
-		currentMoves = currentMovesHead = GenerateMoves(currentPos);
+	for (i = 0; i < chunk->count; i++) {
+		currentPos = chunk->positions[i];
 
 		//this must hold true since we are always considering legal positions
 		//they can only lead to valid positions
 		//and even if primitives might have more moves ahead we stop already
-		isPrimitive = (currentMoves == NULL || Primitive(currentPos) != undecided);
-
-		if (!isPrimitive) {
-			for(; currentMovesHead != NULL; currentMovesHead = currentMovesHead->next) {
-				childPos = DoMove(currentPos, currentMovesHead->move);
-				if (!Visited(childPos)) {
-					AddPositionToQueue(childPos, &tail);
-					MarkAsVisited(childPos);
-				}
+		if (Primitive(currentPos) != undecided)
+			continue;
+
+		currentMoves = currentMovesHead = StatsGenerateMoves(currentPos);
+		for(; currentMovesHead != NULL; currentMovesHead = currentMovesHead->next) {
+			childPos = StatsDoMove(currentPos, currentMovesHead->move);
+			if (!claimPosition(childPos))
+				continue;
+			if (chunk->numChildren == chunk->capacity) {
+				chunk->capacity = chunk->capacity ? 2 * chunk->capacity : STAGE_CHUNK;
+				chunk->children = chunk->children ?
+				                  (POSITION *) SafeRealloc(chunk->children, chunk->capacity * sizeof(POSITION)) :
+				                  (POSITION *) SafeMalloc(chunk->capacity * sizeof(POSITION));
 			}
+			chunk->children[chunk->numChildren++] = childPos;
 		}
+		FreeMoveList(currentMoves);
+	}
+}
 
-		if (head == stagetail) //we have finished this stage, rotating
-		{
-			fclose(StageFile);
-			stagetail = tail;
-			beginNewStage = TRUE;
-		}
+static double elapsedSeconds(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
 
-		FreeMoveList(currentMoves);
+/* walk the game tree in a BFS (no graphs please) and generate files with the names
+        "./stages/1210_stage1.bin"
+   to aid solving the stuff. Each stage is expanded in chunks by --threads
+   workers when the module passes ParallelSolveSafe; otherwise the walk
+   stays on one thread. */
+void WalkGameTree()
+{
+	POSITION *stage, *next;
+	POSITION stageSize, nextSize, totalPositions = 0, i;
+	STAGECHUNK *chunks;
+	int numChunks, c;
+	int numThreads = (gNumThreads > 0 && ParallelSolveSafe()) ? gNumThreads : 1;
+	THREADPOOL *pool = (numThreads > 1) ? ThreadPoolCreate(numThreads) : NULL;
+	struct timespec start;
+	double seconds;
+
+	walkVisited = (unsigned char *) SafeCalloc(gNumberOfPositions / 8 + 1, 1);
+	stage = (POSITION *) SafeMalloc(sizeof(POSITION));
+	stage[0] = gInitialPosition;
+	stageSize = 1;
+	claimPosition(gInitialPosition);
+	TotalStages = -1;
 
-		RemovePositionFromQueue(&head);
+	mkdir("stages", 0755);
+
+	printf("I am walking the game tree now.\n");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (stageSize > 0) {
+		TotalStages++;
+		printf("walking stage %d\n", TotalStages);
+		writeStageFile(TotalStages, stage, stageSize);
+		totalPositions += stageSize;
+
+		numChunks = (int) ((stageSize + STAGE_CHUNK - 1) / STAGE_CHUNK);
+		chunks = (STAGECHUNK *) SafeCalloc(numChunks, sizeof(STAGECHUNK));
+		for (c = 0; c < numChunks; c++) {
+			chunks[c].positions = stage + (POSITION) c * STAGE_CHUNK;
+			chunks[c].count = (c == numChunks - 1) ? stageSize - (POSITION) c * STAGE_CHUNK : STAGE_CHUNK;
+			if (pool)
+				ThreadPoolSubmit(pool, expandChunk, &chunks[c]);
+			else
+				expandChunk(&chunks[c]);
+		}
+		if (pool)
+			ThreadPoolWait(pool);
+
+		//the next stage is the children of every chunk, in chunk order
+		nextSize = 0;
+		for (c = 0; c < numChunks; c++)
+			nextSize += chunks[c].numChildren;
+		next = (POSITION *) SafeMalloc((nextSize ? nextSize : 1) * sizeof(POSITION));
+		for (c = 0, i = 0; c < numChunks; c++) {
+			if (chunks[c].numChildren > 0) {
+				memcpy(next + i, chunks[c].children, chunks[c].numChildren * sizeof(POSITION));
+				i += chunks[c].numChildren;
+				SafeFree(chunks[c].children);
+			}
+		}
+		SafeFree(chunks);
+		SafeFree(stage);
+		stage = next;
+		stageSize = nextSize;
+	}
+
+	SafeFree(stage);
+	SafeFree(walkVisited);
+	walkVisited = NULL;
+	ThreadPoolDestroy(pool);
 
-	} while (head != NULL);
+	seconds = elapsedSeconds(&start);
+	printf("Walked " POSITION_FORMAT " positions in %d stages in %.2f seconds (%.0f positions/sec, %d thread%s).\n",
+	       totalPositions, TotalStages + 1, seconds, seconds > 0 ? totalPositions / seconds : 0.0,
+	       numThreads, numThreads == 1 ? "" : "s");
 }
 
 VALUE DetermineValueBU(POSITION position)
@@ -149,7 +234,7 @@ VALUE DetermineValueBU(POSITION position)
 
 	MOVELIST        *mhead = NULL, *MoveList = NULL;
 
-	FILE            *OutFile = NULL;
+	POSITION        *stagePositions, stageSize, i;
 
 	BOOLEAN foundTie, foundLose, foundWin;
 	VALUE currentValue, oldValue;
@@ -172,7 +257,7 @@ VALUE DetermineValueBU(POSITION position)
 	do {
 		printf("I am starting to solve stage %d\n", CurrentStage);
 
-		openStageFile(&OutFile, CurrentStage);
+		stagePositions = readStageFile(CurrentStage, &stageSize);
 
 		//if(CurrentStage == TotalStages) {  //primitives
 
@@ -189,12 +274,9 @@ VALUE DetermineValueBU(POSITION position)
 
 		while(foundnewvalue) {
 
-			//reset to start reading from the beginning
-			fseek(OutFile, 0, SEEK_SET);
-
 			foundnewvalue = FALSE;
 
-			while(!feof(OutFile)) {
+			for (i = 0; i < stageSize; i++) {
 
 				foundTie = FALSE;
 				foundLose = FALSE;
@@ -203,8 +285,8 @@ VALUE DetermineValueBU(POSITION position)
 				winRemoteness = tieRemoteness = REMOTENESS_MAX;
 				loseRemoteness = 0;
 
-				//read in the positions we need to solve with
-				fscanf(OutFile, POSITION_FORMAT "\n", &postosolve);
+				//the positions we need to solve with
+				postosolve = stagePositions[i];
 
 				//            printf("read out position "POSITION_FORMAT"\n", postosolve);
 
@@ -219,9 +301,9 @@ VALUE DetermineValueBU(POSITION position)
 					StoreValueOfPosition(postosolve, currentValue);
 				} else {
 					//infer the value from children, but does not recurse
-					mhead = MoveList = GenerateMoves(postosolve);
+					mhead = MoveList = StatsGenerateMoves(postosolve);
 					for(; mhead != NULL; mhead = mhead->next) {
-						child = DoMove(postosolve, mhead->move);
+						child = StatsDoMove(postosolve, mhead->move);
 						currentValue = GetValueOfPosition(child);
 						childrmt = Remoteness(child);
 
@@ -267,14 +349,12 @@ VALUE DetermineValueBU(POSITION position)
 
 				foundnewvalue = (foundnewvalue || (oldValue != GetValueOfPosition(postosolve)));
 				//}
-			}  //while(!feof(OutFile)) - find value for one position
+			}  //for each position - find value for one position
 		} //while(foundnewvalue) - find value for all deducable positions in a stage
 
-		fseek(OutFile, 0, SEEK_SET);
-
 		//take care of the all the draws
-		while (!feof(OutFile)) {
-			fscanf(OutFile, POSITION_FORMAT "\n", &postosolve);
+		for (i = 0; i < stageSize; i++) {
+			postosolve = stagePositions[i];
 			if (GetValueOfPosition(postosolve) == undecided) {
 				SetRemoteness(postosolve, REMOTENESS_MAX);
 				StoreValueOfPosition(postosolve, tie);
@@ -287,7 +367,7 @@ VALUE DetermineValueBU(POSITION position)
 
 		//TODO: save db for this stage
 
-		fclose(OutFile);
+		SafeFree(stagePositions);
 
 		printf("I have finished solving stage %d.\n", CurrentStage);
 		// Do you want to continue solving the next stage? (y/n)", CurrentStage);
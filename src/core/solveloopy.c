@@ -87,6 +87,11 @@ VALUE DetermineLoopyValue(POSITION position)
 {
 	VALUE value;
 
+	/* SetParents jumps between positions breadth-first, so GPS needs a
+	   module that can load the global position from a hash */
+	if (gSetGPSPosition == NULL)
+		gUseGPS = FALSE;
+
 	/* initialize */
 	InitializeFR();
 	ParentInitialize();
@@ -347,12 +352,12 @@ void DFS_SetParents (POSITION parent, POSITION position)
 		gParents[position] = StorePositionInList(parent, gParents[position]);
 		if(kDebugDetermineValue) printf("normal, continue searching\n");
 		MarkAsVisited(position);
-		movehead = GenerateMoves(position);
+		movehead = StatsGenerateMoves(position);
 		poshead = NULL;
 
 		for (moveptr = movehead; moveptr != NULL; moveptr = moveptr->next) {
 			gNumberChildren[(int)position]++; /* Record the number of kids */
-			child = DoMove(position, moveptr->move); /* Create the child */
+			child = StatsDoMove(position, moveptr->move); /* Create the child */
 			if (Visited(child)) {        /* Visited? */
 				DFS_SetParents(position, child); /* Go ahead and call (it'll be quick) */
 			} else {
@@ -397,6 +402,8 @@ void SetParents (POSITION parent, POSITION root)
 	// Check if the top is primitive.
 	MarkAsVisited(root);
 	gParents[root] = StorePositionInList(parent, gParents[root]);
+	if (gUseGPS)
+		gSetGPSPosition(root);
 	if ((value = Primitive(root)) != undecided) {
 		SetRemoteness(root, 0);
 		switch (value) {
@@ -419,10 +426,12 @@ void SetParents (POSITION parent, POSITION root)
 			next = posptr->next;
 			pos = posptr->position;
 
-			movehead = GenerateMoves(pos);
+			if (gUseGPS)
+				gSetGPSPosition(pos);
+			movehead = StatsGenerateMoves(pos);
 
 			for (moveptr = movehead; moveptr != NULL; moveptr = moveptr->next) {
-				child = DoMove(pos, moveptr->move);
+				child = StatsDoMove(pos, moveptr->move);
 				// Robert Shi: can we speed this up by removing
 				// branching and use a default gCanonicalPosition
 				// function that returns the position itself when
@@ -437,22 +446,26 @@ void SetParents (POSITION parent, POSITION root)
 				++gNumberChildrenOriginal[(int)pos];
 				gParents[(int)child] = StorePositionInList(pos, gParents[(int)child]);
 
-				if (Visited(child)) continue;
-				MarkAsVisited(child);
-
-				if ((value = Primitive(child)) != undecided) {
-					SetRemoteness(child, 0);
-					switch (value) {
-					case lose: InsertLoseFR(child); break;
-					case win: InsertWinFR(child);  break;
-					case tie: InsertTieFR(child);  break;
-					default: BadElse("SetParents found bad primitive value");
+				if (!Visited(child)) {
+					MarkAsVisited(child);
+
+					if ((value = Primitive(child)) != undecided) {
+						SetRemoteness(child, 0);
+						switch (value) {
+						case lose: InsertLoseFR(child); break;
+						case win: InsertWinFR(child);  break;
+						case tie: InsertTieFR(child);  break;
+						default: BadElse("SetParents found bad primitive value");
+						}
+						StoreValueOfPosition(child, value);
+					} else {
+						nextLevel = StorePositionInList(child, nextLevel);
 					}
-					StoreValueOfPosition(child, value);
-				} else {
-					nextLevel = StorePositionInList(child, nextLevel);
+					gTotalMoves++;
 				}
-				gTotalMoves++;
+
+				if (gUseGPS)
+					gUndoMove(moveptr->move);
 			}
 
 			FreeMoveList(movehead);
@@ -140,7 +140,7 @@ POSITIONSTACK *InitializeFrontier(POSITION source) {
 			MOVELIST *moves_list, *move_node;
 
 			/* Generate list of moves available from position */
-			moves_list = GenerateMoves(position);
+			moves_list = StatsGenerateMoves(position);
 
 			/* Traverse all moves available from position */
 			for (move_node = moves_list;
@@ -150,7 +150,7 @@ POSITIONSTACK *InitializeFrontier(POSITION source) {
 				POSITION child;
 
 				/* Apply move */
-				child = DoMove(position, move_node->move);
+				child = StatsDoMove(position, move_node->move);
 
 				/* Verify validity of produced position */
 				if (child < 0 || child >= gNumberOfPositions) {
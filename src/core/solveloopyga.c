@@ -74,6 +74,11 @@ VALUE lgas_DetermineValue(POSITION position)
 {
 	VALUE value;
 
+	/* lgas_SetParents jumps between positions breadth-first, so GPS needs a
+	   module that can load the global position from a hash */
+	if (gSetGPSPosition == NULL)
+		gUseGPS = FALSE;
+
 	/* initialize */
 	InitializeFR();
 	lgas_ParentInitialize();
@@ -289,6 +294,8 @@ void lgas_SetParents (POSITION parent, POSITION root)
 
 	MarkAsVisited(root);
 	lgas_gParents[root] = CreatePositionMoveNode(parent, move, lgas_gParents[root]);
+	if (gUseGPS)
+		gSetGPSPosition(root);
 	if ((value = Primitive(root)) != undecided) {
 		SetRemoteness(root, 0);
 		switch (value) {
@@ -308,29 +315,35 @@ void lgas_SetParents (POSITION parent, POSITION root)
 		for (posptr = thisLevel; posptr != NULL; posptr = posptr->next) {
 			pos = posptr->position;
 
-			movehead = GenerateMoves(pos);
+			if (gUseGPS)
+				gSetGPSPosition(pos);
+			movehead = StatsGenerateMoves(pos);
 
 			for (moveptr = movehead; moveptr != NULL; moveptr = moveptr->next) {
 				move = moveptr->move;
-				child = DoMove(pos, move);
+				child = StatsDoMove(pos, move);
 				++gNumberChildren[(int)pos];
 				lgas_gParents[(int)child] = CreatePositionMoveNode(pos, move, lgas_gParents[(int)child]);
 
-				if (Visited(child)) continue;
-				MarkAsVisited(child);
+				if (!Visited(child)) {
+					MarkAsVisited(child);
 
-				if ((value = Primitive(child)) != undecided) {
-					SetRemoteness(child, 0);
-					switch (value) {
-					case lose: InsertLoseFR(child); break;
-					case win: InsertWinFR(child);  break;
-					case tie: InsertTieFR(child);  break;
-					default: BadElse("lgas_SetParents found bad primitive value");
+					if ((value = Primitive(child)) != undecided) {
+						SetRemoteness(child, 0);
+						switch (value) {
+						case lose: InsertLoseFR(child); break;
+						case win: InsertWinFR(child);  break;
+						case tie: InsertTieFR(child);  break;
+						default: BadElse("lgas_SetParents found bad primitive value");
+						}
+						StoreValueOfPosition(child, value);
+					} else {
+						nextLevel = StorePositionInList(child, nextLevel);
 					}
-					StoreValueOfPosition(child, value);
-				} else {
-					nextLevel = StorePositionInList(child, nextLevel);
 				}
+
+				if (gUseGPS)
+					gUndoMove(move);
 			}
 
 			FreeMoveList(movehead);
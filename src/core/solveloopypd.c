@@ -129,6 +129,11 @@ VALUE lpds_DetermineValue(POSITION position) {
 	GMSTATUS status = STATUS_SUCCESS;
 	VALUE value = undecided;
 
+	/* SetParents jumps between positions breadth-first, so GPS needs a
+	   module that can load the global position from a hash. */
+	if (gSetGPSPosition == NULL)
+		gUseGPS = FALSE;
+
     /* This solver must be used with Bit-Perfect Database. */
 	if (!gBitPerfectDB) {
 		status = STATUS_MISSING_DEPENDENT_MODULE;
@@ -376,6 +381,9 @@ static void SetParents(POSITION root) {
 	/* Set the only parent of root position as bad. Thus, a bad parent
 	   indicates a root position. */
 	parentsOf[root] = StorePositionInList(kBadPosition, parentsOf[root]);
+	if (gUseGPS) {
+		gSetGPSPosition(root);
+	}
 	/* Edge case: if root is primitive, store it as the only entry
 	   in database and return. */
 	if (SetPrimitiveOrEnqueue(root, &nextLevel) != undecided) {
@@ -389,9 +397,12 @@ static void SetParents(POSITION root) {
 			/* Extract the next position in list before we free it. */
 			next = posptr->next;
 			pos = posptr->position;
-			movehead = GenerateMoves(pos);
+			if (gUseGPS) {
+				gSetGPSPosition(pos);
+			}
+			movehead = StatsGenerateMoves(pos);
 			for (moveptr = movehead; moveptr; moveptr = moveptr->next) {
-				child = DoMove(pos, moveptr->move);
+				child = StatsDoMove(pos, moveptr->move);
 				if (gSymmetries) {
 					child = gCanonicalPosition(child);
 				}
@@ -405,6 +416,9 @@ static void SetParents(POSITION root) {
 					SetPrimitiveOrEnqueue(child, &nextLevel);
 					++gTotalMoves;
 				}
+				if (gUseGPS) {
+					gUndoMove(moveptr->move);
+				}
 			}
 			/* Free as we go */
 			free(posptr);
@@ -613,14 +627,14 @@ static VALUE DetermineValueHelper(POSITION pos) {
 }
 
 static BOOLEAN OnlyHasChildrenOf(POSITION parent, int allowed[static 7]) {
-	MOVELIST *moves = GenerateMoves(parent);
+	MOVELIST *moves = StatsGenerateMoves(parent);
 	MOVELIST *walker;
 	BOOLEAN valid = TRUE;
 
-	for (walker = moves; walker != NULL; walker = walker->next) {
-		if (!allowed[GetValueFromBPDB(DoMove(parent, walker->move))]) {
-			valid = FALSE;
-			break;
+	for (walker = moves; walker != NULL && valid; walker = walker->next) {
+		valid = allowed[GetValueFromBPDB(StatsDoMove(parent, walker->move))];
+		if (gUseGPS) {
+			gUndoMove(walker->move);
 		}
 	}
 	FreeMoveList(moves);
@@ -628,14 +642,14 @@ static BOOLEAN OnlyHasChildrenOf(POSITION parent, int allowed[static 7]) {
 }
 
 static BOOLEAN HasChild(POSITION parent, VALUE childVal) {
-	MOVELIST *moves = GenerateMoves(parent);
+	MOVELIST *moves = StatsGenerateMoves(parent);
 	MOVELIST *walker;
 	BOOLEAN found = FALSE;
 
-	for (walker = moves; walker != NULL; walker = walker->next) {
-		if (GetValueFromBPDB(DoMove(parent, walker->move)) == childVal) {
-			found = TRUE;
-			break;
+	for (walker = moves; walker != NULL && !found; walker = walker->next) {
+		found = GetValueFromBPDB(StatsDoMove(parent, walker->move)) == childVal;
+		if (gUseGPS) {
+			gUndoMove(walker->move);
 		}
 	}
 	FreeMoveList(moves);
@@ -649,6 +663,9 @@ static BOOLEAN SanityCheckDatabase(void) {
 
 	for (i = 0; valid && i < gNumberOfPositions; ++i) {
 		v = GetValueFromBPDB(i);
+		if (gUseGPS && v != undecided) {
+			gSetGPSPosition(i);
+		}
 		switch (v) {
 		case undecided:
 			break;
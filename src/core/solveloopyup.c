@@ -136,7 +136,7 @@ void loopyup_CountChildren(POSITION pos) {
 	MOVELIST *head, *moveList;
 	POSITION moveCount;
 
-	head = moveList = GenerateMoves(pos);
+	head = moveList = StatsGenerateMoves(pos);
 	moveCount = 0;
 	while(moveList != NULL) {
 		moveCount++;
@@ -256,10 +256,10 @@ void loopyup_DetermineLocalValueNoGoAgain(POSITION pos, VALUE callersValue, REMO
 	if (loopyup_childrenCount[pos]==0) {
 		winRemoteness = -1;
 
-		mhead = moveList = GenerateMoves(pos);
+		mhead = moveList = StatsGenerateMoves(pos);
 
 		while(moveList != NULL) {
-			child = DoMove(pos, moveList->move);
+			child = StatsDoMove(pos, moveList->move);
 			childRemoteness = Remoteness(child);
 
 			if (childRemoteness>winRemoteness) {
@@ -301,10 +301,10 @@ void loopyup_DetermineLocalValueGoAgain(POSITION pos, VALUE callersValue, REMOTE
 	winRemoteness = 0;
 	tieRemoteness = loseRemoteness = REMOTENESS_MAX;
 
-	mhead = moveList = GenerateMoves(pos);
+	mhead = moveList = StatsGenerateMoves(pos);
 
 	while(moveList != NULL) {
-		child = DoMove(pos, moveList->move);
+		child = StatsDoMove(pos, moveList->move);
 		childValue = GetValueOfPosition(child);
 		childRemoteness = Remoteness(child);
 
@@ -40,6 +40,8 @@
 #include "levelfile_generator.h"
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <time.h>
 
@@ -61,6 +63,7 @@ BOOLEAN checkCorrectness; // Whether or not to check correctness after the solve
 BOOLEAN levelFiles; // Whether or not to use level files in this solve.
 // LEVEL FILES:
 BITARRAY* l_bitArray = NULL; // the bit array for the CURRENT tier
+LEVELFILE_INDEX* l_levelIndex = NULL; // or, for indexed level files, the queryable file itself
 POSITION l_min = 0;
 
 // Solver procs
@@ -70,6 +73,7 @@ void AutoSolveAllTiersMultiProcess();
 BOOLEAN gotoNextTier();
 void solveFirst(TIER);
 void PrepareToSolveNextTier();
+void PrefetchNextTierChildren();
 void changeTierSolveList();
 void LevelFileSolverInterface();
 BOOLEAN setInitialTierPosition();
@@ -85,8 +89,14 @@ void rInitFRStuff();
 void rFreeFRStuff();
 IPOSITIONLIST* rRemoveFRList(VALUE, REMOTENESS);
 void rInsertFR(VALUE, POSITION, REMOTENESS);
+// Solver Checkpoints
+BOOLEAN rCheckpointDue();
+void rSaveCheckpoint(POSITION, POSITION, BOOLEAN, int, POSITION);
+int rLoadCheckpoint(POSITION, POSITION, BOOLEAN, POSITION*);
+void rRemoveCheckpoint(TIER);
 // Sanity Checkers
-void checkForCorrectness(POSITION, POSITION);
+BOOLEAN checkForCorrectness(POSITION, POSITION);
+BOOLEAN VerifySolvedTiers();
 TIERLIST* checkAndDefineTierTree();
 BOOLEAN checkTierTree();
 // Debug Stuff
@@ -134,7 +144,12 @@ VALUE DetermineRetrogradeValue(POSITION position) {
 	// initialize global variables
 	variant = getOption();
 	tierNames = TRUE;
-	checkLegality = useUndo = forceLoopy = checkCorrectness = levelFiles = FALSE;
+	checkLegality = useUndo = forceLoopy = levelFiles = FALSE;
+	checkCorrectness = gTierCheck;
+	// the sweeps visit positions in hash order, so GPS needs a module that
+	// can load the global position from a hash before expanding each one
+	if (gSetGPSPosition == NULL)
+		gUseGPS = FALSE;
 	// initialize local variables
 	BOOLEAN cont = TRUE, isLegalGiven = TRUE, undoGiven = TRUE;
 
@@ -228,6 +243,8 @@ VALUE DetermineRetrogradeValue(POSITION position) {
 
 	if (solveList == NULL) {
 		ifprintf(gTierSolvePrint, "\nLooks like the game is already fully solved! Enjoy the game!\n");
+		if (gTierCheck)
+			VerifySolvedTiers();
 	} else {
 		if (tiersSolved == 0) // No DBs loaded, a fresh solve
 			ifprintf(gTierSolvePrint, "No DBs Found! Starting a fresh solve...\n");
@@ -255,6 +272,7 @@ VALUE DetermineRetrogradeValue(POSITION position) {
 				printf("\tc)\tCheck (C)orrectness after solve? Currently: %s\n"
 				       "\tf)\t(F)orce Loopy solve for Non-Loopy tiers? Currently: %s\n\n"
 				       "\te)\tL(e)vel File Solver\n\n"
+				       "\tv)\t(V)erify the Correctness of all the tiers solved so far.\n\n"
 				       "\ts)\t(S)olve the next tier.\n\n"
                        "\ta)\t(A)utomate the solving for all the tiers left.\n\n"
                        "\tm)\tAutomate with (M)ultiple Processes the solving for all the tiers left.\n\n"
@@ -283,6 +301,11 @@ VALUE DetermineRetrogradeValue(POSITION position) {
 				case 'e': case 'E':
 					LevelFileSolverInterface();
 					break;
+				case 'v': case 'V':
+					VerifySolvedTiers();
+					// switch back to the current hash window:
+					gInitializeHashWindow(gCurrentTier, TRUE);
+					break;
 				case 's': case 'S':
 					SolveTier(0,gCurrentTierSize);
 					if (!gotoNextTier()) {
@@ -358,7 +381,10 @@ VALUE DetermineRetrogradeValue(POSITION position) {
 			else
 			{
 				//Auto solve all of 'em
+				checkCorrectness = FALSE; // every tier is checked from file once they're all solved
 				AutoSolveAllTiers();
+				if (gTierCheck)
+					VerifySolvedTiers();
 			}
 		}
 	}
@@ -547,10 +573,26 @@ void GenerateTierTree(time_t times[][2]) {
 void PrepareToSolveNextTier() {
 	ifprintf(gTierSolvePrint, "\n------Preparing to solve tier: %llu\n", solveList->tier);
 	gInitializeHashWindow(solveList->tier, TRUE);
+	PrefetchNextTierChildren();
 	PercentDone(Clean); //reset percentage bar
 	ifprintf(gTierSolvePrint, "  Done! Hash Window initialized and Database loaded and prepared!\n");
 }
 
+// Starts loading, in the background, the DBs of the tier after this one.
+// This tier itself is skipped: it is kept in memory once it is saved.
+void PrefetchNextTierChildren() {
+	TIERLIST *children, *ptr;
+	TIER next;
+	if (solveList == NULL || solveList->next == NULL)
+		return;
+	next = solveList->next->tier;
+	children = gTierChildrenFunPtr(next);
+	for (ptr = children; ptr != NULL; ptr = ptr->next)
+		if (ptr->tier != next && ptr->tier != solveList->tier)
+			tierdb_prefetch(ptr->tier);
+	FreeTierList(children);
+}
+
 // we just solved the current tier, now go to the next
 // returns TRUE if there's more tiers to solve, false otherwise
 BOOLEAN gotoNextTier() {
@@ -584,6 +626,7 @@ void checkExistingDB() {
 			continue;
 		} else if (result == 1) {
 			ifprintf(gTierSolvePrint, "  %llu's Tier DB Found!\n", ptr->tier);
+			rRemoveCheckpoint(ptr->tier); // in case we died right after saving it
 			if (ptr->tier != solveList->tier) { // if this isn't next to solve!
 				tmp = ptr->next;
 				solveFirst(ptr->tier);
@@ -952,14 +995,20 @@ void rFreeFRStuff() {
 	if (rTieFR != NULL) SafeFree(rTieFR);
 }
 
+// The slot is emptied, so a checkpoint only sees the lists still to process
 IPOSITIONLIST* rRemoveFRList(VALUE value, REMOTENESS r) {
-	if (value == win)
-		return rWinFR[r];
-	else if (value == lose)
-		return rLoseFR[r];
-	else if (value == tie)
-		return rTieFR[r];
-	return NULL;
+	IPOSITIONLIST* list = NULL;
+	if (value == win) {
+		list = rWinFR[r];
+		rWinFR[r] = NULL;
+	} else if (value == lose) {
+		list = rLoseFR[r];
+		rLoseFR[r] = NULL;
+	} else if (value == tie) {
+		list = rTieFR[r];
+		rTieFR[r] = NULL;
+	}
+	return list;
 }
 
 void rInsertFR(VALUE value, POSITION position, REMOTENESS r) {
@@ -1013,6 +1062,7 @@ void SolveTier(POSITION start, POSITION end) {
 	ifprintf(gTierSolvePrint, "\nSolver Type: %sLOOPY\n",((forceLoopy||gCurrentTierIsLoopy) ? "" : "NON-"));
 	ifprintf(gTierSolvePrint, "Using Symmetries: %s\n",(gSymmetries ? "YES" : "NO"));
 	ifprintf(gTierSolvePrint, "Checking Legality (using IsLegal): %s\n",(checkLegality ? "YES" : "NO"));
+	StatsTierBegin(gCurrentTier, end - start);
 	// now actually SOLVE depending on which solver to use
 	if (forceLoopy || gCurrentTierIsLoopy) { // LOOPY SOLVER
 		ifprintf(gTierSolvePrint, "Using UndoMove Functions: %s\n",(useUndo ? "YES" : "NO"));
@@ -1020,6 +1070,7 @@ void SolveTier(POSITION start, POSITION end) {
 		ifprintf(gTierSolvePrint, "--Freeing Child Counters and Frontier Hashtables...\n");
 		rFreeFRStuff();
 	} else SolveWithNonLoopyAlgorithm(start,end); // NON-LOOPY SOLVER
+	StatsTierEnd();
 	// successfully finished solving!
 	if (partialSolve)
 		ifprintf(gTierSolvePrint, "\nPartial Tier solved!\n");
@@ -1040,13 +1091,230 @@ void SolveTier(POSITION start, POSITION end) {
 		printf("Couldn't save tierDB!\n");
 		ExitStageRight();
 	}
+	rRemoveCheckpoint(gCurrentTier);
+}
+
+/************************************************************************
+**
+** SOLVER CHECKPOINTS
+**
+** Every gTierCheckpointSeconds the solvers write out what they have done
+** on the current tier so far: its DB cells, and for the loopy solver the
+** child counters, the frontier lists and the parent pointers too. A later
+** solve of the same tier (with the same flags) resumes from there, and the
+** file is removed once the tier's DB is saved. The non-loopy solver and
+** the loopy sweep checkpoint between positions, the loopy frontier
+** processing between remotenesses.
+**
+************************************************************************/
+
+#define CHECKPOINT_MAGIC 0x4d47434b
+
+enum { CP_NONE = -1, CP_SWEEP, CP_WINLOSE, CP_TIE }; // where a checkpoint resumes
+
+typedef struct {
+	int magic, variant;
+	TIER tier;
+	POSITION start, end, tierSize, numPositions;
+	BOOLEAN loopy, undo, symmetries, legality;
+	int phase;
+	POSITION next; // the position (CP_SWEEP) or remoteness to resume at
+	POSITION numSolved, trueSizeOfTier;
+} CHECKPOINTHEADER;
+
+time_t lastCheckpoint;
+
+void rCheckpointHeader(CHECKPOINTHEADER* h, POSITION start, POSITION end, BOOLEAN loopy) {
+	memset(h, 0, sizeof(CHECKPOINTHEADER)); // so padding compares equal too
+	h->magic = CHECKPOINT_MAGIC;
+	h->variant = getOption();
+	h->tier = gCurrentTier;
+	h->start = start;
+	h->end = end;
+	h->tierSize = gCurrentTierSize;
+	h->numPositions = gNumberOfPositions;
+	h->loopy = loopy;
+	h->undo = useUndo;
+	h->symmetries = gSymmetries;
+	h->legality = checkLegality;
+}
+
+void rCheckpointFilename(char* name, TIER tier) {
+	sprintf(name, "./data/m%s_%d_tierdb/m%s_%d_%llu_checkpoint.dat",
+	        kDBName, getOption(), kDBName, getOption(), tier);
+}
+
+BOOLEAN rCheckpointDue() {
+	return gTierCheckpointSeconds > 0 && time(NULL) - lastCheckpoint >= gTierCheckpointSeconds;
+}
+
+BOOLEAN rWriteIList(FILE* fp, IPOSITIONLIST* list) {
+	unsigned long long size = (list == NULL) ? 0 : list->size, done, n;
+	IPOSITIONSUBLIST* sub = (list == NULL) ? NULL : list->head;
+	if (fwrite(&size, sizeof(size), 1, fp) != 1)
+		return FALSE;
+	for (done = 0; done < size; done += n, sub = sub->next) {
+		n = (size - done < (unsigned long long) IPOSITION_SUBLIST_SIZE) ? size - done : (unsigned long long) IPOSITION_SUBLIST_SIZE;
+		if (fwrite(sub->positions, sizeof(POSITION), n, fp) != n)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+BOOLEAN rReadIList(FILE* fp, IPOSITIONLIST** list) {
+	unsigned long long size, i;
+	POSITION pos;
+	if (fread(&size, sizeof(size), 1, fp) != 1)
+		return FALSE;
+	for (i = 0; i < size; i++) {
+		if (fread(&pos, sizeof(POSITION), 1, fp) != 1)
+			return FALSE;
+		*list = StorePositionInIList(pos, *list);
+	}
+	return TRUE;
+}
+
+// Each child with parents: the child, how many, then the parents in list order
+BOOLEAN rWriteParents(FILE* fp) {
+	POSITION pos, count, end = kBadPosition;
+	POSITIONLIST* ptr;
+	for (pos = 0; pos < gNumberOfPositions; pos++) {
+		if (rParents[pos] == NULL) continue;
+		for (count = 0, ptr = rParents[pos]; ptr != NULL; ptr = ptr->next)
+			count++;
+		if (fwrite(&pos, sizeof(POSITION), 1, fp) != 1 || fwrite(&count, sizeof(POSITION), 1, fp) != 1)
+			return FALSE;
+		for (ptr = rParents[pos]; ptr != NULL; ptr = ptr->next)
+			if (fwrite(&ptr->position, sizeof(POSITION), 1, fp) != 1)
+				return FALSE;
+	}
+	return fwrite(&end, sizeof(POSITION), 1, fp) == 1;
+}
+
+BOOLEAN rReadParents(FILE* fp) {
+	POSITION pos, count, i;
+	POSITIONLIST *node, **tail;
+	while (fread(&pos, sizeof(POSITION), 1, fp) == 1) {
+		if (pos == kBadPosition)
+			return TRUE;
+		if (pos >= gNumberOfPositions || fread(&count, sizeof(POSITION), 1, fp) != 1)
+			return FALSE;
+		for (tail = &rParents[pos]; *tail != NULL; tail = &(*tail)->next) ;
+		for (i = 0; i < count; i++) {
+			node = (POSITIONLIST*) SafeMalloc(sizeof(POSITIONLIST));
+			if (fread(&node->position, sizeof(POSITION), 1, fp) != 1) {
+				SafeFree(node);
+				return FALSE;
+			}
+			node->next = NULL;
+			*tail = node;
+			tail = &node->next;
+		}
+	}
+	return FALSE;
+}
+
+void rSaveCheckpoint(POSITION start, POSITION end, BOOLEAN loopy, int phase, POSITION next) {
+	char name[256], tmpname[272];
+	CHECKPOINTHEADER h;
+	time_t began = time(NULL);
+	BOOLEAN ok;
+	FILE* fp;
+	int r;
+
+	rCheckpointHeader(&h, start, end, loopy);
+	h.phase = phase;
+	h.next = next;
+	h.numSolved = numSolved;
+	h.trueSizeOfTier = trueSizeOfTier;
+	mkdir("data", 0755);
+	sprintf(name, "./data/m%s_%d_tierdb", kDBName, getOption());
+	mkdir(name, 0755);
+	rCheckpointFilename(name, gCurrentTier);
+	sprintf(tmpname, "%s.tmp", name);
+	if ((fp = fopen(tmpname, "wb")) == NULL) {
+		printf("WARNING: Couldn't create checkpoint %s!\n", tmpname);
+		lastCheckpoint = time(NULL);
+		return;
+	}
+	ok = fwrite(&h, sizeof(h), 1, fp) == 1 && tierdb_checkpoint_save(fp);
+	if (loopy) {
+		ok = ok && fwrite(childCounts, sizeof(CHILDCOUNT), gCurrentTierSize, fp) == gCurrentTierSize;
+		for (r = 0; ok && r < REMOTENESS_MAX; r++)
+			ok = rWriteIList(fp, rWinFR[r]) && rWriteIList(fp, rLoseFR[r]) && rWriteIList(fp, rTieFR[r]);
+		if (!useUndo)
+			ok = ok && rWriteParents(fp);
+	}
+	ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+	if (fclose(fp) != 0)
+		ok = FALSE;
+	// the rename is atomic, so a kill mid-write leaves the last checkpoint intact
+	if (ok && rename(tmpname, name) == 0)
+		ifprintf(gTierSolvePrint, "--Checkpointed tier %llu in %ld seconds.\n", gCurrentTier, (long) (time(NULL) - began));
+	else {
+		printf("WARNING: Couldn't write checkpoint %s!\n", name);
+		remove(tmpname);
+	}
+	lastCheckpoint = time(NULL);
+}
+
+// Restores the solver state and returns where to resume, or CP_NONE
+int rLoadCheckpoint(POSITION start, POSITION end, BOOLEAN loopy, POSITION* next) {
+	char name[256];
+	CHECKPOINTHEADER h, expected;
+	BOOLEAN ok;
+	FILE* fp;
+	int r;
+
+	lastCheckpoint = time(NULL);
+	if (gTierCheckpointSeconds <= 0)
+		return CP_NONE;
+	rCheckpointFilename(name, gCurrentTier);
+	if ((fp = fopen(name, "rb")) == NULL)
+		return CP_NONE;
+	rCheckpointHeader(&expected, start, end, loopy);
+	if (fread(&h, sizeof(h), 1, fp) != 1 || h.magic != expected.magic || h.variant != expected.variant ||
+	    h.tier != expected.tier || h.start != expected.start || h.end != expected.end ||
+	    h.tierSize != expected.tierSize || h.numPositions != expected.numPositions ||
+	    h.loopy != expected.loopy || h.undo != expected.undo ||
+	    h.symmetries != expected.symmetries || h.legality != expected.legality) {
+		printf("Ignoring checkpoint %s, it is from a different solve of this tier.\n", name);
+		fclose(fp);
+		return CP_NONE;
+	}
+	ok = tierdb_checkpoint_load(fp);
+	if (loopy) {
+		ok = ok && fread(childCounts, sizeof(CHILDCOUNT), gCurrentTierSize, fp) == gCurrentTierSize;
+		for (r = 0; ok && r < REMOTENESS_MAX; r++)
+			ok = rReadIList(fp, &rWinFR[r]) && rReadIList(fp, &rLoseFR[r]) && rReadIList(fp, &rTieFR[r]);
+		if (!useUndo)
+			ok = ok && rReadParents(fp);
+	}
+	fclose(fp);
+	if (!ok) {
+		printf("ERROR: Checkpoint %s is truncated or corrupted!\n"
+		       "Delete it to solve tier %llu from scratch.\n", name, gCurrentTier);
+		ExitStageRight();
+	}
+	numSolved = h.numSolved;
+	trueSizeOfTier = h.trueSizeOfTier;
+	*next = h.next;
+	ifprintf(gTierSolvePrint, "--Resuming from checkpoint %s, at %s %llu...\n", name,
+	         (h.phase == CP_SWEEP) ? "position" : (h.phase == CP_WINLOSE) ? "win/lose remoteness" : "tie remoteness", h.next);
+	return h.phase;
+}
+
+void rRemoveCheckpoint(TIER tier) {
+	char name[256];
+	rCheckpointFilename(name, tier);
+	remove(name);
 }
 
 // Note, the NonLoopyAlgorithm works regardless of whether this
 // is a partial tier or not (that's what's nice about it)...
 void SolveWithNonLoopyAlgorithm(POSITION start, POSITION end) {
 	ifprintf(gTierSolvePrint, "\n-----PREPARING NON-LOOPY SOLVER-----\n");
-	POSITION pos, child;
+	POSITION pos, child, solveStart = start, solveEnd = end, resumeAt = start;
 	MOVELIST *moves, *movesptr;
 	VALUE value;
 	REMOTENESS remoteness;
@@ -1065,20 +1333,26 @@ void SolveWithNonLoopyAlgorithm(POSITION start, POSITION end) {
 			if (max < end) end = max;
 		}
 	}
+	if (rLoadCheckpoint(solveStart, solveEnd, FALSE, &resumeAt) == CP_SWEEP && resumeAt > start)
+		start = resumeAt;
 
 	ifprintf(gTierSolvePrint, "Doing a sweep of the tier, and solving it in one go...\n");
 	for (pos = start; pos < end; pos++) { // Solve only parents
+		if ((pos & 4095) == 0 && rCheckpointDue())
+			rSaveCheckpoint(solveStart, solveEnd, FALSE, CP_SWEEP, pos);
 		if (usingLevelFiles && !l_isInLevelFile(pos)) continue; //just skip
 		if (checkLegality && !gIsLegalFunPtr(pos)) continue; //skip
 		if (gSymmetries && pos != gCanonicalPosition(pos))
 			continue; // skip, since we'll do canon one later
 		trueSizeOfTier++;
+		if (gUseGPS)
+			gSetGPSPosition(pos);
 		value = Primitive(pos);
 		if (value != undecided) { // check for primitive-ness
 			SetRemoteness(pos,0);
 			StoreValueOfPosition(pos,value);
 		} else {
-			moves = movesptr = GenerateMoves(pos);
+			moves = movesptr = StatsGenerateMoves(pos);
 			if (moves == NULL) { // no chillins
 				printf("ERROR: GenerateMoves on %llu returned NULL\n", pos);
 				ExitStageRight();
@@ -1087,7 +1361,9 @@ void SolveWithNonLoopyAlgorithm(POSITION start, POSITION end) {
 				minLoseRem = minTieRem = REMOTENESS_MAX;
 				seenLose = seenTie = FALSE;
 				for (; movesptr != NULL; movesptr = movesptr->next) {
-					child = DoMove(pos, movesptr->move);
+					child = StatsDoMove(pos, movesptr->move);
+					if (gUseGPS)
+						gUndoMove(movesptr->move);
 					if (gSymmetries)
 						child = gCanonicalPosition(child);
 					value = GetValueOfPosition(child);
@@ -1212,7 +1488,8 @@ void SolveWithLoopyAlgorithm(POSITION start, POSITION end) {
 	if (start != 0 || end != gCurrentTierSize) // we're only solving a partial tier!
 		partialSolve = TRUE;
 	ifprintf(gTierSolvePrint, "\n-----PREPARING LOOPY SOLVER-----\n");
-	POSITION pos, posSaver, canonPos, child;
+	POSITION pos, posSaver, canonPos, child, solveStart = start, solveEnd = end, resumeAt = 0;
+	int phase;
 	POSITIONLIST* tmp;
 	MOVELIST *moves, *movesptr;
 	VALUE value;
@@ -1234,118 +1511,136 @@ void SolveWithLoopyAlgorithm(POSITION start, POSITION end) {
 	//int i,numMoves; // the generateMovesEfficient stuff is commented out for now
 	ifprintf(gTierSolvePrint, "--Setting up Child Counters and Frontier Hashtables...\n");
 	rInitFRStuff();
-	ifprintf(gTierSolvePrint, "--Doing a sweep of the tier, and setting up the frontier...\n");
-	for (pos = start; pos < end; pos++) { // SET UP PARENTS
-		posSaver = pos;
+	phase = rLoadCheckpoint(solveStart, solveEnd, TRUE, &resumeAt);
+	if (phase <= CP_SWEEP) {
+		ifprintf(gTierSolvePrint, "--Doing a sweep of the tier, and setting up the frontier...\n");
+		for (pos = (phase == CP_SWEEP && resumeAt > start) ? resumeAt : start; pos < end; pos++) { // SET UP PARENTS
+			if ((pos & 4095) == 0 && rCheckpointDue())
+				rSaveCheckpoint(solveStart, solveEnd, TRUE, CP_SWEEP, pos);
+			posSaver = pos;
 solve_start: // GASP!! A LABEL!!
-		if (childCounts[pos] == 0) { // else, ignore this child, it was already solved
-			if (usingLevelFiles && !l_isInLevelFile(pos)) continue; //just skip
-			if (checkLegality && !gIsLegalFunPtr(pos)) continue; //skip
-			if (gSymmetries && pos != gCanonicalPosition(pos))
-				continue; // skip, since we'll do canon one later
-			trueSizeOfTier++;
-			value = Primitive(pos);
-			if (value != undecided) { // check for primitive-ness
-				SetRemoteness(pos,0);
-				StoreValueOfPosition(pos,value);
-				numSolved++;
-				rInsertFR(value, pos, 0);
-			} else {
-				//if (gGenerateMovesEfficientFunPtr == NULL) { // do the normal stuff
-				moves = movesptr = GenerateMoves(pos);
-				if (dedupHash != NULL) {
-					dedupHashElem = 0LL;
-					memset(dedupHash, 0, dedupHashBytes);
-				}
-				if (moves == NULL) { // no chillins
-					printf("ERROR: GenerateMoves on %llu returned NULL\n", pos);
-					ExitStageRight();
+			if (childCounts[pos] == 0) { // else, ignore this child, it was already solved
+				if (usingLevelFiles && !l_isInLevelFile(pos)) continue; //just skip
+				if (checkLegality && !gIsLegalFunPtr(pos)) continue; //skip
+				if (gSymmetries && pos != gCanonicalPosition(pos))
+					continue; // skip, since we'll do canon one later
+				trueSizeOfTier++;
+				if (gUseGPS)
+					gSetGPSPosition(pos);
+				value = Primitive(pos);
+				if (value != undecided) { // check for primitive-ness
+					SetRemoteness(pos,0);
+					StoreValueOfPosition(pos,value);
+					numSolved++;
+					rInsertFR(value, pos, 0);
 				} else {
-					//otherwise, make a Child Counter for it
-					movesptr = moves;
-                    for (; movesptr != NULL; movesptr = movesptr->next) {
-                    	child = gSymmetries ? gCanonicalPosition(DoMove(pos, movesptr->move)) : DoMove(pos, movesptr->move);
-						if (gSymmetries && useUndo && !dedupHashAdd(child)) continue;
-						childCounts[pos]++;
-
-                    	// here's the "partial solving" complication: to solve a position,
-                    	// we might have to solve another in this tier that's not part of our
-                    	// bounds! So, we need to run this loop for those guys too. To do this,
-                    	// we maintain a list of guys to run it for too.
-                    	// It uses the childCounts to ensure no duplicate iterations
-                    	if (partialSolve && child < gCurrentTierSize && childCounts[child] == 0 && (child < start || child >= end)) {
-                        	solveTheseTooList = StorePositionInList(child, solveTheseTooList);
-                    	}
-                    	if (!useUndo) { // if parent pointers, add to parent pointer list
-                        	rParents[child] = StorePositionInList(pos, rParents[child]);
-                    	}
-                    }
-                    FreeMoveList(moves);
+					//if (gGenerateMovesEfficientFunPtr == NULL) { // do the normal stuff
+					moves = movesptr = StatsGenerateMoves(pos);
+					if (dedupHash != NULL) {
+						dedupHashElem = 0LL;
+						memset(dedupHash, 0, dedupHashBytes);
+					}
+					if (moves == NULL) { // no chillins
+						printf("ERROR: GenerateMoves on %llu returned NULL\n", pos);
+						ExitStageRight();
+					} else {
+						//otherwise, make a Child Counter for it
+						movesptr = moves;
+	                    for (; movesptr != NULL; movesptr = movesptr->next) {
+	                    	child = StatsDoMove(pos, movesptr->move);
+	                    	if (gUseGPS)
+	                    		gUndoMove(movesptr->move);
+	                    	if (gSymmetries)
+	                    		child = gCanonicalPosition(child);
+							if (gSymmetries && useUndo && !dedupHashAdd(child)) continue;
+							childCounts[pos]++;
+
+	                    	// here's the "partial solving" complication: to solve a position,
+	                    	// we might have to solve another in this tier that's not part of our
+	                    	// bounds! So, we need to run this loop for those guys too. To do this,
+	                    	// we maintain a list of guys to run it for too.
+	                    	// It uses the childCounts to ensure no duplicate iterations
+	                    	if (partialSolve && child < gCurrentTierSize && childCounts[child] == 0 && (child < start || child >= end)) {
+	                        	solveTheseTooList = StorePositionInList(child, solveTheseTooList);
+	                    	}
+	                    	if (!useUndo) { // if parent pointers, add to parent pointer list
+	                        	rParents[child] = StorePositionInList(pos, rParents[child]);
+	                    	}
+	                    }
+	                    FreeMoveList(moves);
+					}
 				}
 			}
+			// before ending the for-loop, we need to go through the solveTheseTooList
+			if (partialSolve && solveTheseTooList != NULL) {
+				// remove from head
+				tmp = solveTheseTooList;
+				pos = tmp->position;
+				solveTheseTooList = tmp->next;
+				SafeFree(tmp);
+				// now, iterate for the new pos
+				goto solve_start; // HOLY CRAP, A GOTO!
+			}
+			pos = posSaver;
 		}
-		// before ending the for-loop, we need to go through the solveTheseTooList
-		if (partialSolve && solveTheseTooList != NULL) {
-			// remove from head
-			tmp = solveTheseTooList;
-			pos = tmp->position;
-			solveTheseTooList = tmp->next;
-			SafeFree(tmp);
-			// now, iterate for the new pos
-			goto solve_start; // HOLY CRAP, A GOTO!
+		if (checkLegality) {
+			ifprintf(gTierSolvePrint, "True size of tier: %lld\n",trueSizeOfTier);
+			ifprintf(gTierSolvePrint, "Tier %llu's hash efficiency: %.1f%c\n",gCurrentTier, 100*(double)trueSizeOfTier/gCurrentTierSize, '%');
 		}
-		pos = posSaver;
-	}
-	if (checkLegality) {
-		ifprintf(gTierSolvePrint, "True size of tier: %lld\n",trueSizeOfTier);
-		ifprintf(gTierSolvePrint, "Tier %llu's hash efficiency: %.1f%c\n",gCurrentTier, 100*(double)trueSizeOfTier/gCurrentTierSize, '%');
-	}
-	ifprintf(gTierSolvePrint, "Amount now solved (primitives): %lld (%.1f%c)\n",numSolved, 100*(double)numSolved/trueSizeOfTier, '%');
-	if (numSolved == trueSizeOfTier) {
-		ifprintf(gTierSolvePrint, "Tier is all primitives! No loopy algorithm needed!\n");
-		return;
-	}
-	// SET UP FRONTIER!
-	ifprintf(gTierSolvePrint, "--Doing a sweep of child tiers, and setting up the frontier...\n");
-	for (pos = gCurrentTierSize; pos < gNumberOfPositions; pos++) {
-		if (usingLevelFiles && !l_isInLevelFile(pos)) continue; //just skip
-		if (!useUndo && rParents[pos] == NULL) // if we didn't even see this child, don't put it on frontier!
-			continue;
-		if (gSymmetries) {// use the canonical position's values
-			canonPos = gCanonicalPosition(pos);
-			if (useUndo && pos != canonPos)
+		ifprintf(gTierSolvePrint, "Amount now solved (primitives): %lld (%.1f%c)\n",numSolved, 100*(double)numSolved/trueSizeOfTier, '%');
+		if (numSolved == trueSizeOfTier) {
+			ifprintf(gTierSolvePrint, "Tier is all primitives! No loopy algorithm needed!\n");
+			return;
+		}
+		// SET UP FRONTIER!
+		ifprintf(gTierSolvePrint, "--Doing a sweep of child tiers, and setting up the frontier...\n");
+		for (pos = gCurrentTierSize; pos < gNumberOfPositions; pos++) {
+			if (usingLevelFiles && !l_isInLevelFile(pos)) continue; //just skip
+			if (!useUndo && rParents[pos] == NULL) // if we didn't even see this child, don't put it on frontier!
 				continue;
-		} else {
-			canonPos = pos; // else ignore
+			if (gSymmetries) {// use the canonical position's values
+				canonPos = gCanonicalPosition(pos);
+				if (useUndo && pos != canonPos)
+					continue;
+			} else {
+				canonPos = pos; // else ignore
+			}
+			value = GetValueOfPosition(canonPos);
+			remoteness = Remoteness(canonPos);
+			if (!((value == tie && remoteness == REMOTENESS_MAX)
+			      || value == undecided))
+				rInsertFR(value, pos, remoteness);
 		}
-		value = GetValueOfPosition(canonPos);
-		remoteness = Remoteness(canonPos);
-		if (!((value == tie && remoteness == REMOTENESS_MAX)
-		      || value == undecided))
-			rInsertFR(value, pos, remoteness);
 	}
-	tierdb_free_childpositions();
+	if (!checkCorrectness) // the correctness check still reads the child tiers
+		tierdb_free_childpositions();
 	if (usingLevelFiles) l_freeBitArray();
-	ifprintf(gTierSolvePrint, "\n--Beginning the loopy algorithm...\n");
 	REMOTENESS r; IPOSITIONLIST* list;
-	ifprintf(gTierSolvePrint, "--Processing Lose/Win Frontiers!\n");
-	for (r = 0; r <= REMOTENESS_MAX; r++) {
-		if (r!=REMOTENESS_MAX) {
-			list = rRemoveFRList(lose,r);
-			if (list != NULL)
-				LoopyParentsHelper(list, win, r);
-		}
-		if (r!=0) {
-			list = rRemoveFRList(win,r-1);
-			if (list != NULL)
-				LoopyParentsHelper(list, lose, r-1);
+	if (phase <= CP_WINLOSE) {
+		ifprintf(gTierSolvePrint, "\n--Beginning the loopy algorithm...\n");
+		ifprintf(gTierSolvePrint, "--Processing Lose/Win Frontiers!\n");
+		for (r = (phase == CP_WINLOSE) ? resumeAt : 0; r <= REMOTENESS_MAX; r++) {
+			if (rCheckpointDue())
+				rSaveCheckpoint(solveStart, solveEnd, TRUE, CP_WINLOSE, r);
+			if (r!=REMOTENESS_MAX) {
+				list = rRemoveFRList(lose,r);
+				if (list != NULL)
+					LoopyParentsHelper(list, win, r);
+			}
+			if (r!=0) {
+				list = rRemoveFRList(win,r-1);
+				if (list != NULL)
+					LoopyParentsHelper(list, lose, r-1);
+			}
 		}
+		ifprintf(gTierSolvePrint, "Amount now solved: %lld (%.1f%c)\n",numSolved, 100*(double)numSolved/trueSizeOfTier, '%');
+		if (numSolved == trueSizeOfTier)
+			return; // Else, we must process ties!
 	}
-	ifprintf(gTierSolvePrint, "Amount now solved: %lld (%.1f%c)\n",numSolved, 100*(double)numSolved/trueSizeOfTier, '%');
-	if (numSolved == trueSizeOfTier)
-		return; // Else, we must process ties!
 	ifprintf(gTierSolvePrint, "--Processing Tie Frontier!\n");
-	for (r = 0; r < REMOTENESS_MAX; r++) {
+	for (r = (phase == CP_TIE) ? resumeAt : 0; r < REMOTENESS_MAX; r++) {
+		if (rCheckpointDue())
+			rSaveCheckpoint(solveStart, solveEnd, TRUE, CP_TIE, r);
 		list = rRemoveFRList(tie,r);
 		if (list != NULL)
 			LoopyParentsHelper(list, tie, r);
@@ -1454,112 +1749,252 @@ void LoopyParentsHelper(IPOSITIONLIST* list, VALUE valueParents, REMOTENESS remo
 ************************************************************************/
 
 // correctness checker
-void checkForCorrectness(POSITION start, POSITION end) {
+/* Checks one solved position against Primitive and its children's values;
+   prints what is wrong with it only if report is set. */
+static BOOLEAN checkPositionCorrectness(POSITION pos, BOOLEAN report) {
 	BOOLEAN check = TRUE;
-	POSITION pos, child;
+	POSITION child;
 	REMOTENESS maxWinRem, minLoseRem, minTieRem;
 	BOOLEAN seenLose, seenTie, okay;
 	MOVELIST *moves, *children;
 	VALUE value, valueP, valueC; REMOTENESS remoteness, remotenessC;
-	for (pos = start; pos < end; pos++) {
-		value = GetValueOfPosition(pos);
-		if (value == undecided) {
-			if ((checkLegality && !gIsLegalFunPtr(pos)) ||
-			    (gSymmetries && pos != gCanonicalPosition(pos)))
-				continue; // correct to be undecided
-			else {
-				printf("CORRUPTION: (%llu) is UNDECIDED, but shouldn't be!\n", pos);
-				check = FALSE;
-			}
+	value = GetValueOfPosition(pos);
+	if (value == undecided) {
+		if ((checkLegality && !gIsLegalFunPtr(pos)) ||
+		    (gSymmetries && pos != gCanonicalPosition(pos)))
+			return TRUE; // correct to be undecided
+		else {
+			if (report) printf("CORRUPTION: (%llu) is UNDECIDED, but shouldn't be!\n", pos);
+			check = FALSE;
 		}
-		remoteness = Remoteness(pos);
-		valueP = Primitive(pos);
-
-		if (remoteness == 0) { // better be a primitive!
-			if (valueP == undecided) {
-				printf("CORRUPTION: (%llu) is a non-Primitive with Remoteness 0!\n", pos);
-				check = FALSE;
-			} else if (value != valueP) {
-				printf("CORRUPTION: (%llu) is Primitive with value %s, but db says %s!\n",
-				       pos, gValueString[(int)valueP], gValueString[(int)value]);
-				check = FALSE;
-			}
+	}
+	remoteness = Remoteness(pos);
+	if (gUseGPS)
+		gSetGPSPosition(pos);
+	valueP = Primitive(pos);
+
+	if (remoteness == 0) { // better be a primitive!
+		if (valueP == undecided) {
+			if (report) printf("CORRUPTION: (%llu) is a non-Primitive with Remoteness 0!\n", pos);
+			check = FALSE;
+		} else if (value != valueP) {
+			if (report) printf("CORRUPTION: (%llu) is Primitive with value %s, but db says %s!\n",
+			       pos, gValueString[(int)valueP], gValueString[(int)value]);
+			check = FALSE;
+		}
+	} else {
+		if (valueP != undecided) {
+			if (report) printf("CORRUPTION: (%llu) is a Primitive with Remoteness %d, not 0!\n",
+			       pos, remoteness);
+			check = FALSE;
 		} else {
-			if (valueP != undecided) {
-				printf("CORRUPTION: (%llu) is a Primitive with Remoteness %d, not 0!\n",
-				       pos, remoteness);
+			moves = children = StatsGenerateMoves(pos);
+			if (moves == NULL) { // no children!
+				if (report) printf("CORRUPTION: (%llu) has no GenerateMoves, yet is a %s in %d!\n",
+				       pos, gValueString[(int)value], remoteness);
 				check = FALSE;
-			} else {
-				moves = children = GenerateMoves(pos);
-				if (moves == NULL) { // no children!
-					printf("CORRUPTION: (%llu) has no GenerateMoves, yet is a %s in %d!\n",
-					       pos, gValueString[(int)value], remoteness);
-					check = FALSE;
-				} else { //the REALLY annoying part, actually checking the children:
-					minLoseRem = minTieRem = REMOTENESS_MAX;
-					maxWinRem = 0;
-					seenLose = seenTie = FALSE; okay = TRUE;
-					for (; children != NULL; children = children->next) {
-						child = DoMove(pos, children->move);
-						if (gSymmetries)
-							child = gCanonicalPosition(child);
-						valueC = GetValueOfPosition(child);
-						if (valueC != undecided) {
-							remotenessC = Remoteness(child);
-							if (valueC == tie) { //this COULD be tie OR draw
-								seenTie = TRUE;
-								if (remotenessC < minTieRem)
-									minTieRem = remotenessC;
-							} else if (valueC == lose) {
-								seenLose = TRUE;
-								if (remotenessC < minLoseRem)
-									minLoseRem = remotenessC;
-							} else if (valueC == win) {
-								if (remotenessC > maxWinRem)
-									maxWinRem = remotenessC;
-							}
-						} else {
-							printf("CORRUPTION: (%llu) has UNDECIDED child, (%llu)!\n", pos, child);
-							check = okay = FALSE;
+			} else { //the REALLY annoying part, actually checking the children:
+				minLoseRem = minTieRem = REMOTENESS_MAX;
+				maxWinRem = 0;
+				seenLose = seenTie = FALSE; okay = TRUE;
+				for (; children != NULL; children = children->next) {
+					child = StatsDoMove(pos, children->move);
+					if (gUseGPS)
+						gUndoMove(children->move);
+					if (gSymmetries)
+						child = gCanonicalPosition(child);
+					valueC = GetValueOfPosition(child);
+					if (valueC != undecided) {
+						remotenessC = Remoteness(child);
+						if (valueC == tie) { //this COULD be tie OR draw
+							seenTie = TRUE;
+							if (remotenessC < minTieRem)
+								minTieRem = remotenessC;
+						} else if (valueC == lose) {
+							seenLose = TRUE;
+							if (remotenessC < minLoseRem)
+								minLoseRem = remotenessC;
+						} else if (valueC == win) {
+							if (remotenessC > maxWinRem)
+								maxWinRem = remotenessC;
 						}
+					} else {
+						if (report) printf("CORRUPTION: (%llu) has UNDECIDED child, (%llu)!\n", pos, child);
+						check = okay = FALSE;
 					}
-					FreeMoveList(moves);
-					if (okay) { // No undecided children
-						if (seenLose) { // better be WIN!
-							if (value != win || remoteness != minLoseRem+1) {
-								printf("CORRUPTION: (%llu) SHOULD be a %s in %d, but it is a %s in %d!\n",
-								       pos, gValueString[(int)win], minLoseRem+1, gValueString[(int)value], remoteness);
+				}
+				FreeMoveList(moves);
+				if (okay) { // No undecided children
+					if (seenLose) { // better be WIN!
+						if (value != win || remoteness != minLoseRem+1) {
+							if (report) printf("CORRUPTION: (%llu) SHOULD be a %s in %d, but it is a %s in %d!\n",
+							       pos, gValueString[(int)win], minLoseRem+1, gValueString[(int)value], remoteness);
+							check = FALSE;
+						}
+					} else if (seenTie) {
+						if (minTieRem == REMOTENESS_MAX) { // a draw
+							if (value != tie || remoteness != minTieRem) {
+								if (report) printf("CORRUPTION: (%llu) SHOULD be a Draw, but it is a %s in %d!\n",
+								       pos, gValueString[(int)value], remoteness);
 								check = FALSE;
 							}
-						} else if (seenTie) {
-							if (minTieRem == REMOTENESS_MAX) { // a draw
-								if (value != tie || remoteness != minTieRem) {
-									printf("CORRUPTION: (%llu) SHOULD be a Draw, but it is a %s in %d!\n",
-									       pos, gValueString[(int)value], remoteness);
-									check = FALSE;
-								}
-							} else { // a tie
-								if (value != tie || remoteness != minTieRem+1) {
-									printf("CORRUPTION: (%llu) SHOULD be a %s in %d, but it is a %s in %d!\n",
-									       pos, gValueString[(int)tie], minTieRem+1, gValueString[(int)value], remoteness);
-									check = FALSE;
-								}
-							}
-						} else { // better be LOSE!
-							if (value != lose || remoteness != maxWinRem+1) {
-								printf("CORRUPTION: (%llu) SHOULD be a %s in %d, but it is a %s in %d!\n",
-								       pos, gValueString[(int)lose], maxWinRem+1, gValueString[(int)value], remoteness);
+						} else { // a tie
+							if (value != tie || remoteness != minTieRem+1) {
+								if (report) printf("CORRUPTION: (%llu) SHOULD be a %s in %d, but it is a %s in %d!\n",
+								       pos, gValueString[(int)tie], minTieRem+1, gValueString[(int)value], remoteness);
 								check = FALSE;
 							}
 						}
+					} else { // better be LOSE!
+						if (value != lose || remoteness != maxWinRem+1) {
+							if (report) printf("CORRUPTION: (%llu) SHOULD be a %s in %d, but it is a %s in %d!\n",
+							       pos, gValueString[(int)lose], maxWinRem+1, gValueString[(int)value], remoteness);
+							check = FALSE;
+						}
 					}
 				}
 			}
 		}
 	}
-	if (check)
+	return check;
+}
+
+/*
+** The checker runs in forked worker processes rather than threads: the tier
+** modules switch generic_hash contexts inside DoMove and Primitive, so they
+** are not reentrant, while each process has its own hash state and shares the
+** solved DB copy-on-write. Workers claim CHECK_CHUNK_POSITIONS positions at a
+** time from a shared counter and mark bad positions in a shared bitmap, which
+** the parent then walks in order to print the first gTierCheckReportLimit.
+*/
+
+#define CHECK_CHUNK_POSITIONS 4096
+
+typedef struct {
+	POSITION nextChunk;
+	POSITION errors;
+	BYTE bad[];      // one bit per position of [start, end)
+} CHECKSHARED;
+
+static void checkChunks(CHECKSHARED *shared, POSITION start, POSITION end) {
+	POSITION chunk, pos, last;
+	while ((chunk = __atomic_fetch_add(&shared->nextChunk, 1, __ATOMIC_RELAXED)) < (end - start + CHECK_CHUNK_POSITIONS - 1) / CHECK_CHUNK_POSITIONS) {
+		pos = start + chunk * CHECK_CHUNK_POSITIONS;
+		last = (end - pos > CHECK_CHUNK_POSITIONS) ? pos + CHECK_CHUNK_POSITIONS : end;
+		for (; pos < last; pos++)
+			if (!checkPositionCorrectness(pos, FALSE)) {
+				__atomic_fetch_or(&shared->bad[(pos - start) >> 3], (BYTE) (1 << ((pos - start) & 7)), __ATOMIC_RELAXED);
+				__atomic_add_fetch(&shared->errors, 1, __ATOMIC_RELAXED);
+			}
+	}
+}
+
+BOOLEAN checkForCorrectness(POSITION start, POSITION end) {
+	POSITION numChunks, pos, errors;
+	int workers = (gNumThreads > 0) ? gNumThreads : 1, w, reported = 0, status;
+	BOOLEAN check = TRUE;
+	size_t bytes;
+	CHECKSHARED *shared = NULL;
+	pid_t *pids;
+	struct timespec t0, t1;
+
+	if (end <= start)
+		return TRUE;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	numChunks = (end - start + CHECK_CHUNK_POSITIONS - 1) / CHECK_CHUNK_POSITIONS;
+	if (workers > numChunks)
+		workers = (int) numChunks;
+	bytes = sizeof(CHECKSHARED) + (size_t) ((end - start + 7) >> 3);
+	if (workers > 1) {
+		shared = (CHECKSHARED*) mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (shared == MAP_FAILED) {
+			shared = NULL;
+			workers = 1;
+		}
+	}
+	if (shared == NULL)
+		shared = (CHECKSHARED*) SafeCalloc(1, bytes);
+
+	pids = (pid_t*) SafeCalloc(workers, sizeof(pid_t));
+	fflush(stdout);
+	fflush(stderr);
+	for (w = 1; w < workers; w++) {
+		pids[w] = fork();
+		if (pids[w] == 0) {
+			checkChunks(shared, start, end);
+			_exit(0);
+		}
+	}
+	checkChunks(shared, start, end); // the parent is worker 0
+	for (w = 1; w < workers; w++) {
+		if (pids[w] <= 0)
+			continue; // fork failed, the others picked up its chunks
+		if (waitpid(pids[w], &status, 0) != pids[w] || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			printf("CORRUPTION: checker process %d died, its chunks were not fully checked!\n", (int) pids[w]);
+			check = FALSE;
+		}
+	}
+	SafeFree(pids);
+
+	errors = shared->errors;
+	for (pos = start; pos < end && reported < gTierCheckReportLimit && errors > 0; pos++)
+		if (shared->bad[(pos - start) >> 3] & (1 << ((pos - start) & 7))) {
+			checkPositionCorrectness(pos, TRUE);
+			reported++;
+		}
+	if (errors > (POSITION) reported)
+		printf("CORRUPTION: ...and %llu more inconsistent positions not shown.\n", errors - reported);
+	if (workers > 1)
+		munmap(shared, bytes);
+	else SafeFree(shared);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ifprintf(gTierSolvePrint, "Checked %llu positions in %.2f seconds using %d process%s.\n", end - start,
+	         (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, workers, (workers == 1) ? "" : "es");
+	if (check && errors == 0)
 		ifprintf(gTierSolvePrint, "Congratulations! No Corruption found!\n");
-	else printf("There appears to be some corruption...\n");
+	else {
+		printf("There appears to be some corruption...\n");
+		check = FALSE;
+	}
+	return check;
+}
+
+/* Re-loads every solved tier's DB from file and checks all of its positions. */
+BOOLEAN VerifySolvedTiers() {
+	TIERLIST *ptr;
+	BOOLEAN check = TRUE;
+	POSITION badTiers = 0;
+
+	gDBLoadMainTier = TRUE; // trick tierdb into loading main tier temporarily
+	for (ptr = solvedList; ptr != NULL; ptr = ptr->next) {
+		ifprintf(gTierSolvePrint, "\n--Checking Correctness of Tier %llu", ptr->tier);
+		if (tierNames) {
+			tierStr = gTierToStringFunPtr(ptr->tier);
+			ifprintf(gTierSolvePrint, " (%s)", tierStr);
+			if (tierStr != NULL) SafeFree(tierStr);
+		}
+		ifprintf(gTierSolvePrint, "...\n");
+		if (gHashWindowInitialized && gTierInHashWindow[1] == ptr->tier) {
+			// gInitializeHashWindow won't reload a window it already has
+			CreateDatabases();
+			InitializeDatabases();
+			if (!LoadDatabase()) {
+				printf("ERROR: Couldn't load tierDBs for Tier %llu!\n", ptr->tier);
+				ExitStageRight();
+			}
+		} else gInitializeHashWindow(ptr->tier, TRUE);
+		if (!checkForCorrectness(0, gCurrentTierSize)) {
+			printf("Tier %llu has inconsistent positions!\n", ptr->tier);
+			check = FALSE;
+			badTiers++;
+		}
+	}
+	gDBLoadMainTier = FALSE;
+	if (check)
+		ifprintf(gTierSolvePrint, "\nAll solved tiers of %s are consistent!\n", kGameName);
+	else printf("\n%llu solved tiers of %s are inconsistent!\n", badTiers, kGameName);
+	return check;
 }
 
 /* TIER LIST GENERATION SECTION */
@@ -2458,21 +2893,24 @@ BOOLEAN l_readFullLevelFile(POSITION* minHash, POSITION* maxHash) {
 	        kDBName, getOption(), kDBName, getOption(), gCurrentTier);
 	if (isValidLevelFile(fname) != 0) // doesn't exist! return!
 		return FALSE;
+	l_freeBitArray();
+	if (getLevelFileType(fname) == LEVELFILE_INDEXED) { // query it in place
+		l_levelIndex = OpenLevelFileIndex(fname);
+		if (l_levelIndex == NULL)
+			return FALSE;
+		(*minHash) = l_levelIndex->minHashValue; (*maxHash) = l_levelIndex->maxHashValue+1;
+		l_min = l_levelIndex->minHashValue;
+		return TRUE;
+	}
 	POSITION max = getLevelFileMaxHashValue(fname);
 	POSITION min = getLevelFileMinHashValue(fname);
 	POSITION size = (max-min)+1;
-	if (l_bitArray != NULL) SafeFree(l_bitArray);
 	l_bitArray = (BITARRAY*) SafeMalloc(((size/8)+1) * sizeof(BITARRAY));
 	int i;
 	for (i = 0; i < ((size/8)+1); i++)
 		l_bitArray[i] = 0;
-	printf("READING!!!!! size: %llu\n", size);
 	BOOLEAN toReturn = (ReadLevelFile(fname, l_bitArray, size) == 0);
 	if (toReturn) { // if loaded correctly:
-		printf("Here's what I loaded: ");
-		for (i = 0; i < ((size/8)+1); i++)
-			printf("%x ", l_bitArray[i]);
-		printf("\n");
 		(*minHash) = min; (*maxHash) = max+1;
 		l_min = min;
 	}
@@ -2504,11 +2942,15 @@ void l_freeBitArray() {
 	if (l_bitArray != NULL)
 		SafeFree(l_bitArray);
 	l_bitArray = NULL;
+	CloseLevelFileIndex(l_levelIndex);
+	l_levelIndex = NULL;
 }
 
 // This is so we can treat l_bitArray as a sort of visited database, abstractly
 // Assumes pos >= l_min, pos < l_max
 BOOLEAN l_isInLevelFile(TIERPOSITION pos) {
+	if (l_levelIndex != NULL)
+		return LevelFileIndexContains(l_levelIndex, pos);
 	POSITION base = pos-l_min;
 	POSITION cell = base/8;
 	return (l_bitArray[cell] >> (7 - (base % 8))) & 1; // get the right bit in the cell
@@ -2615,14 +3057,11 @@ BOOLEAN l_writeLevelFile(POSITION start, POSITION end) {
 	else
 		sprintf(fname, "./data/m%s_%d_tierdb/m%s_%d_%llu__%llu_%llu_minilevelfile.dat.gz",
 		        kDBName, getOption(), kDBName, getOption(), gCurrentTier, start, end);
-	printf("I'MMA BE WRITIN'!!\n");
-	printf("Here's what I be writin' wit': ");
-	int i;
-	for (i = 0; i < ((gNumberOfPositions/8)+1); i++)
-		printf("%x ", l_windowBitArray[i]);
-	printf("\n");
-
-	BOOLEAN toReturn = (WriteLevelFile(fname, l_windowBitArray, 0, gNumberOfPositions) == 0);
+	// full level files are indexed so single positions can be looked up later
+	BOOLEAN toReturn;
+	if (start == 0 && end == gCurrentTierSize)
+		toReturn = (WriteIndexedLevelFile(fname, l_windowBitArray, 0, gNumberOfPositions) == 0);
+	else toReturn = (WriteLevelFile(fname, l_windowBitArray, 0, gNumberOfPositions) == 0);
 	// now free the arrays
 	SafeFree(l_bitArray); l_bitArray = NULL;
 	SafeFree(l_windowBitArray); l_windowBitArray = NULL;
@@ -2641,16 +3080,21 @@ void SolveLevelFileHelper(TIERPOSITION pos) {
 	l_storeToLevelFile(pos); // "visit" this position
 	if (pos >= gCurrentTierSize) { // out of tier! return
 		return;
-	} else if (Primitive(pos) != undecided) { // check for primitive-ness
+	}
+	if (gUseGPS)
+		gSetGPSPosition(pos);
+	if (Primitive(pos) != undecided) { // check for primitive-ness
 		return;
 	} else { // else, we can recurse!s
-		moves = movesptr = GenerateMoves(pos);
+		moves = movesptr = StatsGenerateMoves(pos);
 		if (moves == NULL) { // no chillins
 			printf("ERROR: GenerateMoves on %llu returned NULL\n", pos);
 			ExitStageRight();
 		} else { // else, solve me
 			for (; movesptr != NULL; movesptr = movesptr->next) {
-				child = DoMove(pos, movesptr->move);
+				child = StatsDoMove(pos, movesptr->move);
+				if (gUseGPS)
+					gUndoMove(movesptr->move);
 				if (gSymmetries)
 					child = gCanonicalPosition(child);
 				SolveLevelFileHelper(child);
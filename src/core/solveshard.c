@@ -0,0 +1,1443 @@
+/************************************************************************
+**
+** NAME:	solveshard.c
+**
+** DESCRIPTION:	Parallel shard solver for large acyclic games whose hash
+**		splits into shards that only point "downward" (Connect 4).
+**
+**		This is the Fa21ParallelSolver shard solver promoted into
+**		the core and driven through the regular module API
+**		(GenerateMoves/DoMove/Primitive). Its single-threaded,
+**		OpenMP and MPI drivers are replaced by one work-stealing
+**		thread pool fed by the shard graph scheduler.
+**
+**		Every shard is visited twice. Discovery walks the shard
+**		from the positions its parents handed down and records,
+**		per child shard, which positions it reaches there. Once all
+**		parents of a shard are discovered the shard itself can be
+**		discovered; once all children of a shard are solved the
+**		shard can be solved, reading child values from their solved
+**		files. The output is the solved-<id>.gz layout sharddb
+**		reads.
+**
+**		Built with MPI (configure --with-mpi) and started under
+**		mpirun -np <n> with n > 1, rank 0 runs the same scheduler
+**		and hands shards out to the other ranks, which keep the data
+**		they produce and send it to each other directly.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-18
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gamesman.h"
+#include "solveshard.h"
+#include "threadpool.h"
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#define SHARDFILENAMELENGTH     256
+
+typedef struct shardgraph {
+	POSITION shardid;
+	int childrencount;
+	int parentcount;
+	int parentsdiscovered;
+	int childrensolved;
+	struct shardgraph** childrenshards;
+	struct shardgraph** parentshards;
+	struct shardtransfer* transfers;   /* one per child, same order */
+	int discovered;
+#ifdef HAVE_MPI
+	int discoveredby, solvedby;        /* ranks, on rank 0 */
+	int parentssolved;
+	unsigned char *holders;            /* ranks sent the solved tree, on rank 0 */
+	unsigned char *solved;             /* solved tree kept for parents, on workers */
+	size_t solvedlength;
+#endif
+} SHARDGRAPH;
+
+/* The positions a shard hands to one child: three sorted lists of
+** in-shard offsets (reached non-primitive, primitive loss, primitive
+** tie), each stored as LEB128 deltas behind a TRANSFERHEADER. The block
+** stays in memory unless the transfer budget is used up, in which case
+** it is written to a single spill file and read back in one piece. */
+#define TRANSFER_NONPRIMITIVE   0
+#define TRANSFER_LOSS           1
+#define TRANSFER_TIE            2
+#define TRANSFER_LISTS          3
+
+typedef struct {
+	uint32_t count[TRANSFER_LISTS];
+	uint32_t length[TRANSFER_LISTS];
+} TRANSFERHEADER;
+
+typedef struct shardtransfer {
+	unsigned char *data;    /* NULL when spilled */
+	size_t length;
+	BOOLEAN spilled;
+} SHARDTRANSFER;
+
+typedef struct {
+	unsigned char *data;
+	size_t length, capacity;
+	uint32_t count, last;
+} TRANSFERLIST;
+
+/* Growable DFS stack; game depth is not known to the core. */
+typedef struct {
+	POSITION *items;
+	size_t count, capacity;
+} FRINGE;
+
+/* One byte per position, paged: a page is only allocated once something
+** nonzero is stored in it, so a shard costs memory in proportion to the
+** positions it actually reaches rather than 2^gShardSize. A solved shard
+** read back from disk keeps its compressed form and decodes a page the
+** first time it is read; PAGEOFFSETS[p] is where page p's block starts
+** in COMPRESSED. */
+#define SHARDPAGEBITS           12
+
+typedef struct {
+	int size;
+	int pagebits;
+	unsigned char **pages;
+	unsigned char *compressed;
+	size_t *pageoffsets;
+} SHARDDATA;
+
+static THREADPOOL*      shardPool = NULL;
+static pthread_mutex_t  shardGraphLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  shardPrintLock = PTHREAD_MUTEX_INITIALIZER;
+static SHARDGRAPH*      shardList = NULL;
+static SHARDGRAPH*      startingShard = NULL;
+static POSITION         startingPosition;
+static int              validShards, shardsDiscovered, shardsSolved;
+static unsigned char    startingValue;
+static char             workingFolder[256];
+static size_t           transferBytes, transferBudget;
+#ifdef HAVE_MPI
+static int              shardRank = 0, shardRanks = 1;
+#endif
+
+/*
+** Shard value storage
+*/
+
+static SHARDDATA* initializesolverdata(int keylen)
+{
+	SHARDDATA *s = (SHARDDATA *) SafeCalloc(1, sizeof(SHARDDATA));
+	s->size = keylen;
+	s->pagebits = keylen < SHARDPAGEBITS ? keylen : SHARDPAGEBITS;
+	s->pages = (unsigned char **) SafeCalloc(1l << (keylen - s->pagebits), sizeof(unsigned char *));
+	return s;
+}
+
+static void initializesegment(unsigned char *data, const unsigned char *buffer, size_t *offset, int size);
+
+static unsigned char *solverpage(SHARDDATA *s, POSITION page)
+{
+	size_t offset;
+	if (s->pages[page] == NULL && s->compressed != NULL) {
+		offset = s->pageoffsets[page];
+		s->pages[page] = (unsigned char *) SafeMalloc(1l << s->pagebits);
+		initializesegment(s->pages[page], s->compressed, &offset, s->pagebits);
+	}
+	return s->pages[page];
+}
+
+static inline void solverinsert(SHARDDATA *s, POSITION key, unsigned char val)
+{
+	unsigned char **page = s->pages + (key >> s->pagebits);
+	if (*page == NULL)
+		*page = (unsigned char *) SafeCalloc(1l << s->pagebits, 1);
+	(*page)[key & ((1l << s->pagebits) - 1)] = val;
+}
+
+static inline unsigned char solverread(SHARDDATA *s, POSITION key)
+{
+	unsigned char *page = s->pages[key >> s->pagebits];
+	if (page == NULL && (page = solverpage(s, key >> s->pagebits)) == NULL)
+		return 0;
+	return page[key & ((1l << s->pagebits) - 1)];
+}
+
+static void freesolver(SHARDDATA *s)
+{
+	POSITION i;
+	if (s == NULL) return;
+	for (i = 0; i < (1ULL << (s->size - s->pagebits)); i++)
+		if (s->pages[i]) SafeFree(s->pages[i]);
+	SafeFree(s->pages);
+	if (s->compressed) SafeFree(s->compressed);
+	if (s->pageoffsets) SafeFree(s->pageoffsets);
+	SafeFree(s);
+}
+
+/* Writes the block of (2^SIZE) length starting at FIRST to OUTPUT.
+   Returns -n if n is the unique nonzero value in the block, 0 if the
+   block is empty, or the number of bytes written otherwise.
+
+   Each block of size 2^n begins with a pointer byte.
+   0: the next byte is the unique value stored in the block.
+   1: left and right halves are identical (zeros count as "anything");
+      what follows is the structure for a block of size 2^(n-1).
+   2: the halves differ; the left block follows, then the right block. */
+static int64_t solversavefragment(SHARDDATA *s, POSITION first, int size, unsigned char* output)
+{
+	if (size <= s->pagebits && s->pages[first >> s->pagebits] == NULL) {
+		return 0;   /* untouched page */
+	}
+	if (size == 0) {
+		return -solverread(s, first);
+	}
+	int64_t leftlength = solversavefragment(s, first, size - 1, output + 1l);
+	if (leftlength > 0) {
+		int64_t rightlength = solversavefragment(s, first + (1l << (size - 1)), size - 1, output + 1l + leftlength);
+		if (rightlength > 0) {
+			output[0] = 2;
+			return leftlength + rightlength + 1l;
+		} else if (rightlength == 0) {
+			output[0] = 1;
+			return leftlength + 1l;
+		} else {
+			output[0] = 2;
+			output[1l + leftlength] = 0;
+			output[2l + leftlength] = -rightlength;
+			return leftlength + 3l;
+		}
+	} else if (leftlength == 0) {
+		int64_t rightlength = solversavefragment(s, first + (1l << (size - 1)), size - 1, output + 1l);
+		if (rightlength <= 0) {
+			return rightlength;
+		}
+		output[0] = 1;
+		return rightlength + 1l;
+	} else {
+		int64_t rightlength = solversavefragment(s, first + (1l << (size - 1)), size - 1, output + 3l);
+		if (rightlength > 0) {
+			output[0] = 2;
+			output[1] = 0;
+			output[2] = -leftlength;
+			return rightlength + 3l;
+		} else if (rightlength == 0) {
+			return leftlength;
+		} else {
+			if (rightlength == leftlength) {
+				return leftlength;
+			}
+			output[0] = 2;
+			output[1] = 0;
+			output[2] = -leftlength;
+			output[3] = 0;
+			output[4] = -rightlength;
+			return 5l;
+		}
+	}
+}
+
+static BOOLEAN solversave(SHARDDATA *s, POSITION shardid)
+{
+	char filename[SHARDFILENAMELENGTH];
+	unsigned char header = s->size, *result;
+	POSITION i, pagecount = 1ULL << (s->size - s->pagebits), touched = 0;
+	int64_t length;
+	gzFile file;
+	char *slash;
+
+	/* A block of 2^n distinct values encodes to 3 * 2^n - 1 bytes at
+	** worst. Untouched pages encode to nothing, and the levels above
+	** the pages add at most 3 bytes per node. */
+	for (i = 0; i < pagecount; i++)
+		if (s->pages[i]) touched++;
+	result = (unsigned char *) SafeMalloc(touched * (3l << s->pagebits) + 6 * pagecount + 2);
+	length = solversavefragment(s, 0, s->size, result);
+
+	if (length <= 0) {
+		result[0] = 0;
+		result[1] = -length;
+		length = 2;
+	}
+	ShardSolvedFileName(filename, SHARDFILENAMELENGTH, shardid);
+	slash = strrchr(filename, '/');
+	*slash = '\0';
+	mkdir(filename, 0755);
+	*slash = '/';
+	if ((file = gzopen(filename, "wb")) == NULL) {
+		fprintf(stderr, "Error: could not write %s\n", filename);
+		SafeFree(result);
+		return FALSE;
+	}
+	gzwrite(file, &header, 1);
+	gzwrite(file, result, length);
+	gzclose(file);
+#ifdef HAVE_MPI
+	/* Parents may be solved on other ranks; they get the tree from here. */
+	if (shardRanks > 1 && shardList[shardid].parentcount > 0) {
+		shardList[shardid].solved = (unsigned char *) SafeMalloc(length + 1);
+		shardList[shardid].solved[0] = header;
+		memcpy(shardList[shardid].solved + 1, result, length);
+		shardList[shardid].solvedlength = length + 1;
+	}
+#endif
+	SafeFree(result);
+	return TRUE;
+}
+
+static void initializesegment(unsigned char *data, const unsigned char *buffer, size_t *offset, int size)
+{
+	unsigned char ptr = buffer[(*offset)++];
+	if (ptr == 0) {
+		memset(data, buffer[(*offset)++], 1l << size);
+	} else if (ptr == 1) {
+		initializesegment(data, buffer, offset, size - 1);
+		memcpy(data + (1l << (size - 1)), data, 1l << (size - 1));
+	} else {
+		initializesegment(data, buffer, offset, size - 1);
+		initializesegment(data + (1l << (size - 1)), buffer, offset, size - 1);
+	}
+}
+
+/* Offset just past the block of (2^SIZE) length starting at OFFSET. */
+static size_t skipsegment(const unsigned char *buffer, size_t offset, int size)
+{
+	unsigned char ptr = buffer[offset++];
+	if (ptr == 0)
+		return offset + 1;
+	offset = skipsegment(buffer, offset, size - 1);
+	return (ptr == 1) ? offset : skipsegment(buffer, offset, size - 1);
+}
+
+/* Records in S->PAGEOFFSETS where each page under the block at OFFSET
+** starts, and returns the offset past the block. A collapsed block
+** above page level serves every page below it. */
+static size_t indexsegment(SHARDDATA *s, size_t offset, POSITION firstpage, int size)
+{
+	POSITION pages, i;
+	unsigned char ptr;
+	size_t end;
+
+	if (size == s->pagebits) {
+		s->pageoffsets[firstpage] = offset;
+		return skipsegment(s->compressed, offset, size);
+	}
+	pages = 1ULL << (size - s->pagebits);
+	ptr = s->compressed[offset];
+	if (ptr == 0) {
+		for (i = 0; i < pages; i++)
+			s->pageoffsets[firstpage + i] = offset;
+		return offset + 2;
+	}
+	end = indexsegment(s, offset + 1, firstpage, size - 1);
+	if (ptr == 1) {
+		for (i = 0; i < pages / 2; i++)
+			s->pageoffsets[firstpage + pages / 2 + i] = s->pageoffsets[firstpage + i];
+		return end;
+	}
+	return indexsegment(s, end, firstpage + pages / 2, size - 1);
+}
+
+/* Opens a solved child shard. Pages are decompressed on first read;
+** positions the solver never stored read back as whatever value their
+** block collapsed to. */
+static SHARDDATA* initializeplayerdata(int keylen, POSITION shardid)
+{
+	char filename[SHARDFILENAMELENGTH];
+	gzFile file;
+	unsigned char *buffer;
+	size_t used = 0, capacity = 1 << 16;
+	int got;
+	SHARDDATA *s;
+
+	ShardSolvedFileName(filename, SHARDFILENAMELENGTH, shardid);
+#ifdef HAVE_MPI
+	if (shardList[shardid].solved != NULL) {
+		used = shardList[shardid].solvedlength;
+		buffer = (unsigned char *) SafeMalloc(used);
+		memcpy(buffer, shardList[shardid].solved, used);
+	} else
+#endif
+	{
+		if ((file = gzopen(filename, "rb")) == NULL)
+			return NULL;
+		buffer = (unsigned char *) SafeMalloc(capacity);
+		while ((got = gzread(file, buffer + used, capacity - used)) > 0) {
+			used += got;
+			if (used == capacity) {
+				capacity *= 2;
+				buffer = (unsigned char *) SafeRealloc(buffer, capacity);
+			}
+		}
+		gzclose(file);
+	}
+	if (used < 3 || buffer[0] != keylen) {
+		fprintf(stderr, "Error: %s is not a solved shard of size %d\n", filename, keylen);
+		SafeFree(buffer);
+		return NULL;
+	}
+	s = initializesolverdata(keylen);
+	s->compressed = buffer;
+	s->pageoffsets = (size_t *) SafeMalloc((1l << (keylen - s->pagebits)) * sizeof(size_t));
+	indexsegment(s, 1, 0, keylen);
+	return s;
+}
+
+/*
+** Helpers
+*/
+
+void ShardSolvedFileName(char *dst, int len, POSITION shardId)
+{
+	POSITION d = shardId;
+	while (d >= 1000) d /= 10;
+	snprintf(dst, len, "./data/%s_%d_sharddb/%llu/solved-%llu.gz", kGameName,
+	         getOption(), (unsigned long long) d, (unsigned long long) shardId);
+}
+
+BOOLEAN ShardWorkerRank()
+{
+#ifdef HAVE_MPI
+	return shardRank != 0;
+#else
+	return FALSE;
+#endif
+}
+
+BOOLEAN ShardDatabaseExists(POSITION position)
+{
+	char filename[SHARDFILENAMELENGTH];
+	struct stat st;
+	if (!gShardHashFunPtr) return FALSE;
+	ShardSolvedFileName(filename, SHARDFILENAMELENGTH, gShardHashFunPtr(position) >> gShardSize);
+	return stat(filename, &st) == 0;
+}
+
+static void fringepush(FRINGE *f, POSITION p)
+{
+	if (f->count == f->capacity) {
+		f->capacity = f->capacity ? 2 * f->capacity : 256;
+		f->items = f->items ? (POSITION *) SafeRealloc(f->items, f->capacity * sizeof(POSITION))
+		           : (POSITION *) SafeMalloc(f->capacity * sizeof(POSITION));
+	}
+	f->items[f->count++] = p;
+}
+
+static unsigned char primitivebyte(POSITION position)
+{
+	switch (Primitive(position)) {
+	case lose: return SHARD_LOSS;
+	case tie: return SHARD_TIE;
+	case win: return SHARD_WIN;
+	default: return SHARD_NOT_PRIMITIVE;
+	}
+}
+
+static int childshardindex(SHARDGRAPH *shard, POSITION shardid)
+{
+	int l;
+	for (l = 0; l < shard->childrencount; l++)
+		if (shard->childrenshards[l]->shardid == shardid)
+			return l;
+	return -1;
+}
+
+/*
+** Transfers
+*/
+
+static void transferfilename(char *dst, int len, POSITION parent, POSITION child)
+{
+	snprintf(dst, len, "%s/transfer-%llu-%llu", workingFolder,
+	         (unsigned long long) parent, (unsigned long long) child);
+}
+
+/* Offsets are appended in increasing order, so only the gap is stored. */
+static void transferappend(TRANSFERLIST *list, uint32_t offset)
+{
+	uint32_t delta = offset - list->last;
+	if (list->length + 5 > list->capacity) {
+		list->capacity = list->capacity ? 2 * list->capacity : 4096;
+		list->data = list->data ? (unsigned char *) SafeRealloc(list->data, list->capacity)
+		             : (unsigned char *) SafeMalloc(list->capacity);
+	}
+	while (delta >= 0x80) {
+		list->data[list->length++] = (unsigned char) (delta | 0x80);
+		delta >>= 7;
+	}
+	list->data[list->length++] = (unsigned char) delta;
+	list->last = offset;
+	list->count++;
+}
+
+/* Packs the lists of the edge from PARENT to its Ith child into one block
+** and either keeps it or spills it, depending on the transfer budget. */
+static void transferstore(SHARDGRAPH *parent, int i, TRANSFERLIST *lists)
+{
+	SHARDTRANSFER *t = parent->transfers + i;
+	TRANSFERHEADER header;
+	char filename[SHARDFILENAMELENGTH];
+	unsigned char *block;
+	size_t offset = sizeof(TRANSFERHEADER);
+	FILE *file;
+	int k;
+
+	t->length = sizeof(TRANSFERHEADER);
+	for (k = 0; k < TRANSFER_LISTS; k++) {
+		header.count[k] = lists[k].count;
+		header.length[k] = (uint32_t) lists[k].length;
+		t->length += lists[k].length;
+	}
+	block = (unsigned char *) SafeMalloc(t->length);
+	memcpy(block, &header, sizeof(TRANSFERHEADER));
+	for (k = 0; k < TRANSFER_LISTS; k++) {
+		if (lists[k].length) memcpy(block + offset, lists[k].data, lists[k].length);
+		offset += lists[k].length;
+	}
+
+	if (__atomic_add_fetch(&transferBytes, t->length, __ATOMIC_SEQ_CST) <= transferBudget) {
+		t->data = block;
+		return;
+	}
+	__atomic_sub_fetch(&transferBytes, t->length, __ATOMIC_SEQ_CST);
+	transferfilename(filename, SHARDFILENAMELENGTH, parent->shardid, parent->childrenshards[i]->shardid);
+	if ((file = fopen(filename, "wb")) == NULL || fwrite(block, 1, t->length, file) != t->length) {
+		fprintf(stderr, "Error: could not write %s\n", filename);
+		ExitStageRight();
+		exit(1);
+	}
+	fclose(file);
+	SafeFree(block);
+	t->spilled = TRUE;
+}
+
+/* The block PARENT left for CHILD. Spilled blocks are read into a fresh
+** buffer that the caller hands back through transferdone. */
+static unsigned char *transferload(SHARDGRAPH *parent, SHARDGRAPH *child)
+{
+	SHARDTRANSFER *t = parent->transfers + childshardindex(parent, child->shardid);
+	char filename[SHARDFILENAMELENGTH];
+	unsigned char *block;
+	FILE *file;
+
+	if (!t->spilled)
+		return t->data;
+	transferfilename(filename, SHARDFILENAMELENGTH, parent->shardid, child->shardid);
+	block = (unsigned char *) SafeMalloc(t->length);
+	if ((file = fopen(filename, "rb")) == NULL || fread(block, 1, t->length, file) != t->length) {
+		fprintf(stderr, "Error: could not read %s\n", filename);
+		ExitStageRight();
+		exit(1);
+	}
+	fclose(file);
+	return block;
+}
+
+/* Releases a block from transferload; FINAL drops the edge for good. */
+static void transferdone(SHARDGRAPH *parent, SHARDGRAPH *child, unsigned char *block, BOOLEAN final)
+{
+	SHARDTRANSFER *t = parent->transfers + childshardindex(parent, child->shardid);
+	char filename[SHARDFILENAMELENGTH];
+
+	if (t->spilled) {
+		SafeFree(block);
+		if (final) {
+			transferfilename(filename, SHARDFILENAMELENGTH, parent->shardid, child->shardid);
+			remove(filename);
+		}
+	} else if (final) {
+		__atomic_sub_fetch(&transferBytes, t->length, __ATOMIC_SEQ_CST);
+		SafeFree(t->data);
+		t->data = NULL;
+	}
+}
+
+/* Decodes list K of BLOCK into OFFSETS, which must hold its count. */
+static uint32_t transferread(const unsigned char *block, int k, uint32_t **offsets)
+{
+	const TRANSFERHEADER *header = (const TRANSFERHEADER *) block;
+	const unsigned char *p = block + sizeof(TRANSFERHEADER);
+	uint32_t j, value = 0, delta;
+	int shift, l;
+
+	for (l = 0; l < k; l++)
+		p += header->length[l];
+	*offsets = (uint32_t *) SafeMalloc((header->count[k] + 1) * sizeof(uint32_t));
+	for (j = 0; j < header->count[k]; j++) {
+		delta = 0;
+		shift = 0;
+		do {
+			delta |= (uint32_t) (*p & 0x7F) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+		value += delta;
+		(*offsets)[j] = value;
+	}
+	return header->count[k];
+}
+
+/*
+** Discovery
+*/
+
+/* Walks every position of TARGETSHARD reachable from START without
+** leaving the shard, and records first contact with each child shard. */
+static void discoverfrom(SHARDGRAPH *targetshard, POSITION start, SHARDDATA *localpositions,
+                         SHARDDATA **childrenshards, FRINGE *fringe)
+{
+	const POSITION SHARDOFFSETMASK = (1ULL << gShardSize) - 1;
+	MOVELIST *moves, *ptr;
+	POSITION g, newg, h, newpositionshard;
+	int l;
+
+	fringe->count = 0;
+	fringepush(fringe, start);
+	while (fringe->count) {
+		g = fringe->items[--fringe->count];
+		h = gShardHashFunPtr(g);
+		if (solverread(localpositions, h & SHARDOFFSETMASK) != 0)
+			continue;
+		/* Mark as expanded before looking at the children. */
+		solverinsert(localpositions, h & SHARDOFFSETMASK, 1);
+		moves = StatsGenerateMoves(g);
+		for (ptr = moves; ptr != NULL; ptr = ptr->next) {
+			newg = StatsDoMove(g, ptr->move);
+			h = gShardHashFunPtr(newg);
+			newpositionshard = h >> gShardSize;
+			if (newpositionshard == targetshard->shardid) {
+				if (!solverread(localpositions, h & SHARDOFFSETMASK)) {
+					if (primitivebyte(newg) == SHARD_NOT_PRIMITIVE)
+						fringepush(fringe, newg);
+					else
+						solverinsert(localpositions, h & SHARDOFFSETMASK, 2);
+				}
+			} else if ((l = childshardindex(targetshard, newpositionshard)) >= 0) {
+				if (!solverread(childrenshards[l], h & SHARDOFFSETMASK))
+					solverinsert(childrenshards[l], h & SHARDOFFSETMASK, primitivebyte(newg));
+			}
+		}
+		FreeMoveList(moves);
+	}
+}
+
+static void savetransfer(SHARDGRAPH *targetshard, int i, SHARDDATA *childpositions)
+{
+	const POSITION SHARDOFFSETMASK = (1ULL << gShardSize) - 1;
+	SHARDGRAPH *child = targetshard->childrenshards[i];
+	TRANSFERLIST lists[TRANSFER_LISTS];
+	MOVELIST *moves, *ptr;
+	POSITION g, newg, h;
+	uint32_t j;
+	int k;
+
+	memset(lists, 0, sizeof(lists));
+	for (j = 0; j < (1ULL << gShardSize); j++) {
+		if (childpositions->pages[j >> childpositions->pagebits] == NULL) {
+			j |= (1U << childpositions->pagebits) - 1;   /* nothing reached here */
+			continue;
+		}
+		switch (solverread(childpositions, j)) {
+		case SHARD_LOSS:
+			transferappend(lists + TRANSFER_LOSS, j);
+			break;
+		case SHARD_TIE:
+			transferappend(lists + TRANSFER_TIE, j);
+			break;
+		case SHARD_NOT_PRIMITIVE:
+			transferappend(lists + TRANSFER_NONPRIMITIVE, j);
+		/* fall through */
+		case SHARD_UNSAVED_NONPRIMITIVE:
+			/* The child shard reaches this position's in-shard children
+			** from here anyway, and they hash higher, so the rest of
+			** this scan need not send them. */
+			g = gShardUnhashFunPtr((child->shardid << gShardSize) + j);
+			moves = StatsGenerateMoves(g);
+			for (ptr = moves; ptr != NULL; ptr = ptr->next) {
+				newg = StatsDoMove(g, ptr->move);
+				h = gShardHashFunPtr(newg);
+				if ((h >> gShardSize) == child->shardid)
+					solverinsert(childpositions, h & SHARDOFFSETMASK,
+					             primitivebyte(newg) == SHARD_NOT_PRIMITIVE ?
+					             SHARD_UNSAVED_NONPRIMITIVE : SHARD_UNSAVED_PRIMITIVE);
+			}
+			FreeMoveList(moves);
+			break;
+		}
+	}
+	transferstore(targetshard, i, lists);
+	for (k = 0; k < TRANSFER_LISTS; k++)
+		if (lists[k].data) SafeFree(lists[k].data);
+}
+
+static void discoverfragment(SHARDGRAPH *targetshard, BOOLEAN isstartingfragment)
+{
+	int childrenshardcount = targetshard->childrencount, i;
+	SHARDDATA *localpositions = initializesolverdata(gShardSize);
+	SHARDDATA **childrenshards = (SHARDDATA **) SafeMalloc(sizeof(SHARDDATA *) * (childrenshardcount + 1));
+	FRINGE fringe = { NULL, 0, 0 };
+	uint32_t j, count, *offsets;
+	unsigned char *block;
+
+	for (i = 0; i < childrenshardcount; i++)
+		childrenshards[i] = initializesolverdata(gShardSize);
+
+	if (isstartingfragment) {
+		discoverfrom(targetshard, startingPosition, localpositions, childrenshards, &fringe);
+	} else {
+		for (i = 0; i < targetshard->parentcount; i++) {
+			block = transferload(targetshard->parentshards[i], targetshard);
+			count = transferread(block, TRANSFER_NONPRIMITIVE, &offsets);
+			for (j = 0; j < count; j++) {
+				if (solverread(localpositions, offsets[j])) continue;
+				discoverfrom(targetshard,
+				             gShardUnhashFunPtr((targetshard->shardid << gShardSize) + offsets[j]),
+				             localpositions, childrenshards, &fringe);
+			}
+			SafeFree(offsets);
+			transferdone(targetshard->parentshards[i], targetshard, block, FALSE);
+		}
+	}
+	for (i = 0; i < childrenshardcount; i++) {
+		savetransfer(targetshard, i, childrenshards[i]);
+		freesolver(childrenshards[i]);
+	}
+	freesolver(localpositions);
+	SafeFree(childrenshards);
+	if (fringe.items) SafeFree(fringe.items);
+}
+
+/*
+** Solving
+*/
+
+/* Post-order DFS from START over the positions of TARGETSHARD. A position
+** stays on the fringe until all of its in-shard children have a value;
+** then its value is the best over the children, one move further. */
+static void solvefrom(SHARDGRAPH *targetshard, POSITION start, SHARDDATA *localpositions,
+                      SHARDDATA **childrenshards, FRINGE *fringe)
+{
+	const POSITION SHARDOFFSETMASK = (1ULL << gShardSize) - 1;
+	MOVELIST *moves, *ptr;
+	POSITION g, newg, h, newpositionshard;
+	unsigned char primitive, minprimitive;
+	size_t oldindex;
+	int l;
+
+	fringe->count = 0;
+	fringepush(fringe, start);
+	while (fringe->count) {
+		minprimitive = 255;
+		oldindex = fringe->count;
+		g = fringe->items[fringe->count - 1];
+		h = gShardHashFunPtr(g);
+		if (solverread(localpositions, h & SHARDOFFSETMASK) != 0) {
+			fringe->count--;
+			continue;
+		}
+		moves = StatsGenerateMoves(g);
+		for (ptr = moves; ptr != NULL; ptr = ptr->next) {
+			newg = StatsDoMove(g, ptr->move);
+			h = gShardHashFunPtr(newg);
+			newpositionshard = h >> gShardSize;
+			if (newpositionshard != targetshard->shardid) {
+				/* Child shards are solved; their reads are never zero. */
+				l = childshardindex(targetshard, newpositionshard);
+				primitive = (l >= 0) ? solverread(childrenshards[l], h & SHARDOFFSETMASK) : 0;
+			} else {
+				primitive = solverread(localpositions, h & SHARDOFFSETMASK);
+			}
+			if (!primitive) {
+				primitive = primitivebyte(newg);
+				if (primitive != SHARD_NOT_PRIMITIVE) {
+					solverinsert(localpositions, h & SHARDOFFSETMASK, primitive);
+					minprimitive = minprimitive <= primitive ? minprimitive : primitive;
+				} else {
+					fringepush(fringe, newg);
+				}
+			} else {
+				minprimitive = minprimitive <= primitive ? minprimitive : primitive;
+			}
+		}
+		FreeMoveList(moves);
+		if (fringe->count == oldindex) {
+			if (minprimitive & 128) {
+				if (minprimitive & 64) minprimitive = 257 - minprimitive; /* all children win */
+				else minprimitive = minprimitive + 1;                     /* best is a tie */
+			} else {
+				minprimitive = 255 - minprimitive;                        /* a child loses */
+			}
+			solverinsert(localpositions, gShardHashFunPtr(g) & SHARDOFFSETMASK, minprimitive);
+			fringe->count--;
+		}
+	}
+}
+
+static void readprimitivetransfer(const unsigned char *block, int k, unsigned char value,
+                                  SHARDDATA *localpositions)
+{
+	uint32_t j, count, *offsets;
+
+	count = transferread(block, k, &offsets);
+	for (j = 0; j < count; j++)
+		solverinsert(localpositions, offsets[j], value);
+	SafeFree(offsets);
+}
+
+static void solvefragment(SHARDGRAPH *targetshard, BOOLEAN isstartingfragment)
+{
+	int childrenshardcount = targetshard->childrencount, i;
+	SHARDDATA *localpositions = initializesolverdata(gShardSize);
+	SHARDDATA **childrenshards = (SHARDDATA **) SafeMalloc(sizeof(SHARDDATA *) * (childrenshardcount + 1));
+	FRINGE fringe = { NULL, 0, 0 };
+	uint32_t j, count, *offsets;
+	unsigned char *block;
+
+	for (i = 0; i < childrenshardcount; i++) {
+		if ((childrenshards[i] = initializeplayerdata(gShardSize, targetshard->childrenshards[i]->shardid)) == NULL) {
+			fprintf(stderr, "Error: solved child shard %llu is missing\n",
+			        (unsigned long long) targetshard->childrenshards[i]->shardid);
+			ExitStageRight();
+			exit(1);
+		}
+	}
+
+	if (isstartingfragment) {
+		solvefrom(targetshard, startingPosition, localpositions, childrenshards, &fringe);
+		startingValue = solverread(localpositions, gShardHashFunPtr(startingPosition) & ((1ULL << gShardSize) - 1));
+	} else {
+		for (i = 0; i < targetshard->parentcount; i++) {
+			block = transferload(targetshard->parentshards[i], targetshard);
+			readprimitivetransfer(block, TRANSFER_LOSS, SHARD_LOSS, localpositions);
+			readprimitivetransfer(block, TRANSFER_TIE, SHARD_TIE, localpositions);
+			count = transferread(block, TRANSFER_NONPRIMITIVE, &offsets);
+			for (j = 0; j < count; j++) {
+				if (solverread(localpositions, offsets[j])) continue;
+				solvefrom(targetshard,
+				          gShardUnhashFunPtr((targetshard->shardid << gShardSize) + offsets[j]),
+				          localpositions, childrenshards, &fringe);
+			}
+			SafeFree(offsets);
+			transferdone(targetshard->parentshards[i], targetshard, block, TRUE);
+		}
+	}
+
+	solversave(localpositions, targetshard->shardid);
+
+	freesolver(localpositions);
+	for (i = 0; i < childrenshardcount; i++)
+		freesolver(childrenshards[i]);
+	SafeFree(childrenshards);
+	if (fringe.items) SafeFree(fringe.items);
+}
+
+/*
+** Shard graph
+*/
+
+static int initializeshard(char* shardinitialized, POSITION startingshard)
+{
+	POSITION* childrenshards;
+	int childrencount, subshardsadded = 1, i;
+
+	if (shardinitialized[startingshard])
+		return 0;
+	shardinitialized[startingshard] = 1;
+	childrencount = gShardChildrenFunPtr(startingshard, &childrenshards);
+	shardList[startingshard].shardid = startingshard;
+	shardList[startingshard].childrencount = childrencount;
+	shardList[startingshard].childrenshards = (SHARDGRAPH **) SafeCalloc(childrencount + 1, sizeof(SHARDGRAPH *));
+	shardList[startingshard].transfers = (SHARDTRANSFER *) SafeCalloc(childrencount + 1, sizeof(SHARDTRANSFER));
+	for (i = 0; i < childrencount; i++) {
+		subshardsadded += initializeshard(shardinitialized, childrenshards[i]);
+		shardList[startingshard].childrenshards[i] = shardList + childrenshards[i];
+		shardList[childrenshards[i]].parentcount++;
+	}
+	if (childrenshards) SafeFree(childrenshards);
+	return subshardsadded;
+}
+
+static void initializeparentshard(SHARDGRAPH* shard)
+{
+	int i;
+	SHARDGRAPH *child;
+
+	if (shard->parentshards) return;
+	shard->parentshards = (SHARDGRAPH **) SafeCalloc(shard->parentcount + 1, sizeof(SHARDGRAPH *));
+	shard->parentcount = 0;
+	for (i = 0; i < shard->childrencount; i++) {
+		child = shard->childrenshards[i];
+		initializeparentshard(child);
+		child->parentshards[child->parentcount++] = shard;
+	}
+}
+
+/* Transfers stay in memory up to a quarter of physical memory. */
+static size_t transferbudget()
+{
+	long pages = sysconf(_SC_PHYS_PAGES), pagesize = sysconf(_SC_PAGESIZE);
+	if (pages <= 0 || pagesize <= 0)
+		return (size_t) 1 << 30;
+	return (size_t) pages / 4 * (size_t) pagesize;
+}
+
+static POSITION shardcount()
+{
+	return 1ULL << (gShardHashLength - gShardSize);
+}
+
+static void freeshardlist()
+{
+	POSITION i;
+	int j;
+	for (i = 0; i < shardcount(); i++) {
+		for (j = 0; j < shardList[i].childrencount; j++)
+			if (shardList[i].transfers[j].data) SafeFree(shardList[i].transfers[j].data);
+		if (shardList[i].transfers) SafeFree(shardList[i].transfers);
+		if (shardList[i].childrenshards) SafeFree(shardList[i].childrenshards);
+		if (shardList[i].parentshards) SafeFree(shardList[i].parentshards);
+#ifdef HAVE_MPI
+		if (shardList[i].holders) SafeFree(shardList[i].holders);
+		if (shardList[i].solved) SafeFree(shardList[i].solved);
+#endif
+	}
+	SafeFree(shardList);
+	shardList = NULL;
+}
+
+/*
+** Scheduling
+*/
+
+static void shardtask(void *arg);
+
+#ifdef HAVE_MPI
+static SHARDGRAPH**     readyShards = NULL;     /* rank 0 of an MPI solve */
+static int              readyCount = 0;
+#endif
+
+/* Makes SHARD workable: on the thread pool, or in the ready list that
+** rank 0 of an MPI solve hands shards out from. */
+static void queueshard(SHARDGRAPH *shard)
+{
+#ifdef HAVE_MPI
+	if (shardRanks > 1) {
+		readyShards[readyCount++] = shard;
+		return;
+	}
+#endif
+	ThreadPoolSubmit(shardPool, shardtask, shard);
+}
+
+/* Tells all children/parents of COMPLETEDSHARD that it is done and queues
+** the ones that became workable. ISSOLVED is FALSE after discovery and
+** TRUE after solving. Called with shardGraphLock held (or on rank 0 of
+** an MPI solve). */
+static void addshardstoqueue(SHARDGRAPH *completedshard, BOOLEAN issolved)
+{
+	int i;
+	if (issolved) {
+		for (i = 0; i < completedshard->parentcount; i++) {
+			SHARDGRAPH *parentshard = completedshard->parentshards[i];
+			if (++parentshard->childrensolved == parentshard->childrencount)
+				queueshard(parentshard);
+		}
+	} else {
+		for (i = 0; i < completedshard->childrencount; i++) {
+			SHARDGRAPH *childshard = completedshard->childrenshards[i];
+			if (++childshard->parentsdiscovered == childshard->parentcount)
+				queueshard(childshard);
+		}
+		if (completedshard->childrencount == 0)
+			queueshard(completedshard);
+	}
+}
+
+static void shardtask(void *arg)
+{
+	SHARDGRAPH *shard = (SHARDGRAPH *) arg;
+	BOOLEAN issolve = shard->discovered > 0;
+
+	pthread_mutex_lock(&shardPrintLock);
+	if (gTierSolvePrint) {
+		printf("\n%s shard %d/%d with shard id %llu by thread %d", issolve ? "Solving" : "Discovering",
+		       issolve ? ++shardsSolved : ++shardsDiscovered, validShards,
+		       (unsigned long long) shard->shardid, ThreadPoolWorkerId());
+		fflush(stdout);
+	}
+	pthread_mutex_unlock(&shardPrintLock);
+
+	if (issolve)
+		solvefragment(shard, shard == startingShard);
+	else
+		discoverfragment(shard, shard == startingShard);
+
+	pthread_mutex_lock(&shardGraphLock);
+	shard->discovered++;
+	addshardstoqueue(shard, issolve);
+	pthread_mutex_unlock(&shardGraphLock);
+}
+
+#ifdef HAVE_MPI
+
+/*
+** MPI distribution
+**
+** Rank 0 keeps the ready list that addshardstoqueue fills and hands every
+** other rank up to SHARDPIPELINE shards at a time, so that a rank has its
+** next shard in hand when it finishes one. A shard goes to the rank that
+** holds most of its inputs if that rank has room: the ranks that
+** discovered its parents for discovery, and the ranks that solved its
+** children for solving. Transfer blocks and solved trees stay on the rank
+** that made them; rank 0 tells the holder to send one to the rank that
+** needs it, and to drop it once no shard needs it any more. The solved
+** files are still written, as they are the database. All ranks block in
+** MPI_Probe or MPI_Recv while they wait.
+*/
+
+#define SHARDPIPELINE           2
+#define SHARDAFFINITYSCAN       64
+
+/* Control messages are three uint64_t; BLOCK and SOLVED carry the ids of
+** the edge or shard in front of the data. */
+#define SHARDTAG_TASK           1       /* shard, issolve */
+#define SHARDTAG_DONE           2       /* shard, issolve, starting value */
+#define SHARDTAG_SENDBLOCK      3       /* parent, child, to rank */
+#define SHARDTAG_SENDSOLVED     4       /* shard, to rank */
+#define SHARDTAG_BLOCK          5       /* parent, child, transfer block */
+#define SHARDTAG_SOLVED         6       /* shard, solved tree */
+#define SHARDTAG_RELEASEBLOCK   7       /* parent, child */
+#define SHARDTAG_RELEASESOLVED  8       /* shard */
+#define SHARDTAG_TERMINATE      9       /* starting value */
+
+static MPI_Request*     shardSendRequests = NULL;
+static unsigned char**  shardSendBuffers = NULL;
+static int              shardSendCount = 0, shardSendCapacity = 0;
+
+static void shardcontrol(int rank, int tag, uint64_t a, uint64_t b, uint64_t c)
+{
+	uint64_t message[3] = { a, b, c };
+	MPI_Send(message, sizeof(message), MPI_BYTE, rank, tag, MPI_COMM_WORLD);
+}
+
+/* Sends BUFFER without waiting for RANK to take it, so that two ranks
+** sending each other data cannot block each other; BUFFER is freed once
+** the send completes. */
+static void shardsend(int rank, int tag, unsigned char *buffer, size_t length)
+{
+	if (shardSendCount == shardSendCapacity) {
+		shardSendCapacity = shardSendCapacity ? 2 * shardSendCapacity : 16;
+		shardSendRequests = shardSendRequests ?
+		        (MPI_Request *) SafeRealloc(shardSendRequests, shardSendCapacity * sizeof(MPI_Request)) :
+		        (MPI_Request *) SafeMalloc(shardSendCapacity * sizeof(MPI_Request));
+		shardSendBuffers = shardSendBuffers ?
+		        (unsigned char **) SafeRealloc(shardSendBuffers, shardSendCapacity * sizeof(unsigned char *)) :
+		        (unsigned char **) SafeMalloc(shardSendCapacity * sizeof(unsigned char *));
+	}
+	MPI_Isend(buffer, (int) length, MPI_BYTE, rank, tag, MPI_COMM_WORLD, shardSendRequests + shardSendCount);
+	shardSendBuffers[shardSendCount++] = buffer;
+}
+
+/* Frees the buffers of the sends that have completed, or with WAIT, of
+** all of them. */
+static void shardsendsdone(BOOLEAN wait)
+{
+	int i, done = 1, kept = 0;
+	for (i = 0; i < shardSendCount; i++) {
+		if (wait)
+			MPI_Wait(shardSendRequests + i, MPI_STATUS_IGNORE);
+		else
+			MPI_Test(shardSendRequests + i, &done, MPI_STATUS_IGNORE);
+		if (done) {
+			SafeFree(shardSendBuffers[i]);
+		} else {
+			shardSendRequests[kept] = shardSendRequests[i];
+			shardSendBuffers[kept++] = shardSendBuffers[i];
+		}
+	}
+	shardSendCount = kept;
+	if (wait && shardSendRequests) {
+		SafeFree(shardSendRequests);
+		SafeFree(shardSendBuffers);
+		shardSendRequests = NULL;
+		shardSendBuffers = NULL;
+		shardSendCapacity = 0;
+	}
+}
+
+/* Drops this rank's copy of the block PARENT left for CHILD, if any. */
+static void transferrelease(SHARDGRAPH *parent, SHARDGRAPH *child)
+{
+	SHARDTRANSFER *t = parent->transfers + childshardindex(parent, child->shardid);
+	char filename[SHARDFILENAMELENGTH];
+
+	if (t->spilled) {
+		transferfilename(filename, SHARDFILENAMELENGTH, parent->shardid, child->shardid);
+		remove(filename);
+		t->spilled = FALSE;
+	} else if (t->data) {
+		__atomic_sub_fetch(&transferBytes, t->length, __ATOMIC_SEQ_CST);
+		SafeFree(t->data);
+		t->data = NULL;
+	}
+}
+
+/* TRUE once every input of SHARD is on this rank. */
+static BOOLEAN shardrunnable(SHARDGRAPH *shard, BOOLEAN issolve)
+{
+	SHARDTRANSFER *t;
+	int i;
+	for (i = 0; i < shard->parentcount; i++) {
+		t = shard->parentshards[i]->transfers + childshardindex(shard->parentshards[i], shard->shardid);
+		if (t->data == NULL && !t->spilled)
+			return FALSE;
+	}
+	if (issolve)
+		for (i = 0; i < shard->childrencount; i++)
+			if (shard->childrenshards[i]->solved == NULL)
+				return FALSE;
+	return TRUE;
+}
+
+/* Runs the shards rank 0 assigns to this rank until it says the solve is
+** over, and returns the value of the starting position. */
+static unsigned char shardworker()
+{
+	SHARDGRAPH *tasks[SHARDPIPELINE], *parent, *child;
+	BOOLEAN issolve[SHARDPIPELINE], solve;
+	SHARDTRANSFER *t;
+	MPI_Status status;
+	unsigned char *buffer, *block, *out, value;
+	uint64_t *header;
+	int taskcount = 0, i, flag, length;
+
+	for (;;) {
+		for (i = 0; i < taskcount && !shardrunnable(tasks[i], issolve[i]); i++) ;
+		flag = 1;
+		if (i < taskcount)
+			MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+		else
+			MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+
+		if (!flag) {
+			/* Nothing to answer first; run the shard. */
+			child = tasks[i];
+			solve = issolve[i];
+			for (taskcount--; i < taskcount; i++) {
+				tasks[i] = tasks[i + 1];
+				issolve[i] = issolve[i + 1];
+			}
+			if (solve)
+				solvefragment(child, child == startingShard);
+			else
+				discoverfragment(child, child == startingShard);
+			shardcontrol(0, SHARDTAG_DONE, child->shardid, solve,
+			             (solve && child == startingShard) ? startingValue : 0);
+			shardsendsdone(FALSE);
+			continue;
+		}
+
+		MPI_Get_count(&status, MPI_BYTE, &length);
+		buffer = (unsigned char *) SafeMalloc(length);
+		MPI_Recv(buffer, length, MPI_BYTE, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		header = (uint64_t *) buffer;
+		parent = shardList + header[0];
+		switch (status.MPI_TAG) {
+		case SHARDTAG_TASK:
+			tasks[taskcount] = parent;
+			issolve[taskcount++] = (BOOLEAN) header[1];
+			break;
+		case SHARDTAG_SENDBLOCK:
+			child = shardList + header[1];
+			t = parent->transfers + childshardindex(parent, child->shardid);
+			block = transferload(parent, child);
+			out = (unsigned char *) SafeMalloc(2 * sizeof(uint64_t) + t->length);
+			memcpy(out, header, 2 * sizeof(uint64_t));
+			memcpy(out + 2 * sizeof(uint64_t), block, t->length);
+			shardsend((int) header[2], SHARDTAG_BLOCK, out, 2 * sizeof(uint64_t) + t->length);
+			transferdone(parent, child, block, FALSE);
+			break;
+		case SHARDTAG_SENDSOLVED:
+			out = (unsigned char *) SafeMalloc(sizeof(uint64_t) + parent->solvedlength);
+			memcpy(out, header, sizeof(uint64_t));
+			memcpy(out + sizeof(uint64_t), parent->solved, parent->solvedlength);
+			shardsend((int) header[1], SHARDTAG_SOLVED, out, sizeof(uint64_t) + parent->solvedlength);
+			break;
+		case SHARDTAG_BLOCK:
+			child = shardList + header[1];
+			t = parent->transfers + childshardindex(parent, child->shardid);
+			if (t->data == NULL && !t->spilled) {
+				t->length = length - 2 * sizeof(uint64_t);
+				t->data = (unsigned char *) SafeMalloc(t->length);
+				memcpy(t->data, buffer + 2 * sizeof(uint64_t), t->length);
+				__atomic_add_fetch(&transferBytes, t->length, __ATOMIC_SEQ_CST);
+			}
+			break;
+		case SHARDTAG_SOLVED:
+			if (parent->solved == NULL) {
+				parent->solvedlength = length - sizeof(uint64_t);
+				parent->solved = (unsigned char *) SafeMalloc(parent->solvedlength);
+				memcpy(parent->solved, buffer + sizeof(uint64_t), parent->solvedlength);
+			}
+			break;
+		case SHARDTAG_RELEASEBLOCK:
+			transferrelease(parent, shardList + header[1]);
+			break;
+		case SHARDTAG_RELEASESOLVED:
+			if (parent->solved) SafeFree(parent->solved);
+			parent->solved = NULL;
+			break;
+		case SHARDTAG_TERMINATE:
+			value = (unsigned char) header[0];
+			SafeFree(buffer);
+			shardsendsdone(TRUE);
+			return value;
+		}
+		SafeFree(buffer);
+		shardsendsdone(FALSE);
+	}
+}
+
+/* The worker rank holding most of the inputs of SHARD, or 0 if none does. */
+static int shardaffinity(SHARDGRAPH *shard, int *votes)
+{
+	int i, best = 0;
+
+	memset(votes, 0, shardRanks * sizeof(int));
+	if (shard->discovered > 0) {
+		votes[shard->discoveredby]++;
+		for (i = 0; i < shard->childrencount; i++)
+			votes[shard->childrenshards[i]->solvedby]++;
+	} else {
+		for (i = 0; i < shard->parentcount; i++)
+			votes[shard->parentshards[i]->discoveredby]++;
+	}
+	for (i = 1; i < shardRanks; i++)
+		if (votes[i] > votes[best] || (best == 0 && votes[i] > 0))
+			best = i;
+	return best;
+}
+
+/* Gives the first ready shard at or after index I to RANK, asking the
+** holders of its inputs to send them there. */
+static void shardassign(int i, int rank, int *load)
+{
+	SHARDGRAPH *shard = readyShards[i], *other;
+	BOOLEAN issolve = shard->discovered > 0;
+
+	memmove(readyShards + i, readyShards + i + 1, (readyCount - i - 1) * sizeof(SHARDGRAPH *));
+	readyCount--;
+	load[rank]++;
+	if (gTierSolvePrint) {
+		printf("\n%s shard %d/%d with shard id %llu on rank %d", issolve ? "Solving" : "Discovering",
+		       issolve ? ++shardsSolved : ++shardsDiscovered, validShards,
+		       (unsigned long long) shard->shardid, rank);
+		fflush(stdout);
+	}
+	/* The rank that discovered the shard kept the blocks its parents sent. */
+	if (!issolve || shard->discoveredby != rank)
+		for (i = 0; i < shard->parentcount; i++) {
+			other = shard->parentshards[i];
+			if (other->discoveredby != rank)
+				shardcontrol(other->discoveredby, SHARDTAG_SENDBLOCK, other->shardid, shard->shardid, rank);
+		}
+	if (issolve)
+		for (i = 0; i < shard->childrencount; i++) {
+			other = shard->childrenshards[i];
+			if (other->holders == NULL)
+				other->holders = (unsigned char *) SafeCalloc(shardRanks, 1);
+			if (other->solvedby != rank && !other->holders[rank]) {
+				other->holders[rank] = 1;
+				shardcontrol(other->solvedby, SHARDTAG_SENDSOLVED, other->shardid, rank, 0);
+			}
+		}
+	shardcontrol(rank, SHARDTAG_TASK, shard->shardid, issolve, 0);
+}
+
+/* Tells the ranks still holding inputs of SHARD, just solved, that they
+** can drop the ones no other shard needs. */
+static void shardrelease(SHARDGRAPH *shard)
+{
+	SHARDGRAPH *other;
+	int i, rank;
+
+	for (i = 0; i < shard->parentcount; i++) {
+		other = shard->parentshards[i];
+		if (other->discoveredby != shard->solvedby)
+			shardcontrol(other->discoveredby, SHARDTAG_RELEASEBLOCK, other->shardid, shard->shardid, 0);
+		if (shard->discoveredby != shard->solvedby && shard->discoveredby != other->discoveredby)
+			shardcontrol(shard->discoveredby, SHARDTAG_RELEASEBLOCK, other->shardid, shard->shardid, 0);
+	}
+	for (i = 0; i < shard->childrencount; i++) {
+		other = shard->childrenshards[i];
+		if (++other->parentssolved < other->parentcount)
+			continue;
+		for (rank = 1; rank < shardRanks; rank++)
+			if (rank == other->solvedby || (other->holders && other->holders[rank]))
+				shardcontrol(rank, SHARDTAG_RELEASESOLVED, other->shardid, 0, 0);
+	}
+}
+
+/* Rank 0: schedules the whole solve and returns the value of the
+** starting position. */
+static unsigned char sharddistribute()
+{
+	int *load = (int *) SafeCalloc(shardRanks, sizeof(int));
+	int *votes = (int *) SafeMalloc(shardRanks * sizeof(int));
+	int i, rank, best;
+	uint64_t message[3];
+	MPI_Status status;
+	SHARDGRAPH *shard;
+	BOOLEAN issolve;
+	unsigned char value = 0;
+
+	readyShards = (SHARDGRAPH **) SafeMalloc((2 * validShards + 1) * sizeof(SHARDGRAPH *));
+	readyCount = 0;
+	queueshard(startingShard);
+	while (startingShard->discovered < 2) {
+		/* Shards whose inputs sit on a rank with room go there, ... */
+		for (i = 0; i < readyCount && i < SHARDAFFINITYSCAN; ) {
+			rank = shardaffinity(readyShards[i], votes);
+			if (rank > 0 && load[rank] < SHARDPIPELINE)
+				shardassign(i, rank, load);
+			else
+				i++;
+		}
+		/* ... the rest to the least loaded ranks. */
+		while (readyCount > 0) {
+			for (best = 1, rank = 2; rank < shardRanks; rank++)
+				if (load[rank] < load[best])
+					best = rank;
+			if (load[best] >= SHARDPIPELINE)
+				break;
+			shardassign(0, best, load);
+		}
+
+		MPI_Recv(message, sizeof(message), MPI_BYTE, MPI_ANY_SOURCE, SHARDTAG_DONE, MPI_COMM_WORLD, &status);
+		shard = shardList + message[0];
+		issolve = (BOOLEAN) message[1];
+		load[status.MPI_SOURCE]--;
+		if (issolve) {
+			shard->solvedby = status.MPI_SOURCE;
+			shardrelease(shard);
+			if (shard == startingShard)
+				value = (unsigned char) message[2];
+		} else {
+			shard->discoveredby = status.MPI_SOURCE;
+		}
+		shard->discovered++;
+		addshardstoqueue(shard, issolve);
+	}
+	for (rank = 1; rank < shardRanks; rank++)
+		shardcontrol(rank, SHARDTAG_TERMINATE, value, 0, 0);
+	SafeFree(readyShards);
+	readyShards = NULL;
+	SafeFree(load);
+	SafeFree(votes);
+	return value;
+}
+
+#endif /* HAVE_MPI */
+
+VALUE DetermineShardValue(POSITION position)
+{
+	char *shardinitialized;
+#ifdef HAVE_MPI
+	int initialized, noderanks;
+	MPI_Comm node;
+
+	MPI_Initialized(&initialized);
+	if (!initialized)
+		MPI_Init(NULL, NULL);
+	MPI_Comm_rank(MPI_COMM_WORLD, &shardRank);
+	MPI_Comm_size(MPI_COMM_WORLD, &shardRanks);
+#endif
+
+	if (!gShardHashFunPtr || !gShardUnhashFunPtr || !gShardChildrenFunPtr || gShardHashLength <= gShardSize) {
+		fprintf(stderr, "Error: %s does not provide the shard solver hooks\n", kGameName);
+		return undecided;
+	}
+
+	mkdir("data", 0755);
+	snprintf(workingFolder, sizeof(workingFolder), "./data/%s_%d_sharddb", kGameName, getOption());
+	mkdir(workingFolder, 0755);
+
+	startingPosition = position;
+	shardList = (SHARDGRAPH *) SafeCalloc(shardcount(), sizeof(SHARDGRAPH));
+	shardinitialized = (char *) SafeCalloc(shardcount(), sizeof(char));
+	startingShard = shardList + (gShardHashFunPtr(position) >> gShardSize);
+	validShards = initializeshard(shardinitialized, startingShard - shardList);
+	initializeparentshard(startingShard);
+	SafeFree(shardinitialized);
+	shardsDiscovered = shardsSolved = 0;
+	transferBytes = 0;
+	transferBudget = transferbudget();
+
+#ifdef HAVE_MPI
+	if (shardRanks > 1) {
+		/* The ranks on one machine share its transfer budget. */
+		MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+		MPI_Comm_size(node, &noderanks);
+		MPI_Comm_free(&node);
+		transferBudget /= noderanks;
+		if (shardRank == 0) {
+			if (gTierSolvePrint) {
+				printf("\nShard graph computed: %d shards will be computed on %d ranks",
+				       validShards, shardRanks - 1);
+				fflush(stdout);
+			}
+			startingValue = sharddistribute();
+		} else {
+			startingValue = shardworker();
+		}
+	} else
+#endif
+	{
+		shardPool = ThreadPoolCreate(DefaultNumberOfThreads());
+		if (gTierSolvePrint) {
+			printf("\nShard graph computed: %d shards will be computed on %d threads",
+			       validShards, ThreadPoolSize(shardPool));
+			fflush(stdout);
+		}
+		ThreadPoolSubmit(shardPool, shardtask, startingShard);
+		ThreadPoolWait(shardPool);
+		ThreadPoolDestroy(shardPool);
+		shardPool = NULL;
+	}
+	freeshardlist();
+#ifdef HAVE_MPI
+	if (!initialized)
+		MPI_Finalize();
+	/* Only rank 0 goes on to save and report the result; see ShardWorkerRank. */
+	if (shardRank != 0)
+		return undecided;
+#endif
+
+	if (startingValue == 0 || startingValue == SHARD_NOT_PRIMITIVE) return undecided;
+	if (startingValue < 64) return lose;
+	if (startingValue < 192) return tie;
+	return win;
+}
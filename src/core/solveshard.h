@@ -0,0 +1,79 @@
+/************************************************************************
+**
+** NAME:	solveshard.h
+**
+** DESCRIPTION:	Parallel shard solver, promoted from Fa21ParallelSolver.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-18
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#ifndef GMCORE_SOLVESHARD_H
+#define GMCORE_SOLVESHARD_H
+
+/*
+** A module sets kSupportsShardGamesman and, in InitializeGame, the
+** following hooks (declared in globals.h):
+**
+**   gShardHashLength      number of bits in a shard hash
+**   gShardSize            log2 of the number of positions per shard;
+**                         shard id = hash >> gShardSize
+**   gShardHashFunPtr      POSITION -> shard hash. Every child must hash
+**                         strictly higher than its parent (acyclic game).
+**   gShardUnhashFunPtr    shard hash -> POSITION usable by GenerateMoves
+**   gShardChildrenFunPtr  fills a SafeMalloc'd array with the ids of the
+**                         shards reachable in one move from a shard and
+**                         returns its length
+**
+** GenerateMoves, DoMove and Primitive are called from several threads at
+** once and must not touch shared mutable state.
+**
+** Values are stored one byte per position with the encoding of the
+** original Fa21 solver, which sharddb decodes:
+**
+**   1..63     lose in 0..62      128..191  tie in 0..63
+**   192..255  win in 63..0       0         not seen
+*/
+
+#define SHARD_LOSS                      1
+#define SHARD_TIE                       128
+#define SHARD_WIN                       255
+#define SHARD_NOT_PRIMITIVE             127
+#define SHARD_UNSAVED_PRIMITIVE         125
+#define SHARD_UNSAVED_NONPRIMITIVE      126
+
+VALUE           DetermineShardValue     (POSITION position);
+
+/* Path of the solved file for SHARDID, in the layout sharddb reads. */
+void            ShardSolvedFileName     (char *dst, int len, POSITION shardId);
+
+/* TRUE if the shard holding POSITION has already been solved. */
+BOOLEAN         ShardDatabaseExists     (POSITION position);
+
+/* TRUE in every MPI rank but rank 0 once DetermineShardValue has run.
+   Those ranks only compute shards: they return undecided, and the caller
+   skips loading, reporting and saving the result and lets them end. */
+BOOLEAN         ShardWorkerRank         ();
+
+#endif /* GMCORE_SOLVESHARD_H */
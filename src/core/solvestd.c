@@ -29,14 +29,38 @@
 **
 **************************************************************************/
 
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include "gamesman.h"
+#include "threadpool.h"
 
 
 /*
 ** Code
 */
 
+static VALUE determineValueRecursive(POSITION position);
+static VALUE determineValueParallel(POSITION position, int numThreads);
+
+/* With --threads the acyclic solver walks the game in parallel (see
+** determineValueParallel below), which needs GenerateMoves, DoMove,
+** Primitive and gCanonicalPosition to be reentrant and a database whose
+** cells can be written independently (see ParallelSolveSafe); GPS
+** modules and the packed or out-of-core databases keep the recursive
+** solver. */
 VALUE DetermineValueSTD(POSITION position)
+{
+	int numThreads = (gNumThreads > 0) ? gNumThreads : 1;
+
+	if (numThreads > 1 && ParallelSolveSafe() &&
+	    !gUseGPS && !(kSupportsTierGamesman && gTierGamesman) &&
+	    !gBitPerfectDB && !gTwoBits && !gCollDB && !gUnivDB && !gNetworkDB && !gFileDB)
+		return determineValueParallel(position, numThreads);
+	return determineValueRecursive(position);
+}
+
+static VALUE determineValueRecursive(POSITION position)
 {
 	BOOLEAN foundTie = FALSE, foundLose = FALSE, foundWin = FALSE;
 	MOVELIST *ptr, *head;
@@ -68,11 +92,11 @@ VALUE DetermineValueSTD(POSITION position)
 		MarkAsVisited(position);
 		if(!kPartizan && !gTwoBits)
 			theMexCalc = MexCalcInit();
-		head = ptr = GenerateMoves(position);
+		head = ptr = StatsGenerateMoves(position);
 		while (ptr != NULL) {
 			MOVE move = ptr->move;
 			gAnalysis.TotalMoves++;
-			child = DoMove(position,ptr->move); /* Create the child */
+			child = StatsDoMove(position,ptr->move); /* Create the child */
 
 			if(gSymmetries)
 				child = gCanonicalPosition(child);
@@ -80,7 +104,7 @@ VALUE DetermineValueSTD(POSITION position)
 			if (child >= gNumberOfPositions)
 				FoundBadPosition(child, position, move);
 
-			value = DetermineValueSTD(child); /* DFS call */
+			value = determineValueRecursive(child); /* DFS call */
 
 			if (kPartizan && gPutWinBy && !gTwoBits) {
 				int childWinByValue = WinByLoad(child);
@@ -153,3 +177,363 @@ VALUE DetermineValueSTD(POSITION position)
 	return(undecided);      /* But has been added to satisty lint */
 }
 
+
+
+/*
+** Parallel solver.
+**
+** Every worker runs an iterative DFS over its own explicit stack, so deep
+** games no longer depend on the size of the C stack. Each position carries
+** two bits: CLAIMED once a worker has taken it on and DONE once its value,
+** remoteness and mex are in the database. A worker only descends into the
+** children it claims itself. Children that another worker is still solving
+** are set aside and waited for once the rest of the position is finished,
+** so no position is ever expanded twice. Because the game is acyclic, a
+** chain of such waits always ends at a worker that is making progress (a
+** loopy module handed to this solver may hang instead of being reported).
+**
+** Work moves between threads through the pool's work-stealing deques:
+** while fewer than SPAWN_PER_THREAD offers per worker are queued, a worker
+** expanding a position offers its unclaimed children as subtree tasks.
+** Idle workers steal the oldest, shallowest offers; an offer whose root has
+** been claimed by the time it runs returns at once.
+**
+** A position's value, remoteness and mex depend only on its children's, so
+** the database is the same as the recursive solver's.
+*/
+
+#define SPAWN_PER_THREAD 4
+
+#define STD_CLAIMED 1
+#define STD_DONE    2
+
+typedef struct {
+	POSITION child;
+	MOVE move;
+	BOOLEAN pending;        /* was being solved by another worker */
+} STDEDGE;
+
+typedef struct {
+	POSITION position;
+	POSITION firstEdge, endEdge, nextEdge;
+	int pending;
+	BOOLEAN foundTie, foundLose, foundWin;
+	REMOTENESS maxRemoteness, minRemoteness, minTieRemoteness;
+	MEXCALC theMexCalc;
+	int minWinByValue, maxWinByValue;
+} STDFRAME;
+
+typedef struct {
+	STDFRAME *frames;
+	POSITION numFrames, maxFrames;
+	STDEDGE *edges;
+	POSITION numEdges, maxEdges;
+	POSITION totalMoves, solved;
+} STDWORKER;
+
+static unsigned char *stdState;
+static STDWORKER *stdWorkers;
+static THREADPOOL *stdPool;
+static int stdOffers, stdOfferLimit;
+
+/* StoreValueOfPosition also feeds the analysis counters and the progress
+   meter, which every worker shares. */
+static pthread_mutex_t stdStoreLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char stdPositionState(POSITION pos)
+{
+	return (__atomic_load_n(&stdState[pos >> 2], __ATOMIC_ACQUIRE) >> ((pos & 3) << 1)) & 3;
+}
+
+static BOOLEAN stdClaimPosition(POSITION pos)
+{
+	unsigned char bit = STD_CLAIMED << ((pos & 3) << 1);
+	return !(__atomic_fetch_or(&stdState[pos >> 2], bit, __ATOMIC_ACQ_REL) & bit);
+}
+
+static void stdFinishPosition(POSITION pos)
+{
+	__atomic_fetch_or(&stdState[pos >> 2], STD_DONE << ((pos & 3) << 1), __ATOMIC_RELEASE);
+}
+
+static void stdStoreValue(STDWORKER *w, POSITION position, REMOTENESS remoteness, VALUE value)
+{
+	SetRemoteness(position, remoteness);
+	pthread_mutex_lock(&stdStoreLock);
+	StoreValueOfPosition(position, value);
+	pthread_mutex_unlock(&stdStoreLock);
+	stdFinishPosition(position);
+	w->solved++;
+}
+
+static void stdSolveTask(void *arg);
+
+/* Stores POSITION right away if it is primitive and returns FALSE,
+   otherwise pushes a frame holding all of its children and returns TRUE. */
+static BOOLEAN stdExpand(STDWORKER *w, POSITION position)
+{
+	MOVELIST *ptr, *head;
+	STDFRAME *f;
+	STDEDGE *e;
+	VALUE value;
+	POSITION child, i, *offer;
+
+	if ((value = Primitive(position)) != undecided) {
+		if (!kPartizan)
+			MexStore(position, MexPrimitive(value)); /* lose=0, win=* */
+		else if (gPutWinBy)
+			WinByStore(position, gPutWinBy(position));
+		stdStoreValue(w, position, 0, value); /* terminal positions have 0 remoteness */
+		return FALSE;
+	}
+
+	if (w->numFrames == w->maxFrames) {
+		w->maxFrames = w->maxFrames ? 2 * w->maxFrames : 64;
+		w->frames = w->frames ?
+		            (STDFRAME *) SafeRealloc(w->frames, w->maxFrames * sizeof(STDFRAME)) :
+		            (STDFRAME *) SafeMalloc(w->maxFrames * sizeof(STDFRAME));
+	}
+	f = &w->frames[w->numFrames++];
+	f->position = position;
+	f->firstEdge = f->nextEdge = w->numEdges;
+	f->pending = 0;
+	f->foundTie = f->foundLose = f->foundWin = FALSE;
+	f->maxRemoteness = 0;
+	f->minRemoteness = f->minTieRemoteness = MAXINT2;
+	f->theMexCalc = MexCalcInit();
+	f->minWinByValue = (1 << (MEX_BITS-1)) - 1;
+	f->maxWinByValue = -(1 << (MEX_BITS-1));
+
+	head = ptr = StatsGenerateMoves(position);
+	for (; ptr != NULL; ptr = ptr->next) {
+		w->totalMoves++;
+		child = StatsDoMove(position, ptr->move); /* Create the child */
+		if (gSymmetries)
+			child = gCanonicalPosition(child);
+		if (child >= gNumberOfPositions)
+			FoundBadPosition(child, position, ptr->move);
+		if (w->numEdges == w->maxEdges) {
+			w->maxEdges = w->maxEdges ? 2 * w->maxEdges : 1024;
+			w->edges = w->edges ?
+			           (STDEDGE *) SafeRealloc(w->edges, w->maxEdges * sizeof(STDEDGE)) :
+			           (STDEDGE *) SafeMalloc(w->maxEdges * sizeof(STDEDGE));
+		}
+		e = &w->edges[w->numEdges++];
+		e->child = child;
+		e->move = ptr->move;
+		e->pending = FALSE;
+	}
+	FreeMoveList(head);
+	f->endEdge = w->numEdges;
+
+	/* this worker goes on with the first child; offer the rest */
+	for (i = f->firstEdge + 1; i < f->endEdge; i++) {
+		if (__atomic_load_n(&stdOffers, __ATOMIC_RELAXED) >= stdOfferLimit)
+			break;
+		if (stdPositionState(w->edges[i].child) != 0)
+			continue;
+		__atomic_fetch_add(&stdOffers, 1, __ATOMIC_RELAXED);
+		offer = (POSITION *) SafeMalloc(sizeof(POSITION));
+		*offer = w->edges[i].child;
+		ThreadPoolSubmit(stdPool, stdSolveTask, offer);
+	}
+	return TRUE;
+}
+
+/* Called on a position this worker has just claimed. Returns TRUE if it
+   still has to be solved, i.e. a frame for it was pushed. */
+static BOOLEAN stdDescend(STDWORKER *w, POSITION position)
+{
+	/* solved by an earlier call to the solver */
+	if (GetValueOfPosition(position) != undecided) {
+		stdFinishPosition(position);
+		return FALSE;
+	}
+	return stdExpand(w, position);
+}
+
+static void stdAccumulate(STDFRAME *f, STDEDGE *e)
+{
+	VALUE value = GetValueOfPosition(e->child);
+	REMOTENESS remoteness = Remoteness(e->child);
+	int childWinByValue;
+
+	if (kPartizan && gPutWinBy) {
+		childWinByValue = WinByLoad(e->child);
+		if (childWinByValue < f->minWinByValue)
+			f->minWinByValue = childWinByValue;
+		if (childWinByValue > f->maxWinByValue)
+			f->maxWinByValue = childWinByValue;
+	}
+
+	if (gGoAgain(f->position, e->move))
+		switch(value)
+		{
+		case lose: value=win; break;
+		case win: value=lose; break;
+		default: break; /* value stays the same */
+		}
+
+	if (!kPartizan)
+		f->theMexCalc = MexAdd(f->theMexCalc, MexLoad(e->child));
+	if (value == lose) {
+		f->foundLose = TRUE;
+		if (remoteness < f->minRemoteness) f->minRemoteness = remoteness;
+	} else if (value == tie) {
+		f->foundTie = TRUE;
+		if (remoteness < f->minTieRemoteness) f->minTieRemoteness = remoteness;
+	} else if (value == win) {
+		f->foundWin = TRUE;
+		if (remoteness > f->maxRemoteness) f->maxRemoteness = remoteness;
+	} else
+		BadElse("DetermineValue[1]");
+}
+
+/* Stores the position on top of the stack and pops it. */
+static void stdFinishFrame(STDWORKER *w)
+{
+	STDFRAME *f = &w->frames[w->numFrames - 1];
+	int turn;
+
+	if (!kPartizan)
+		MexStore(f->position, MexCompute(f->theMexCalc));
+	else if (gPutWinBy) {
+		turn = generic_hash_turn(f->position);
+		if (turn == 1)
+			WinByStore(f->position, f->maxWinByValue);
+		else if (turn == 2)
+			WinByStore(f->position, f->minWinByValue);
+		else BadElse("Bad generic_hash_turn(position)");
+	}
+	if (f->foundLose)
+		stdStoreValue(w, f->position, f->minRemoteness + 1, win); /* Winners want to mate soon! */
+	else if (f->foundTie)
+		stdStoreValue(w, f->position, f->minTieRemoteness + 1, tie); /* Tiers want to mate now! */
+	else if (f->foundWin)
+		stdStoreValue(w, f->position, f->maxRemoteness + 1, lose); /* Losers want to extend! */
+	else {
+		BadElse("DetermineValue[2]. GenereateMoves most likely didnt return anything.");
+		stdFinishPosition(f->position); /* release anyone waiting on it */
+	}
+	w->numEdges = f->firstEdge;
+	w->numFrames--;
+}
+
+static BOOLEAN stdOnStack(STDWORKER *w, POSITION position)
+{
+	POSITION i;
+
+	for (i = 0; i < w->numFrames; i++)
+		if (w->frames[i].position == position)
+			return TRUE;
+	return FALSE;
+}
+
+static void stdSolveSubtree(STDWORKER *w, POSITION root)
+{
+	STDFRAME *f;
+	STDEDGE *e;
+	unsigned char state;
+	POSITION i;
+
+	if (!stdClaimPosition(root) || !stdDescend(w, root))
+		return;
+
+	while (w->numFrames > 0) {
+		f = &w->frames[w->numFrames - 1];
+		if (f->nextEdge < f->endEdge) {
+			e = &w->edges[f->nextEdge];
+			state = stdPositionState(e->child);
+			if (state & STD_DONE) {
+				stdAccumulate(f, e);
+				f->nextEdge++;
+			} else if (!(state & STD_CLAIMED) && stdClaimPosition(e->child)) {
+				/* when a frame was pushed, its parent picks up this edge
+				   once it is popped */
+				if (!stdDescend(w, e->child)) {
+					stdAccumulate(f, e);
+					f->nextEdge++;
+				}
+			} else if (stdOnStack(w, e->child)) { /* Cycle! */
+				printf("Sorry, but I think this is a loopy game. I give up.");
+				ExitStageRight();
+				exit(0);
+			} else {
+				e->pending = TRUE;
+				f->pending++;
+				f->nextEdge++;
+			}
+		} else if (f->pending > 0) {
+			for (i = f->firstEdge; i < f->endEdge; i++) {
+				e = &w->edges[i];
+				if (!e->pending)
+					continue;
+				while (!(stdPositionState(e->child) & STD_DONE))
+					sched_yield();
+				stdAccumulate(f, e);
+			}
+			f->pending = 0;
+		} else {
+			stdFinishFrame(w);
+			if (w->numFrames > 0) {
+				f = &w->frames[w->numFrames - 1];
+				stdAccumulate(f, &w->edges[f->nextEdge]);
+				f->nextEdge++;
+			}
+		}
+	}
+}
+
+static void stdSolveTask(void *arg)
+{
+	POSITION root = *(POSITION *) arg;
+
+	SafeFree(arg);
+	__atomic_fetch_sub(&stdOffers, 1, __ATOMIC_RELAXED);
+	stdSolveSubtree(&stdWorkers[ThreadPoolWorkerId()], root);
+}
+
+static VALUE determineValueParallel(POSITION position, int numThreads)
+{
+	POSITION *offer, solved = 0;
+	struct timespec start, end;
+	double seconds;
+	int t;
+
+	if (gSymmetries)
+		position = gCanonicalPosition(position);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stdState = (unsigned char *) SafeCalloc(gNumberOfPositions / 4 + 1, 1);
+	stdWorkers = (STDWORKER *) SafeCalloc(numThreads, sizeof(STDWORKER));
+	stdOffers = 1;
+	stdOfferLimit = SPAWN_PER_THREAD * numThreads;
+	stdPool = ThreadPoolCreate(numThreads);
+
+	offer = (POSITION *) SafeMalloc(sizeof(POSITION));
+	*offer = position;
+	ThreadPoolSubmit(stdPool, stdSolveTask, offer);
+	ThreadPoolWait(stdPool);
+	ThreadPoolDestroy(stdPool);
+	stdPool = NULL;
+
+	for (t = 0; t < numThreads; t++) {
+		gAnalysis.TotalMoves += stdWorkers[t].totalMoves;
+		solved += stdWorkers[t].solved;
+		if (stdWorkers[t].frames)
+			SafeFree(stdWorkers[t].frames);
+		if (stdWorkers[t].edges)
+			SafeFree(stdWorkers[t].edges);
+	}
+	SafeFree(stdWorkers);
+	stdWorkers = NULL;
+	SafeFree(stdState);
+	stdState = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (kDebugDetermineValue && solved > 0)
+		printf("Solved " POSITION_FORMAT " positions in %.2f seconds using %d threads.\n",
+		       solved, seconds, numThreads);
+	return GetValueOfPosition(position);
+}
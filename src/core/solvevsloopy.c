@@ -96,6 +96,11 @@ VALUE VSDetermineLoopyValue(POSITION position)
 	GMSTATUS status = STATUS_SUCCESS;
 	VALUE value;
 
+	/* VSSetParents jumps between positions breadth-first, so GPS needs a
+	   module that can load the global position from a hash */
+	if (gSetGPSPosition == NULL)
+		gUseGPS = FALSE;
+
 	/* initialize */
 	VSInitializeFR();
 	VSParentInitialize();
@@ -402,6 +407,8 @@ void VSSetParents (POSITION parent, POSITION root)
 
 	gVSParents[root] = StorePositionInList(parent, gVSParents[root]);
 
+	if (gUseGPS)
+		gSetGPSPosition(root);
 	if ((value = Primitive(root)) != undecided) {
 		SetRemoteness(root, 0);
 		switch (value) {
@@ -424,10 +431,12 @@ void VSSetParents (POSITION parent, POSITION root)
 			next = posptr->next;
 			pos = posptr->position;
 
-			movehead = GenerateMoves(pos);
+			if (gUseGPS)
+				gSetGPSPosition(pos);
+			movehead = StatsGenerateMoves(pos);
 
 			for (moveptr = movehead; moveptr != NULL; moveptr = moveptr->next) {
-				child = DoMove(pos, moveptr->move);
+				child = StatsDoMove(pos, moveptr->move);
 				if (gSymmetries)
 					child = gCanonicalPosition(child);
 
@@ -437,22 +446,26 @@ void VSSetParents (POSITION parent, POSITION root)
 				++gVSNumberChildrenOriginal[(int)pos];
 				gVSParents[(int)child] = StorePositionInList(pos, gVSParents[(int)child]);
 
-				if (Visited(child)) continue;
-				MarkAsVisited(child);
+				if (!Visited(child)) {
+					MarkAsVisited(child);
 
-				if ((value = Primitive(child)) != undecided) {
-					SetRemoteness(child, 0);
-					switch (value) {
-					case lose: VSInsertLoseFR(child); break;
-					case win: VSInsertWinFR(child);  break;
-					case tie: VSInsertTieFR(child);  break;
-					default: BadElse("SetParents found bad primitive value");
+					if ((value = Primitive(child)) != undecided) {
+						SetRemoteness(child, 0);
+						switch (value) {
+						case lose: VSInsertLoseFR(child); break;
+						case win: VSInsertWinFR(child);  break;
+						case tie: VSInsertTieFR(child);  break;
+						default: BadElse("SetParents found bad primitive value");
+						}
+						StoreValueOfPosition(child, value);
+					} else {
+						nextLevel = StorePositionInList(child, nextLevel);
 					}
-					StoreValueOfPosition(child, value);
-				} else {
-					nextLevel = StorePositionInList(child, nextLevel);
+					gTotalMoves++;
 				}
-				gTotalMoves++;
+
+				if (gUseGPS)
+					gUndoMove(moveptr->move);
 			}
 
 			FreeMoveList(movehead);
@@ -154,11 +154,11 @@ VALUE DetermineValueVSSTDHelper( POSITION position )
 
 		if(!kPartizan && !gTwoBits)
 			theMexCalc = MexCalcInit();
-		head = ptr = GenerateMoves(position);
+		head = ptr = StatsGenerateMoves(position);
 		while (ptr != NULL) {
 			MOVE move = ptr->move;
 			gAnalysis.TotalMoves++;
-			child = DoMove(position,ptr->move); /* Create the child */
+			child = StatsDoMove(position,ptr->move); /* Create the child */
 
 			if(gSymmetries)
 				child = gCanonicalPosition(child);
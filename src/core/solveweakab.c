@@ -117,7 +117,7 @@ SCORE alpha_beta(POSITION position, SCORE alpha, SCORE beta, REMOTENESS min_remo
 		else {
 
 			/* Generate possible moves from this position */
-			moves_list = GenerateMoves(position);
+			moves_list = StatsGenerateMoves(position);
 
 			if (moves_list == NULL) {
 				fprintf(stderr,"ERROR: empty move list\n");
@@ -132,7 +132,7 @@ SCORE alpha_beta(POSITION position, SCORE alpha, SCORE beta, REMOTENESS min_remo
 				run = TRUE;
 
 				/* Obtain position resulting from application of move */
-				child = DoMove(position, move_node->move);
+				child = StatsDoMove(position, move_node->move);
 
 				/* Normalize child position if symmetry handling is enabled */
 				if (gSymmetries) {
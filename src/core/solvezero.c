@@ -30,8 +30,12 @@
 **
 **************************************************************************/
 
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
 #include "gamesman.h"
 #include "solveloopy.h"
+#include "threadpool.h"
 
 
 /**************
@@ -39,11 +43,8 @@
 **		Written by: Scott Lindeneau
 **  Requierments: gDatabase intialized w/ all positions set to undecided
 **  Benefits: Almost no memory overhead for the solver.
-**			  9 POSITION's, 2 int's, 1 VALUE, 2 MOVELIST pointers
-**				32bit machines: around 60 bytes
-**				64bit machines: around 96 bytes
-**					(this depends on the size of VALUE)
-**			  plus whatever the movelist adds, varies per parent (possibly big)
+**			  two bits per position for the worklists, plus
+**			  whatever the movelist adds, varies per parent (possibly big)
 **
 **  Calls: StoreValueOfPosition, GetValueOfPosition
 **		   MarkAsVisited, Visited
@@ -51,127 +52,307 @@
 **		   Remoteness, SetRemoteness
 **
 **	Logic:
-**			Go through all possible nodes finding the visited undecided positions
-**			See if you can find a value for these positions, if you cannot, it means
-**			one of two things. Either
-**			   a) the node you are at loops back up the tree to create a draw
-**			   b) more undecided nodes beneath current node need values
-**			In the event of (a) you can mark those nodes off as draws, however we
-**			dont know if (a) is true unless we can be sure that (b) is false
-**			We can say (b) is false when the number of undecided positions stops
-**                     changing
+**			The solver works in passes over a worklist, a bitmap holding the
+**			positions that may still change. A pass evaluates every position
+**			in it: a position nobody has visited yet is marked visited and
+**			checked for being primitive, the others look at their children.
+**			Once every child has a value, the position gets its value and
+**			remoteness exactly as in the recursive solver. Otherwise it goes
+**			back on the worklist for the next pass, and so do all children
+**			that have not been visited yet.
 **
-**			Why is this true?
-**			    Suppose (b) holds for some node J. This means that there is some
-**			    node beneath node J that is undecided and can be assigned a value. We
-**			    can call this node W. Once node W is assigned a value,
-**			    the total number of undecided nodes in the tree
-**                         decreases(thus differs).
+**			We cannot afford parent pointers, so a waiting position cannot
+**			be woken up by the child it waits for. Instead, with the in-memory
+**			database, it keeps the index of its first undecided move in its
+**			(unused while undecided) remoteness field. The next pass only
+**			regenerates that one child, and as long as it is still
+**			undecided the position is skipped without touching the others;
+**			once it is decided the watch moves on to the next undecided
+**			move. A position is thus only evaluated in full twice: when it
+**			is first visited and when all of its children have values.
 **
-**                     But what happens if you add the same number of undecided nodes to the tree
-**			as you find values for?
-**			    Simple, if you have added new nodes, iter again, eventually you will
-**			    have to stop adding new nodes, and the number of undecided positions
-**			    can only decrease(if they change at all)
+**			Each pass is split into chunks of ZERO_CHUNK_WORDS bitmap words
+**			that --threads workers evaluate concurrently. A worker only writes
+**			the positions of its own chunks; children are queued through
+**			atomic bit sets. Only modules that pass ParallelSolveSafe get
+**			workers, and only on a database whose cells can be written
+**			independently, so the packed databases stay on one thread.
 **
-**			Eventually, the number of undecided nodes will stop changing, either
-**                     through solving all of the nodes, or the proof for (b).
-**			Then all remaining nodes that are visited and undecided are set to draws
+**			When a pass neither decides nor discovers a position, nothing
+**			can change any more and all remaining visited undecided positions
+**			are draws. The solver is only selected for non-loopy games (see
+**			SetSolver), where this only happens once everything is solved.
 **************/
 
-VALUE DetermineZeroValue(POSITION position)
+/* 64 positions per word, 4096 positions per task */
+#define ZERO_CHUNK_WORDS        64
+
+/* Watched-move encoding in the remoteness field of undecided positions:
+   0 means none, k means the k-th move of GenerateMoves. */
+#define ZERO_NO_WATCH           0
+#define ZERO_MAX_WATCH          (REMOTENESS_MAX - 1)
+
+typedef unsigned long long ZEROWORD;
+
+typedef struct {
+	POSITION firstWord, endWord;
+	POSITION touched, waiting, decided, discovered;
+} ZEROCHUNK;
+
+static ZEROWORD *zeroCurrent, *zeroNext;
+static BOOLEAN zeroWatch;
+
+/* StoreValueOfPosition also feeds the analysis counters and the progress
+   meter, which every worker shares. */
+static pthread_mutex_t zeroStoreLock = PTHREAD_MUTEX_INITIALIZER;
+
+static BOOLEAN zeroQueue(POSITION pos)
+{
+	ZEROWORD bit = 1ULL << (pos & 63);
+	return !(__atomic_fetch_or(&zeroNext[pos >> 6], bit, __ATOMIC_RELAXED) & bit);
+}
+
+static void zeroStore(POSITION pos, REMOTENESS remoteness, VALUE value)
+{
+	SetRemoteness(pos, remoteness);
+	pthread_mutex_lock(&zeroStoreLock);
+	StoreValueOfPosition(pos, value);
+	pthread_mutex_unlock(&zeroStoreLock);
+}
+
+static POSITION zeroChild(POSITION pos, MOVE move)
+{
+	POSITION child = StatsDoMove(pos, move);
+
+	if (gSymmetries)
+		child = gCanonicalPosition(child);
+	if (child >= gNumberOfPositions)
+		FoundBadPosition(child, pos, move);
+	return child;
+}
+
+static void zeroEvaluate(POSITION pos, ZEROCHUNK *chunk)
 {
-	POSITION i,lowSeen,highSeen;
-	POSITION numUndecided, oldNumUndecided, numNew;
-	MOVELIST *moveptr, *headMove;
+	BOOLEAN foundTie = FALSE, foundLose = FALSE, foundWin = FALSE, visited;
+	MOVELIST *moves, *ptr;
 	POSITION child;
-	VALUE childValue;
-	POSITION numTot, numWin, numTie;
-	int tieRemoteness, winRemoteness;
-
-	//if (gTwoBits)
-	//    InitializeVisitedArray();
-
-	StoreValueOfPosition(position,Primitive(position));
-	MarkAsVisited(position);
-	oldNumUndecided = 0;
-	numUndecided = 1;
-	numNew = 1;
-
-	lowSeen = position;
-	highSeen = lowSeen+1;
-
-	while((numUndecided != oldNumUndecided) || (numNew != 0)) {
-
-		oldNumUndecided = numUndecided;
-		numUndecided = 0;
-		numNew = 0;
-		for(i = lowSeen; i <= highSeen; i++) {
-			if(Visited(i)) {
-				if(GetValueOfPosition(i) == undecided) {
-					moveptr = headMove = GenerateMoves(i);
-					numTot = numWin = numTie = 0;
-					tieRemoteness = winRemoteness = REMOTENESS_MAX;
-					while(moveptr != NULL) {
-						child = DoMove(i,moveptr->move);
-						numTot++;
-						if(Visited(child))
-							childValue = GetValueOfPosition(child);
-						else{
-							childValue = Primitive(child);
-							numNew++;
-							MarkAsVisited(child);
-							StoreValueOfPosition(child,childValue);
-							if(childValue != undecided) {
-								SetRemoteness(child,0);
-							}
-							if(child < lowSeen) lowSeen = child;
-							if(child > highSeen) highSeen = child + 1;
-						}
-
-						if(childValue == lose) {
-							StoreValueOfPosition(i,win);
-							if(Remoteness(i) > Remoteness(child)+1)
-								SetRemoteness(i,Remoteness(child)+1);
-						}
-
-						if(childValue == win) {
-							numWin++;
-							if(Remoteness(child) < winRemoteness) {
-								winRemoteness = Remoteness(child);
-							}
-						}
-						if(childValue == tie) {
-							numTie++;
-							if(Remoteness(child) < tieRemoteness) {
-								tieRemoteness = Remoteness(child);
-							}
-						}
-
-						moveptr = moveptr->next;
-					}
-					FreeMoveList(headMove);
-					if((numTot != 0) && (numTot == numWin + numTie)) {
-						if(numTie == 0) {
-							SetRemoteness(i, winRemoteness+1);
-							StoreValueOfPosition(i,lose);
-						}else{
-							SetRemoteness(i, tieRemoteness+1);
-							StoreValueOfPosition(i,tie);
-						}
-					}
-
-					if(GetValueOfPosition(i) == undecided)
-						numUndecided++;
-				}
+	VALUE value;
+	REMOTENESS maxRemoteness = 0, minRemoteness = MAXINT2;
+	REMOTENESS minTieRemoteness = MAXINT2, remoteness;
+	REMOTENESS watch = ZERO_NO_WATCH, firstUndecided = ZERO_NO_WATCH, index;
+	BOOLEAN foundUndecided = FALSE;
+	MEXCALC theMexCalc = 0;
+	int childWinByValue, minWinByValue = ((1 << (MEX_BITS-1))-1), maxWinByValue = -(1 << (MEX_BITS-1));
+
+	if (!Visited(pos)) {
+		MarkAsVisited(pos);
+		if ((value = Primitive(pos)) != undecided) {
+			if (!kPartizan && !gTwoBits)
+				MexStore(pos, MexPrimitive(value)); /* lose=0, win=* */
+			else if (kPartizan && gPutWinBy && !gTwoBits)
+				WinByStore(pos, gPutWinBy(pos));
+			zeroStore(pos, 0, value);
+			chunk->decided++;
+			return;
+		}
+	} else if (GetValueOfPosition(pos) != undecided) {
+		return; /* queued again after it was decided */
+	} else if (zeroWatch) {
+		watch = Remoteness(pos);
+	}
+
+	moves = StatsGenerateMoves(pos);
+
+	/* Moves before the watched one were decided when it was picked, and
+	   positions never become undecided again: only look from there on. */
+	if (watch != ZERO_NO_WATCH) {
+		for (ptr = moves, index = 1; ptr != NULL && index < watch; ptr = ptr->next)
+			index++;
+		for (; ptr != NULL && index <= ZERO_MAX_WATCH; ptr = ptr->next, index++) {
+			child = zeroChild(pos, ptr->move);
+			if (Visited(child))
+				value = GetValueOfPosition(child);
+			else if ((value = Primitive(child)) == undecided)
+				zeroQueue(child);
+			if (value == undecided) {
+				if (index != watch)
+					SetRemoteness(pos, index);
+				FreeMoveList(moves);
+				zeroQueue(pos);
+				chunk->waiting++;
+				return;
 			}
 		}
+	}
+
+	chunk->touched++;
+	if (!kPartizan && !gTwoBits)
+		theMexCalc = MexCalcInit();
+	for (ptr = moves, index = 1; ptr != NULL; ptr = ptr->next, index++) {
+		child = zeroChild(pos, ptr->move);
+		if ((visited = Visited(child))) {
+			value = GetValueOfPosition(child);
+		} else {
+			/* its own evaluation stores it, one pass later */
+			value = Primitive(child);
+			if (zeroQueue(child))
+				chunk->discovered++;
+		}
 
-		printf("\nnumUndecided: " POSITION_FORMAT ", diff: " POSITION_FORMAT ", numNew: " POSITION_FORMAT
-		       ", lowSeen: " POSITION_FORMAT ", highSeen: " POSITION_FORMAT,
-		       numUndecided,numUndecided - oldNumUndecided,numNew,lowSeen,highSeen);
+		if (value == undecided) {
+			if (!foundUndecided && index <= ZERO_MAX_WATCH)
+				firstUndecided = index;
+			foundUndecided = TRUE;
+			continue;
+		}
+		if (foundUndecided)
+			continue; /* cannot decide this pass anyway */
+
+		remoteness = visited ? Remoteness(child) : 0;
+		if (kPartizan && gPutWinBy && !gTwoBits) {
+			childWinByValue = visited ? WinByLoad(child) : gPutWinBy(child);
+			if (childWinByValue < minWinByValue)
+				minWinByValue = childWinByValue;
+			if (childWinByValue > maxWinByValue)
+				maxWinByValue = childWinByValue;
+		}
+		if (!kPartizan && !gTwoBits)
+			theMexCalc = MexAdd(theMexCalc, visited ? MexLoad(child) : MexPrimitive(value));
 
+		if (gGoAgain(pos, ptr->move))
+			switch(value)
+			{
+			case lose: value=win; break;
+			case win: value=lose; break;
+			default: break; /* value stays the same */
+			}
+
+		if (value == lose) {
+			foundLose = TRUE;
+			if (remoteness < minRemoteness) minRemoteness = remoteness;
+		} else if (value == tie) {
+			foundTie = TRUE;
+			if (remoteness < minTieRemoteness) minTieRemoteness = remoteness;
+		} else if (value == win) {
+			foundWin = TRUE;
+			if (remoteness > maxRemoteness) maxRemoteness = remoteness;
+		} else
+			BadElse("DetermineZeroValue[1]");
+	}
+	FreeMoveList(moves);
+
+	if (foundUndecided) {
+		if (zeroWatch)
+			SetRemoteness(pos, firstUndecided);
+		zeroQueue(pos);
+		return;
+	}
+
+	if (!kPartizan && !gTwoBits)
+		MexStore(pos, MexCompute(theMexCalc));
+	else if (kPartizan && gPutWinBy && !gTwoBits) {
+		int turn = generic_hash_turn(pos);
+		if (turn == 1)
+			WinByStore(pos, maxWinByValue);
+		else if (turn == 2)
+			WinByStore(pos, minWinByValue);
+		else BadElse("Bad generic_hash_turn(position)");
+	}
+	if (foundLose)
+		zeroStore(pos, minRemoteness + 1, win); /* Winners want to mate soon! */
+	else if (foundTie)
+		zeroStore(pos, minTieRemoteness + 1, tie); /* Tiers want to mate now! */
+	else if (foundWin)
+		zeroStore(pos, maxRemoteness + 1, lose); /* Losers want to extend! */
+	else {
+		BadElse("DetermineZeroValue[2]. GenereateMoves most likely didnt return anything.");
+		return;
 	}
+	chunk->decided++;
+}
+
+static void zeroSweepChunk(void *arg)
+{
+	ZEROCHUNK *chunk = (ZEROCHUNK *) arg;
+	POSITION w;
+	ZEROWORD bits;
+
+	for (w = chunk->firstWord; w < chunk->endWord; w++)
+		for (bits = zeroCurrent[w]; bits != 0; bits &= bits - 1)
+			zeroEvaluate((w << 6) + __builtin_ctzll(bits), chunk);
+}
+
+VALUE DetermineZeroValue(POSITION position)
+{
+	POSITION i, numWords = gNumberOfPositions / 64 + 1, queued;
+	POSITION touched, waiting, decided, discovered, totalTouched = 0, totalWaiting = 0;
+	ZEROWORD *swap;
+	ZEROCHUNK *chunks;
+	int numChunks, c, passes = 0;
+	int numThreads = (gNumThreads > 0) ? gNumThreads : 1;
+	THREADPOOL *pool = NULL;
+	struct timespec start, end;
+	double seconds;
+
+	/* only the in-memory database keeps one independent cell per position */
+	zeroWatch = !gUseGPS && !(kSupportsTierGamesman && gTierGamesman) &&
+	            !gBitPerfectDB && !gTwoBits && !gCollDB && !gUnivDB && !gNetworkDB && !gFileDB;
+	if (!zeroWatch || !ParallelSolveSafe())
+		numThreads = 1;
+	if (numThreads > 1)
+		pool = ThreadPoolCreate(numThreads);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (gSymmetries)
+		position = gCanonicalPosition(position);
+	zeroCurrent = (ZEROWORD *) SafeCalloc(numWords, sizeof(ZEROWORD));
+	zeroNext = (ZEROWORD *) SafeCalloc(numWords, sizeof(ZEROWORD));
+	zeroCurrent[position >> 6] = 1ULL << (position & 63);
+
+	numChunks = (int) ((numWords + ZERO_CHUNK_WORDS - 1) / ZERO_CHUNK_WORDS);
+	chunks = (ZEROCHUNK *) SafeMalloc(numChunks * sizeof(ZEROCHUNK));
+
+	do {
+		passes++;
+		for (c = 0; c < numChunks; c++) {
+			memset(&chunks[c], 0, sizeof(ZEROCHUNK));
+			chunks[c].firstWord = (POSITION) c * ZERO_CHUNK_WORDS;
+			chunks[c].endWord = (c == numChunks - 1) ? numWords : chunks[c].firstWord + ZERO_CHUNK_WORDS;
+			if (pool)
+				ThreadPoolSubmit(pool, zeroSweepChunk, &chunks[c]);
+			else
+				zeroSweepChunk(&chunks[c]);
+		}
+		if (pool)
+			ThreadPoolWait(pool);
+
+		touched = waiting = decided = discovered = 0;
+		for (c = 0; c < numChunks; c++) {
+			touched += chunks[c].touched;
+			waiting += chunks[c].waiting;
+			decided += chunks[c].decided;
+			discovered += chunks[c].discovered;
+		}
+		totalTouched += touched;
+		totalWaiting += waiting;
+
+		swap = zeroCurrent;
+		zeroCurrent = zeroNext;
+		zeroNext = swap;
+		memset(zeroNext, 0, numWords * sizeof(ZEROWORD));
+		for (i = 0, queued = 0; i < numWords; i++)
+			queued += __builtin_popcountll(zeroCurrent[i]);
+
+		printf("\nPass %d: evaluated " POSITION_FORMAT ", waiting " POSITION_FORMAT ", decided " POSITION_FORMAT
+		       ", new " POSITION_FORMAT ", queued " POSITION_FORMAT,
+		       passes, touched, waiting, decided, discovered, queued);
+	} while (queued > 0 && (decided > 0 || discovered > 0));
+
+	ThreadPoolDestroy(pool);
+	SafeFree(chunks);
+	SafeFree(zeroCurrent);
+	SafeFree(zeroNext);
+	zeroCurrent = zeroNext = NULL;
 
 	for(i = 0; i < gNumberOfPositions; i++) {
 		if(Visited(i) && (GetValueOfPosition(i) == undecided)) {
@@ -181,6 +362,11 @@ VALUE DetermineZeroValue(POSITION position)
 		UnMarkAsVisited(i);
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("\nSolved in %d passes: " POSITION_FORMAT " evaluations, " POSITION_FORMAT
+	       " skipped on a watched move, %.2f seconds using %d thread%s.\n",
+	       passes, totalTouched, totalWaiting, seconds, numThreads, numThreads == 1 ? "" : "s");
+
 	return GetValueOfPosition(position);
 }
-
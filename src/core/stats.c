@@ -0,0 +1,365 @@
+/************************************************************************
+**
+** NAME:	stats.c
+**
+** DESCRIPTION:	Live solver counters: positions per tier, time split
+**		between GenerateMoves, DoMove and the database, hash window
+**		loads and database cache hit rates.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-19
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#include <pthread.h>
+#include <time.h>
+#include "gamesman.h"
+#include "stats.h"
+
+/* Only the owning thread writes its counters; the snapshot reads them from
+** another thread, so both sides go through relaxed atomics (plain loads and
+** stores on every target we build for). */
+#define STAT_BUMP(field, n)     __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+#define STAT_READ(field)        __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+typedef struct statthread {
+	UINT64 *calls;          /* the owner's tStatsCalls, NULL once it exited */
+	UINT64 retiredCalls[STAT_NUMTIMERS];
+	UINT64 sampled[STAT_NUMTIMERS];
+	UINT64 sampledNanos[STAT_NUMTIMERS];
+	UINT64 hits[STAT_NUMCACHES];
+	UINT64 misses[STAT_NUMCACHES];
+	int id;
+	BOOLEAN inUse;
+	struct statthread *next;
+	char pad[64];           /* keep neighbouring records off our cache line */
+} STATTHREAD;
+
+typedef struct {
+	TIER tier;
+	TIERPOSITION size;
+	UINT64 positions;
+	double seconds;
+} STATTIER;
+
+static STRING kTimerNames[STAT_NUMTIMERS] = {
+	"generatemoves", "domove", "dbget", "dbput", "hashwindow"
+};
+static STRING kCacheNames[STAT_NUMCACHES] = { "sharddb", "netdb", "filedb" };
+
+static pthread_mutex_t gStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t gStatsKey;
+static pthread_once_t gStatsKeyOnce = PTHREAD_ONCE_INIT;
+__thread UINT64 tStatsCalls[STAT_NUMTIMERS] __attribute__((tls_model("initial-exec")));
+static __thread STATTHREAD *tStats = NULL;
+static STATTHREAD *gStatsThreads = NULL;
+static int gStatsNumThreads = 0;
+static STATCACHECOUNTER gStatsCacheCounters[STAT_NUMCACHES];
+
+static STATTIER *gStatsTiers = NULL;
+static int gStatsNumTiers = 0, gStatsTierCapacity = 0;
+static BOOLEAN gStatsInTier = FALSE;
+static STATTIER gStatsCurrentTier;
+static UINT64 gStatsTierStart;
+
+static UINT64 gStatsStartTime;
+static pid_t gStatsPid;
+static STRING gStatsOutput = NULL;
+static pthread_t gStatsWriter;
+static pthread_cond_t gStatsWake = PTHREAD_COND_INITIALIZER;
+static BOOLEAN gStatsWriterRunning = FALSE, gStatsStopping = FALSE;
+
+static void     statsRelease    (void *record);
+static void     statsMakeKey    (void);
+static STATTHREAD *statsRegister (void);
+static UINT64   statsPositions  (void);
+static void     statsWriteFile  (void);
+static void*    statsWriterMain (void *arg);
+
+UINT64 StatsClock(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (UINT64) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Records of finished threads are handed to the next thread that starts,
+** so thread pools created per tier do not grow the list. */
+static void statsRelease(void *record) {
+	STATTHREAD *t = (STATTHREAD *) record;
+	int i;
+	pthread_mutex_lock(&gStatsLock);
+	for (i = 0; i < STAT_NUMTIMERS; i++)
+		t->retiredCalls[i] += tStatsCalls[i];
+	t->calls = NULL;
+	t->inUse = FALSE;
+	pthread_mutex_unlock(&gStatsLock);
+}
+
+static void statsMakeKey(void) {
+	pthread_key_create(&gStatsKey, statsRelease);
+}
+
+/* Nothing that can fail (and exit, running StatsStop) is called with
+** gStatsLock held. */
+static STATTHREAD *statsRegister(void) {
+	STATTHREAD *t, *fresh = (STATTHREAD *) SafeMalloc(sizeof(STATTHREAD));
+	pthread_once(&gStatsKeyOnce, statsMakeKey);
+	memset(fresh, 0, sizeof(STATTHREAD));
+	pthread_mutex_lock(&gStatsLock);
+	for (t = gStatsThreads; t != NULL && t->inUse; t = t->next) ;
+	if (t == NULL) {
+		t = fresh;
+		t->id = gStatsNumThreads++;
+		t->next = gStatsThreads;
+		gStatsThreads = t;
+		fresh = NULL;
+	}
+	t->calls = tStatsCalls;
+	t->inUse = TRUE;
+	pthread_mutex_unlock(&gStatsLock);
+	if (fresh != NULL)
+		SafeFree(fresh);
+	pthread_setspecific(gStatsKey, t);
+	return tStats = t;
+}
+
+void StatsTimerSample(STATTIMER timer, UINT64 nanoseconds) {
+	STATTHREAD *t = tStats ? tStats : statsRegister();
+	STAT_BUMP(t->sampledNanos[timer], nanoseconds);
+	STAT_BUMP(t->sampled[timer], 1);
+}
+
+void StatsTimerRecord(STATTIMER timer, UINT64 nanoseconds) {
+	STAT_BUMP(tStatsCalls[timer], 1);
+	StatsTimerSample(timer, nanoseconds);
+}
+
+MOVELIST *StatsGenerateMoves(POSITION position) {
+	MOVELIST *moves;
+	STATS_TIMED(STAT_GENERATEMOVES, moves = GenerateMoves(position));
+	return moves;
+}
+
+POSITION StatsDoMove(POSITION position, MOVE move) {
+	POSITION child;
+	STATS_TIMED(STAT_DOMOVE, child = DoMove(position, move));
+	return child;
+}
+
+void StatsCacheAccess(STATCACHE cache, UINT64 hits, UINT64 misses) {
+	STATTHREAD *t;
+	if (!gStats)
+		return;
+	t = tStats ? tStats : statsRegister();
+	STAT_BUMP(t->hits[cache], hits);
+	STAT_BUMP(t->misses[cache], misses);
+}
+
+void StatsSetCacheCounter(STATCACHE cache, STATCACHECOUNTER counter) {
+	gStatsCacheCounters[cache] = counter;
+}
+
+static UINT64 statsCalls(STATTHREAD *t, STATTIMER timer) {
+	return t->retiredCalls[timer] + (t->calls ? STAT_READ(t->calls[timer]) : 0);
+}
+
+/* Positions expanded so far, over all threads. */
+static UINT64 statsPositions(void) {
+	STATTHREAD *t;
+	UINT64 positions = 0;
+	for (t = gStatsThreads; t != NULL; t = t->next)
+		positions += statsCalls(t, STAT_GENERATEMOVES);
+	return positions;
+}
+
+void StatsTierBegin(TIER tier, TIERPOSITION size) {
+	if (!gStats)
+		return;
+	pthread_mutex_lock(&gStatsLock);
+	gStatsCurrentTier.tier = tier;
+	gStatsCurrentTier.size = size;
+	gStatsCurrentTier.positions = statsPositions();
+	gStatsTierStart = StatsClock();
+	gStatsInTier = TRUE;
+	pthread_mutex_unlock(&gStatsLock);
+}
+
+/* Tiers begin and end on the solver's main thread, the only writer. */
+void StatsTierEnd(void) {
+	STATTIER *tiers = gStatsTiers, *old = NULL;
+	if (!gStats || !gStatsInTier)
+		return;
+	if (gStatsNumTiers == gStatsTierCapacity) {
+		tiers = (STATTIER *) SafeMalloc(2 * (gStatsTierCapacity + 32) * sizeof(STATTIER));
+		if (gStatsNumTiers)
+			memcpy(tiers, gStatsTiers, gStatsNumTiers * sizeof(STATTIER));
+	}
+	pthread_mutex_lock(&gStatsLock);
+	if (tiers != gStatsTiers) {
+		old = gStatsTiers;
+		gStatsTiers = tiers;
+		gStatsTierCapacity = 2 * (gStatsTierCapacity + 32);
+	}
+	gStatsCurrentTier.positions = statsPositions() - gStatsCurrentTier.positions;
+	gStatsCurrentTier.seconds = (StatsClock() - gStatsTierStart) / 1e9;
+	gStatsTiers[gStatsNumTiers++] = gStatsCurrentTier;
+	gStatsInTier = FALSE;
+	pthread_mutex_unlock(&gStatsLock);
+	if (old != NULL)
+		SafeFree(old);
+}
+
+static void statsPrintTier(FILE *fp, STATTIER *tier) {
+	fprintf(fp, "{\"tier\":%llu,\"size\":%llu,\"positions\":%llu,\"seconds\":%.3f,\"positions_per_s\":%.0f}",
+	        tier->tier, tier->size, tier->positions, tier->seconds,
+	        tier->seconds > 0 ? tier->positions / tier->seconds : 0.0);
+}
+
+void StatsPrint(FILE *fp) {
+	UINT64 calls[STAT_NUMTIMERS] = { 0 }, sampled[STAT_NUMTIMERS] = { 0 }, nanos[STAT_NUMTIMERS] = { 0 };
+	UINT64 hits[STAT_NUMCACHES] = { 0 }, misses[STAT_NUMCACHES] = { 0 };
+	double elapsed = gStatsStartTime ? (StatsClock() - gStatsStartTime) / 1e9 : 0;
+	STATTHREAD *t;
+	STATTIER current;
+	int i;
+
+	pthread_mutex_lock(&gStatsLock);
+	for (t = gStatsThreads; t != NULL; t = t->next) {
+		for (i = 0; i < STAT_NUMTIMERS; i++) {
+			calls[i] += statsCalls(t, i);
+			sampled[i] += STAT_READ(t->sampled[i]);
+			nanos[i] += STAT_READ(t->sampledNanos[i]);
+		}
+		for (i = 0; i < STAT_NUMCACHES; i++) {
+			hits[i] += STAT_READ(t->hits[i]);
+			misses[i] += STAT_READ(t->misses[i]);
+		}
+	}
+	for (i = 0; i < STAT_NUMCACHES; i++) {
+		if (gStatsCacheCounters[i] != NULL) {
+			UINT64 h = 0, m = 0;
+			gStatsCacheCounters[i](&h, &m);
+			hits[i] += h;
+			misses[i] += m;
+		}
+	}
+
+	fprintf(fp, "{\"enabled\":%s,\"game\":\"%s\",\"option\":%d,\"elapsed_s\":%.3f,\"threads\":%d,"
+	        "\"positions\":%llu,\"positions_per_s\":%.0f,\"timers\":{",
+	        gStats ? "true" : "false", kDBName, getOption(), elapsed, gStatsNumThreads,
+	        calls[STAT_GENERATEMOVES], elapsed > 0 ? calls[STAT_GENERATEMOVES] / elapsed : 0.0);
+	for (i = 0; i < STAT_NUMTIMERS; i++)
+		fprintf(fp, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.3f}", i ? "," : "", kTimerNames[i], calls[i],
+		        sampled[i] ? (double) nanos[i] * calls[i] / sampled[i] / 1e9 : 0.0);
+	fprintf(fp, "},\"caches\":{");
+	for (i = 0; i < STAT_NUMCACHES; i++)
+		fprintf(fp, "%s\"%s\":{\"hits\":%llu,\"misses\":%llu,\"hit_rate\":%.4f}", i ? "," : "",
+		        kCacheNames[i], hits[i], misses[i],
+		        hits[i] + misses[i] ? (double) hits[i] / (hits[i] + misses[i]) : 0.0);
+	fprintf(fp, "}");
+	if (gStatsInTier) {
+		current = gStatsCurrentTier;
+		current.positions = calls[STAT_GENERATEMOVES] - current.positions;
+		current.seconds = (StatsClock() - gStatsTierStart) / 1e9;
+		fprintf(fp, ",\"current_tier\":");
+		statsPrintTier(fp, &current);
+	}
+	fprintf(fp, ",\"tiers\":[");
+	for (i = 0; i < gStatsNumTiers; i++) {
+		if (i) fprintf(fp, ",");
+		statsPrintTier(fp, &gStatsTiers[i]);
+	}
+	fprintf(fp, "],\"per_thread\":[");
+	for (t = gStatsThreads; t != NULL; t = t->next) {
+		fprintf(fp, "{\"thread\":%d,\"positions\":%llu,\"domove\":%llu,\"dbget\":%llu,\"dbput\":%llu}%s",
+		        t->id, statsCalls(t, STAT_GENERATEMOVES), statsCalls(t, STAT_DOMOVE),
+		        statsCalls(t, STAT_DBGET), statsCalls(t, STAT_DBPUT),
+		        t->next ? "," : "");
+	}
+	fprintf(fp, "]}");
+	pthread_mutex_unlock(&gStatsLock);
+}
+
+/* Written next to the target and renamed over it, so a reader polling the
+** file never sees half a snapshot. */
+static void statsWriteFile(void) {
+	char tmp[1024];
+	FILE *fp;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", gStatsOutput);
+	if ((fp = fopen(tmp, "w")) == NULL)
+		return;
+	StatsPrint(fp);
+	fputc('\n', fp);
+	if (fclose(fp) == 0)
+		rename(tmp, gStatsOutput);
+}
+
+static void *statsWriterMain(void *arg) {
+	struct timespec deadline;
+	(void) arg;
+	pthread_mutex_lock(&gStatsLock);
+	while (!gStatsStopping) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += gStatsInterval > 0 ? gStatsInterval : 1;
+		pthread_cond_timedwait(&gStatsWake, &gStatsLock, &deadline);
+		if (gStatsStopping)
+			break;
+		pthread_mutex_unlock(&gStatsLock);
+		statsWriteFile();
+		pthread_mutex_lock(&gStatsLock);
+	}
+	pthread_mutex_unlock(&gStatsLock);
+	return NULL;
+}
+
+void StatsStart(STRING filename) {
+	gStats = TRUE;
+	if (!gStatsStartTime)
+		gStatsStartTime = StatsClock();
+	if (tStats == NULL)
+		statsRegister();
+	if (filename == NULL || gStatsWriterRunning)
+		return;
+	gStatsOutput = filename;
+	gStatsPid = getpid();
+	if (pthread_create(&gStatsWriter, NULL, statsWriterMain, NULL) != 0) {
+		fprintf(stderr, "Could not start the stats writer, %s will not be updated\n", filename);
+		return;
+	}
+	gStatsWriterRunning = TRUE;
+	atexit(StatsStop);
+}
+
+void StatsStop(void) {
+	/* Processes forked by a solver inherit the atexit hook but not the
+	** writer thread. */
+	if (!gStatsWriterRunning || getpid() != gStatsPid)
+		return;
+	pthread_mutex_lock(&gStatsLock);
+	gStatsStopping = TRUE;
+	pthread_cond_signal(&gStatsWake);
+	pthread_mutex_unlock(&gStatsLock);
+	pthread_join(gStatsWriter, NULL);
+	gStatsWriterRunning = FALSE;
+	statsWriteFile();
+}
@@ -0,0 +1,114 @@
+/************************************************************************
+**
+** NAME:	stats.h
+**
+** DESCRIPTION:	Live solver counters: positions per tier, time split
+**		between GenerateMoves, DoMove and the database, hash window
+**		loads and database cache hit rates.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-19
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#ifndef GMCORE_STATS_H
+#define GMCORE_STATS_H
+
+/* Everything below is a no-op (one branch on gStats) unless --stats was
+** given. Counters are kept per thread and only summed when a snapshot is
+** taken, so the solver threads never share a cache line. Timers are
+** sampled: one call in STATS_SAMPLE_PERIOD reads the clock and the total
+** is extrapolated from the sampled calls. */
+
+#define STATS_SAMPLE_PERIOD 256
+
+typedef enum {
+	STAT_GENERATEMOVES,
+	STAT_DOMOVE,
+	STAT_DBGET,
+	STAT_DBPUT,
+	STAT_HASHWINDOW,
+	STAT_NUMTIMERS
+} STATTIMER;
+
+typedef enum {
+	STAT_SHARDDB,
+	STAT_NETDB,
+	STAT_FILEDB,
+	STAT_NUMCACHES
+} STATCACHE;
+
+/* Reads the hit and miss totals of a cache that keeps its own counts. */
+typedef void (*STATCACHECOUNTER)(UINT64 *hits, UINT64 *misses);
+
+/* Turns the counters on. With a FILENAME, a snapshot is also written
+** there every gStatsInterval seconds and once more at exit. */
+void            StatsStart              (STRING filename);
+
+/* Writes the final snapshot and stops the writer thread. */
+void            StatsStop               (void);
+
+/* Writes a snapshot as one line of JSON, without the newline. */
+void            StatsPrint              (FILE *fp);
+
+/* Counted versions of the module calls, for the solvers' inner loops. */
+MOVELIST*       StatsGenerateMoves      (POSITION position);
+POSITION        StatsDoMove             (POSITION position, MOVE move);
+
+/* Calls of each timer made by the calling thread. Bumped inline by
+** STATS_TIMED so that unsampled calls never leave the caller; stats.c
+** finds each thread's array when that thread first takes a sample. */
+extern __thread UINT64 tStatsCalls[STAT_NUMTIMERS] __attribute__((tls_model("initial-exec")));
+
+#define STATS_BUMP_CALLS(timer) \
+	(__atomic_store_n(&tStatsCalls[timer], tStatsCalls[timer] + 1, __ATOMIC_RELAXED), \
+	 (tStatsCalls[timer] & (STATS_SAMPLE_PERIOD - 1)) == 0)
+
+/* Runs STATEMENT, counted (and, for one call in STATS_SAMPLE_PERIOD,
+** timed) against TIMER. */
+#define STATS_TIMED(timer, statement) do { \
+		if (gStats && STATS_BUMP_CALLS(timer)) { \
+			UINT64 statsStart_ = StatsClock(); \
+			statement; \
+			StatsTimerSample(timer, StatsClock() - statsStart_); \
+		} else { \
+			statement; \
+		} \
+} while (0)
+
+/* Adds one sampled call of TIMER that took NANOSECONDS. */
+void            StatsTimerSample        (STATTIMER timer, UINT64 nanoseconds);
+
+/* Counts one call to TIMER that took NANOSECONDS, for events that are rare
+** enough to time every time (hash window loads). */
+void            StatsTimerRecord        (STATTIMER timer, UINT64 nanoseconds);
+UINT64          StatsClock              (void);
+
+void            StatsCacheAccess        (STATCACHE cache, UINT64 hits, UINT64 misses);
+void            StatsSetCacheCounter    (STATCACHE cache, STATCACHECOUNTER counter);
+
+/* Bracket the solve of one tier (or of a part of it). */
+void            StatsTierBegin          (TIER tier, TIERPOSITION size);
+void            StatsTierEnd            (void);
+
+#endif /* GMCORE_STATS_H */
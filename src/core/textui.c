@@ -1358,13 +1358,18 @@ void AnalysisMenu()
 
 void VisualizationMenu()
 {
-	char c;
+	char c, input[MAXINPUTLENGTH];
 
 	do {
 		printf("\n\t----- Post-Evaluation VISUALIZATION menu for %s -----\n\n", kGameName);
 		printf("\n\te)\t Toggle (E)dge drawing (currently %s)", gDrawEdges ? "ON" : "OFF");
 		printf("\n\tn)\t Toggle writing text file with (N)ode visualization (currently %s)", gGenerateNodeViz ? "ON" : "OFF");
 		printf("\n\tr)\t Toggle ordering nodes by (R)emoteness (currently %s)", gRemotenessOrder ? "ON" : "OFF");
+		printf("\n\ts)\t Set the fraction of positions (S)ampled (currently %g)", gVisSampleRate);
+		if(gVisDepthLimit < 0)
+			printf("\n\td)\t Set the (D)epth limit from the initial position (currently none)");
+		else
+			printf("\n\td)\t Set the (D)epth limit from the initial position (currently %d)", gVisDepthLimit);
 		printf("\n\n\tv)\t Visualize game graph");
 		printf("\n\n\th)\t(H)elp\n");
 		printf("\n\tb)\t(B)ack = Return to previous activity\n");
@@ -1386,6 +1391,17 @@ void VisualizationMenu()
 		case 'R': case 'r':
 			gRemotenessOrder = !gRemotenessOrder;
 			break;
+		case 'S': case 's':
+			printf("\nPlease enter the fraction of positions to draw moves from (0-1] : ");
+			GetMyStr(input, MAXINPUTLENGTH);
+			gVisSampleRate = atof(input);
+			if(gVisSampleRate <= 0 || gVisSampleRate > 1)
+				gVisSampleRate = 1.0;
+			break;
+		case 'D': case 'd':
+			printf("\nPlease enter the depth limit (-1 for none) : ");
+			gVisDepthLimit = GetMyInt();
+			break;
 		case 'V': case 'v':
 			Visualize();
 			HitAnyKeyToContinue();
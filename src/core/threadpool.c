@@ -0,0 +1,258 @@
+/************************************************************************
+**
+** NAME:	threadpool.c
+**
+** DESCRIPTION:	Work-stealing thread pool shared by the parallel solvers.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-18
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#include <pthread.h>
+#include <unistd.h>
+#include "gamesman.h"
+#include "threadpool.h"
+
+typedef struct {
+	THREADTASK task;
+	void *arg;
+} TASKENTRY;
+
+/* Ring buffer; the owner pushes and pops at the tail, thieves take from
+** the head. A mutex per deque keeps this simple; tasks handed to the pool
+** are coarse (a shard, a chunk of a stage) so it is never contended. */
+typedef struct {
+	pthread_mutex_t lock;
+	TASKENTRY *items;
+	size_t head, count, capacity;
+} TASKDEQUE;
+
+struct threadpool {
+	int numThreads;
+	pthread_t *threads;
+	TASKDEQUE *deques;
+	pthread_mutex_t lock;
+	pthread_cond_t workAvailable;
+	pthread_cond_t allDone;
+	long queued;            /* tasks sitting in some deque */
+	long pending;           /* tasks submitted but not yet returned */
+	unsigned int nextDeque; /* round robin for submissions from outside */
+	BOOLEAN shutdown;
+};
+
+typedef struct {
+	THREADPOOL *pool;
+	int id;
+} WORKERARGS;
+
+static __thread int tWorkerId = -1;
+static __thread THREADPOOL *tWorkerPool = NULL;
+
+static void DequePushTail(TASKDEQUE *dq, THREADTASK task, void *arg)
+{
+	pthread_mutex_lock(&dq->lock);
+	if (dq->count == dq->capacity) {
+		size_t newCapacity = dq->capacity ? dq->capacity * 2 : 64, i;
+		TASKENTRY *items = (TASKENTRY *) SafeMalloc(newCapacity * sizeof(TASKENTRY));
+		for (i = 0; i < dq->count; i++)
+			items[i] = dq->items[(dq->head + i) % dq->capacity];
+		if (dq->items) SafeFree(dq->items);
+		dq->items = items;
+		dq->head = 0;
+		dq->capacity = newCapacity;
+	}
+	dq->items[(dq->head + dq->count) % dq->capacity].task = task;
+	dq->items[(dq->head + dq->count) % dq->capacity].arg = arg;
+	dq->count++;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+static BOOLEAN DequePopTail(TASKDEQUE *dq, TASKENTRY *out)
+{
+	BOOLEAN found = FALSE;
+	pthread_mutex_lock(&dq->lock);
+	if (dq->count > 0) {
+		dq->count--;
+		*out = dq->items[(dq->head + dq->count) % dq->capacity];
+		found = TRUE;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return found;
+}
+
+static BOOLEAN DequeStealHead(TASKDEQUE *dq, TASKENTRY *out)
+{
+	BOOLEAN found = FALSE;
+	pthread_mutex_lock(&dq->lock);
+	if (dq->count > 0) {
+		*out = dq->items[dq->head];
+		dq->head = (dq->head + 1) % dq->capacity;
+		dq->count--;
+		found = TRUE;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return found;
+}
+
+static BOOLEAN FindTask(THREADPOOL *pool, int id, TASKENTRY *out)
+{
+	int i;
+	if (DequePopTail(&pool->deques[id], out))
+		return TRUE;
+	for (i = 1; i < pool->numThreads; i++)
+		if (DequeStealHead(&pool->deques[(id + i) % pool->numThreads], out))
+			return TRUE;
+	return FALSE;
+}
+
+static void *WorkerMain(void *vargs)
+{
+	WORKERARGS *args = (WORKERARGS *) vargs;
+	THREADPOOL *pool = args->pool;
+	TASKENTRY entry;
+
+	tWorkerId = args->id;
+	tWorkerPool = pool;
+	SafeFree(args);
+
+	for (;;) {
+		if (FindTask(pool, tWorkerId, &entry)) {
+			__atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+			entry.task(entry.arg);
+			if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+				pthread_mutex_lock(&pool->lock);
+				pthread_cond_broadcast(&pool->allDone);
+				pthread_mutex_unlock(&pool->lock);
+			}
+			continue;
+		}
+		pthread_mutex_lock(&pool->lock);
+		while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) <= 0 && !pool->shutdown)
+			pthread_cond_wait(&pool->workAvailable, &pool->lock);
+		if (pool->shutdown && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) <= 0) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return NULL;
+}
+
+THREADPOOL *ThreadPoolCreate(int numThreads)
+{
+	THREADPOOL *pool = (THREADPOOL *) SafeCalloc(1, sizeof(THREADPOOL));
+	int i;
+
+	if (numThreads < 1) numThreads = 1;
+	pool->numThreads = numThreads;
+	pool->threads = (pthread_t *) SafeCalloc(numThreads, sizeof(pthread_t));
+	pool->deques = (TASKDEQUE *) SafeCalloc(numThreads, sizeof(TASKDEQUE));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->workAvailable, NULL);
+	pthread_cond_init(&pool->allDone, NULL);
+	for (i = 0; i < numThreads; i++)
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+	for (i = 0; i < numThreads; i++) {
+		WORKERARGS *args = (WORKERARGS *) SafeMalloc(sizeof(WORKERARGS));
+		args->pool = pool;
+		args->id = i;
+		if (pthread_create(&pool->threads[i], NULL, WorkerMain, args) != 0) {
+			fprintf(stderr, "Error: ThreadPoolCreate could not start worker %d\n", i);
+			ExitStageRight();
+			exit(1);
+		}
+	}
+	return pool;
+}
+
+void ThreadPoolSubmit(THREADPOOL *pool, THREADTASK task, void *arg)
+{
+	int target;
+
+	/* Count the task as pending before it becomes visible, so that a
+	** thief finishing it cannot make ThreadPoolWait see zero while the
+	** submitting task is still running. */
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	if (tWorkerPool == pool)
+		target = tWorkerId;
+	else
+		target = __atomic_fetch_add(&pool->nextDeque, 1, __ATOMIC_RELAXED) % pool->numThreads;
+	DequePushTail(&pool->deques[target], task, arg);
+
+	pthread_mutex_lock(&pool->lock);
+	__atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+	pthread_cond_signal(&pool->workAvailable);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void ThreadPoolWait(THREADPOOL *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) > 0)
+		pthread_cond_wait(&pool->allDone, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void ThreadPoolDestroy(THREADPOOL *pool)
+{
+	int i;
+
+	if (pool == NULL) return;
+	ThreadPoolWait(pool);
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = TRUE;
+	pthread_cond_broadcast(&pool->workAvailable);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->numThreads; i++)
+		pthread_join(pool->threads[i], NULL);
+	for (i = 0; i < pool->numThreads; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		if (pool->deques[i].items) SafeFree(pool->deques[i].items);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->workAvailable);
+	pthread_cond_destroy(&pool->allDone);
+	SafeFree(pool->deques);
+	SafeFree(pool->threads);
+	SafeFree(pool);
+}
+
+int ThreadPoolWorkerId()
+{
+	return tWorkerId;
+}
+
+int ThreadPoolSize(THREADPOOL *pool)
+{
+	return pool->numThreads;
+}
+
+int DefaultNumberOfThreads()
+{
+	long n;
+	if (gNumThreads > 0)
+		return gNumThreads;
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (int) n : 1;
+}
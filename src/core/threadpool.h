@@ -0,0 +1,65 @@
+/************************************************************************
+**
+** NAME:	threadpool.h
+**
+** DESCRIPTION:	Work-stealing thread pool shared by the parallel solvers.
+**
+** AUTHOR:	GamesCrafters Research Group, UC Berkeley
+**		Supervised by Dan Garcia <ddgarcia@cs.berkeley.edu>
+**
+** DATE:	2026-10-18
+**
+** LICENSE:	This file is part of GAMESMAN,
+**		The Finite, Two-person Perfect-Information Game Generator
+**		Released under the GPL:
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program, in COPYING; if not, write to the Free Software
+** Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+**
+**************************************************************************/
+
+#ifndef GMCORE_THREADPOOL_H
+#define GMCORE_THREADPOOL_H
+
+typedef void (*THREADTASK)(void *arg);
+
+typedef struct threadpool THREADPOOL;
+
+/* Starts NUMTHREADS workers (at least one). Each worker owns a deque;
+** tasks submitted from inside a worker go to the bottom of its own deque
+** and are popped LIFO, idle workers steal FIFO from the top of the others.
+** Workers with nothing to run or steal sleep on a condition variable. */
+THREADPOOL*     ThreadPoolCreate        (int numThreads);
+
+/* Queues TASK(ARG). May be called from any thread, including from inside
+** a running task. */
+void            ThreadPoolSubmit        (THREADPOOL *pool, THREADTASK task, void *arg);
+
+/* Blocks until every submitted task, including the ones those tasks
+** submitted in turn, has returned. */
+void            ThreadPoolWait          (THREADPOOL *pool);
+
+/* Waits for outstanding work, then joins and frees the workers. */
+void            ThreadPoolDestroy       (THREADPOOL *pool);
+
+/* Index in [0, numThreads) of the calling worker, or -1 when called from a
+** thread that does not belong to a pool. */
+int             ThreadPoolWorkerId      (void);
+
+int             ThreadPoolSize          (THREADPOOL *pool);
+
+/* Number of workers to use when the user did not ask for a count. */
+int             DefaultNumberOfThreads  (void);
+
+#endif /* GMCORE_THREADPOOL_H */
@@ -40,9 +40,12 @@
 #include <zlib.h>
 #include <netinet/in.h>
 #include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "gamesman.h"
 #include <dirent.h>
 #include "tierdb.h"
+#include "threadpool.h"
 
 /*internal declarations and definitions*/
 
@@ -71,6 +74,7 @@ VALUE           tierdb_set_value                (POSITION pos, VALUE val);
 /* Remoteness */
 REMOTENESS      tierdb_get_remoteness           (POSITION pos);
 REMOTENESS      tierdb_get_remoteness_from_lookup_table (POSITION pos);
+void            tierdb_get_bulk_from_lookup_table (POSITION* positions, VALUE* values, REMOTENESS* remotenesses, int length);
 void            tierdb_set_remoteness           (POSITION pos, REMOTENESS val);
 
 /* Visited */
@@ -93,6 +97,11 @@ tierdb_cellValue*       tierdb_get_raw_ptr      (POSITION pos);
 tierdb_cellValue        tierdb_get_raw_from_lookup_table (POSITION pos);
 void                    load_offsets (TIER tier);
 
+/* whole-file reads, and the prefetched copies of child tiers */
+BOOLEAN                 tierdb_read_file (char* filename, POSITION numPos, tierdb_cellValue* cells);
+BOOLEAN                 tierdb_prefetch_copy (TIER tier, tierdb_cellValue* dest, POSITION numPos);
+void                    tierdb_prefetch_keep (TIER tier, tierdb_cellValue* src, POSITION numPos);
+
 tierdb_cellValue*       tierdb_array;
 
 char tierdb_outfilename[80];
@@ -155,6 +164,7 @@ BOOLEAN tierdb_reinit(DB_Table *new_db)
     	closedir(dir);
 		new_db->get_value = tierdb_get_value_from_lookup_table;
 		new_db->get_remoteness = tierdb_get_remoteness_from_lookup_table;
+		new_db->get_bulk = tierdb_get_bulk_from_lookup_table;
 		new_db->check_visited = tierdb_check_visited_from_lookup_table;
 		new_db->get_mex = tierdb_get_mex_from_lookup_table;
 		alreadyReinitialized = TRUE;
@@ -170,6 +180,22 @@ void tierdb_free_childpositions()
 		tierdb_array = (tierdb_cellValue *) SafeRealloc(tierdb_array, gCurrentTierSize * sizeof(tierdb_cellValue));
 }
 
+/* The cells of the tier being solved, raw, for the solver's checkpoints.
+   These files never leave the machine, so no byte order conversion. */
+BOOLEAN tierdb_checkpoint_save(FILE* fp)
+{
+	if (!tierdb_array)
+		return FALSE;
+	return fwrite(tierdb_array, sizeof(tierdb_cellValue), gCurrentTierSize, fp) == gCurrentTierSize;
+}
+
+BOOLEAN tierdb_checkpoint_load(FILE* fp)
+{
+	if (!tierdb_array)
+		return FALSE;
+	return fread(tierdb_array, sizeof(tierdb_cellValue), gCurrentTierSize, fp) == gCurrentTierSize;
+}
+
 void tierdb_free()
 {
 	if(tierdb_array)
@@ -253,6 +279,84 @@ tierdb_cellValue tierdb_get_raw_from_lookup_table(POSITION pos)
     return buf;
 }
 
+/* One position of a bulk lookup, and where its cell is in the files */
+typedef struct {
+	TIER tier;
+	unsigned long long chunk;
+	unsigned long seekTo;
+	int index;
+} tierdb_lookup;
+
+static int tierdb_lookup_compare(const void* a, const void* b)
+{
+	const tierdb_lookup *x = a, *y = b;
+	if (x->tier != y->tier)
+		return x->tier < y->tier ? -1 : 1;
+	if (x->chunk != y->chunk)
+		return x->chunk < y->chunk ? -1 : 1;
+	if (x->seekTo != y->seekTo)
+		return x->seekTo < y->seekTo ? -1 : 1;
+	return 0;
+}
+
+/*
+Same as tierdb_get_raw_from_lookup_table for every position, but
+the cells are read in file order: each tier's offsets are loaded
+once, each chunk is opened once and only ever seeked forward, and
+value and remoteness come from the same read.
+*/
+void tierdb_get_bulk_from_lookup_table(POSITION* positions, VALUE* values, REMOTENESS* remotenesses, int length)
+{
+	tierdb_lookup *lookups = (tierdb_lookup *) SafeMalloc(length * sizeof(tierdb_lookup));
+	TIERPOSITION tierposition;
+	int i, j;
+
+	for (i = 0; i < length; i++) {
+		gUnhashToTierPosition(positions[i], &tierposition, &lookups[i].tier);
+		lookups[i].chunk = (tierposition * 2 + sizeof(short) + sizeof(POSITION)) / FILESIZE;
+		lookups[i].seekTo = (tierposition * 2 + sizeof(short) + sizeof(POSITION)) % FILESIZE;
+		lookups[i].index = i;
+	}
+	qsort(lookups, length, sizeof(tierdb_lookup), tierdb_lookup_compare);
+
+	for (i = 0; i < length; i = j) {
+		TIER tier = lookups[i].tier;
+		unsigned long long chunk = lookups[i].chunk;
+		unsigned long at = 0;
+		unsigned short buf = 0;
+
+		load_offsets(tier);
+		sprintf(tierdb_outfilename, "./data/m%s_%d_tierdb/m%s_%d_%llu_tierdb.dat.gz",
+		        kDBName, getOption(), kDBName, getOption(), tier);
+		int fd = open(tierdb_outfilename, O_RDONLY);
+		if (fd < 0) {
+			printf("Unable to open %s\n", tierdb_outfilename);
+			exit(1);
+		}
+		lseek(fd, offsets[chunk], SEEK_SET);
+		gzFile gzf = gzdopen(fd, "rb");
+		if (gzf == Z_NULL) {
+			printf("Unable to gzdopen %s\n", tierdb_outfilename);
+			exit(1);
+		}
+
+		for (j = i; j < length && lookups[j].tier == tier && lookups[j].chunk == chunk; j++) {
+			/* The same cell twice is read once. */
+			if (j == i || lookups[j].seekTo != lookups[j - 1].seekTo) {
+				gzseek(gzf, lookups[j].seekTo - at, SEEK_CUR);
+				gzread(gzf, &buf, 2);
+				at = lookups[j].seekTo + 2;
+			}
+			tierdb_cellValue cell = ntohs(buf);
+			values[lookups[j].index] = (VALUE)((int)cell & VALUE_MASK);
+			remotenesses[lookups[j].index] = (REMOTENESS)((((int)cell & REMOTENESS_MASK) >> REMOTENESS_SHIFT));
+		}
+		gzclose(gzf); /* also closes fd */
+	}
+
+	SafeFree(lookups);
+}
+
 VALUE tierdb_set_value(POSITION pos, VALUE val)
 {
 	tierdb_cellValue *ptr;
@@ -434,8 +538,12 @@ BOOLEAN tierdb_save_database ()
 	sprintf(tierdb_lookupfilename, "./data/m%s_%d_tierdb/lookup/m%s_%d_%llu_tierdb.dat.gz.idx",
 		        kDBName, getOption(), kDBName, getOption(), gCurrentTier);
 	FILE *indexFP = fopen(tierdb_lookupfilename, "wb");
+	// written under another name and renamed once complete, so a solve killed
+	// mid-save never leaves a truncated DB that looks like a solved tier
+	char partfilename[sizeof(tierdb_outfilename) + 8];
+	sprintf(partfilename, "%s.part", tierdb_outfilename);
 
-	if((tierdb_filep = gzopen(tierdb_outfilename, "wb")) == NULL) {
+	if((tierdb_filep = gzopen(partfilename, "wb")) == NULL) {
 		if(kDebugDetermineValue) {
 			printf("Unable to create compressed data file\n");
 		}
@@ -455,9 +563,9 @@ BOOLEAN tierdb_save_database ()
 		if ((sizeof(short) + sizeof(POSITION) + (i + 1) * sizeof(tierdb_cellValue)) % FILESIZE == 0 || i + 1 == finish) {
 			gzclose(tierdb_filep);
 			off_t prevsize = statbuf.st_size;
-			stat(tierdb_outfilename, &statbuf);
+			stat(partfilename, &statbuf);
 			fprintf(indexFP, "%ld\n",statbuf.st_size - prevsize);
-			if((tierdb_filep = gzopen(tierdb_outfilename, "ab")) == NULL) {
+			if((tierdb_filep = gzopen(partfilename, "ab")) == NULL) {
 				if(kDebugDetermineValue) {
 					printf("Unable to create compressed data file\n");
 				}
@@ -468,16 +576,19 @@ BOOLEAN tierdb_save_database ()
 	tierdb_goodClose = gzclose(tierdb_filep);
 	fclose(indexFP);
 
-	if(tierdb_goodCompression && (tierdb_goodClose == 0)) {
+	if(tierdb_goodCompression && (tierdb_goodClose == 0) && rename(partfilename, tierdb_outfilename) == 0) {
 		if(kDebugDetermineValue && !gJustSolving) {
 			printf("File Successfully compressed\n");
 		}
+		// the next tier usually has this one as a child
+		if (start == 0 && finish == gCurrentTierSize)
+			tierdb_prefetch_keep(gCurrentTier, tierdb_array, gCurrentTierSize);
 		return TRUE;
 	} else {
 		if(kDebugDetermineValue) {
 			fprintf(stderr, "\nError in file compression.\n Error codes:\ngzwrite error: %d\ngzclose error:%d\nBytes To Be Written: " POSITION_FORMAT "\nBytes Written: " POSITION_FORMAT "\n",tierdb_goodCompression, tierdb_goodClose,sTot*4,tot);
 		}
-		remove (tierdb_outfilename);
+		remove (partfilename);
 		return FALSE;
 	}
 
@@ -514,10 +625,7 @@ BOOLEAN tierdb_load_database()
 	if(!gHashWindowInitialized)
 		return FALSE;
 
-	POSITION i, maxpos; int j;
-	tierdb_goodDecompression = 1;
-	tierdb_goodClose = 1;
-	BOOLEAN correctDBVer;
+	POSITION maxpos, numPos; int j;
 
 	if(!tierdb_array && !gZeroMemPlayer)
 		return FALSE;
@@ -531,9 +639,14 @@ BOOLEAN tierdb_load_database()
 				tierdb_array[j] = undecided;
 			continue;
 		}
+		numPos = gMaxPosOffset[index]-gMaxPosOffset[index-1];
+		if (tierdb_prefetch_copy(gTierInHashWindow[index], tierdb_array+gMaxPosOffset[index-1], numPos)) {
+			gTierDBExists[index] = TRUE;
+			continue;
+		}
 		sprintf(tierdb_outfilename, "./data/m%s_%d_tierdb/m%s_%d_%llu_tierdb.dat.gz",
 		        kDBName, getOption(), kDBName, getOption(), gTierInHashWindow[index]);
-		if((tierdb_filep = gzopen(tierdb_outfilename, "rb")) == NULL) {
+		if (access(tierdb_outfilename, R_OK) != 0) {
 			if (gOpponent == AgainstEvaluator) { // go ahead and ignore the loading of the DB
 				maxpos = gMaxPosOffset[index];
 				for(j = 0; j < maxpos; j++)
@@ -541,29 +654,8 @@ BOOLEAN tierdb_load_database()
 				continue;
 			} else return FALSE;
 		}
-		tierdb_goodDecompression = gzread(tierdb_filep,tierdb_dbVer,sizeof(short));
-		tierdb_goodDecompression = gzread(tierdb_filep,tierdb_numPos,sizeof(POSITION));
-		*tierdb_dbVer = ntohs(*tierdb_dbVer);
-		*tierdb_numPos = ntohl(*tierdb_numPos) | (((POSITION) ntohl(*tierdb_numPos >> 32)) << 32);
-		if(*tierdb_numPos != (gMaxPosOffset[index]-gMaxPosOffset[index-1])) {
-			if (kDebugDetermineValue)
-				printf("\n\nError in file decompression: Stored gNumberOfPositions differs from internal gNumberOfPositions\n\n");
+		if (!tierdb_read_file(tierdb_outfilename, numPos, tierdb_array+gMaxPosOffset[index-1]))
 			return FALSE;
-		}
-		correctDBVer = (*tierdb_dbVer == tierdb_FILEVER);
-		if (correctDBVer) {
-			maxpos = gMaxPosOffset[index];
-			for(i = gMaxPosOffset[index-1]; i < maxpos && tierdb_goodDecompression; i++) {
-				tierdb_goodDecompression = gzread(tierdb_filep, tierdb_array+i, sizeof(tierdb_cellValue));
-				tierdb_array[i] = ntohs(tierdb_array[i]);
-			}
-		}
-		tierdb_goodClose = gzclose(tierdb_filep);
-		if(!(tierdb_goodDecompression && (tierdb_goodClose == 0) && correctDBVer)) {
-			if(kDebugDetermineValue)
-				printf("\n\nError in file decompression:\ngzread error: %d\ngzclose error: %d\ndb version: %d\n",tierdb_goodDecompression,tierdb_goodClose,*tierdb_dbVer);
-			return FALSE;
-		}
 		gTierDBExists[index] = TRUE; // lets static evaluator know that this tierdb actually exists!
 	}
 	if(kDebugDetermineValue)
@@ -571,6 +663,250 @@ BOOLEAN tierdb_load_database()
 	return TRUE;
 }
 
+/* Reads a whole tier file into CELLS (host byte order) with a few large
+ * gzreads. Uses only locals, so the prefetch worker can call it too.
+ * Returns FALSE if the file is missing, of another version, or not
+ * NUMPOS positions long. */
+BOOLEAN tierdb_read_file(char* filename, POSITION numPos, tierdb_cellValue* cells)
+{
+	gzFile filep;
+	short dbVer;
+	POSITION storedNumPos, i, done = 0;
+	unsigned int chunk;
+	int got = 1, closed;
+
+	if ((filep = gzopen(filename, "rb")) == NULL)
+		return FALSE;
+	if (gzread(filep, &dbVer, sizeof(short)) != sizeof(short) ||
+	    gzread(filep, &storedNumPos, sizeof(POSITION)) != sizeof(POSITION)) {
+		gzclose(filep);
+		return FALSE;
+	}
+	dbVer = ntohs(dbVer);
+	storedNumPos = ntohl(storedNumPos) | (((POSITION) ntohl(storedNumPos >> 32)) << 32);
+	if (storedNumPos != numPos || dbVer != tierdb_FILEVER) {
+		if (kDebugDetermineValue)
+			printf("\n\nError in file decompression: Stored gNumberOfPositions differs from internal gNumberOfPositions\n\n");
+		gzclose(filep);
+		return FALSE;
+	}
+	gzbuffer(filep, 1 << 17);
+	while (done < numPos && got > 0) {
+		chunk = (numPos - done > (1 << 28)) ? (1 << 28) : (unsigned int) (numPos - done);
+		got = gzread(filep, cells + done, chunk * sizeof(tierdb_cellValue));
+		if (got != (int) (chunk * sizeof(tierdb_cellValue)))
+			got = 0;
+		else done += chunk;
+	}
+	closed = gzclose(filep);
+	if (done != numPos || closed != 0) {
+		if (kDebugDetermineValue)
+			printf("\n\nError in file decompression:\ngzread error: %d\ngzclose error: %d\n", got, closed);
+		return FALSE;
+	}
+	for (i = 0; i < numPos; i++)
+		cells[i] = ntohs(cells[i]);
+	return TRUE;
+}
+
+/* Prefetched tier DBs.
+ *
+ * While a tier solves, the retrograde solver asks for the DBs of the next
+ * tier's children (tierdb_prefetch). A background worker decompresses them
+ * into host-order arrays, and tierdb_load_database copies those into the
+ * window instead of reading the files again. A tier that was just saved is
+ * kept the same way, since it is usually a child of the next tier. Entries
+ * stay for later parents until the memory ceiling (--tierprefetch) pushes
+ * out the least recently used ones. */
+
+#define PREFETCH_PENDING        0
+#define PREFETCH_READY          1
+#define PREFETCH_FAILED         2
+
+typedef struct tierdb_prefetch_entry {
+	TIER tier;
+	int variant;
+	POSITION numPos;
+	tierdb_cellValue *cells;
+	int state;
+	unsigned long lastUse;
+	char filename[256];
+	struct tierdb_prefetch_entry *next;
+} TIERDB_PREFETCH;
+
+static TIERDB_PREFETCH *tierdb_prefetched = NULL;
+static pthread_mutex_t tierdb_prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tierdb_prefetch_done = PTHREAD_COND_INITIALIZER;
+static THREADPOOL *tierdb_prefetch_pool = NULL;
+static unsigned long long tierdb_prefetch_bytes = 0;
+static unsigned long tierdb_prefetch_clock = 0;
+
+static unsigned long long tierdb_prefetch_ceiling()
+{
+	long pages, pageSize;
+	if (gTierPrefetchMB >= 0)
+		return (unsigned long long) gTierPrefetchMB << 20;
+	pages = sysconf(_SC_PHYS_PAGES);
+	pageSize = sysconf(_SC_PAGESIZE);
+	if (pages <= 0 || pageSize <= 0)
+		return 256ULL << 20;
+	return (unsigned long long) pages * pageSize / 8;
+}
+
+// Lock held. The entry for TIER in the current variant, if any.
+static TIERDB_PREFETCH* tierdb_prefetch_find(TIER tier)
+{
+	TIERDB_PREFETCH *e;
+	int variant = getOption();
+	for (e = tierdb_prefetched; e != NULL; e = e->next)
+		if (e->tier == tier && e->variant == variant)
+			return e;
+	return NULL;
+}
+
+// Lock held. Unlinks and frees E, which must not be pending.
+static void tierdb_prefetch_drop(TIERDB_PREFETCH *e)
+{
+	TIERDB_PREFETCH **p;
+	for (p = &tierdb_prefetched; *p != e; p = &(*p)->next) ;
+	*p = e->next;
+	if (e->cells != NULL) {
+		SafeFree(e->cells);
+		tierdb_prefetch_bytes -= e->numPos * sizeof(tierdb_cellValue);
+	}
+	SafeFree(e);
+}
+
+// Lock held. Makes room for BYTES more, evicting the least recently used
+// loaded entries; FALSE if that isn't possible.
+static BOOLEAN tierdb_prefetch_reserve(unsigned long long bytes)
+{
+	unsigned long long ceiling = tierdb_prefetch_ceiling();
+	TIERDB_PREFETCH *e, *oldest;
+
+	if (bytes > ceiling)
+		return FALSE;
+	while (tierdb_prefetch_bytes + bytes > ceiling) {
+		oldest = NULL;
+		for (e = tierdb_prefetched; e != NULL; e = e->next)
+			if (e->state != PREFETCH_PENDING && (oldest == NULL || e->lastUse < oldest->lastUse))
+				oldest = e;
+		if (oldest == NULL)
+			return FALSE;
+		tierdb_prefetch_drop(oldest);
+	}
+	tierdb_prefetch_bytes += bytes;
+	return TRUE;
+}
+
+static void tierdb_prefetch_load(void *arg)
+{
+	TIERDB_PREFETCH *e = (TIERDB_PREFETCH *) arg;
+	BOOLEAN ok = tierdb_read_file(e->filename, e->numPos, e->cells);
+
+	pthread_mutex_lock(&tierdb_prefetch_lock);
+	if (!ok) {
+		SafeFree(e->cells);
+		e->cells = NULL;
+		tierdb_prefetch_bytes -= e->numPos * sizeof(tierdb_cellValue);
+	}
+	e->state = ok ? PREFETCH_READY : PREFETCH_FAILED;
+	pthread_cond_broadcast(&tierdb_prefetch_done);
+	pthread_mutex_unlock(&tierdb_prefetch_lock);
+}
+
+/* Starts loading TIER's DB in the background, if it has been solved, isn't
+ * already held, and fits under the ceiling. */
+void tierdb_prefetch(TIER tier)
+{
+	TIERDB_PREFETCH *e;
+	POSITION numPos;
+	char filename[256];
+
+	if (tierdb_prefetch_ceiling() == 0)
+		return;
+	snprintf(filename, sizeof(filename), "./data/m%s_%d_tierdb/m%s_%d_%llu_tierdb.dat.gz",
+	         kDBName, getOption(), kDBName, getOption(), tier);
+	if (access(filename, R_OK) != 0)
+		return;
+	numPos = gNumberOfTierPositionsFunPtr(tier);
+
+	pthread_mutex_lock(&tierdb_prefetch_lock);
+	if ((e = tierdb_prefetch_find(tier)) != NULL) {
+		e->lastUse = ++tierdb_prefetch_clock;
+		pthread_mutex_unlock(&tierdb_prefetch_lock);
+		return;
+	}
+	if (!tierdb_prefetch_reserve(numPos * sizeof(tierdb_cellValue))) {
+		pthread_mutex_unlock(&tierdb_prefetch_lock);
+		return;
+	}
+	e = (TIERDB_PREFETCH *) SafeCalloc(1, sizeof(TIERDB_PREFETCH));
+	e->tier = tier;
+	e->variant = getOption();
+	e->numPos = numPos;
+	e->cells = (tierdb_cellValue *) SafeMalloc((numPos ? numPos : 1) * sizeof(tierdb_cellValue));
+	e->state = PREFETCH_PENDING;
+	e->lastUse = ++tierdb_prefetch_clock;
+	strcpy(e->filename, filename);
+	e->next = tierdb_prefetched;
+	tierdb_prefetched = e;
+	pthread_mutex_unlock(&tierdb_prefetch_lock);
+
+	if (tierdb_prefetch_pool == NULL)
+		tierdb_prefetch_pool = ThreadPoolCreate(1);
+	ThreadPoolSubmit(tierdb_prefetch_pool, tierdb_prefetch_load, e);
+}
+
+/* Copies the held copy of TIER into DEST, waiting for it if it is still
+ * loading. FALSE if there is none, so the caller reads the file itself. */
+BOOLEAN tierdb_prefetch_copy(TIER tier, tierdb_cellValue* dest, POSITION numPos)
+{
+	TIERDB_PREFETCH *e;
+	BOOLEAN found = FALSE;
+
+	pthread_mutex_lock(&tierdb_prefetch_lock);
+	if ((e = tierdb_prefetch_find(tier)) != NULL) {
+		while (e->state == PREFETCH_PENDING)
+			pthread_cond_wait(&tierdb_prefetch_done, &tierdb_prefetch_lock);
+		if (e->state == PREFETCH_READY && e->numPos == numPos) {
+			memcpy(dest, e->cells, numPos * sizeof(tierdb_cellValue));
+			e->lastUse = ++tierdb_prefetch_clock;
+			found = TRUE;
+		} else tierdb_prefetch_drop(e);
+	}
+	pthread_mutex_unlock(&tierdb_prefetch_lock);
+	return found;
+}
+
+/* Holds a copy of a tier that was just written, replacing any older one. */
+void tierdb_prefetch_keep(TIER tier, tierdb_cellValue* src, POSITION numPos)
+{
+	TIERDB_PREFETCH *e;
+
+	if (tierdb_prefetch_ceiling() == 0)
+		return;
+	pthread_mutex_lock(&tierdb_prefetch_lock);
+	if ((e = tierdb_prefetch_find(tier)) != NULL) {
+		while (e->state == PREFETCH_PENDING)
+			pthread_cond_wait(&tierdb_prefetch_done, &tierdb_prefetch_lock);
+		tierdb_prefetch_drop(e);
+	}
+	if (tierdb_prefetch_reserve(numPos * sizeof(tierdb_cellValue))) {
+		e = (TIERDB_PREFETCH *) SafeCalloc(1, sizeof(TIERDB_PREFETCH));
+		e->tier = tier;
+		e->variant = getOption();
+		e->numPos = numPos;
+		e->cells = (tierdb_cellValue *) SafeMalloc((numPos ? numPos : 1) * sizeof(tierdb_cellValue));
+		memcpy(e->cells, src, numPos * sizeof(tierdb_cellValue));
+		e->state = PREFETCH_READY;
+		e->lastUse = ++tierdb_prefetch_clock;
+		e->next = tierdb_prefetched;
+		tierdb_prefetched = e;
+	}
+	pthread_mutex_unlock(&tierdb_prefetch_lock);
+}
+
 /* A helper to solveretrograde which simply checks for the existance of a DB.
  * Error Codes: 0 = Doesn't exist, -1 = Incorrect/corrupted, 1 = Exists. */
 int CheckTierDB(TIER tier, int variant) {
@@ -5,7 +5,10 @@
 void    tierdb_init     (DB_Table*);
 BOOLEAN tierdb_reinit (DB_Table*);
 void tierdb_free_childpositions();
+BOOLEAN tierdb_checkpoint_save (FILE*);
+BOOLEAN tierdb_checkpoint_load (FILE*);
 int CheckTierDB     (TIER, int);
 BOOLEAN tierdb_load_minifile (char*);
+void tierdb_prefetch (TIER);
 
 #endif /* GMCORE_TIERDB_H */
@@ -38,6 +38,7 @@
 #include "db.h"
 #include "misc.h"
 #include "openPositions.h"
+#include "threadpool.h"
 #include "visualization.h"
 
 
@@ -49,68 +50,62 @@
  * Local Variables
  */
 FILE *DOTFile;
-EDGELIST GameTree = { NULL, NULL, NULL, 0, NULL, NULL, NULL, 0 }; // Initialize struct members to NULL
+EDGELIST GameTree = { 0, NULL, NULL, 0, NULL, 0 }; // Initialize struct members to NULL
 BOOLEAN ranklistSet;
 
+/*
+ * Edges are never stored for the whole graph. Each level file is written
+ * by scanning the parents VIS_CHUNK_POSITIONS at a time, a batch of
+ * chunks per round: the chunks generate their edges (in parallel with
+ * --threads when the module passes ParallelSolveSafe), then the edges are
+ * written in parent order and the chunk buffers are reused, so memory is
+ * bounded by one batch.
+ */
+typedef struct vis_chunk {
+	EDGELIST *tree;
+	POSITION first, last;
+	int level;
+	EDGE *edges;
+	POSITION numEdges, capacity;
+} VISCHUNK;
+
+#define VisBit(bits, pos)       ((bits)[(pos) >> 3] & (1 << ((pos) & 7)))
+
 /**
  * Code
  */
 
 BOOLEAN PrepareTree(EDGELIST *tree) {
-	int level;
-
 	tree->NumberOfLevels = 1;
 	tree->maxRank = 0;
-	tree->edges = (EDGE **) SafeMalloc(tree->NumberOfLevels*sizeof(EDGE *));
-	tree->edgesPerLevel = (POSITION *) SafeMalloc(tree->NumberOfLevels*sizeof(POSITION));
-	tree->nextEdgeInLevel = (POSITION *) SafeMalloc(tree->NumberOfLevels*sizeof(POSITION));
-
-	for(level = 0; level < tree->NumberOfLevels; level++) {
-		tree->edgesPerLevel[level] = INI_EDGES_PER_LEVEL;
-		tree->nextEdgeInLevel[level] = 0;
-		tree->edges[level] = (EDGE *) SafeMalloc(INI_EDGES_PER_LEVEL*sizeof(EDGE));
-		memset((tree->edges)[level], 0, INI_EDGES_PER_LEVEL*sizeof(EDGE));
-	}
+	tree->parents = NULL;
 
 	PrepareRankList(tree);
 	UnMarkAllAsVisited();
 	return TRUE;
 }
 
+/* Nodes of each rank are spilled to a temporary file until the level is
+   written out, instead of being kept in memory */
 BOOLEAN PrepareRankList(EDGELIST *tree) {
 	REMOTENESS currentRemoteness;
 
 	if(ranklistSet) {
-		if(tree->nodeRanks != NULL) {
-			for(currentRemoteness = 0; currentRemoteness < REMOTENESS_MAX+2; currentRemoteness++) {
-				SafeFree(tree->nodeRanks[currentRemoteness]);
+		for(currentRemoteness = 0; currentRemoteness < REMOTENESS_MAX+2; currentRemoteness++) {
+			if(tree->rankFiles[currentRemoteness] != NULL) {
+				fclose(tree->rankFiles[currentRemoteness]);
 			}
-			SafeFree(tree->nodeRanks);
-		}
-
-		if(tree->nodesPerRank != NULL) {
-			SafeFree(tree->nodesPerRank);
-		}
-
-		if(tree->nextNodeInRank != NULL) {
-			SafeFree(tree->nextNodeInRank);
 		}
+		SafeFree(tree->rankFiles);
+		SafeFree(tree->nextNodeInRank);
 		ranklistSet = FALSE;
 	}
 
-	tree->nodeRanks = (POSITION **) SafeMalloc((REMOTENESS_MAX+2)*sizeof(POSITION *));
-	tree->nodesPerRank = (POSITION *) SafeMalloc((REMOTENESS_MAX+2)*sizeof(POSITION));
+	tree->rankFiles = (FILE **) SafeMalloc((REMOTENESS_MAX+2)*sizeof(FILE *));
 	tree->nextNodeInRank = (POSITION *) SafeMalloc((REMOTENESS_MAX+2)*sizeof(POSITION));
 
 	for(currentRemoteness = 0; currentRemoteness < REMOTENESS_MAX+2; currentRemoteness++) {
-		// Don't want to allocate space that will probably end up wasted
-		if(currentRemoteness < 15) {
-			tree->nodeRanks[currentRemoteness] = (POSITION *) SafeMalloc(1000*sizeof(POSITION));
-			tree->nodesPerRank[currentRemoteness] = 1000;
-		} else {
-			tree->nodeRanks[currentRemoteness] = (POSITION *) SafeMalloc(1*sizeof(POSITION));
-			tree->nodesPerRank[currentRemoteness] = 1;
-		}
+		tree->rankFiles[currentRemoteness] = NULL;
 		tree->nextNodeInRank[currentRemoteness] = 0;
 	}
 	ranklistSet = TRUE;
@@ -118,66 +113,33 @@ BOOLEAN PrepareRankList(EDGELIST *tree) {
 }
 
 void CleanupTree(EDGELIST *tree) {
-	int level;
 	REMOTENESS currentRemoteness;
 
-	SafeFree(tree->edgesPerLevel);
-	SafeFree(tree->nextEdgeInLevel);
-	SafeFree(tree->nodesPerRank);
-	SafeFree(tree->nextNodeInRank);
-
-	for(level = 0; level < tree->NumberOfLevels; level++) {
-		SafeFree(tree->edges[level]);
-	}
-
 	for(currentRemoteness = 0; currentRemoteness < REMOTENESS_MAX+2; currentRemoteness++) {
-		SafeFree(tree->nodeRanks[currentRemoteness]);
+		if(tree->rankFiles[currentRemoteness] != NULL) {
+			fclose(tree->rankFiles[currentRemoteness]);
+		}
 	}
 
-	SafeFree(tree->nodeRanks);
-	SafeFree(tree->edges);
+	SafeFree(tree->rankFiles);
+	SafeFree(tree->nextNodeInRank);
+	if(tree->parents != NULL) {
+		SafeFree(tree->parents);
+		tree->parents = NULL;
+	}
 	ranklistSet = FALSE;
 	UnMarkAllAsVisited();
 }
 
-void ResizeTree(EDGELIST *tree, int newSize) {
-	//printf("\nResizing tree\n");
-	//printf("Current size: %d, new size: %d\n", tree->NumberOfLevels, newSize+1);
-	int level;
-	tree->edges = (EDGE **) SafeRealloc(tree->edges, (newSize+1) * sizeof(EDGE *));
-	tree->edgesPerLevel = (POSITION *) SafeRealloc(tree->edgesPerLevel, (newSize+1) * sizeof(POSITION));
-	tree->nextEdgeInLevel = (POSITION *) SafeRealloc(tree->nextEdgeInLevel, (newSize+1) * sizeof(POSITION));
-
-	for(level = tree->NumberOfLevels; level < (newSize+1); level++) {
-		tree->edges[level] = (EDGE *) SafeMalloc(INI_EDGES_PER_LEVEL*sizeof(EDGE));
-		tree->edgesPerLevel[level] = INI_EDGES_PER_LEVEL;
-		tree->nextEdgeInLevel[level] = 0;
-	}
-
-	tree->NumberOfLevels = newSize+1;
-	//printf("Done resizing tree\n");
-}
-
 void Visualize() {
 	printf("\nGenerating visualization for %s...", kDBName);
 	Stopwatch();
 
-	//printf("\nPreparing tree");
 	PrepareTree(&GameTree);
-
-	//printf("\nPreparing file");
 	PrepareDOTFile();
-
-	//printf("\nFilling tree");
-	PopulateEdgelist(&GameTree);
-
-	//printf("\nWriting file");
+	PrepareLevels(&GameTree);
 	Write(DOTFile, &GameTree);
-
-	//printf("\nClosing file");
 	CloseDOTFile(DOTFile);
-
-	//printf("\nCleaning up tree");
 	CleanupTree(&GameTree);
 
 	printf("done in %u seconds!", Stopwatch());
@@ -186,65 +148,192 @@ void Visualize() {
 	return;
 }
 
-void PopulateEdgelist(EDGELIST *tree) {
-	int level;
-	POSITION parent, child;
-	MOVELIST *childMoves;
-	MOVE theMove;
-	OPEN_POS_DATA pdata, cdata;
-	int resizeCount = 0;
-	int resizeLevelCount = 0;
+static int VisParentLevel(POSITION parent) {
+	if(kLoopy && gUseOpen) {
+		return GetLevelNumber(GetOpenData(parent));
+	}
+	return 0;
+}
 
-	if(!kLoopy || !gUseOpen)
-		level = 0;
+/* Keeps a fixed, reproducible gVisSampleRate fraction of the parents */
+static BOOLEAN VisSampled(POSITION parent) {
+	uint64_t h = (uint64_t) parent + 0x9E3779B97F4A7C15ULL;
 
-	for(parent=0; parent < gNumberOfPositions; parent++) {
-		if(GetValueOfPosition(parent) == undecided &&
-		   Remoteness(parent) != REMOTENESS_MAX) {
-			continue;
-		}
+	if(gVisSampleRate >= 1.0) {
+		return TRUE;
+	}
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return (double) (h >> 11) < gVisSampleRate * 9007199254740992.0; /* 2^53 */
+}
+
+/* Whether the edges out of PARENT belong in the graph (in LEVEL's file,
+   or in any file when LEVEL is negative) */
+static BOOLEAN VisIncludeParent(EDGELIST *tree, POSITION parent, int level) {
+	if(GetValueOfPosition(parent) == undecided &&
+	   Remoteness(parent) != REMOTENESS_MAX) {
+		return FALSE;
+	}
+	if(level >= 0 && VisParentLevel(parent) != level) {
+		return FALSE;
+	}
+	if(!VisSampled(parent) || (tree->parents != NULL && !VisBit(tree->parents, parent))) {
+		return FALSE;
+	}
+	return Primitive(parent) == undecided;
+}
+
+static void VisChunkPush(VISCHUNK *chunk, POSITION parent, POSITION child) {
+	if(chunk->numEdges == chunk->capacity) {
+		chunk->capacity = chunk->capacity ? 2*chunk->capacity : 1024;
+		chunk->edges = chunk->edges ? (EDGE *) SafeRealloc(chunk->edges, chunk->capacity*sizeof(EDGE)) : (EDGE *) SafeMalloc(chunk->capacity*sizeof(EDGE));
+	}
+	chunk->edges[chunk->numEdges].Parent = parent;
+	chunk->edges[chunk->numEdges].Child = child;
+	chunk->numEdges++;
+}
+
+/* task: edges out of the chunk's parents in chunk->level */
+static void VisChunkEdges(void *arg) {
+	VISCHUNK *chunk = (VISCHUNK *) arg;
+	POSITION parent;
+	MOVELIST *childMoves, *ptr;
 
-		if(Primitive(parent) != undecided) {
+	for(parent = chunk->first; parent < chunk->last; parent++) {
+		if(!VisIncludeParent(chunk->tree, parent, chunk->level)) {
 			continue;
-		} else {
-			childMoves = GenerateMoves(parent);
 		}
+		childMoves = GenerateMoves(parent);
+		for(ptr = childMoves; ptr != NULL; ptr = ptr->next) {
+			VisChunkPush(chunk, parent, DoMove(parent, ptr->move));
+		}
+		FreeMoveList(childMoves);
+	}
+}
 
-		while(1) {
-			theMove = childMoves->move;
-			child = DoMove(parent, theMove);
+/* task: one breadth-first step of the depth limit. Children of the chunk's
+   frontier positions that have not been reached go to the next frontier;
+   the edge buffer is reused to hand back the parents it expanded */
+static void VisChunkExpand(void *arg) {
+	VISCHUNK *chunk = (VISCHUNK *) arg;
+	EDGELIST *tree = chunk->tree;
+	unsigned char *frontier = tree->parents + tree->bitsetSize;
+	unsigned char *next = frontier + tree->bitsetSize;
+	POSITION parent, child;
+	MOVELIST *childMoves, *ptr;
 
-			if(kLoopy && gUseOpen) {
-				pdata = GetOpenData(parent);
-				cdata = GetOpenData(child);
-				level = GetLevelNumber(pdata);
+	for(parent = chunk->first; parent < chunk->last; parent++) {
+		if(!VisBit(frontier, parent) || Primitive(parent) != undecided) {
+			continue;
+		}
+		childMoves = GenerateMoves(parent);
+		for(ptr = childMoves; ptr != NULL; ptr = ptr->next) {
+			child = DoMove(parent, ptr->move);
+			if(!VisBit(tree->parents, child)) {
+				__atomic_fetch_or(&next[child >> 3], (unsigned char) (1 << (child & 7)), __ATOMIC_RELAXED);
 			}
+		}
+		FreeMoveList(childMoves);
+	}
+}
 
-			/* If the level is more than the number in tree, resize to handle more levels */
+static void VisRunChunks(THREADPOOL *pool, THREADTASK task, VISCHUNK *chunks, int numChunks) {
+	int c;
+	for(c = 0; c < numChunks; c++) {
+		chunks[c].numEdges = 0;
+		if(pool) ThreadPoolSubmit(pool, task, &chunks[c]);
+		else task(&chunks[c]);
+	}
+	if(pool) ThreadPoolWait(pool);
+}
 
-			if(level > (GameTree.NumberOfLevels - 1)) {
-				resizeCount++;
-				ResizeTree(&GameTree, level);
-			}
+/* Runs TASK over every position, a batch of chunks at a time, handing
+   each chunk to WRITECHUNK (if any) in position order after its batch */
+static void VisForEachChunk(EDGELIST *tree, int level, THREADTASK task, FILE *fp,
+                            void (*writeChunk)(FILE *, EDGELIST *, int, VISCHUNK *)) {
+	int numThreads = (gNumThreads > 0 && ParallelSolveSafe()) ? gNumThreads : 1;
+	int numChunks = numThreads * 4, batch, c;
+	THREADPOOL *pool = (numThreads > 1) ? ThreadPoolCreate(numThreads) : NULL;
+	VISCHUNK *chunks = (VISCHUNK *) SafeMalloc(numChunks*sizeof(VISCHUNK));
+	POSITION first = 0;
+
+	memset(chunks, 0, numChunks*sizeof(VISCHUNK));
+	while(first < gNumberOfPositions) {
+		for(batch = 0; batch < numChunks && first < gNumberOfPositions; batch++) {
+			chunks[batch].tree = tree;
+			chunks[batch].level = level;
+			chunks[batch].first = first;
+			first += VIS_CHUNK_POSITIONS;
+			chunks[batch].last = (first < gNumberOfPositions) ? first : gNumberOfPositions;
+		}
+		VisRunChunks(pool, task, chunks, batch);
+		for(c = 0; writeChunk != NULL && c < batch; c++) {
+			writeChunk(fp, tree, level, &chunks[c]);
+		}
+	}
 
-			(((GameTree.edges)[level])[(GameTree.nextEdgeInLevel)[level]]).Parent = parent;
-			(((GameTree.edges)[level])[(GameTree.nextEdgeInLevel)[level]]).Child = child;
-			(GameTree.nextEdgeInLevel)[level] += 1;
+	ThreadPoolDestroy(pool);
+	for(c = 0; c < numChunks; c++) {
+		if(chunks[c].edges != NULL) {
+			SafeFree(chunks[c].edges);
+		}
+	}
+	SafeFree(chunks);
+}
 
-			/* Resize an individual level if no room left */
+/* With gVisDepthLimit >= 0, only positions fewer than that many moves
+   from the initial position keep their edges: find them breadth-first */
+static void PrepareDepthLimit(EDGELIST *tree) {
+	unsigned char *frontier, *next;
+	POSITION i;
+	int depth;
+	BOOLEAN grew = TRUE;
+
+	tree->bitsetSize = (gNumberOfPositions + 7) / 8;
+	tree->parents = (unsigned char *) SafeMalloc(3*tree->bitsetSize);
+	memset(tree->parents, 0, 3*tree->bitsetSize);
+	frontier = tree->parents + tree->bitsetSize;
+	next = frontier + tree->bitsetSize;
+	frontier[gInitialPosition >> 3] |= 1 << (gInitialPosition & 7);
+
+	for(depth = 0; depth < gVisDepthLimit && grew; depth++) {
+		for(i = 0; i < tree->bitsetSize; i++) {
+			tree->parents[i] |= frontier[i];
+		}
+		if(depth == gVisDepthLimit - 1) {
+			break;
+		}
+		VisForEachChunk(tree, 0, VisChunkExpand, NULL, NULL);
+		for(i = 0, grew = FALSE; i < tree->bitsetSize; i++) {
+			next[i] &= ~tree->parents[i];
+			frontier[i] = next[i];
+			next[i] = 0;
+			grew |= (frontier[i] != 0);
+		}
+	}
+	tree->parents = (unsigned char *) SafeRealloc(tree->parents, tree->bitsetSize);
+}
 
-			if(((GameTree.edgesPerLevel)[level] - 2) <= (GameTree.nextEdgeInLevel)[level]) {
-				resizeLevelCount++;
-				(GameTree.edges)[level] = SafeRealloc((GameTree.edges)[level], (GameTree.edgesPerLevel)[level] * 2 * sizeof(EDGE));
-				(GameTree.edgesPerLevel)[level] = (GameTree.edgesPerLevel)[level] * 2;
-			}
+/* Finds how many level files there are (and the depth-limited parents);
+   the edges themselves are generated while each level is written */
+void PrepareLevels(EDGELIST *tree) {
+	POSITION parent;
+	int level;
+
+	if(gVisDepthLimit >= 0) {
+		PrepareDepthLimit(tree);
+	}
 
-			if((childMoves = childMoves->next) == NULL) {
-				break;
+	tree->NumberOfLevels = 1;
+	if(kLoopy && gUseOpen) {
+		for(parent = 0; parent < gNumberOfPositions; parent++) {
+			level = VisParentLevel(parent);
+			if(level > tree->NumberOfLevels - 1 && VisIncludeParent(tree, parent, level)) {
+				tree->NumberOfLevels = level + 1;
 			}
 		}
 	}
-	//printf("Levels resized: %d, tree resized: %d\n", resizeLevelCount, resizeCount);
 }
 
 void Write(FILE *fp, EDGELIST *tree) {
@@ -261,11 +350,26 @@ void Write(FILE *fp, EDGELIST *tree) {
 	 */
 }
 
+static void WriteChunkEdges(FILE *fp, EDGELIST *tree, int level, VISCHUNK *chunk) {
+	POSITION currentEdge;
+	EDGE theEdge;
+
+	for(currentEdge = 0; currentEdge < chunk->numEdges; currentEdge++) {
+		theEdge = chunk->edges[currentEdge];
+		WriteNode(fp, theEdge.Parent, level, tree);
+		WriteNode(fp, theEdge.Child, level, tree);
+
+		fprintf(fp, "\t\t%llu -> %llu [color = \"%s\"]\n", theEdge.Parent, theEdge.Child, MoveColor(theEdge));
+	}
+}
+
+void WriteEdges(FILE *fp, EDGELIST *tree, int currentLevel) {
+	VisForEachChunk(tree, currentLevel, VisChunkEdges, fp, WriteChunkEdges);
+}
+
 void WriteLevel(EDGELIST *tree, int currentLevel) {
 	FILE *fp;
-	POSITION currentEdge;
 	char filename[80];
-	EDGE theEdge;
 
 	sprintf(filename, "visualization/m%s/m%s_%d_level_%d_vis.dot", kDBName, kDBName, getOption(), currentLevel);
 	fp = fopen(filename, "w+");
@@ -314,13 +418,7 @@ void WriteLevel(EDGELIST *tree, int currentLevel) {
 	fprintf(fp, "\t\t\t}\n");
 	fprintf(fp, "\t\t}\n");
 
-	for(currentEdge = 0; currentEdge < (tree->nextEdgeInLevel)[currentLevel]; currentEdge++) {
-		theEdge = (tree->edges)[currentLevel][currentEdge];
-		WriteNode(fp, theEdge.Parent, currentLevel, tree);
-		WriteNode(fp, theEdge.Child, currentLevel, tree);
-
-		fprintf(fp, "\t\t%llu -> %llu [color = \"%s\"]\n", theEdge.Parent, theEdge.Child, MoveColor(theEdge));
-	}
+	WriteEdges(fp, tree, currentLevel);
 
 	if(gRemotenessOrder) {
 		WriteRanks(fp, tree);
@@ -406,44 +504,48 @@ void WriteNode(FILE *fp, POSITION node, int level, EDGELIST *tree) {
 	}
 }
 
+static void WriteRank(FILE *fp, EDGELIST *tree, REMOTENESS rank) {
+	FILE *rankFile = tree->rankFiles[rank];
+	POSITION currentNode, node;
+
+	if(rankFile == NULL) {
+		return;
+	}
+	rewind(rankFile);
+	for(currentNode = 0; currentNode < tree->nextNodeInRank[rank]; currentNode++) {
+		if(fread(&node, sizeof(POSITION), 1, rankFile) != 1) {
+			break;
+		}
+		fprintf(fp, "%llu; ", node);
+	}
+}
+
 void WriteRanks(FILE *fp, EDGELIST *tree) {
 	REMOTENESS currentRank;
-	POSITION currentNode;
 
 	for(currentRank = 0; currentRank < tree->maxRank+1; currentRank++) {
 		fprintf(fp, "\t\t{ rank = \"same\"; ");
-		for(currentNode = 0; currentNode < tree->nextNodeInRank[currentRank]; currentNode++) {
-			fprintf(fp, "%llu; ", tree->nodeRanks[currentRank][currentNode]);
-		}
+		WriteRank(fp, tree, currentRank);
 		fprintf(fp, "}\n");
 	}
 
 	fprintf(fp, "\t\t{ rank = \"min\"; ");
-	for(currentNode = 0; currentNode < tree->nextNodeInRank[REMOTENESS_MAX]; currentNode++) {
-		fprintf(fp, "%llu; ", tree->nodeRanks[REMOTENESS_MAX][currentNode]);
-	}
+	WriteRank(fp, tree, REMOTENESS_MAX);
 	fprintf(fp, "}\n");
 
 	fprintf(fp, "\t\t{ rank = \"max\"; ");
-	for(currentNode = 0; currentNode < tree->nextNodeInRank[REMOTENESS_MAX+1]; currentNode++) {
-		fprintf(fp, "%llu; ", tree->nodeRanks[REMOTENESS_MAX+1][currentNode]);
-	}
+	WriteRank(fp, tree, REMOTENESS_MAX+1);
 	fprintf(fp, "}\n");
 }
 
 void UpdateRankList(EDGELIST *tree, POSITION node, REMOTENESS nodeRemoteness) {
-	tree->nodeRanks[nodeRemoteness][tree->nextNodeInRank[nodeRemoteness]] = node;
-	tree->nextNodeInRank[nodeRemoteness] += 1;
-
-	if(tree->nextNodeInRank[nodeRemoteness] >= tree->nodesPerRank[nodeRemoteness]) {
-		if(tree->nodesPerRank[nodeRemoteness] < 1000) {
-			tree->nodeRanks[nodeRemoteness] = SafeRealloc(tree->nodeRanks[nodeRemoteness],1000*sizeof(POSITION));
-			tree->nodesPerRank[nodeRemoteness] = 1000;
-		} else {
-			tree->nodeRanks[nodeRemoteness] = SafeRealloc(tree->nodeRanks[nodeRemoteness],tree->nodesPerRank[nodeRemoteness]*2*sizeof(POSITION));
-			tree->nodesPerRank[nodeRemoteness] = tree->nodesPerRank[nodeRemoteness]*2;
-		}
+	if(tree->rankFiles[nodeRemoteness] == NULL &&
+	   (tree->rankFiles[nodeRemoteness] = tmpfile()) == NULL) {
+		printf("\nFailed to open temporary file for node ranks!");
+		exit(0);
 	}
+	fwrite(&node, sizeof(POSITION), 1, tree->rankFiles[nodeRemoteness]);
+	tree->nextNodeInRank[nodeRemoteness] += 1;
 
 	if(nodeRemoteness > tree->maxRank && nodeRemoteness < REMOTENESS_MAX) {
 		tree->maxRank = nodeRemoteness;
@@ -1,7 +1,7 @@
 #ifndef GMCORE_VISUALIZATION_H
 #define GMCORE_VISUALIZATION_H
 
-#define INI_EDGES_PER_LEVEL 1000
+#define VIS_CHUNK_POSITIONS 4096     // parents per unit of edge generation
 
 #define LOSE_COLOR "#8B0000"
 #define WIN_COLOR  "#00FF00"
@@ -19,14 +19,12 @@ typedef struct tree_edge
 
 typedef struct edge_list
 {
-	EDGE **edges;
-	POSITION *edgesPerLevel;
-	POSITION *nextEdgeInLevel;
 	int NumberOfLevels;
-	POSITION **nodeRanks;
+	FILE **rankFiles;               // nodes of each rank, spilled until written
 	POSITION *nextNodeInRank;
-	POSITION *nodesPerRank;
 	REMOTENESS maxRank;
+	unsigned char *parents;         // depth-limited parents bitset (NULL = all)
+	POSITION bitsetSize;
 } EDGELIST;
 
 /* Public functions */
@@ -43,8 +41,9 @@ STRING PositionColor(POSITION);
 STRING PositionShape(POSITION);
 STRING PositionValue(POSITION);
 STRING MoveColor(EDGE);
-void PopulateEdgelist(EDGELIST *);
+void PrepareLevels(EDGELIST *);
 void WriteLevel(EDGELIST *, int);
+void WriteEdges(FILE *, EDGELIST *, int);
 void WriteNode(FILE *, POSITION, int, EDGELIST *);
 void WriteRanks(FILE *, EDGELIST *);
 void WriteBoards();
@@ -2,10 +2,11 @@ import sys
 import pygamesman
 from pygamesman import export
 
-win = 0
-lose = 1
-tie = 2
-undecided = 3
+# Must match VALUE in core/types.h
+undecided = 0
+win = 1
+lose = 2
+tie = 3
 
 class Game:
 	
@@ -40,6 +41,25 @@ class Game:
 
 	def call(self, name, *args):
 		return apply(getattr(self, name), args)
+
+	# The solver asks for many positions per call. Returns the primitive
+	# value of each position, the number of moves of each undecided one,
+	# and all of those moves and their children as flat lists. Override
+	# this to expand a whole batch at once.
+	def Expand(self, positions):
+		primitives, counts, moves, children = [], [], [], []
+		for position in positions:
+			value = self.Primitive(position)
+			primitives.append(value)
+			if value == undecided:
+				positionMoves = self.GenerateMoves(position)
+				counts.append(len(positionMoves))
+				for move in positionMoves:
+					moves.append(move)
+					children.append(self.DoMove(position, move))
+			else:
+				counts.append(0)
+		return primitives, counts, moves, children
 	
 	def InitializeGame(self):
 		pass
@@ -130,6 +130,7 @@ STRING MoveToString(MOVE);
 
 void InitializeGame()
 {
+	kReentrant = TRUE;
 	gMoveToStringFunPtr = &MoveToString;
 }
 
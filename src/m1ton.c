@@ -110,6 +110,7 @@ STRING gGameSpecificMenu = "1.\tSet the value of N\n  \t(the target ending sum.\
 
 void InitializeGame()
 {
+	kReentrant = TRUE;
 	gNumberOfPositions = N + 1;
 	gMoveToStringFunPtr = &MoveToString;
 }
@@ -166,6 +166,7 @@ MOVE SlotsToMove(SLOT fromSlot, SLOT toSlot);
 ************************************************************************/
 
 void InitializeGame() {
+	kReentrant = TRUE;
 	gMoveToStringFunPtr = &MoveToString;
 }
 
@@ -59,6 +59,9 @@ STRING kHelpExample = "";
 
 POSITION GetCanonicalPosition(POSITION);
 STRING MoveToString(MOVE);
+POSITION ShardHash(POSITION);
+POSITION ShardUnhash(POSITION);
+int ShardChildren(POSITION, POSITION**);
 
 int ROWCOUNT = 6;
 int COLUMNCOUNT = 6;
@@ -91,6 +94,10 @@ void SetTclCGameSpecificOptions(int theOptions[]) {
 
 void InitializeGame() {
   kSupportsShardGamesman = TRUE;
+  gShardHashLength = (ROWCOUNT + 1) * COLUMNCOUNT;
+  gShardHashFunPtr = &ShardHash;
+  gShardUnhashFunPtr = &ShardUnhash;
+  gShardChildrenFunPtr = &ShardChildren;
   gCanonicalPosition = GetCanonicalPosition;
   gMoveToStringFunPtr = &MoveToString;
   
@@ -210,9 +217,113 @@ static BOOLEAN isawin(POSITION position, POSITION pieces)
 ************************************************************************/
 
 VALUE Primitive(POSITION position) {
+  POSITION origpos = position;
+  int mostrecentmove = (position >> 55) & 0xFF;
+  if ((position & ((1ULL << ((ROWCOUNT + 1) * COLUMNCOUNT)) - 1)) == INITIALPOSITION) {
+    return undecided; // No move has been made yet
+  }
+  if ((position & 0x8000000000000000L) == 0) { // Check wins of 1s
+    for (int i = 0; i < COLUMNCOUNT; i++) {
+      int start = (ROWCOUNT + 1) * (i + 1) - 1;
+      while ((position & (1ULL << start)) == 0) start--;
+      position ^= (1ULL << start);
+    }
+  } else { // Check wins of 0s
+    for (int i = 0; i < COLUMNCOUNT; i++) {
+      int start = (ROWCOUNT + 1) * (i + 1) - 1;
+      int start2 = start + 1;
+      while ((position & (1ULL << start)) == 0) start--;
+      position |= (1ULL << start2) - (1ULL << start);
+    }
+    position = ~position;
+  }
+  position &= (1ULL << (COLUMNCOUNT * (ROWCOUNT + 1))) - 1;
+  // At this point, the position should contain 1s only on the places that match the most recent move.
+  int x = mostrecentmove / (ROWCOUNT + 1), y = mostrecentmove % (ROWCOUNT + 1);
+  if ((y >= CONNECT - 1) && isawin(position, VERTICALWIN << (mostrecentmove - (CONNECT - 1)))) return lose;
+  for (int i = 0; i < CONNECT; i++) {
+    if (x >= i && (x + ((CONNECT - 1) - i)) < COLUMNCOUNT) {
+      if (isawin(position, HORIZONTALWIN << (mostrecentmove - i * (ROWCOUNT + 1)))) return lose;
+      if (y >= i && (y + ((CONNECT - 1) - i)) < ROWCOUNT) {
+        if (isawin(position, UPDIAGWIN << (mostrecentmove - i * (ROWCOUNT + 2)))) return lose;
+      }
+      if (y + i < ROWCOUNT && (y - ((CONNECT - 1) - i)) >= 0) {
+        if (isawin(position, DOWNDIAGWIN << (mostrecentmove - i * (ROWCOUNT)))) return lose;
+      }
+    }
+  }
+  if ((origpos & (INITIALPOSITION << ROWCOUNT)) == INITIALPOSITION << ROWCOUNT) return tie;
   return undecided;
 }
 
+/************************************************************************
+**
+** Shard solver hooks (see core/solveshard.h). The board bits are the
+** hash: a move only ever adds to a column, so children hash higher.
+**
+************************************************************************/
+
+POSITION ShardHash(POSITION position) {
+  return position & ((1ULL << ((ROWCOUNT + 1) * COLUMNCOUNT)) - 1);
+}
+
+POSITION ShardUnhash(POSITION hash) {
+  int emptyspots = 0;
+  for (int j = 0; j < COLUMNCOUNT; j++) {
+    for (int i = ROWCOUNT; i >= 0; i--) {
+      if ((hash & (1ULL << (j * (ROWCOUNT + 1) + i))) == 0) emptyspots++;
+      else break;
+    }
+  }
+  return hash | ((POSITION) ((ROWCOUNT * COLUMNCOUNT - emptyspots) % 2)) << 63;
+}
+
+/* Shards reachable in one move: the shard id is the top columns of the
+** board, so only a move into one of those columns changes the shard. */
+int ShardChildren(POSITION parentshard, POSITION **childrenshards) {
+  int id_size = (ROWCOUNT + 1) * COLUMNCOUNT - gShardSize;
+  int full_cols = id_size / (ROWCOUNT + 1);
+  int remainders = id_size % (ROWCOUNT + 1);
+  int length = 0;
+
+  // Count the number of non-full whole columns
+  for (int i = 0; i < full_cols; i++) {
+    if (!(parentshard & (1ULL << (id_size - 1 - (ROWCOUNT + 1) * i)))) {
+      length += 2;
+    }
+  }
+  if (remainders) {
+    // Count the moves in the partial column
+    POSITION filter = (1ULL << remainders) - 1;
+    if (!(parentshard & (1ULL << (remainders - 1)))) {
+      length += (parentshard & filter) ? 2 : 1;
+    }
+  }
+  POSITION *children = (POSITION *) SafeMalloc((length + 1) * sizeof(POSITION));
+  int allocatedchildren = 0;
+  int columnremainingbits = ROWCOUNT + 1;
+  for (int i = id_size - 1; i >= 0;) {
+    if (parentshard & (1ULL << i)) {
+      if (columnremainingbits != ROWCOUNT + 1) {
+        children[allocatedchildren] = parentshard + (1ULL << i);
+        children[allocatedchildren + 1] = parentshard + (1ULL << (i + 1));
+        allocatedchildren += 2;
+      }
+      i -= columnremainingbits;
+      columnremainingbits = ROWCOUNT + 1;
+    } else {
+      columnremainingbits--;
+      i--;
+    }
+  }
+  if (allocatedchildren < length) {
+    children[allocatedchildren] = parentshard + 1;
+    allocatedchildren++;
+  }
+  *childrenshards = children;
+  return length;
+}
+
 /************************************************************************
 **
 ** NAME: PrintPosition
@@ -436,6 +547,7 @@ void setOption(int option) {
   INITIALPOSITION = l;
 
   gInitialPosition = INITIALPOSITION;
+  gShardHashLength = (ROWCOUNT + 1) * COLUMNCOUNT;
 }
 
 POSITION InteractStringToPosition(STRING str) {
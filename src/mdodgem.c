@@ -163,17 +163,28 @@ int g3Array[] =          { 1, 3, 9, 27, 81, 243, 729, 2187, 6561 };
 
 BOOLEAN gToTrapIsToWin = FALSE;  /* Being stuck is when you can't move. */
 
+/* Global position solver variables. */
+struct {
+	BlankOX board[BOARDSIZE];
+	BlankOX whosTurn;
+} gPosition;
+
 /** Function Prototypes */
 void PositionToBlankOX(POSITION thePos, BlankOX *theBlankOX, BlankOX *whosTurn);
 void MoveToSlots(MOVE theMove, SLOT *fromSlot, SLOT *toSlot);
 MOVE SlotsToMove (SLOT fromSlot, SLOT toSlot);
 SLOT GetToSlot(SLOT fromSlot, int direction,BlankOX whosTurn);
+void UndoMove(MOVE theMove);
+void SetGPSPosition(POSITION thePosition);
 
 STRING MToS (MOVE);
 
 void InitializeGame()
 {
 	gMoveToStringFunPtr = &MToS;
+	SetGPSPosition(gInitialPosition);
+	gUndoMove = UndoMove;
+	gSetGPSPosition = SetGPSPosition;
 }
 
 void FreeGame()
@@ -281,9 +292,18 @@ MOVE theMove;
 	SLOT fromSlot, toSlot;
 	BlankOX theBlankOX[BOARDSIZE], whosTurn;
 
-	PositionToBlankOX(thePosition,theBlankOX,&whosTurn);
 	MoveToSlots(theMove, &fromSlot, &toSlot);
 
+	if (gUseGPS) {
+		whosTurn = gPosition.whosTurn;
+		gPosition.board[fromSlot] = Blank;
+		if (toSlot != OFFTHEBOARD)
+			gPosition.board[toSlot] = whosTurn;
+		gPosition.whosTurn = (whosTurn == o ? x : o);
+	}
+	else
+		PositionToBlankOX(thePosition,theBlankOX,&whosTurn);
+
 	if(toSlot == OFFTHEBOARD) /* removed from board */
 		return(thePosition
 		       + (whosTurn == o ? POSITION_OFFSET : -POSITION_OFFSET)
@@ -295,6 +315,25 @@ MOVE theMove;
 		       + (g3Array[toSlot] * (int)whosTurn)); /* put in to slot */
 }
 
+void UndoMove(theMove)
+MOVE theMove;
+{
+	SLOT fromSlot, toSlot;
+
+	MoveToSlots(theMove, &fromSlot, &toSlot);
+
+	gPosition.whosTurn = (gPosition.whosTurn == o ? x : o);
+	gPosition.board[fromSlot] = gPosition.whosTurn;
+	if (toSlot != OFFTHEBOARD)
+		gPosition.board[toSlot] = Blank;
+}
+
+void SetGPSPosition(thePosition)
+POSITION thePosition;
+{
+	PositionToBlankOX(thePosition,gPosition.board,&gPosition.whosTurn);
+}
+
 /************************************************************************
 **
 ** NAME:        GetInitialPosition
@@ -392,9 +431,13 @@ VALUE Primitive(position)
 POSITION position;
 {
 	BOOLEAN CantMove(), OkMove();
-	BlankOX theBlankOX[BOARDSIZE],whosTurn,OnlyPlayerLeft();
+	BlankOX localBlankOX[BOARDSIZE],*theBlankOX = gPosition.board,OnlyPlayerLeft();
+	BlankOX whosTurn = gPosition.whosTurn;
 
-	PositionToBlankOX(position,theBlankOX,&whosTurn);
+	if (!gUseGPS) {
+		PositionToBlankOX(position,localBlankOX,&whosTurn);
+		theBlankOX = localBlankOX;
+	}
 
 	if (OnlyPlayerLeft(theBlankOX) == whosTurn)
 		return(gStandardGame ? lose : win); /* cause you're the only one left */
@@ -505,10 +548,14 @@ POSITION position;
 	BOOLEAN OkMove();
 	MOVELIST *head = NULL;
 	MOVELIST *CreateMovelistNode();
-	BlankOX theBlankOX[BOARDSIZE], whosTurn;
+	BlankOX localBlankOX[BOARDSIZE], *theBlankOX = gPosition.board;
+	BlankOX whosTurn = gPosition.whosTurn;
 	int i,j; /* Values for J: 0=left,1=straight,2=right */
 
-	PositionToBlankOX(position,theBlankOX,&whosTurn);
+	if (!gUseGPS) {
+		PositionToBlankOX(position,localBlankOX,&whosTurn);
+		theBlankOX = localBlankOX;
+	}
 
 	for(i = 0; i < BOARDSIZE; i++) { /* enumerate over all FROM slots */
 		for(j = 0; j < 3; j++) { /* enumerate over all directions */
@@ -69,6 +69,7 @@ featureEvaluatorCustom getSEvalCustomFnPtr(STRING fnName){
 
 void InitializeGame()
 {
+	kReentrant = TRUE;
 	// HERE, YOU SHOULD ASSIGN gNumberOfPositions and gInitialPosition
 	gNumberOfPositions =(1<<(rows*3)) * 2;
 	gInitialPosition = 7858; // 1, 3, 5, 7-piece rows
@@ -142,6 +142,7 @@ extern void             SafeFree ();
 
 void InitializeGame ()
 {
+	kReentrant = TRUE;
 	gMoveToStringFunPtr = &MoveToString;
 }
 
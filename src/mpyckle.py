@@ -69,6 +69,30 @@ class Pyckle(Game):
 		position |= ( {True:2, False:1}[players[1] > players[2]] ) << 2*move
 		return position
 
+	# Unpacks each board once for its primitive value, moves and children,
+	# instead of once per Primitive, GenerateMoves and DoMove call.
+	def Expand(self, positions):
+		primitives, counts, moves, children = [], [], [], []
+		for position in positions:
+			cells = [(position >> cell) & 3 for cell in range(0, 16, 2)]
+			value = undecided
+			for index in range(1, len(cells)):
+				if cells[index] != 0 and cells[index] == cells[index - 1]:
+					value = lose
+					break
+			if value == undecided and 0 not in cells:
+				value = tie
+			primitives.append(value)
+			if value == undecided:
+				unit = {True:2, False:1}[cells.count(1) > cells.count(2)]
+				empty = [move for move in range(len(cells)) if cells[move] == 0]
+				counts.append(len(empty))
+				moves.extend(empty)
+				children.extend([position | (unit << 2*move) for move in empty])
+			else:
+				counts.append(0)
+		return primitives, counts, moves, children
+
 	def Primitive(self, position):
 		previous = 0
 		blanks = 0
@@ -164,6 +164,7 @@ MOVE SlotsToMove(SLOT fromSlot, SLOT toSlot);
 STRING MoveToString( MOVE );
 
 void InitializeGame() {
+	kReentrant = TRUE;
 	gMoveToStringFunPtr = &MoveToString;
 }
 
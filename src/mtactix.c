@@ -225,6 +225,7 @@ STRING MoveToString( MOVE );
 
 void InitializeGame()
 {
+	kReentrant = TRUE;
 	gMoveToStringFunPtr= &MoveToString;
 }
 
@@ -184,21 +184,28 @@ char *gBlankOXString[] = { " ", "o", "x" };
 /* Powers of 3 - this is the way I encode the position, as an integer */
 int g3Array[] = { 1, 3, 9, 27, 81, 243, 729, 2187, 6561 };
 
+/* The board as seen by the bitboard kernel: its columns are our rows, so
+   that kernel cell number (col * rows + row) is our square number and the
+   kernel's ternary hash is the g3Array encoding above. */
+BITBOARDSHAPE gShape;
+
+#define SQUARE_CELL(square) BITBOARD_CELL(&gShape, (square) / BOARDCOLS, (square) % BOARDCOLS)
+
 /* Global position solver variables.*/
 struct {
-	BlankOX board[BOARDSIZE];
+	BITBOARD stones[3];     /* indexed by o and x; stones[Blank] stays empty */
 	BlankOX nextPiece;
 	int piecesPlaced;
 } gPosition;
 
 /** Function Prototypes **/
-BOOLEAN AllFilledIn(BlankOX theBlankOX[]);
 POSITION BlankOXToPosition(BlankOX *theBlankOX);
 POSITION GetCanonicalPosition(POSITION position);
 void PositionToBlankOX(POSITION thePos,BlankOX *theBlankOX);
-BOOLEAN ThreeInARow(BlankOX[], int, int, int);
+void PositionToStones(POSITION thePos, BITBOARD stones[3]);
 void UndoMove(MOVE move);
 BlankOX WhoseTurn(BlankOX *theBlankOX);
+BlankOX StonesWhoseTurn(BITBOARD stones[3]);
 
 STRING MoveToString( MOVE );
 POSITION ActualNumberOfPositions(int variant);
@@ -242,6 +249,7 @@ int gRotate90CWNewPosition[] = { 6, 3, 0, 7, 4, 1, 8, 5, 2 };
 
 void InitializeGame()
 {
+	kReentrant = TRUE;
 	/**************************************************/
 	/**************** SYMMETRY FUN BEGIN **************/
 	/**************************************************/
@@ -268,7 +276,9 @@ void InitializeGame()
 	/**************** SYMMETRY FUN END ****************/
 	/**************************************************/
 
-	PositionToBlankOX(gInitialPosition, gPosition.board);
+	BitboardInitShape(&gShape, BOARDROWS, BOARDCOLS, 3);
+
+	PositionToStones(gInitialPosition, gPosition.stones);
 	gPosition.nextPiece = x;
 	gPosition.piecesPlaced = 0;
 	gUndoMove = UndoMove;
@@ -378,32 +388,33 @@ void SetTclCGameSpecificOptions(int theOptions[])
 **
 ** OUTPUTS:     (POSITION) : The position that results after the move.
 **
-** CALLS:       PositionToBlankOX(POSITION,*BlankOX)
-**              BlankOX WhosTurn(*BlankOX)
+** CALLS:       PositionToStones(POSITION,BITBOARD[])
+**              BlankOX StonesWhoseTurn(BITBOARD[])
 **
 ************************************************************************/
 
 POSITION DoMove(POSITION position, MOVE move)
 {
 	if (gUseGPS) {
-		gPosition.board[move] = gPosition.nextPiece;
+		gPosition.stones[gPosition.nextPiece] |= SQUARE_CELL(move);
 		gPosition.nextPiece = gPosition.nextPiece == x ? o : x;
 		++gPosition.piecesPlaced;
 
-		return BlankOXToPosition(gPosition.board);
+		return BitboardTernaryHash(&gShape, gPosition.stones[o], gPosition.stones[x]);
 	}
 	else {
-		BlankOX board[BOARDSIZE];
+		BITBOARD stones[3];
 
-		PositionToBlankOX(position, board);
+		PositionToStones(position, stones);
 
-		return position + g3Array[move] * (int) WhoseTurn(board);
+		return position + g3Array[move] * (int) StonesWhoseTurn(stones);
 	}
 }
 
 void UndoMove(MOVE move)
 {
-	gPosition.board[move] = Blank;
+	gPosition.stones[o] &= ~SQUARE_CELL(move);
+	gPosition.stones[x] &= ~SQUARE_CELL(move);
 	gPosition.nextPiece = gPosition.nextPiece == x ? o : x;
 	--gPosition.piecesPlaced;
 }
@@ -492,28 +503,26 @@ STRING computersName;
 **
 ** OUTPUTS:     (VALUE) an enum which is oneof: (win,lose,tie,undecided)
 **
-** CALLS:       BOOLEAN ThreeInARow()
-**              BOOLEAN AllFilledIn()
-**              PositionToBlankOX()
+** CALLS:       BOOLEAN BitboardHasLine()
+**              PositionToStones()
 **
 ************************************************************************/
 
 VALUE Primitive(POSITION position)
 {
-	if (!gUseGPS)
-		PositionToBlankOX(position, gPosition.board); // Temporary storage.
-
-	if (ThreeInARow(gPosition.board, 0, 1, 2) ||
-	    ThreeInARow(gPosition.board, 3, 4, 5) ||
-	    ThreeInARow(gPosition.board, 6, 7, 8) ||
-	    ThreeInARow(gPosition.board, 0, 3, 6) ||
-	    ThreeInARow(gPosition.board, 1, 4, 7) ||
-	    ThreeInARow(gPosition.board, 2, 5, 8) ||
-	    ThreeInARow(gPosition.board, 0, 4, 8) ||
-	    ThreeInARow(gPosition.board, 2, 4, 6))
+	BITBOARD localStones[3], *stones = gPosition.stones;
+
+	/* Outside of GPS mode, unhash into local stones so that the parallel
+	   solvers can call this from several threads. */
+	if (!gUseGPS) {
+		PositionToStones(position, localStones);
+		stones = localStones;
+	}
+
+	if (BitboardHasLine(&gShape, stones[o]) || BitboardHasLine(&gShape, stones[x]))
 		return gStandardGame ? lose : win;
 	else if ((gUseGPS && (gPosition.piecesPlaced == BOARDSIZE)) ||
-	         ((!gUseGPS) && AllFilledIn(gPosition.board)))
+	         ((!gUseGPS) && (stones[o] | stones[x]) == gShape.cells))
 		return tie;
 	else
 		return undecided;
@@ -573,23 +582,21 @@ BOOLEAN usersTurn;
 ** OUTPUTS:     (MOVELIST *), a pointer that points to the first item
 **              in the linked list of moves that can be generated.
 **
-** CALLS:       MOVELIST *CreateMovelistNode(MOVE,MOVELIST *)
+** CALLS:       MOVELIST *BitboardPlaceMoves(BITBOARDSHAPE*,BITBOARD)
 **
 ************************************************************************/
 
 MOVELIST *GenerateMoves(POSITION position)
 {
-	int index;
-	MOVELIST *moves = NULL;
+	BITBOARD localStones[3], *stones = gPosition.stones;
 
-	if (!gUseGPS)
-		PositionToBlankOX(position, gPosition.board); // Temporary storage.
-
-	for (index = 0; index < BOARDSIZE; ++index)
-		if (gPosition.board[index] == Blank)
-			moves = CreateMovelistNode(index, moves);
+	if (!gUseGPS) {
+		PositionToStones(position, localStones);
+		stones = localStones;
+	}
 
-	return moves;
+	/* Moves come out numbered by square, highest first */
+	return BitboardPlaceMoves(&gShape, stones[o] | stones[x]);
 }
 
 /**************************************************/
@@ -858,48 +865,20 @@ BlankOX *theBlankOX;
 
 /************************************************************************
 **
-** NAME:        ThreeInARow
-**
-** DESCRIPTION: Return TRUE iff there are three-in-a-row.
-**
-** INPUTS:      BlankOX theBlankOX[BOARDSIZE] : The BlankOX array.
-**              int a,b,c                     : The 3 positions to check.
-**
-** OUTPUTS:     (BOOLEAN) TRUE iff there are three-in-a-row.
-**
-************************************************************************/
-
-BOOLEAN ThreeInARow(theBlankOX,a,b,c)
-BlankOX theBlankOX[];
-int a,b,c;
-{
-	return(       theBlankOX[a] == theBlankOX[b] &&
-	              theBlankOX[b] == theBlankOX[c] &&
-	              theBlankOX[c] != Blank );
-}
-
-/************************************************************************
-**
-** NAME:        AllFilledIn
+** NAME:        PositionToStones
 **
-** DESCRIPTION: Return TRUE iff all the blanks are filled in.
+** DESCRIPTION: convert an internal position to the bitboards of o's and
+**              x's stones.
 **
-** INPUTS:      BlankOX theBlankOX[BOARDSIZE] : The BlankOX array.
-**
-** OUTPUTS:     (BOOLEAN) TRUE iff all the blanks are filled in.
+** INPUTS:      POSITION thePos    : The position input.
+**              BITBOARD stones[3] : The stones output, indexed by o and x.
 **
 ************************************************************************/
 
-BOOLEAN AllFilledIn(theBlankOX)
-BlankOX theBlankOX[];
+void PositionToStones(POSITION thePos, BITBOARD stones[3])
 {
-	BOOLEAN answer = TRUE;
-	int i;
-
-	for(i = 0; i < BOARDSIZE; i++)
-		answer &= (theBlankOX[i] == o || theBlankOX[i] == x);
-
-	return(answer);
+	stones[Blank] = 0;
+	BitboardTernaryUnhash(&gShape, thePos, &stones[o], &stones[x]);
 }
 
 /************************************************************************
@@ -916,8 +895,7 @@ BlankOX theBlankOX[];
 **
 ************************************************************************/
 
-BlankOX WhoseTurn(theBlankOX)
-BlankOX *theBlankOX;
+BlankOX WhoseTurn(BlankOX *theBlankOX)
 {
 	int i, xcount = 0, ocount = 0;
 
@@ -926,7 +904,6 @@ BlankOX *theBlankOX;
 			xcount++;
 		else if(theBlankOX[i] == o)
 			ocount++;
-		else ;    /* don't count blanks */
 
 	if(xcount == ocount)
 		return(x);  /* in our TicTacToe, x always goes first */
@@ -934,6 +911,15 @@ BlankOX *theBlankOX;
 		return(o);
 }
 
+/* WhoseTurn of a board unhashed into bitboards by PositionToStones */
+BlankOX StonesWhoseTurn(BITBOARD stones[3])
+{
+	if(BitboardCount(stones[x]) == BitboardCount(stones[o]))
+		return(x);
+	else
+		return(o);
+}
+
 STRING kDBName = "ttt";
 
 int NumberOfOptions()
@@ -59,6 +59,7 @@
 
 #include <stdio.h>
 #include "gamesman.h"
+#include "core/seval.h"
 
 POSITION gNumberOfPositions  = 0;
 POSITION kBadPosition        = -1;
@@ -160,6 +161,9 @@ Computer wins. Nice try, Dan."
 // This is so I don't have to change "BlankOX" occurences everywhere.
 typedef char BlankOX;
 
+/* Pieces handed to the static evaluator's library traits */
+static BlankOX gSEvalX = x, gSEvalO = o, gSEvalBlank = Blank;
+
 /** Function Prototypes **/
 BOOLEAN AllFilledIn(BlankOX*);
 BOOLEAN ThreeInARow(BlankOX*, int, int, int);
@@ -168,6 +172,7 @@ STRING MoveToString(MOVE);
 
 // HASH/UNHASH
 char* customUnhash(POSITION);
+void customUnhashInto(POSITION, void*);
 POSITION BlankOXToPosition(BlankOX*);
 BlankOX* PositionToBlankOX(POSITION);
 BlankOX WhoseTurn(BlankOX*);
@@ -247,6 +252,8 @@ void InitializeGame()
 	// linearUnhash expects void *
 	// dchan 10-16-07
 	linearUnhash = (void *) gCustomUnhash;
+	linearUnhashInto = &customUnhashInto;
+	initializeStaticEvaluatorBoard(sizeof(BlankOX), 3, 3, TRUE, &gSEvalX, &gSEvalO, &gSEvalBlank);
 
 	//discard current hash
 	generic_hash_destroy();
@@ -723,16 +730,22 @@ char* customUnhash(POSITION position) {
 	return (char*)PositionToBlankOX(position);
 }
 
-// "Unhash"
-BlankOX* PositionToBlankOX(POSITION position)
-{
-	char* board = (char *) SafeMalloc(BOARDSIZE * sizeof(char)); // make board space
+// "Unhash" into a caller-owned board (lets the static evaluator reuse one)
+void customUnhashInto(POSITION position, void* board) {
 	if (gHashWindowInitialized) { // using hash windows
 		TIERPOSITION tierpos; TIER tier;
 		gUnhashToTierPosition(position, &tierpos, &tier); // get tierpos
 		generic_hash_context_switch(tier); // switch to that tier's context
-		return (BlankOX *) generic_hash_unhash(tierpos, board); // unhash in that tier
-	} else return (BlankOX *) generic_hash_unhash(position, board);
+		generic_hash_unhash(tierpos, (char*)board); // unhash in that tier
+	} else generic_hash_unhash(position, (char*)board);
+}
+
+// "Unhash"
+BlankOX* PositionToBlankOX(POSITION position)
+{
+	char* board = (char *) SafeMalloc(BOARDSIZE * sizeof(char)); // make board space
+	customUnhashInto(position, board);
+	return (BlankOX *) board;
 }
 
 // "Hash"
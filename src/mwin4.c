@@ -127,7 +127,6 @@ int WIN4_WIDTH_PLUS_ONE;
 #define MINH 1
 #define TOTAL_STAGES (WIN4_WIDTH*WIN4_HEIGHT)
 
-#define DIRECTION_PAIRS 4
 #define NO_COLUMN -1
 
 BOOLEAN gLibraries           = FALSE;
@@ -140,6 +139,10 @@ char           *gBlankOXString[] = { "X", "O", "-" };
 
 int gContinuousPiecesGoal = 4;
 
+/* Board dimensions and goal for the bitboard kernel. The column hash the
+   kernel builds is the position encoding described at the top. */
+BITBOARDSHAPE gShape;
+
 typedef struct {
 	int *convert;
 } NumToPieceConv;
@@ -150,7 +153,7 @@ NumToPieceConv *PieceDistToNum;
 /* Global position solver variables.*/
 
 struct {
-	XOBlank board[MAXW][MAXH];
+	BITBOARD stones[2];     /* indexed by x and o */
 	POSITION heights[MAXW];
 	POSITION lastColumn;
 	XOBlank nextPiece;
@@ -159,22 +162,6 @@ struct {
 } gPosition;
 
 
-typedef enum {
-	NO_DIRECTION,
-	DOWN,
-	LEFT,
-	RIGHT,
-	UP,
-	DIRECTIONS
-} Direction;
-
-Direction gDirections[DIRECTION_PAIRS][2] = {{LEFT, UP},
-					     {NO_DIRECTION, UP},
-					     {RIGHT, UP},
-					     {LEFT, NO_DIRECTION}};
-
-Direction gOppositeDirections[DIRECTIONS];
-
 /* stage-based bottom-up solver variables */
 POSITION currentHeights[MAXW];
 
@@ -194,13 +181,15 @@ void            SetPieces(int currentcol);
 void            RecordPosition(POSITION pos, POSITIONLIST *head);
 POSITIONLIST   *EnumerateWithinStage(int stage);
 
-int             CountContinuousPieces(int column, int row, Direction horizontalDirection,
-                                      Direction verticalDirection);
 void            PositionToBoard(POSITION pos, XOBlank board[MAXW][MAXH]);
+void            PositionToStones(POSITION pos, BITBOARD stones[2]);
+POSITION        WindowToColumnHash(POSITION pos);
+POSITION        ColumnHashToWindow(POSITION pos, TIER tier);
 
 void            linearUnhash2(POSITION pos, XOBlank* board);
 void            InitPieceToNumConvs();
 void            UndoMove(MOVE move);
+void            SetGPSPosition(POSITION position);
 void            SetupTierStuff();
 void            positionToBinary(POSITION p);
 STRING          MoveToString( MOVE );
@@ -234,36 +223,17 @@ POSITION GetInitialPosition() {
 
 void InitializeGame()
 {
-	unsigned int i, j;
+	BitboardInitShape(&gShape, WIN4_WIDTH, WIN4_HEIGHT, gContinuousPiecesGoal);
 	gNumberOfPositions = MyNumberOfPos();
 	gInitialPosition    = MyInitialPosition();
 	gEnumerateWithinStage = &EnumerateWithinStage;
 
 	gMinimalPosition = gInitialPosition;
 
-	gOppositeDirections[NO_DIRECTION] = NO_DIRECTION;
-	gOppositeDirections[DOWN] = UP;
-	gOppositeDirections[LEFT] = RIGHT;
-	gOppositeDirections[RIGHT] = LEFT;
-	gOppositeDirections[UP] = DOWN;
 	SetupTierStuff();
-	PositionToBoard(gInitialPosition, gPosition.board);
-
-	for (i = 0; i < WIN4_WIDTH; ++i) {
-		gPosition.heights[i] = 0;
-
-		for (j = 0; j < WIN4_HEIGHT; ++j) {
-			if (gPosition.board[i][j] == Blank)
-				break;
-
-			++gPosition.heights[i];
-		}
-	}
-
-	gPosition.lastColumn = NO_COLUMN;
-	gPosition.nextPiece = x;
-	gPosition.piecesPlaced = 0;
+	SetGPSPosition(gInitialPosition);
 	gUndoMove = UndoMove;
+	gSetGPSPosition = SetGPSPosition;
 	gMoveToStringFunPtr =  &MoveToString;
 	gCanonicalPosition = GetCanonicalPosition;
 }
@@ -343,6 +313,8 @@ void GameSpecificMenu() {
 
 		case 'b': case 'B':
 
+			BitboardInitShape(&gShape, WIN4_WIDTH, WIN4_HEIGHT, gContinuousPiecesGoal);
+
 			if (gLibraries) {
 				LibInitialize(4,WIN4_HEIGHT,WIN4_WIDTH,TRUE);
 				Test();
@@ -383,73 +355,71 @@ void SetTclCGameSpecificOptions(int theOptions[])
 **
 ** OUTPUTS:     (POSITION) : The position that results after the move.
 **
-** CALLS:       XOBlank WhosTurn(POSITION)
+** CALLS:       PositionToStones(POSITION,BITBOARD[])
 **
 ************************************************************************/
 
 POSITION DoMove(POSITION position, MOVE move)
 {
-	XOBlank turn,WhoseTurn();
-	POSITION turn2;
-	int i,free=0;
-	POSITION permutation_index, sizebits, remainderbits, temp=1;
-	TIER tier; TIERPOSITION tierpos;
-	POSITION modpos, bitmask, tierbits, temp1, temp2, temp3=2;
-
-	if (gHashWindowInitialized) {
-		gUnhashToTierPosition(position, &tierpos, &tier);
-		tierbits = temp << tier;
-		permutation_index = position / tierbits;
-		tierpos = (NumToPieceDist[tier].convert[permutation_index]);
-		tierpos <<= tier;
-		modpos = tierpos + (position % tierbits);
-		modpos <<= (64 - tier - TIER_COL_BITS);
-		position = ModPosToPosition(modpos);
-
-	}
-
-	for (i=move*(WIN4_HEIGHT+1)+WIN4_HEIGHT; (position & (temp1 = (temp << i))) == 0; --i)
-		free++;
-
-	if (free == 0) return kBadPosition;
-
-	turn = gUseGPS ? gPosition.nextPiece : WhoseTurn(position);
-	turn2 = (POSITION)turn;
-	position &= ~(temp1);
+	BITBOARD localStones[2], *stones = gPosition.stones, cell;
+	XOBlank turn;
 
 	if (gUseGPS) {
-		gPosition.board[move][gPosition.heights[move]++] = gPosition.nextPiece;
+		if (gPosition.heights[move] == WIN4_HEIGHT) return kBadPosition;
+
+		cell = BITBOARD_CELL(&gShape, move, gPosition.heights[move]++);
+		turn = gPosition.nextPiece;
 		gPosition.previousColumn = gPosition.lastColumn;
 		gPosition.lastColumn = move;
 		gPosition.nextPiece = gPosition.nextPiece == x ? o : x;
 		++gPosition.piecesPlaced;
 	}
+	else {
+		stones = localStones;
+		PositionToStones(position, stones);
+
+		cell = BitboardDropCells(&gShape, stones[x] | stones[o]) & BITBOARD_COLUMN(&gShape, move);
+		if (cell == 0) return kBadPosition;
 
-	position = (position | (temp2 = (temp3+turn2)<<i));
-
-	if (gHashWindowInitialized) {
-		tier = PositionToTier(position);
-		tierbits = temp << tier;
-		tierpos = PositionToModPos(position, tier);
-		bitmask = tierbits - 1;
-		sizebits = tierpos >> (64 - TIER_COL_BITS);
-		remainderbits = (tierpos >> (64 - tier - TIER_COL_BITS)) & bitmask;
-		permutation_index = PieceDistToNum[tier].convert[sizebits];
-		tierpos = permutation_index * tierbits + remainderbits;
-		position = gHashToWindowPosition(tierpos, tier);
+		turn = BitboardCount(stones[x]) == BitboardCount(stones[o]) ? x : o;
 	}
 
-	return position;
+	stones[turn] |= cell;
+
+	return ColumnHashToWindow(BitboardColumnHash(&gShape, stones[o], stones[x] | stones[o]),
+	                          BitboardCount(stones[x] | stones[o]));
 }
 
 void UndoMove(MOVE move)
 {
-	gPosition.board[move][--gPosition.heights[move]] = Blank;
+	BITBOARD cell = BITBOARD_CELL(&gShape, move, --gPosition.heights[move]);
+
+	gPosition.stones[x] &= ~cell;
+	gPosition.stones[o] &= ~cell;
 	gPosition.lastColumn = gPosition.previousColumn;
 	gPosition.nextPiece = gPosition.nextPiece == x ? o : x;
 	--gPosition.piecesPlaced;
 }
 
+/* Loads gPosition from a hash. No last move is known, so Primitive does a
+   full board check until the next DoMove. */
+void SetGPSPosition(POSITION position)
+{
+	int col;
+
+	PositionToStones(position, gPosition.stones);
+
+	for (col = 0; col < WIN4_WIDTH; ++col)
+		gPosition.heights[col] = BitboardCount((gPosition.stones[x] | gPosition.stones[o]) &
+		                                       BITBOARD_COLUMN(&gShape, col));
+
+	/* Same rule as WhoseTurn, which also covers the unreachable positions
+	   a tier sweeps over */
+	gPosition.lastColumn = gPosition.previousColumn = NO_COLUMN;
+	gPosition.nextPiece = BitboardCount(gPosition.stones[x]) == BitboardCount(gPosition.stones[o]) ? x : o;
+	gPosition.piecesPlaced = BitboardCount(gPosition.stones[x] | gPosition.stones[o]);
+}
+
 /************************************************************************
 **
 ** NAME:        PrintComputersMove
@@ -483,7 +453,7 @@ void PrintComputersMove(MOVE computersMove,STRING computersName)
 **
 ** OUTPUTS:     (VALUE) an enum which is oneof: (win,lose,tie,undecided)
 **
-** CALLS:       PositionToBoard()
+** CALLS:       BitboardHasLine(), BitboardHasLineThrough()
 **
 ** WARNING:     Behavior undefined for a position which is impossible !!
 **
@@ -493,154 +463,44 @@ VALUE Primitive(POSITION position)
 {
 	if (!gLibraries) {
 
-		if (gUseGPS) {
-			int count, index;
-			Direction horizontalDirection, verticalDirection;
-			int lastRow = gPosition.heights[gPosition.lastColumn] - 1;
-
-			for (index = 0; index < DIRECTION_PAIRS; ++index) {
-				count = 1;
-				horizontalDirection = gDirections[index][0];
-				verticalDirection = gDirections[index][1];
-				count += CountContinuousPieces(gPosition.lastColumn, lastRow,
-				                               horizontalDirection, verticalDirection);
+		BITBOARD localStones[2], *stones = gPosition.stones;
 
-				if (count >= gContinuousPiecesGoal)
-					return gStandardGame ? lose : win;
-
-				count += CountContinuousPieces(gPosition.lastColumn, lastRow,
-				                               gOppositeDirections[horizontalDirection],
-				                               gOppositeDirections[verticalDirection]);
+		if (gUseGPS && gPosition.lastColumn != NO_COLUMN) {
+			/* Only a line through the stone just played can be new */
+			XOBlank lastPiece = gPosition.nextPiece == x ? o : x;
+			BITBOARD lastCell = BITBOARD_CELL(&gShape, gPosition.lastColumn,
+			                                  gPosition.heights[gPosition.lastColumn] - 1);
 
-				if (count >= gContinuousPiecesGoal)
-					return gStandardGame ? lose : win;
-			}
+			if (BitboardHasLineThrough(&gShape, gPosition.stones[lastPiece], lastCell))
+				return gStandardGame ? lose : win;
 
 			return gPosition.piecesPlaced == WIN4_WIDTH * WIN4_HEIGHT ? tie : undecided;
 		}
 
-		int ul[WIN4_WIDTH][WIN4_HEIGHT]; //upper left
-		int l[WIN4_WIDTH][WIN4_HEIGHT]; //left
-		int ll[WIN4_WIDTH][WIN4_HEIGHT]; //lower left
-		int u[WIN4_WIDTH][WIN4_HEIGHT]; //up
-		XOBlank board[WIN4_WIDTH][WIN4_HEIGHT+1];
-		int col,row;
-		PositionToBoard(position, gPosition.board); // Temporary storage.
-		for (col=0; col<WIN4_WIDTH; col++)
-			board[col][WIN4_HEIGHT]=2;
-		for (col=0; col<WIN4_WIDTH; col++)
-			for (row=0; row<WIN4_HEIGHT; row++)
-				board[col][row] = gPosition.board[col][row];
-		// Check for four in a row
-		// First do column 0:
-		col=0;
-		row=WIN4_HEIGHT-1;
-		while (row>=0) {
-			if (board[0][row]==2) {
-				ul[0][row]=0;
-				l[0][row]=0;
-				ll[0][row]=0;
-				u[0][row]=0;
-			}
-			else {
-				ul[0][row]=1;
-				l[0][row]=1;
-				ll[0][row]=1;
-				if (board[0][row+1]==board[0][row]) {
-					u[0][row]=u[0][row+1]+1;
-					if (u[0][row] == gContinuousPiecesGoal)
-						return gStandardGame ? lose : win;
-				}
-				else u[0][row]=1;
-			}
-			row--;
-		}
-		// Now do the other columns
-		for (col=1; col<WIN4_WIDTH; col++) {
-			row=WIN4_HEIGHT-1;
-			while (row>0) {
-				if (board[col][row]==2) {
-					ul[col][row]=0;
-					l[col][row]=0;
-					ll[col][row]=0;
-					u[col][row]=0;
-				}
-				else {
-					if (board[col][row]==board[col][row+1]) {
-						u[col][row]=u[col][row+1]+1;
-						if (u[col][row] == gContinuousPiecesGoal)
-							return gStandardGame ? lose : win;
-					}
-					else u[col][row]=1;
-					if (board[col][row]==board[col-1][row+1]) {
-						ul[col][row]=ul[col-1][row+1]+1;
-						if (ul[col][row] == gContinuousPiecesGoal)
-							return gStandardGame ? lose : win;
-					}
-					else ul[col][row]=1;
-					if (board[col][row]==board[col-1][row]) {
-						l[col][row]=l[col-1][row]+1;
-						if (l[col][row] == gContinuousPiecesGoal)
-							return gStandardGame ? lose : win;
-					}
-					else l[col][row]=1;
-					if (board[col][row]==board[col-1][row-1]) {
-						ll[col][row]=ll[col-1][row-1]+1;
-						if (ll[col][row] == gContinuousPiecesGoal)
-							return gStandardGame ? lose : win;
-					}
-					else ll[col][row]=1;
-				}
-				row--;
-			}
-			if (board[col][row]==2) {
-				ul[col][row]=0;
-				l[col][row]=0;
-				ll[col][row]=0;
-				u[col][row]=0;
-			}
-			else {
-				if (board[col][row]==board[col][row+1]) {
-					u[col][row]=u[col][row+1]+1;
-					if (u[col][row] == gContinuousPiecesGoal)
-						return gStandardGame ? lose : win;
-				}
-				else u[col][row]=1;
-				if (board[col][row]==board[col-1][row+1]) {
-					ul[col][row]=ul[col-1][row+1]+1;
-					if (ul[col][row] == gContinuousPiecesGoal)
-						return gStandardGame ? lose : win;
-				}
-				else ul[col][row]=1;
-				if (board[col][row]==board[col-1][row]) {
-					l[col][row]=l[col-1][row]+1;
-					if (l[col][row] == gContinuousPiecesGoal)
-						return gStandardGame ? lose : win;
-				}
-				else l[col][row]=1;
-				ll[col][row]=1;
-			}
+		if (!gUseGPS) {
+			stones = localStones;
+			PositionToStones(position, stones);
 		}
 
-		//Now check if the board is full:
-		for (col=0; col<WIN4_WIDTH; col++)
-			for (row=0; row<WIN4_HEIGHT; row++)
-				if (board[col][row]==2) return(undecided);
+		if (BitboardHasLine(&gShape, stones[x]) || BitboardHasLine(&gShape, stones[o]))
+			return gStandardGame ? lose : win;
 
-		return(tie);
+		return (stones[x] | stones[o]) == gShape.cells ? tie : undecided;
 
 	} else {
 
 		int col, row, xx=0, oo=1, bb=2;
 		XOBlank linearBoard[WIN4_WIDTH*WIN4_HEIGHT], WhoseTurn();
 
-		if (gUseGPS) {
+		if (gUseGPS && gPosition.lastColumn != NO_COLUMN) {
 			int lastRow = gPosition.heights[gPosition.lastColumn];
 
 			//copy the board into 1D representation
 			for(row=WIN4_HEIGHT-1; row>=0; row--) {
 				for(col=0; col<WIN4_WIDTH; col++) {
-					linearBoard[col+WIN4_WIDTH*(WIN4_HEIGHT - 1 - row)] = gPosition.board[col][row];
+					BITBOARD cell = BITBOARD_CELL(&gShape, col, row);
+					linearBoard[col+WIN4_WIDTH*(WIN4_HEIGHT - 1 - row)] =
+					        (gPosition.stones[x] & cell) ? x : (gPosition.stones[o] & cell) ? o : Blank;
 				}
 			}
 
@@ -742,25 +602,20 @@ void PrintPosition(POSITION position,STRING playerName,BOOLEAN usersTurn)
 ** OUTPUTS:     (MOVELIST *), a pointer that points to the first item
 **              in the linked list of moves that can be generated.
 **
-** CALLS:       MOVELIST *CreateMovelistNode(MOVE,MOVELIST *)
+** CALLS:       MOVELIST *BitboardDropMoves(BITBOARDSHAPE*,BITBOARD)
 **
 ************************************************************************/
 
 MOVELIST *GenerateMoves(POSITION position)
 {
-	MOVELIST *head = NULL;
-	int i;
+	BITBOARD stones[2];
 
-	if (!gUseGPS)
-		PositionToBoard(position, gPosition.board); // Temporary storage.
+	if (gUseGPS)
+		return BitboardDropMoves(&gShape, gPosition.stones[x] | gPosition.stones[o]);
 
-	for(i = 0; i < WIN4_WIDTH; i++) {
-		if(gPosition.board[i][WIN4_HEIGHT-1] == Blank)
-			head = CreateMovelistNode(i,head);
-	}
-
-	return(head);
+	PositionToStones(position, stones);
 
+	return BitboardDropMoves(&gShape, stones[x] | stones[o]);
 }
 
 /************************************************************************
@@ -889,78 +744,89 @@ STRING MoveToString (MOVE theMove)
 
 void PositionToBoard(POSITION pos, XOBlank board[MAXW][MAXH])
 {
-	int col, row, h;
-	POSITION permutation_index, tierbits, temp1, temp2, temp3=1;
-	TIER tier;
-	TIERPOSITION tierpos, modpos;
-
-	if (gHashWindowInitialized) {
-		gUnhashToTierPosition(pos, &tierpos, &tier);
-		tierbits = temp3 << tier;
-		permutation_index = pos / tierbits;
-		tierpos = (NumToPieceDist[tier].convert[permutation_index]);
-		tierpos <<= tier;
-		modpos = tierpos + (pos % tierbits);
-		modpos <<= (64 - tier - TIER_COL_BITS);
-		pos = ModPosToPosition(modpos);
-	}
+	BITBOARD stones[2], cell;
+	int col, row;
 
+	PositionToStones(pos, stones);
 
-	for (col=0; col<WIN4_WIDTH; col++) {
-		row=WIN4_HEIGHT-1;
-		for (h=col*(WIN4_HEIGHT+1)+WIN4_HEIGHT;
-		     (pos & (temp1 = (temp3 << h))) == 0;
-		     h--) {
-			// These two lines cause a crash when printing position 0
-			board[col][row]=2;
-			row--;
-		}
-		h--;
-		while (row >=0) {
-			if ((pos & (temp2 = (temp3 << h))) != 0) board[col][row]=1;
-			else board[col][row]=0;
-			row--;
-			h--;
+	for (col=0; col<WIN4_WIDTH; col++)
+		for (row=0; row<WIN4_HEIGHT; row++) {
+			cell = BITBOARD_CELL(&gShape, col, row);
+			board[col][row] = (stones[x] & cell) ? x : (stones[o] & cell) ? o : Blank;
 		}
-	}
 }
 
 
 void linearUnhash2(POSITION pos, XOBlank board[WIN4_HEIGHT*WIN4_WIDTH]) {
-	int col, row, h;
-	POSITION permutation_index, tierbits, temp1, temp2, temp3 = 1;
+	XOBlank columns[MAXW][MAXH];
+	int col, row;
+
+	PositionToBoard(pos, columns);
+
+	for (col=0; col<WIN4_WIDTH; col++)
+		for (row=0; row<WIN4_HEIGHT; row++)
+			board[col + WIN4_WIDTH*(WIN4_HEIGHT - 1 - row)] = columns[col][row];
+}
+
+/************************************************************************
+**
+** NAME:        PositionToStones
+**
+** DESCRIPTION: convert an internal position to the bitboards of x's and
+**              o's stones.
+**
+** INPUTS:      POSITION pos       : The position input.
+**              BITBOARD stones[2] : The stones output, indexed by x and o.
+**
+************************************************************************/
+
+void PositionToStones(POSITION pos, BITBOARD stones[2])
+{
+	BITBOARD occupied;
+
+	stones[o] = BitboardColumnUnhash(&gShape, WindowToColumnHash(pos), &occupied);
+	stones[x] = occupied & ~stones[o];
+}
+
+/* Tier positions are numbered by the hash window; these convert between
+   that numbering and the column hash. */
+POSITION WindowToColumnHash(POSITION pos)
+{
+	POSITION permutation_index, tierbits, temp=1;
 	TIER tier;
 	TIERPOSITION tierpos, modpos;
 
-	if (gHashWindowInitialized) {
-		gUnhashToTierPosition(pos, &tierpos, &tier);
-		tierbits = temp3 << tier;
-		permutation_index = pos / tierbits;
-		tierpos = (NumToPieceDist[tier].convert[permutation_index]);
-		tierpos <<= tier;
-		modpos = tierpos + (pos % tierbits);
-		modpos <<= (64 - tier - TIER_COL_BITS);
-		pos = ModPosToPosition(modpos);
-	}
+	if (!gHashWindowInitialized)
+		return pos;
 
+	gUnhashToTierPosition(pos, &tierpos, &tier);
+	tierbits = temp << tier;
+	permutation_index = pos / tierbits;
+	tierpos = (NumToPieceDist[tier].convert[permutation_index]);
+	tierpos <<= tier;
+	modpos = tierpos + (pos % tierbits);
+	modpos <<= (64 - tier - TIER_COL_BITS);
 
+	return ModPosToPosition(modpos);
+}
 
-	for (col=0; col<WIN4_WIDTH; col++) {
-		row=WIN4_HEIGHT-1;
-		for (h=col*(WIN4_HEIGHT+1)+WIN4_HEIGHT;
-		     (pos & (temp1 = (temp3 << h))) == 0;
-		     h--) {
-			board[col + WIN4_WIDTH*(WIN4_HEIGHT - 1 - row)] = 2;
-			row--;
-		}
-		h--;
-		while (row >=0) {
-			if ((pos & (temp2 = (temp3<<h))) != 0) board[col + WIN4_WIDTH*(WIN4_HEIGHT - 1 - row)] = 1;
-			else board[col + WIN4_WIDTH*(WIN4_HEIGHT - 1 - row)] = 0;
-			row--;
-			h--;
-		}
-	}
+POSITION ColumnHashToWindow(POSITION pos, TIER tier)
+{
+	POSITION permutation_index, sizebits, remainderbits, bitmask, tierbits, temp=1;
+	TIERPOSITION tierpos;
+
+	if (!gHashWindowInitialized)
+		return pos;
+
+	tierbits = temp << tier;
+	tierpos = PositionToModPos(pos, tier);
+	bitmask = tierbits - 1;
+	sizebits = tierpos >> (64 - TIER_COL_BITS);
+	remainderbits = (tierpos >> (64 - tier - TIER_COL_BITS)) & bitmask;
+	permutation_index = PieceDistToNum[tier].convert[sizebits];
+	tierpos = permutation_index * tierbits + remainderbits;
+
+	return gHashToWindowPosition(tierpos, tier);
 }
 
 
@@ -1085,59 +951,12 @@ void setOption(int option)
 		gStandardGame = FALSE;
 }
 
-int CountContinuousPieces(int column, int row, Direction horizontalDirection,
-                          Direction verticalDirection) {
-	int count = -1;
-	XOBlank piece;
-
-	do {
-		++count;
-		piece = gPosition.board[column][row];
-
-		switch (horizontalDirection) {
-		case LEFT:
-			--column;
-			break;
-		case RIGHT:
-			++column;
-			break;
-		default:
-			;
-		}
-
-		switch (verticalDirection) {
-		case DOWN:
-			--row;
-			break;
-		case UP:
-			++row;
-			break;
-		default:
-			;
-		}
-	}
-	while (column >= 0 && column < WIN4_WIDTH && row >= 0 && row < WIN4_HEIGHT &&
-	       gPosition.board[column][row] == piece);
-
-	return count;
-}
-
 void CountPieces(POSITION pos, int *xcount, int *ocount)
 {
-	int row, col, h;
-	POSITION temp1, temp2, temp3=1;
-	for (col=0; col<WIN4_WIDTH; col++) {
-		row=WIN4_HEIGHT-1;
-		for (h=col*(WIN4_HEIGHT+1)+WIN4_HEIGHT; (pos & (temp1=(temp3 << h)))==0; h--)
-			row--;
-		h--;
-		while (row >=0) {
-			if ((pos & (temp2=(temp3<<h))) != 0) (*ocount)++;
-			else (*xcount)++;
-			row--;
-			h--;
-		}
-	}
+	BITBOARD occupied, ones = BitboardColumnUnhash(&gShape, pos, &occupied);
+
+	*ocount += BitboardCount(ones);
+	*xcount += BitboardCount(occupied & ~ones);
 }
 
 /* bottom-up solver support functions */
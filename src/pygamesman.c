@@ -55,9 +55,6 @@ void importSTRING(void *to, PyObject *from) {
 
 static PyObject *callback = NULL;
 
-/* Should be in gamesman.h */
-int gamesman_main(int argc, char *argv[]);
-
 void *PrintError() {
 
 	PyErr_Print();
@@ -97,7 +94,8 @@ static PyObject *initialize(PyObject *self, PyObject *args) {
 					return NULL;
 				}
 			}
-			result = Py_BuildValue("i", gamesman_main(argc, argv));
+			HandleArguments(argc, argv);
+			result = Py_BuildValue("i", gamesman_main(argv[0]));
 		}
 	}
 	return result;
@@ -169,7 +167,164 @@ PyAPI_FUNC(PyObject *) call(PyObject *arglist) {
 	return result;
 }
 
+/*
+** Batched expansion. Crossing into Python for every GenerateMoves, DoMove
+** and Primitive dominates the solve time of a Python game, so the solver's
+** calls are served from a cache filled by the game's Expand method, which
+** handles many positions per call:
+**
+**     primitives, counts, moves, children = game.Expand(positions)
+**
+** gives the primitive value of each position and, for undecided ones, how
+** many moves it has; the moves and the children they lead to are
+** concatenated in flat lists. On a miss the position is expanded together
+** with up to PY_EXPAND_BATCH - 1 unsolved children of earlier expansions,
+** most recent first, which is the order a depth-first solver visits them
+** in. The cache assumes, like the rest of this file, that the game's
+** functions depend on nothing but their arguments.
+*/
+
+#define PY_EXPAND_BATCH         256
+#define PY_CACHE_BITS           16
+#define PY_PENDING_SIZE         (4 * PY_EXPAND_BATCH)   // power of 2
+
+typedef struct {
+	POSITION position;      // INVALID_POSITION if the slot is empty
+	VALUE primitive;
+	int count;
+	MOVE *moves;
+	POSITION *children;
+} PYEXPANSION;
+
+static PYEXPANSION *pyCache = NULL;
+static POSITION pyPending[PY_PENDING_SIZE];   // ring used as a stack
+static int pyPendingTop = 0, pyPendingCount = 0;
+
+static PYEXPANSION *pyCacheSlot(POSITION position) {
+	return &pyCache[(position * 0x9E3779B97F4A7C15ULL) >> (64 - PY_CACHE_BITS)];
+}
+
+static void pyCacheReset() {
+	int index;
+
+	if (pyCache == NULL)
+		pyCache = (PYEXPANSION *) SafeMalloc((1 << PY_CACHE_BITS) * sizeof(PYEXPANSION));
+	else
+		for (index = 0; index < (1 << PY_CACHE_BITS); index++)
+			if (pyCache[index].count > 0) {
+				SafeFree(pyCache[index].moves);
+				SafeFree(pyCache[index].children);
+			}
+	for (index = 0; index < (1 << PY_CACHE_BITS); index++) {
+		pyCache[index].position = INVALID_POSITION;
+		pyCache[index].count = 0;
+	}
+	pyPendingTop = pyPendingCount = 0;
+}
+
+static void pyPushPending(POSITION position) {
+	pyPending[pyPendingTop] = position;
+	pyPendingTop = (pyPendingTop + 1) & (PY_PENDING_SIZE - 1);
+	if (pyPendingCount < PY_PENDING_SIZE)
+		pyPendingCount++;
+}
+
+static POSITION pyPopPending() {
+	pyPendingTop = (pyPendingTop - 1) & (PY_PENDING_SIZE - 1);
+	pyPendingCount--;
+	return pyPending[pyPendingTop];
+}
+
+static PyObject *pyFastSequence(PyObject *result, int index, Py_ssize_t length) {
+	PyObject *sequence = PySequence_Fast(PyTuple_GetItem(result, index), "Expand must return four sequences");
+
+	if (sequence == NULL)
+		PrintError();
+	if (length >= 0 && PySequence_Fast_GET_SIZE(sequence) != length) {
+		PyErr_SetString(PyExc_ValueError, "Expand returned sequences of mismatched lengths");
+		PrintError();
+	}
+	return sequence;
+}
+
+static PYEXPANSION *pyExpand(POSITION position) {
+	POSITION batch[PY_EXPAND_BATCH], candidate;
+	PyObject *py_positions, *result, *primitives, *counts, *moves, *children;
+	PYEXPANSION *entry = pyCacheSlot(position);
+	Py_ssize_t edges = 0, edge;
+	int size = 1, index, other;
+
+	if (entry->position == position)
+		return entry;
+
+	batch[0] = position;
+	while (size < PY_EXPAND_BATCH && pyPendingCount > 0) {
+		candidate = pyPopPending();
+		if (pyCacheSlot(candidate)->position == candidate ||
+		    GetValueOfPosition(candidate) != undecided)
+			continue;
+		for (other = 0; other < size && batch[other] != candidate; other++)
+			;
+		if (other == size)
+			batch[size++] = candidate;
+	}
+
+	py_positions = PyList_New(size);
+	for (index = 0; index < size; index++)
+		PyList_SET_ITEM(py_positions, index, PyPosition_FromPosition(batch[index]));
+	result = call(Py_BuildValue("(sO)", "Expand", py_positions));
+	Py_DECREF(py_positions);
+
+	if (!PyTuple_Check(result) || PyTuple_Size(result) != 4) {
+		PyErr_SetString(PyExc_TypeError, "Expand must return a tuple of four sequences");
+		PrintError();
+	}
+	primitives = pyFastSequence(result, 0, size);
+	counts = pyFastSequence(result, 1, size);
+	moves = pyFastSequence(result, 2, -1);
+	children = pyFastSequence(result, 3, PySequence_Fast_GET_SIZE(moves));
+
+	/* Later positions first, so the requested one's children end up on top
+	   of the pending stack. */
+	for (index = 0; index < size; index++)
+		edges += PyInt_AsLong(PySequence_Fast_GET_ITEM(counts, index));
+	if (edges != PySequence_Fast_GET_SIZE(moves)) {
+		PyErr_SetString(PyExc_ValueError, "Expand move counts do not add up to the moves returned");
+		PrintError();
+	}
+	for (index = size - 1; index >= 0; index--) {
+		entry = pyCacheSlot(batch[index]);
+		if (entry->count > 0) {
+			SafeFree(entry->moves);
+			SafeFree(entry->children);
+		}
+		entry->position = batch[index];
+		entry->primitive = (VALUE) PyInt_AsLong(PySequence_Fast_GET_ITEM(primitives, index));
+		entry->count = (int) PyInt_AsLong(PySequence_Fast_GET_ITEM(counts, index));
+		edges -= entry->count;
+		if (entry->count > 0) {
+			entry->moves = (MOVE *) SafeMalloc(entry->count * sizeof(MOVE));
+			entry->children = (POSITION *) SafeMalloc(entry->count * sizeof(POSITION));
+		}
+		for (edge = 0; edge < entry->count; edge++) {
+			entry->moves[edge] = PyMove_AsMove(PySequence_Fast_GET_ITEM(moves, edges + edge));
+			entry->children[edge] = PyPosition_AsPosition(PySequence_Fast_GET_ITEM(children, edges + edge));
+			pyPushPending(entry->children[edge]);
+		}
+	}
+	if (PyErr_Occurred())
+		PrintError();
+
+	Py_DECREF(primitives);
+	Py_DECREF(counts);
+	Py_DECREF(moves);
+	Py_DECREF(children);
+	Py_DECREF(result);
+	return pyCacheSlot(position);
+}
+
 void InitializeGame() {
+	pyCacheReset();
 	Py_DECREF(call(Py_BuildValue("(s)", "InitializeGame")));
 }
 
@@ -189,8 +344,16 @@ MOVELIST *GenerateMoves(POSITION position) {
 	PyObject *py_position;
 	PyObject *py_movelist;
 	MOVELIST *movelist = NULL;
+	PYEXPANSION *entry = pyExpand(position);
 	int index;
 
+	/* Expand only lists the moves of undecided positions. */
+	if (entry->primitive == undecided) {
+		for (index = 0; index < entry->count; index++)
+			movelist = CreateMovelistNode(entry->moves[index], movelist);
+		return movelist;
+	}
+
 	py_position = PyPosition_FromPosition(position);
 	py_movelist = call(Py_BuildValue("(sO)", "GenerateMoves", py_position));
 
@@ -214,17 +377,7 @@ MOVELIST *GenerateMoves(POSITION position) {
 }
 
 VALUE Primitive(POSITION position) {
-	PyObject *py_position, *py_value;
-	VALUE value;
-
-	py_position = PyPosition_FromPosition(position);
-	py_value = call(Py_BuildValue("(sO)", "Primitive", py_position));
-	verify(PyArg_Parse(py_value, "i", &value));
-
-	Py_DECREF(py_position);
-	Py_DECREF(py_value);
-
-	return value;
+	return pyExpand(position)->primitive;
 }
 
 USERINPUT GetAndPrintPlayersMove(POSITION position, MOVE *move, STRING playerName) {
@@ -296,6 +449,13 @@ POSITION DoMove(POSITION position, MOVE move) {
 
 	PyObject *py_position, *py_move, *py_newposition;
 	POSITION newposition;
+	PYEXPANSION *entry = pyCacheSlot(position);
+	int index;
+
+	if (entry->position == position)
+		for (index = 0; index < entry->count; index++)
+			if (entry->moves[index] == move)
+				return entry->children[index];
 
 	py_position = PyPosition_FromPosition(position);
 	py_move = PyMove_FromMove(move);
@@ -339,3 +499,20 @@ BOOLEAN ValidTextInput(STRING input){
 int NumberOfOptions(){
 	return 0;
 }
+
+/* Interface to the interact server not supported yet */
+POSITION InteractStringToPosition(STRING str) {
+	return INVALID_POSITION;
+}
+
+STRING InteractPositionToString(POSITION pos) {
+	return NULL;
+}
+
+STRING InteractPositionToEndData(POSITION pos) {
+	return NULL;
+}
+
+STRING InteractMoveToString(POSITION pos, MOVE mv) {
+	return NULL;
+}
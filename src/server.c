@@ -1,33 +1,72 @@
 #include "gamesman.h"
 #include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+/*
+** Gameline server.
+**
+** Every message in either direction is a 2-byte big-endian length
+** (counting the length itself) followed by the text. A request names a
+** command which is run as "./<command>"; its standard output is sent back
+** as the response.
+**
+** The server is a single blocking poll() loop: it sleeps until a socket
+** or a child pipe is ready, so an idle server uses no CPU. Commands run
+** as children through popen(), and their output is collected from the
+** pipe by the same loop, so a slow game never stalls other gConnections.
+** A connection handles one request at a time and is not read from while
+** its command runs or its response is being written, which bounds the
+** memory of a connection to one request plus one response.
+*/
 
 #define SA struct sockaddr
 
-#define MAXNUMCLIENTS 256
+#define LISTENQ 1024
 
-#define MAXNAMELENGTH 100
+/* Largest frame the 16-bit length prefix can describe */
+#define MAXFRAME 65535
+#define MAXPAYLOAD (MAXFRAME - 2)
 
-#define MAXLINE 4096
-#define LISTENQ 1024
-#define max(a,b) (((a)>(b)) ? (a) : (b))
+/* Commands running at once; further requests wait for a free slot */
+#define MAXCHILDREN 64
 
-void execute(char * command, char * output)
-{
-	FILE * filep;
-	int i = 0;
-	char thechar;
-	strcpy(output, "");
-	strcat(command, " > .tempOut");
-	system(command);
-	if(!(filep = fopen(".tempOut", "r")))
-		printf("Cannot open temp file for reading, quitting.\n"), exit(1);
-
-	while((thechar = fgetc(filep)) != EOF)
-		output[i++] = thechar;
-	output[i] = (char)NULL;
-	fclose(filep);
-	remove(".tempOut");
-}
+#define READCHUNK 4096
+
+typedef enum {
+	CONN_READING,                   /* collecting a request frame */
+	CONN_WAITING,                   /* full request, no free child slot */
+	CONN_RUNNING,                   /* command output being collected */
+	CONN_WRITING                    /* response being written */
+} CONNSTATE;
+
+typedef struct connection {
+	int fd;
+	int id;
+	CONNSTATE state;
+
+	unsigned char header[2];
+	unsigned int length;            /* frame length, 0 until the header is in */
+	unsigned int got;               /* bytes of the frame received */
+	char *request;                  /* frame payload, NUL terminated */
+
+	FILE *child;
+	char *response;                 /* framed response: length + payload */
+	unsigned int responseLength;
+	unsigned int sent;
+} CONNECTION;
+
+static CONNECTION **gConnections = NULL;
+static int gNumConnections = 0;
+static int gMaxConnections = 0;
+static int gNumChildren = 0;
+static int gNextId = 1;
+
+static struct pollfd *gPollfds = NULL;
+static CONNECTION **gPollOwners = NULL;
+static int gMaxPollfds = 0;
 
 short getLength(void * line)
 {
@@ -43,284 +82,362 @@ void setLength(void * line, short length)
 	memcpy(line, &length, 2);
 }
 
-int stuff(char * source, char * dest)
+/* Non-blocking, and not inherited by the commands we run */
+void SetNonBlocking(int fd)
 {
-	int a = strlen(source);
-	memcpy(dest+2, source, a);
-	setLength(dest, a+2);
-	return a+2;
+	int val = fcntl(fd, F_GETFL, 0);
+	fcntl(fd, F_SETFL, val | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
 }
 
-void unstuff(char * source, char * dest)
+/* Let the process use every descriptor the hard limit allows */
+void RaiseDescriptorLimit()
 {
-	int a = getLength(source);
-	memcpy(dest, source+2, a-2);
-	dest[a-2] = (char)NULL;
+	struct rlimit rl;
+	if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
 }
 
-char fromsocket[MAXNUMCLIENTS][MAXLINE];
-char tosockbuf[MAXNUMCLIENTS][MAXLINE];
+void AddConnection(int connfd)
+{
+	CONNECTION *conn;
 
-char * tosockbegptr[MAXNUMCLIENTS];
-char * tosockendptr[MAXNUMCLIENTS];
+	if(gNumConnections == gMaxConnections)
+	{
+		gMaxConnections = gMaxConnections ? 2 * gMaxConnections : 64;
+		gConnections = (CONNECTION **) realloc(gConnections, gMaxConnections * sizeof(CONNECTION *));
+	}
+	conn = (CONNECTION *) malloc(sizeof(CONNECTION));
+	memset(conn, 0, sizeof(CONNECTION));
+	conn->fd = connfd;
+	conn->id = gNextId++;
+	conn->state = CONN_READING;
+	gConnections[gNumConnections++] = conn;
+}
 
-char * stdoutendptr;
-char * stdoutbegptr;
-char stdoutbuf[MAXLINE];
+void ResetConnection(CONNECTION *conn)
+{
+	if(conn->request) free(conn->request);
+	if(conn->response) free(conn->response);
+	conn->request = conn->response = NULL;
+	conn->length = conn->got = 0;
+	conn->responseLength = conn->sent = 0;
+	conn->state = CONN_READING;
+}
 
-int clients[MAXNUMCLIENTS];
-int j[MAXNUMCLIENTS];
-short lengths[MAXNUMCLIENTS];
-int joins[MAXNUMCLIENTS];
+void CloseConnection(CONNECTION *conn, char *reason)
+{
+	if(conn->child)
+	{
+		pclose(conn->child);
+		conn->child = NULL;
+		gNumChildren--;
+	}
+	close(conn->fd);
+	conn->fd = -1;
+	ResetConnection(conn);
+	printf("disconnected: client %d %s\n", conn->id, reason);
+}
 
-void ActUponClientInput(char * buffer, int row, int sockfd);
+/* Append output to the response, silently dropping what does not fit */
+void AppendResponse(CONNECTION *conn, char *data, unsigned int n)
+{
+	unsigned int room, size;
 
-int paslength;
-char username[50][256];
-char password[50][256];
+	if(conn->response == NULL)
+	{
+		conn->response = (char *) malloc(2 + READCHUNK);
+		conn->responseLength = 2;
+	}
+	room = MAXFRAME - conn->responseLength;
+	if(n > room) n = room;
+	if(n == 0) return;
+
+	size = conn->responseLength + n;
+	if(size > 2 + READCHUNK)
+		conn->response = (char *) realloc(conn->response, size);
+	memcpy(conn->response + conn->responseLength, data, n);
+	conn->responseLength = size;
+}
 
-FILE * fileps[MAXNUMCLIENTS];
+void FinishResponse(CONNECTION *conn)
+{
+	if(conn->response == NULL) AppendResponse(conn, "", 0);
+	setLength(conn->response, (short) conn->responseLength);
+	conn->sent = 0;
+	conn->state = CONN_WRITING;
+	free(conn->request);
+	conn->request = NULL;
+}
 
-int main (int argc, char ** argv)
+/*
+** Turn a complete request into either an immediate response or a running
+** child. Returns FALSE if the connection has to be dropped.
+*/
+BOOLEAN StartRequest(CONNECTION *conn)
 {
-	int listenfd, serv_port, i, maxfd, clilen, connfd, val;
-	struct sockaddr_in cliaddr, servaddr;
-	fd_set rset, wset;
-	struct timeval tval;
-	FILE * pass;
+	char *input = conn->request;
+	char commandName[256];
+	char syscommand[MAXPAYLOAD + 16];
+	int i;
+
+	for(i = 0; *input != ' ' && *input && i < 255; i++, input++)
+		commandName[i] = *input;
+	commandName[i] = '\0';
+	while(*input == ' ') input++;
+
+	if(!strcmp(commandName, "GameList"))
+	{
+		FILE *filep;
+		char line[1024];
+		if((filep = fopen("gamelist.txt", "r")) == NULL)
+		{
+			printf("Unable to open gamelist.txt\n");
+			return FALSE;
+		}
+		if(fgets(line, sizeof(line), filep) == NULL) line[0] = '\0';
+		fclose(filep);
+		line[strcspn(line, "\n")] = '\0';
+		AppendResponse(conn, line, strlen(line));
+		FinishResponse(conn);
+		return TRUE;
+	}
+
+	if(!strcmp(commandName, "NumberOfOptions"))
+	{
+		char gameName[256];
+		for(i = 0; input[i] != ' ' && input[i] && i < 255; i++)
+			gameName[i] = input[i];
+		gameName[i] = '\0';
+		sprintf(syscommand, "./%s -numberOfOptions", gameName);
+	}
+	else
+		sprintf(syscommand, "./%s", conn->request);
+
+	fflush(stdout);
+	if((conn->child = popen(syscommand, "r")) == NULL)
+	{
+		fprintf(stderr, "Could not run %s: %s\n", syscommand, strerror(errno));
+		FinishResponse(conn);
+		return TRUE;
+	}
+	SetNonBlocking(fileno(conn->child));
+	gNumChildren++;
+	conn->state = CONN_RUNNING;
+	return TRUE;
+}
+
+/* Read what the socket has; returns FALSE if the connection is gone */
+BOOLEAN ReadRequest(CONNECTION *conn)
+{
+	int n;
 
-	stdoutbegptr = stdoutendptr = stdoutbuf;
-	for(i = 0; i < MAXNUMCLIENTS; i++)
+	while(conn->state == CONN_READING)
 	{
-		tosockbegptr[i] = tosockendptr[i] = tosockbuf[i];
-		clients[i] = -1;
-		j[i] = 0;
-		lengths[i] = 0;
-		joins[i] = 0;
-		fileps[i] = NULL;
+		if(conn->length == 0)
+			n = read(conn->fd, conn->header + conn->got, 2 - conn->got);
+		else
+			n = read(conn->fd, conn->request + conn->got - 2, conn->length - conn->got);
+
+		if(n < 0)
+			return (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR);
+		if(n == 0)
+			return FALSE;
+
+		conn->got += n;
+		if(conn->length == 0)
+		{
+			if(conn->got < 2) continue;
+			conn->length = (unsigned short) getLength(conn->header);
+			if(conn->length <= 2)
+				return FALSE;   /* malformed or empty request */
+			conn->request = (char *) malloc(conn->length - 1);
+		}
+		if(conn->got == conn->length)
+		{
+			conn->request[conn->length - 2] = '\0';
+			conn->state = CONN_WAITING;
+		}
+	}
+	return TRUE;
+}
+
+/* Collect command output; returns FALSE if the connection is gone */
+BOOLEAN ReadChild(CONNECTION *conn)
+{
+	char buffer[READCHUNK];
+	int n;
+
+	while((n = read(fileno(conn->child), buffer, sizeof(buffer))) > 0)
+		AppendResponse(conn, buffer, n);
+	if(n < 0 && (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR))
+		return TRUE;
+
+	pclose(conn->child);
+	conn->child = NULL;
+	gNumChildren--;
+	FinishResponse(conn);
+	return TRUE;
+}
+
+/* Write what the socket takes; returns FALSE if the connection is gone */
+BOOLEAN WriteResponse(CONNECTION *conn)
+{
+	int n;
+
+	while(conn->sent < conn->responseLength)
+	{
+		n = write(conn->fd, conn->response + conn->sent, conn->responseLength - conn->sent);
+		if(n < 0)
+			return (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR);
+		conn->sent += n;
 	}
+	ResetConnection(conn);
+	return TRUE;
+}
+
+void AddPollfd(int *count, int fd, short events, CONNECTION *owner)
+{
+	if(*count == gMaxPollfds)
+	{
+		gMaxPollfds = gMaxPollfds ? 2 * gMaxPollfds : 128;
+		gPollfds = (struct pollfd *) realloc(gPollfds, gMaxPollfds * sizeof(struct pollfd));
+		gPollOwners = (CONNECTION **) realloc(gPollOwners, gMaxPollfds * sizeof(CONNECTION *));
+	}
+	gPollfds[*count].fd = fd;
+	gPollfds[*count].events = events;
+	gPollfds[*count].revents = 0;
+	gPollOwners[*count] = owner;
+	(*count)++;
+}
+
+int main (int argc, char ** argv)
+{
+	int listenfd, serv_port, i, connfd, count, on = 1;
+	BOOLEAN acceptPaused = FALSE;
+	struct sockaddr_in cliaddr, servaddr;
+	socklen_t clilen;
 
 	if (argc != 2) printf("Usage: %s <server port>\n", argv[0]), exit(1);
 	sscanf(argv[1], "%d", &serv_port);
 	if(serv_port <= 0) printf("Usage: port number must be a positive integer\n"), exit(1);
 
+	signal(SIGPIPE, SIG_IGN);
+	RaiseDescriptorLimit();
+
 	listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
 
 	bzero(&servaddr, sizeof(servaddr));
 	servaddr.sin_family = AF_INET;
 	servaddr.sin_port = htons(serv_port);
 	servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-	memset(&(servaddr.sin_zero), '\0', 8); //zero rest of struct
 
-	bind(listenfd, (struct sockaddr *)&servaddr, sizeof(servaddr));
+	if(bind(listenfd, (SA *)&servaddr, sizeof(servaddr)) < 0)
+		fprintf(stderr, "Cannot bind port %d: %s\n", serv_port, strerror(errno)), exit(1);
 
 	listen(listenfd, LISTENQ);
-
-	val = fcntl(listenfd, F_GETFL, 0);
-	fcntl(listenfd, F_SETFL, val | O_NONBLOCK);
-
-	val = fcntl(STDOUT_FILENO, F_GETFL, 0);
-	fcntl(STDOUT_FILENO, F_SETFL, val | O_NONBLOCK);
-
-	maxfd = max(listenfd, STDOUT_FILENO);
+	SetNonBlocking(listenfd);
 
 	while(1)
 	{
-		tval.tv_sec = 0;
-		tval.tv_usec = 0;
-
-		FD_ZERO(&rset);
-		FD_ZERO(&wset);
-
-		FD_SET(listenfd, &rset);
-
-		if(stdoutendptr > stdoutbegptr) FD_SET(STDOUT_FILENO, &wset);
-		for(i = 0; i < MAXNUMCLIENTS; i++)
-		{
-			if(clients[i] > 0)
-			{
-				if(tosockendptr[i] > tosockbegptr[i])
-					FD_SET(clients[i], &wset);
-				FD_SET(clients[i], &rset);
-			}
-		}
-
-		select(maxfd + 1, &rset, &wset, NULL, &tval);
-
-		if(FD_ISSET(listenfd, &rset))
+		/*
+		** Hand free child slots to waiting requests, then build the poll
+		** set from the state of each connection, dropping closed ones.
+		*/
+		count = 0;
+		AddPollfd(&count, listenfd, acceptPaused ? 0 : POLLIN, NULL);
+		for(i = 0; i < gNumConnections; i++)
 		{
-			clilen = sizeof(cliaddr);
-			connfd = accept(listenfd, (SA *)&cliaddr, &clilen);
-			if(connfd < 0)
+			CONNECTION *conn = gConnections[i];
+			if(conn->fd < 0)
 			{
-				if(errno != EWOULDBLOCK)
-					fprintf(stderr, "internal socket failure. Exitting\n"), exit(1);
+				free(conn);
+				gConnections[i--] = gConnections[--gNumConnections];
+				continue;
 			}
-			else
-			{
-				for(i = 0; i < MAXNUMCLIENTS; i++)
-				{
-					if(clients[i] < 0)
-					{
-						clients[i] = connfd;
-						val = fcntl(connfd, F_GETFL, 0);
-						fcntl(connfd, F_SETFL, val | O_NONBLOCK);
-						joins[i] = 0;
-						break;
-					}
-				}
-				if(i == MAXNUMCLIENTS)
+			if(conn->state == CONN_WAITING && gNumChildren < MAXCHILDREN)
+				if(!StartRequest(conn))
 				{
-					// Eventually handle some error here
+					CloseConnection(conn, "sent a request that failed");
+					i--;
+					continue;
 				}
-				else if(connfd > maxfd) maxfd = connfd;
-				printf("Just accepted a connection\n");
-			}
-		}
-		if(FD_ISSET(STDOUT_FILENO, &wset))
-		{
-			int nwritten = write(STDOUT_FILENO, stdoutbegptr, stdoutendptr - stdoutbegptr);
-			if(nwritten < 0)
-			{
-				if(errno != EWOULDBLOCK)
-					fprintf(stderr, "Non-Blocking IO Error\n"), exit(1);
-			}
-			else
+			switch(conn->state)
 			{
-				stdoutbegptr += nwritten;
-				if(stdoutendptr == stdoutbegptr)
-					stdoutbegptr = stdoutendptr = stdoutbuf;
+			case CONN_READING:
+				AddPollfd(&count, conn->fd, POLLIN, conn);
+				break;
+			case CONN_WRITING:
+				AddPollfd(&count, conn->fd, POLLOUT, conn);
+				break;
+			case CONN_RUNNING:
+				AddPollfd(&count, fileno(conn->child), POLLIN, conn);
+				break;
+			case CONN_WAITING:
+				/* A hangup now shows up when the response is written */
+				break;
 			}
 		}
-		for(i = 0; i < MAXNUMCLIENTS; i++)
+
+		fflush(stdout);
+		if(poll(gPollfds, count, -1) < 0)
 		{
-			if(clients[i] < 0) continue;
+			if(errno == EINTR) continue;
+			fprintf(stderr, "poll failed: %s\n", strerror(errno)), exit(1);
+		}
 
-			if(FD_ISSET(clients[i], &wset))
-			{
-				int n = write(clients[i], tosockbegptr[i], tosockendptr[i] - tosockbegptr[i]);
-				tosockbegptr[i] += n;
-				if(tosockbegptr[i] == tosockendptr[i])
-					tosockbegptr[i] = tosockendptr[i] = tosockbuf[i];
-			}
-			if(FD_ISSET(clients[i], &rset))
+		if(gPollfds[0].revents & POLLIN)
+		{
+			while(1)
 			{
-				char schar;
-				int n;
-				if((n=read(clients[i], &schar, 1)) < 0)
+				clilen = sizeof(cliaddr);
+				connfd = accept(listenfd, (SA *)&cliaddr, &clilen);
+				if(connfd < 0)
 				{
-					if(errno != EWOULDBLOCK)
-						fprintf(stderr, "Non-Blocking IO Error\n"), exit(1);
-				}
-				else if(n == 0)
-				{
-					close(clients[i]);
-					stdoutendptr += sprintf(stdoutendptr, "disconnected: client %d closed connection\n", i+1);
-					clients[i] = -1;
-					lengths[i] = 0;
-					j[i] = 0;
-					fclose(fileps[i]);
-					continue;
-				}
-				else if(n > 0)
-				{
-					fromsocket[i][j[i]] = schar;
-					j[i] = j[i] + 1;
-					if(j[i] == 2)
-					{
-						memcpy(lengths+i, fromsocket[i], 2);
-						lengths[i] = ntohs(lengths[i]);
-					}
-					/// no else if here...
-					if(j[i] == lengths[i])
-					{
-						fromsocket[i][j[i]] = (char)NULL;
-						ActUponClientInput(fromsocket[i], i, clients[i]);
-						j[i] = 0;
-						lengths[i] = 0;
-					}
-					else
-						fromsocket[i][j[i]] = (char)NULL;
+					/* Out of descriptors: stop listening until one closes */
+					if(errno == EMFILE || errno == ENFILE)
+						acceptPaused = TRUE;
+					else if(errno != EWOULDBLOCK && errno != EAGAIN &&
+					        errno != EINTR && errno != ECONNABORTED)
+						fprintf(stderr, "internal socket failure. Exitting\n"), exit(1);
+					break;
 				}
+				SetNonBlocking(connfd);
+				AddConnection(connfd);
+				printf("accepted: client %d\n", gNextId - 1);
 			}
 		}
-	}
-
-	return 0;
-}
-
-void ActUponClientInput(char * inputstart, int row, int sockfd)
-{
-	int i, a;
-	char commandName[256];
-	char gameName[256];
-	char optionstring[64];
-	int option;
-	char response[1024];
-	char buffer[1024];
-	char * input = inputstart;
-
-	input += 2;
 
-	for(i = 0; *input != ' ' && *input; i++, input++)
-		commandName[i] = *input;
-	commandName[i] = (char)NULL;
-	while(*input == ' ') input++;
-
-	if(!strcmp(commandName, "GameList"))
-	{
-		FILE * filep;
-		if((filep = fopen("gamelist.txt", "r")) == NULL)
+		for(i = 1; i < count; i++)
 		{
-			printf("Unable to open gamelist.txt\n");
-			close(sockfd);
-			return;
+			CONNECTION *conn = gPollOwners[i];
+			short revents = gPollfds[i].revents;
+			BOOLEAN alive = TRUE;
+
+			if(revents == 0 || conn->fd < 0) continue;
+
+			if(conn->child && gPollfds[i].fd == fileno(conn->child))
+				alive = ReadChild(conn);
+			else if(revents & (POLLERR | POLLNVAL))
+				alive = FALSE;
+			else if(conn->state == CONN_READING && (revents & (POLLIN | POLLHUP)))
+				alive = ReadRequest(conn);
+			else if(conn->state == CONN_WRITING && (revents & POLLOUT))
+				alive = WriteResponse(conn);
+			else if(revents & POLLHUP)
+				alive = FALSE;
+
+			if(!alive)
+			{
+				CloseConnection(conn, "closed connection");
+				acceptPaused = FALSE;
+			}
 		}
-		fgets(response, 1020, filep);
-		response[strlen(response)-1] = (char)NULL;
-		fclose(filep);
 	}
-	else if(!strcmp(commandName, "NumberOfOptions"))
-	{
-		char syscommand[256];
-		for(i = 0; input[i] != ' ' && input[i]; i++)
-			gameName[i] = input[i];
-		gameName[i] = (char)NULL;
-		sprintf(syscommand, "./%s -%s", gameName, "numberOfOptions");
-		execute(syscommand, response);
-	}
-	else
-	{
-		char syscommand[256];
-		strcpy(syscommand, "./");
-		strcat(syscommand, inputstart+2);
-		execute(syscommand, response);
-	}
-
-	a = stuff(response, buffer);
-	writen(sockfd, buffer, a);
-}
 
-ssize_t writen(int fd, const void *vptr, size_t n)
-{
-	size_t nleft;
-	ssize_t nwritten;
-	const char      *ptr;
-
-	ptr = vptr;
-	nleft = n;
-	while (nleft > 0)
-	{
-		if ( (nwritten = write(fd, ptr, nleft)) <= 0)
-		{
-			if (errno == EINTR)
-				nwritten = 0;           /* and call write() again */
-			else
-				return(-1);                     /* error */
-		}
-
-		nleft -= nwritten;
-		ptr   += nwritten;
-	}
-	return(n);
+	return 0;
 }
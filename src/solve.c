@@ -1,43 +1,370 @@
+/*
+** GAMESMAN automatic game solver.
+**
+** Solves every option of a module, several at a time:
+**
+**	solve [-j jobs] [-m megabytes] [-b bytes] [-o first-last] [-f]
+**	      [-l logdir] [-r report] <module> [module arguments]
+**
+** Each option (or each one in the -o range) is queried first with
+** "--option <n> --variantinfo", which reports its size and whether its
+** database is already on disk. Options that are solved are skipped
+** (unless -f), and the rest are run as
+** "./<module> [module arguments] --solve <n>", largest first, with at most
+** <jobs> at a time and their estimated memory within <megabytes>. The
+** estimate starts at <bytes> per position and, unless -b is given, is
+** raised to the worst ratio seen once options finish. Output of each solve
+** goes to <logdir>/<module>_<n>.log, and a per-option timing report is
+** printed at the end (and written tab-separated to <report> with -r).
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAXARGS 64
+
+/* Resident memory of a solve that is not accounted for by positions */
+#define BASEBYTES (16.0 * 1024 * 1024)
+
+#define DEFAULTBYTESPERPOSITION 12.0
+
+typedef enum {
+	PENDING, RUNNING, DONE, FAILED, SKIPPED
+} STATUS;
+
+char *statusNames[] = { "pending", "running", "done", "failed", "skipped" };
+
+typedef struct {
+	int option;
+	unsigned long long positions;
+	int tiered;
+	STATUS status;
+	int exitCode;
+	int alone;              /* rerun by itself after being killed */
+	pid_t pid;
+	double estimate;        /* bytes reserved while running */
+	double start, wall, user, sys;
+	long maxrss;            /* kilobytes */
+} VARIANT;
+
+char *program;
+char *moduleArgs[MAXARGS];
+int numModuleArgs = 0;
 
-main(int argc, char ** argv)
+VARIANT *variants;
+int numVariants = 0;
+
+double Now()
 {
-	FILE * filep;
-	int n, i=0, a;
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
 
-	char mystring [255];
+/* Runs program with moduleArgs and extra, returning its output (both streams) */
+int Capture(char **extra, int numExtra, char *output, int size)
+{
+	char *argv[MAXARGS + 8];
+	int fds[2], n, got = 0, status, i, argc = 0;
+	pid_t pid;
 
-	if(argc == 1)
-		printf("Usage: %s <module name>\n", argv[0]), exit(1);
+	argv[argc++] = program;
+	for(i = 0; i < numModuleArgs; i++) argv[argc++] = moduleArgs[i];
+	for(i = 0; i < numExtra; i++) argv[argc++] = extra[i];
+	argv[argc] = NULL;
 
-	printf("\n\nGAMESMAN automatic game solver, written by Sunil Ramesh\n\n");
+	if(pipe(fds) < 0) return -1;
+	if((pid = fork()) == 0)
+	{
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execv(program, argv);
+		_exit(127);
+	}
+	close(fds[1]);
+	while(got < size - 1 && (n = read(fds[0], output + got, size - 1 - got)) > 0)
+		got += n;
+	output[got] = '\0';
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int NumberOfOptions()
+{
+	char output[4096], *line;
+	char *extra[] = { "--numoptions" };
+	int n;
+
+	if(Capture(extra, 1, output, sizeof(output)) < 0 ||
+	   (line = strstr(output, "Number of Options:")) == NULL ||
+	   sscanf(line, "Number of Options: %d", &n) != 1)
+		return -1;
+	return n;
+}
+
+/* Fills in the size of v and whether it is solved; unknown sizes are 0 */
+void QueryVariant(VARIANT *v, int force)
+{
+	char output[4096], optionString[16], *line;
+	char *extra[] = { "--option", optionString, "--variantinfo" };
+	int option, solved = 0;
+
+	sprintf(optionString, "%d", v->option);
+	v->positions = 0;
+	v->tiered = 0;
+	if(Capture(extra, 3, output, sizeof(output)) >= 0 &&
+	   (line = strstr(output, "option=")) != NULL)
+		sscanf(line, "option=%d positions=%llu tiered=%d solved=%d",
+		       &option, &v->positions, &v->tiered, &solved);
+	v->status = (solved && !force) ? SKIPPED : PENDING;
+}
+
+/* Pass an interrupt on to the running solves before dying of it */
+void Interrupt(int sig)
+{
+	int i;
+	for(i = 0; i < numVariants; i++)
+		if(variants[i].status == RUNNING)
+			kill(variants[i].pid, sig);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+int LargestFirst(const void *a, const void *b)
+{
+	const VARIANT *x = (const VARIANT *) a, *y = (const VARIANT *) b;
+	if(x->positions != y->positions)
+		return (x->positions < y->positions) ? 1 : -1;
+	return x->option - y->option;
+}
+
+void Launch(VARIANT *v, char *logdir, char *module)
+{
+	char *argv[MAXARGS + 8];
+	char optionString[16], logname[1024];
+	int argc = 0, i, fd;
+
+	sprintf(optionString, "%d", v->option);
+	if(strrchr(module, '/')) module = strrchr(module, '/') + 1;
+	snprintf(logname, sizeof(logname), "%s/%s_%d.log", logdir, module, v->option);
 
-	sprintf(mystring, "./%s -numberOfOptions > .solvetemp", argv[1]);
+	argv[argc++] = program;
+	for(i = 0; i < numModuleArgs; i++) argv[argc++] = moduleArgs[i];
+	argv[argc++] = "--solve";
+	argv[argc++] = optionString;
+	argv[argc] = NULL;
 
-	if(system(mystring) == 0) printf("Invalid module. Quitting\n"), exit(1);
+	v->start = Now();
+	if((v->pid = fork()) == 0)
+	{
+		if((fd = open(logname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0)
+		{
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+		if((fd = open("/dev/null", O_RDONLY)) >= 0)
+		{
+			dup2(fd, STDIN_FILENO);
+			close(fd);
+		}
+		execv(program, argv);
+		_exit(127);
+	}
+	if(v->pid < 0)
+		perror("fork"), exit(1);
+	v->status = RUNNING;
+}
 
-	if((filep = fopen(".solvetemp", "r")) == NULL)
-		printf("Sorry, an internal error occurred.\n"), exit(1);
+void Usage(char *name)
+{
+	fprintf(stderr, "Usage: %s [-j jobs] [-m megabytes] [-b bytes-per-position]\n"
+	        "\t[-o first-last] [-f] [-l logdir] [-r report] <module name> [module arguments]\n\n"
+	        "\t-j  options solved at once (default: online processors)\n"
+	        "\t-m  memory budget for all solves (default: 90%% of physical memory)\n"
+	        "\t-b  memory estimate per position (default: learned, starting at %g)\n"
+	        "\t-o  only solve this range of options (default: all)\n"
+	        "\t-f  solve options whose database already exists\n"
+	        "\t-l  directory for the output of each solve (default: solvelogs)\n"
+	        "\t-r  write a tab-separated timing report to this file\n",
+	        name, DEFAULTBYTESPERPOSITION);
+	exit(1);
+}
 
-	fscanf(filep, "%d", &n);
-	fclose(filep);
-	remove(".solvetemp");
+int main(int argc, char ** argv)
+{
+	int jobs = 0, force = 0, fixedRatio = 0, n, i, status, running = 0, finished = 0, failed = 0;
+	int first = 1, last = 0;
+	double budget = 0, inUse = 0, bytesPerPosition = DEFAULTBYTESPERPOSITION, learned = 0, start;
+	char *module, *logdir = "solvelogs", *report = NULL;
+	VARIANT *v;
+	struct rusage ru;
+	pid_t pid;
+	FILE *filep;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(!strcmp(argv[i], "-f")) { force = 1; continue; }
+		if(i + 1 >= argc || argv[i][1] == '\0' || argv[i][2] != '\0') Usage(argv[0]);
+		switch(argv[i][1])
+		{
+		case 'j': jobs = atoi(argv[++i]); break;
+		case 'm': budget = atof(argv[++i]) * 1024 * 1024; break;
+		case 'b': bytesPerPosition = atof(argv[++i]); fixedRatio = 1; break;
+		case 'l': logdir = argv[++i]; break;
+		case 'r': report = argv[++i]; break;
+		case 'o':
+			if(sscanf(argv[++i], "%d-%d", &first, &last) != 2) last = first;
+			break;
+		default: Usage(argv[0]);
+		}
+	}
+	if(i == argc) Usage(argv[0]);
+	module = argv[i++];
+	for(; i < argc && numModuleArgs < MAXARGS; i++)
+		moduleArgs[numModuleArgs++] = argv[i];
+
+	if(jobs <= 0) jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if(jobs <= 0) jobs = 1;
+	if(budget <= 0) budget = 0.9 * (double) sysconf(_SC_PHYS_PAGES) * (double) sysconf(_SC_PAGESIZE);
+
+	program = (char *) malloc(strlen(module) + 3);
+	sprintf(program, strchr(module, '/') ? "%s" : "./%s", module);
+
+	printf("\n\nGAMESMAN automatic game solver, written by Sunil Ramesh\n\n");
 
-	printf("Solving %s, %d options:\n\n", argv[1], n);
+	if((n = NumberOfOptions()) <= 0)
+		printf("Invalid module. Quitting\n"), exit(1);
+	if(last <= 0 || last > n) last = n;
+	if(first < 1 || first > last)
+		printf("No options in range %d-%d. Quitting\n", first, last), exit(1);
+	n = last - first + 1;
+	if(mkdir(logdir, 0755) < 0 && errno != EEXIST)
+		printf("Cannot create %s: %s\n", logdir, strerror(errno)), exit(1);
 
-	a = printf("Finished %d of %d Games (%3.0f%%)", i, n, 100*(float)i/(float)n);
+	if((variants = (VARIANT *) calloc(n, sizeof(VARIANT))) == NULL)
+		printf("Cannot track %d options; pick a range with -o. Quitting\n", n), exit(1);
+	for(i = 0; i < n; i++)
+	{
+		variants[i].option = first + i;
+		QueryVariant(variants + i, force);
+		if(variants[i].status == SKIPPED) finished++;
+	}
+	qsort(variants, n, sizeof(VARIANT), LargestFirst);
 
+	printf("Solving %s, %d options (%d already solved), %d at a time within %.0f MB:\n\n",
+	       module, n, finished, jobs, budget / (1024 * 1024));
 	fflush(stdout);
 
-	for(i = 1; i <= n; i++)
+	numVariants = n;
+	signal(SIGINT, Interrupt);
+	signal(SIGTERM, Interrupt);
+	signal(SIGHUP, Interrupt);
+
+	start = Now();
+	while(finished < n)
 	{
-		for(; a >= 0; a--) printf("\b");
-		fflush(stdout);
-		sprintf(mystring, "./%s -s %d", argv[1], i);
-		system(mystring);
-		a = printf("Finished %d of %d Games (%3.0f%%)", i, n, 100*(float)i/(float)n);
+		/* Start the largest pending options that fit; if nothing is
+		   running, start the largest even if it is over the budget. */
+		for(i = 0; i < n && running < jobs; i++)
+		{
+			v = variants + i;
+			if(v->status != PENDING) continue;
+			v->estimate = BASEBYTES + bytesPerPosition * (double) v->positions;
+			if(v->alone && v->estimate < budget) v->estimate = budget;
+			if(inUse + v->estimate > budget && running > 0) continue;
+			if(v->estimate > budget)
+				printf("Option %d may not fit in memory (estimated %.0f MB)\n",
+				       v->option, v->estimate / (1024 * 1024));
+			Launch(v, logdir, module);
+			inUse += v->estimate;
+			running++;
+		}
+
+		if((pid = wait4(-1, &status, 0, &ru)) < 0)
+		{
+			if(errno == EINTR) continue;
+			perror("wait4"), exit(1);
+		}
+		for(v = NULL, i = 0; i < n; i++)
+			if(variants[i].status == RUNNING && variants[i].pid == pid)
+				v = variants + i;
+		if(v == NULL) continue;
+
+		v->wall = Now() - v->start;
+		v->user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+		v->sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+		v->maxrss = ru.ru_maxrss;
+		v->exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+		inUse -= v->estimate;
+		running--;
+
+		/* Killed while sharing memory, most likely by the OOM killer:
+		   give it the machine to itself once before calling it failed */
+		if(v->exitCode == -SIGKILL && !v->alone && running > 0)
+		{
+			printf("option %d was killed after %.1fs (%.0f MB); retrying it alone\n",
+			       v->option, v->wall, v->maxrss / 1024.0);
+			fflush(stdout);
+			v->alone = 1;
+			v->status = PENDING;
+			continue;
+		}
+		v->status = (v->exitCode == 0) ? DONE : FAILED;
+		if(v->status == FAILED) failed++;
+		finished++;
+
+		/* Learn the memory per position from what finished solves used */
+		if(!fixedRatio && v->status == DONE && v->positions > 0)
+		{
+			double ratio = ((double) v->maxrss * 1024 - BASEBYTES) / (double) v->positions;
+			if(ratio > learned) learned = ratio;
+			if(learned > 0) bytesPerPosition = learned;
+		}
+
+		printf("[%3d/%3d] option %d %s in %.1fs (%.0f MB, %d running)\n",
+		       finished, n, v->option, statusNames[v->status], v->wall,
+		       v->maxrss / 1024.0, running);
 		fflush(stdout);
 	}
-	printf("\n\nDone solving %s\n\nThanks for using GAMESMAN automatic game solver !\n\n", argv[1]);
+
+	printf("\n%8s %14s %8s %6s %10s %10s %10s\n",
+	       "option", "positions", "status", "exit", "wall(s)", "user(s)", "rss(MB)");
+	for(i = 0; i < n; i++)
+	{
+		v = variants + i;
+		printf("%8d %14llu %8s %6d %10.2f %10.2f %10.1f\n", v->option, v->positions,
+		       statusNames[v->status], v->exitCode, v->wall, v->user, v->maxrss / 1024.0);
+	}
+	printf("\nDone solving %s in %.1fs", module, Now() - start);
+	if(failed) printf(", %d options failed (see %s)", failed, logdir);
+	printf("\n\nThanks for using GAMESMAN automatic game solver !\n\n");
+
+	if(report != NULL)
+	{
+		if((filep = fopen(report, "w")) == NULL)
+			printf("Cannot write %s\n", report), exit(1);
+		fprintf(filep, "option\tpositions\ttiered\tstatus\texit\twall_s\tuser_s\tsys_s\tmaxrss_kb\n");
+		for(i = 0; i < n; i++)
+		{
+			v = variants + i;
+			fprintf(filep, "%d\t%llu\t%d\t%s\t%d\t%.3f\t%.3f\t%.3f\t%ld\n", v->option, v->positions,
+			        v->tiered, statusNames[v->status], v->exitCode, v->wall, v->user, v->sys, v->maxrss);
+		}
+		fclose(filep);
+	}
+	return failed ? 1 : 0;
 }